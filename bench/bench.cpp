@@ -0,0 +1,492 @@
+//-----------------------------------------------------------------------------
+//! Benchmarks of the pipeline stages.
+//!
+//! Every expression of the corpus file (one per line) and the large ones
+//! built from them runs through every operation, each one repeated until it
+//! has taken BENCH_MIN_TIME_NS, in batches that grow from one call up to
+//! BENCH_BATCH_SIZE calls. A JSON object per line goes to stdout:
+//!
+//!     {"expression":"corpus_1","nodes":9,"operation":"differentiate",
+//!      "iterations":1234,"nsPerOp":512.3,"nodesPerSecond":1.7e+07,
+//!      "bytesPerOp":576}
+//!
+//! nodes are the nodes of the input tree. Bytes are everything requested
+//! from malloc(), calloc() and realloc() by the operation, which are replaced
+//! here to count them. simplify and taylor are skipped for the expressions
+//! larger than BENCH_SIMPLIFY_MAX_NODES and BENCH_TAYLOR_MAX_NODES, the
+//! simplification passes are superlinear in the tree size and the
+//! derivatives taken by the expansion grow fast.
+//!
+//! Simplification uses the rules main() loads, ../rules/simplify.rules next
+//! to the executable, or the rules file given after the corpus.
+//!
+//! usage: bench [corpus file [rules file]]
+//-----------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UTB_DEFINITIONS
+#include "../src/utilib.h"
+#include "../src/differentiation.h"
+#include "../src/expression_cse.h"
+#include "../src/expression_loader.h"
+#include "../src/expression_simplifier.h"
+#include "../src/expression_tree.h"
+#include "../src/expression_writer.h"
+#include "../src/instrumentation.h"
+#include "../src/rewrite_rules.h"
+#include "../src/symbol_table.h"
+#include "../src/taylor_expansion.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const char*   BENCH_DEFAULT_CORPUS     = "bench/corpus.txt";
+static const uint64_t BENCH_MIN_TIME_NS        = 200000000;
+static const size_t   BENCH_BATCH_SIZE         = 16;
+static const size_t   BENCH_MAX_CASES          = 64;
+static const size_t   BENCH_MAX_NAME_LENGTH    = 32;
+static const size_t   BENCH_MAX_PATH_LENGTH    = 64;
+static const size_t   BENCH_TAYLOR_ORDER       = 3;
+static const size_t   BENCH_TAYLOR_MAX_NODES   = 100;
+static const size_t   BENCH_SIMPLIFY_MAX_NODES = 20000;
+static const double   BENCH_VARIABLE_VALUE     = 0.5;
+
+//! Large expressions are the corpus ones combined into a balanced tree of
+//! about these many nodes.
+static const size_t   BENCH_LARGE_SIZES[]      = { 1000, 10000, 100000 };
+
+struct BenchCase
+{
+    char    name[BENCH_MAX_NAME_LENGTH];
+    char    path[BENCH_MAX_PATH_LENGTH];    //!< the expression alone, for loadExpression()
+    ETNode* root;
+    size_t  nodesCount;
+};
+
+struct BenchContext
+{
+    const BenchCase* benchCase;
+    ETNode*          results[BENCH_BATCH_SIZE];
+    size_t           batchSize;
+    double*          varValues;
+    FILE*            devNull;
+    double           sum;
+};
+
+//! Runs the operation on every slot of the batch, prepare is called before
+//! it outside of the timing. Expressions larger than maxNodes are skipped,
+//! 0 is no limit.
+struct BenchOperation
+{
+    const char* name;
+    size_t      maxNodes;
+    void        (*prepare) (BenchContext* context);
+    void        (*run)     (BenchContext* context);
+};
+
+static size_t BENCH_ALLOCATED_BYTES = 0;
+
+extern "C" void* __libc_malloc  (size_t size);
+extern "C" void* __libc_calloc  (size_t count, size_t size);
+extern "C" void* __libc_realloc (void* pointer, size_t size);
+extern "C" void  __libc_free    (void* pointer);
+
+extern "C" void* malloc(size_t size)
+{
+    BENCH_ALLOCATED_BYTES += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    BENCH_ALLOCATED_BYTES += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    BENCH_ALLOCATED_BYTES += size;
+    return __libc_realloc(pointer, size);
+}
+
+extern "C" void free(void* pointer)
+{
+    __libc_free(pointer);
+}
+
+size_t  loadCorpus          (BenchCase* cases, const char* filename);
+size_t  buildLargeCases     (BenchCase* cases, size_t casesCount);
+ETNode* combineTrees        (ETNode** trees, size_t count, size_t depth);
+bool    writeCaseFile       (BenchCase* benchCase, const char* text);
+void    runBenchmark        (const BenchOperation* operation, BenchContext* context);
+void    destroyResults      (BenchContext* context);
+
+void    runLoad             (BenchContext* context);
+void    runDifferentiate    (BenchContext* context);
+void    prepareSimplify     (BenchContext* context);
+void    runSimplify         (BenchContext* context);
+void    runTaylor           (BenchContext* context);
+void    runEvaluate         (BenchContext* context);
+void    runLatex            (BenchContext* context);
+
+static const BenchOperation BENCH_OPERATIONS[] =
+                            {
+                                { "load",          0,                        nullptr,         runLoad          },
+                                { "differentiate", 0,                        nullptr,         runDifferentiate },
+                                { "simplify",      BENCH_SIMPLIFY_MAX_NODES, prepareSimplify, runSimplify      },
+                                { "taylor",        BENCH_TAYLOR_MAX_NODES,   nullptr,         runTaylor        },
+                                { "evaluate",      0,                        nullptr,         runEvaluate      },
+                                { "latex",         0,                        nullptr,         runLatex         }
+                            };
+
+int main(int argc, char* argv[])
+{
+    const char* corpus = argc > 1 ? argv[1] : BENCH_DEFAULT_CORPUS;
+
+    char        defaultRules[RULES_MAX_PATH_LENGTH] = {};
+    const char* rulesFile = argc > 2 ? argv[2] : defaultRules;
+
+    if (argc <= 2 && !getDefaultRulesPath(defaultRules, sizeof(defaultRules)))
+    {
+        fprintf(stderr, "Unable to find '%s' of the executable.\n", DEFAULT_RULES_FILE_NAME);
+        return -1;
+    }
+
+    RuleSet rules = {};
+    construct(&rules);
+
+    if (!loadRules(&rules, rulesFile))
+    {
+        destroy(&rules);
+        return -1;
+    }
+
+    setSimplifyRules(&rules);
+
+    BenchCase cases[BENCH_MAX_CASES] = {};
+
+    size_t corpusCount = loadCorpus(cases, corpus);
+    if (corpusCount == 0)
+    {
+        fprintf(stderr, "No expressions in '%s'.\n", corpus);
+        destroy(&rules);
+        return -1;
+    }
+
+    size_t casesCount = buildLargeCases(cases, corpusCount);
+
+    // every variable of the benchmarks has been interned by the corpus
+    size_t varValuesCount = variablesCount();
+
+    BenchContext context = {};
+    context.varValues    = (double*) calloc(varValuesCount, sizeof(double));
+    context.devNull      = fopen("/dev/null", "w");
+
+    if (context.varValues == nullptr || context.devNull == nullptr)
+    {
+        fprintf(stderr, "Unable to set up the benchmarks.\n");
+        destroy(&rules);
+        return -1;
+    }
+
+    for (size_t i = 0; i < varValuesCount; i++) { context.varValues[i] = BENCH_VARIABLE_VALUE; }
+
+    for (size_t i = 0; i < casesCount; i++)
+    {
+        context.benchCase = &cases[i];
+
+        for (size_t j = 0; j < sizeof(BENCH_OPERATIONS) / sizeof(BENCH_OPERATIONS[0]); j++)
+        {
+            runBenchmark(&BENCH_OPERATIONS[j], &context);
+        }
+
+        unlink(cases[i].path);
+        destroySubtree(cases[i].root);
+    }
+
+    fclose(context.devNull);
+    free(context.varValues);
+    destroy(&rules);
+
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of cases, the lines that don't parse are skipped.
+//-----------------------------------------------------------------------------
+size_t loadCorpus(BenchCase* cases, const char* filename)
+{
+    assert(cases    != nullptr);
+    assert(filename != nullptr);
+
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Unable to open '%s'.\n", filename);
+        return 0;
+    }
+
+    char*   line       = nullptr;
+    size_t  capacity   = 0;
+    ssize_t length     = 0;
+    size_t  lineNumber = 0;
+    size_t  casesCount = 0;
+
+    while (casesCount < BENCH_MAX_CASES / 2 && (length = getline(&line, &capacity, file)) != -1)
+    {
+        lineNumber++;
+
+        if (length > 0 && line[length - 1] == '\n') { line[--length] = '\0'; }
+
+        BenchCase* benchCase = &cases[casesCount];
+        ExprTree   tree      = {};
+
+        if (parseExpression(&tree, line) != PARSE_NO_ERROR) { continue; }
+
+        snprintf(benchCase->name, sizeof(benchCase->name), "corpus_%zu", lineNumber);
+        benchCase->root = tree.root;
+        treeSize(benchCase->root, &benchCase->nodesCount);
+
+        if (!writeCaseFile(benchCase, line))
+        {
+            destroySubtree(benchCase->root);
+            break;
+        }
+
+        casesCount++;
+    }
+
+    free(line);
+    fclose(file);
+
+    return casesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the large cases after the corpus ones.
+//!
+//! @return number of all the cases.
+//-----------------------------------------------------------------------------
+size_t buildLargeCases(BenchCase* cases, size_t casesCount)
+{
+    assert(cases != nullptr);
+
+    size_t corpusCount = casesCount;
+
+    for (size_t i = 0; i < sizeof(BENCH_LARGE_SIZES) / sizeof(BENCH_LARGE_SIZES[0]); i++)
+    {
+        if (casesCount == BENCH_MAX_CASES) { break; }
+
+        size_t   nodesCount = 0;
+        size_t   treesCount = 0;
+        ETNode** trees      = nullptr;
+
+        while (nodesCount < BENCH_LARGE_SIZES[i])
+        {
+            ETNode** newTrees = (ETNode**) realloc(trees, (treesCount + 1) * sizeof(ETNode*));
+            CHECK_NULL(newTrees, break);
+
+            trees = newTrees;
+            trees[treesCount] = copyTree(cases[treesCount % corpusCount].root);
+
+            nodesCount += cases[treesCount % corpusCount].nodesCount + 1;
+            treesCount++;
+        }
+
+        BenchCase* benchCase = &cases[casesCount];
+
+        snprintf(benchCase->name, sizeof(benchCase->name), "large_%zu", BENCH_LARGE_SIZES[i]);
+        benchCase->root = combineTrees(trees, treesCount, 0);
+        treeSize(benchCase->root, &benchCase->nodesCount);
+
+        free(trees);
+
+        StringBuilder text = {};
+        construct(&text);
+
+        bool isWritten = writeExpression(&text, benchCase->root, EXPR_FORMAT_INFIX) &&
+                         writeCaseFile(benchCase, getString(&text));
+
+        destroy(&text);
+
+        if (!isWritten)
+        {
+            destroySubtree(benchCase->root);
+            break;
+        }
+
+        casesCount++;
+    }
+
+    return casesCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Joins the trees pairwise with +, * and - by the level, so the result is
+//! balanced and both sums and products get differentiated.
+//-----------------------------------------------------------------------------
+ETNode* combineTrees(ETNode** trees, size_t count, size_t depth)
+{
+    assert(trees != nullptr);
+    assert(count > 0);
+
+    if (count == 1) { return trees[0]; }
+
+    static const Operation OPERATIONS[] = { OP_ADD, OP_MUL, OP_SUB };
+
+    ETNode* left  = combineTrees(trees,             count / 2,         depth + 1);
+    ETNode* right = combineTrees(trees + count / 2, count - count / 2, depth + 1);
+
+    return newNode(TYPE_OP, { .op = OPERATIONS[depth % 3] }, left, right);
+}
+
+bool writeCaseFile(BenchCase* benchCase, const char* text)
+{
+    assert(benchCase != nullptr);
+    assert(text      != nullptr);
+
+    const char* tmpDir = getenv("TMPDIR");
+    snprintf(benchCase->path, sizeof(benchCase->path), "%s/bench_XXXXXX", tmpDir == nullptr ? "/tmp" : tmpDir);
+
+    int fd = mkstemp(benchCase->path);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Unable to create a file for %s.\n", benchCase->name);
+        return false;
+    }
+
+    size_t length    = strlen(text);
+    bool   isWritten = write(fd, text, length) == (ssize_t) length;
+
+    close(fd);
+
+    return isWritten;
+}
+
+void runBenchmark(const BenchOperation* operation, BenchContext* context)
+{
+    assert(operation != nullptr);
+    assert(context   != nullptr);
+
+    if (operation->maxNodes != 0 && context->benchCase->nodesCount > operation->maxNodes) { return; }
+
+    size_t   iterations  = 0;
+    uint64_t nanoseconds = 0;
+    size_t   bytes       = 0;
+
+    context->batchSize = 1;
+
+    while (nanoseconds < BENCH_MIN_TIME_NS)
+    {
+        if (operation->prepare != nullptr) { operation->prepare(context); }
+
+        size_t   bytesBefore = BENCH_ALLOCATED_BYTES;
+        uint64_t startTime   = getInstrTime();
+
+        operation->run(context);
+
+        nanoseconds += getInstrTime() - startTime;
+        bytes       += BENCH_ALLOCATED_BYTES - bytesBefore;
+        iterations  += context->batchSize;
+
+        destroyResults(context);
+
+        if (context->batchSize < BENCH_BATCH_SIZE) { context->batchSize *= 2; }
+    }
+
+    double nsPerOp = (double) nanoseconds / (double) iterations;
+
+    printf("{\"expression\":\"%s\",\"nodes\":%zu,\"operation\":\"%s\",\"iterations\":%zu,"
+           "\"nsPerOp\":%.1f,\"nodesPerSecond\":%.4g,\"bytesPerOp\":%zu}\n",
+           context->benchCase->name, context->benchCase->nodesCount, operation->name, iterations,
+           nsPerOp, (double) context->benchCase->nodesCount * 1e9 / nsPerOp, bytes / iterations);
+
+    fflush(stdout);
+}
+
+void destroyResults(BenchContext* context)
+{
+    assert(context != nullptr);
+
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        destroySubtree(context->results[i]);
+        context->results[i] = nullptr;
+    }
+}
+
+void runLoad(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        ExprTree tree = {};
+        loadExpression(&tree, context->benchCase->path);
+
+        context->results[i] = tree.root;
+    }
+}
+
+void runDifferentiate(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        context->results[i] = differentiate(context->benchCase->root);
+    }
+}
+
+//! Simplifies derivatives, the parsed expressions have little to simplify.
+void prepareSimplify(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        context->results[i] = differentiate(context->benchCase->root);
+    }
+}
+
+void runSimplify(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        simplifyTree(context->results[i]);
+    }
+}
+
+void runTaylor(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        context->results[i] = taylorExpansion(context->benchCase->root, 0, BENCH_TAYLOR_ORDER);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Evaluates the way the batch mode does, through the let-bound form.
+//-----------------------------------------------------------------------------
+void runEvaluate(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        LetExpr letExpr = {};
+
+        if (eliminateCommonSubexprs(&letExpr, context->benchCase->root, CSE_EVALUATE_MIN_SIZE))
+        {
+            context->sum += evaluateLetExpr(&letExpr, context->varValues);
+        }
+
+        destroy(&letExpr);
+    }
+}
+
+void runLatex(BenchContext* context)
+{
+    for (size_t i = 0; i < context->batchSize; i++)
+    {
+        latexDumpSubtree(context->devNull, context->benchCase->root);
+    }
+
+    fflush(context->devNull);
+}
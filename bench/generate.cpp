@@ -0,0 +1,200 @@
+//-----------------------------------------------------------------------------
+//! Writes random expressions to stdout, one per line, for the benchmarks and
+//! the batch mode. See EXPRESSION_GENERATOR for the options, line i is
+//! generated with the seed + i.
+//!
+//!     generate --nodes=1000000 --shape=balanced --ops=+:2,*:2,sin:1 > big.txt
+//-----------------------------------------------------------------------------
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UTB_DEFINITIONS
+#include "../src/utilib.h"
+#include "../src/expression_generator.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const char* USAGE =
+    "usage: %s [--nodes=<n>] [--count=<n>] [--seed=<n>] [--shape=balanced|left-deep|random]\n"
+    "          [--depth=<n>] [--ops=<operation>:<weight>,...] [--variables=<letters>]\n"
+    "          [--var-density=<p>]\n";
+
+static const char* NODES_OPTION       = "--nodes=";
+static const char* COUNT_OPTION       = "--count=";
+static const char* SEED_OPTION        = "--seed=";
+static const char* SHAPE_OPTION       = "--shape=";
+static const char* DEPTH_OPTION       = "--depth=";
+static const char* VARIABLES_OPTION   = "--variables=";
+static const char* DENSITY_OPTION     = "--var-density=";
+
+//! --ops=<operation>:<weight>,... sets the weights of the operations listed,
+//! the others get 0.
+static const char* OPERATIONS_OPTION  = "--ops=";
+
+struct Options
+{
+    GeneratorConfig config = {};
+    size_t          count  = 1;
+};
+
+bool        parseOption     (Options* options, const char* arg);
+bool        parseWeights    (GeneratorConfig* config, const char* value);
+const char* getValueOption  (const char* arg, const char* option);
+
+int main(int argc, char* argv[])
+{
+    Options options = {};
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!parseOption(&options, argv[i]))
+        {
+            fprintf(stderr, USAGE, argv[0]);
+            return -1;
+        }
+    }
+
+    if (!isGeneratorConfigValid(&options.config))
+    {
+        fprintf(stderr, "Invalid generator settings.\n");
+        return -1;
+    }
+
+    uint64_t seed = options.config.seed;
+
+    for (size_t i = 0; i < options.count; i++)
+    {
+        options.config.seed = seed + i;
+
+        if (!writeRandomExpression(stdout, &options.config) || fputc('\n', stdout) == EOF)
+        {
+            fprintf(stderr, "Unable to write expression %zu.\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+bool parseOption(Options* options, const char* arg)
+{
+    assert(options != nullptr);
+    assert(arg     != nullptr);
+
+    GeneratorConfig* config = &options->config;
+    const char*      value  = nullptr;
+    char*            end    = nullptr;
+
+    if ((value = getValueOption(arg, SHAPE_OPTION)) != nullptr)
+    {
+        config->shape = getGeneratorShape(value);
+        if (config->shape == GENERATOR_SHAPE_INVALID)
+        {
+            fprintf(stderr, "Unknown shape '%s'.\n", value);
+            return false;
+        }
+
+        return true;
+    }
+
+    if ((value = getValueOption(arg, OPERATIONS_OPTION)) != nullptr) { return parseWeights(config, value); }
+    if ((value = getValueOption(arg, VARIABLES_OPTION))  != nullptr) { config->variables = value; return true; }
+
+    bool isCount = true;
+
+    if ((value = getValueOption(arg, NODES_OPTION)) != nullptr)
+    {
+        config->nodesCount = strtoull(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, COUNT_OPTION)) != nullptr)
+    {
+        options->count = strtoull(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, SEED_OPTION)) != nullptr)
+    {
+        config->seed = strtoull(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, DEPTH_OPTION)) != nullptr)
+    {
+        config->maxDepth = strtoull(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, DENSITY_OPTION)) != nullptr)
+    {
+        config->variableDensity = strtod(value, &end);
+        isCount = false;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown option '%s'.\n", arg);
+        return false;
+    }
+
+    // strtoull() takes "-1" too
+    if (*value == '\0' || *end != '\0' || (isCount && *value == '-'))
+    {
+        fprintf(stderr, "Invalid value in '%s'.\n", arg);
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [out] config
+//! @param [in]  value  "<operation>:<weight>,...", e.g. "+:2,sin:0.5"
+//-----------------------------------------------------------------------------
+bool parseWeights(GeneratorConfig* config, const char* value)
+{
+    assert(config != nullptr);
+    assert(value  != nullptr);
+
+    for (int i = 0; i < OPERATIONS_COUNT; i++) { config->opWeights[i] = 0; }
+
+    while (*value != '\0')
+    {
+        const char* colon = strchr(value, ':');
+        CHECK_NULL(colon, fprintf(stderr, "Expected <operation>:<weight> in '%s'.\n", value); return false);
+
+        Operation operation = OP_INVALID;
+
+        for (int i = 0; i < OPERATIONS_COUNT; i++)
+        {
+            if (strlen(OPERATIONS[i]) == (size_t) (colon - value) && strncmp(value, OPERATIONS[i], colon - value) == 0)
+            {
+                operation = (Operation) i;
+            }
+        }
+
+        if (operation == OP_INVALID)
+        {
+            fprintf(stderr, "Unknown operation in '%s'.\n", value);
+            return false;
+        }
+
+        char* end = nullptr;
+        config->opWeights[operation] = strtod(colon + 1, &end);
+
+        if (end == colon + 1 || (*end != ',' && *end != '\0'))
+        {
+            fprintf(stderr, "Invalid weight in '%s'.\n", value);
+            return false;
+        }
+
+        value = *end == ',' ? end + 1 : end;
+    }
+
+    return true;
+}
+
+const char* getValueOption(const char* arg, const char* option)
+{
+    assert(arg    != nullptr);
+    assert(option != nullptr);
+
+    size_t length = strlen(option);
+
+    return strncmp(arg, option, length) == 0 ? arg + length : nullptr;
+}
@@ -0,0 +1,430 @@
+#include <assert.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t LOG_MAX_SPEC_LENGTH = 32;
+
+static const char* LOG_LEVEL_NAMES[] = { "debug", "info", "warning", "error" };
+
+struct LogRecord
+{
+    const LogSite* site;
+    uint64_t       time;
+    size_t         droppedCount;
+    size_t         argsCount;
+    LogArg         args[LOG_MAX_ARGS];
+};
+
+//! Single producer (the owner thread) and single consumer (whoever holds the
+//! log's mutex), records [tail, head) are waiting to be written.
+struct LogRing
+{
+    LogRecord           records[LOG_RING_CAPACITY];
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+    size_t              droppedCount;
+    std::atomic<bool>   isOrphaned;
+    LogRing*            next;
+};
+
+//! Marks the ring of an exiting thread, it's freed once it's written out.
+struct LogRingOwner
+{
+    LogRing* ring = nullptr;
+
+    ~LogRingOwner() { if (ring != nullptr) { ring->isOrphaned.store(true, std::memory_order_release); } }
+};
+
+struct AsyncLog
+{
+    std::mutex              mutex;
+    std::condition_variable wakeup;
+    std::thread             thread;
+
+    LogRing*                rings;
+    std::atomic<bool>       isRunning;
+    bool                    isStopping;
+
+    LogSink                 sink;
+    FILE*                   file;
+    uint64_t                startTime;
+};
+
+static AsyncLog                  ASYNC_LOG  = {};
+static thread_local LogRingOwner LOG_OWNER  = {};
+
+LogRing* getThreadRing  ();
+uint64_t getLogTime     ();
+void     logLoop        ();
+void     drainRings     ();
+void     writeRecord    (const LogRecord* record);
+size_t   formatArg      (char* buffer, size_t size, const char* spec, size_t specLength,
+                         char conversion, const LogArg* arg);
+
+//-----------------------------------------------------------------------------
+//! Starts the thread writing the records, stopLog() has to be called before
+//! the program exits.
+//!
+//! @param [in] sink  LOG_SINK_HTML writes through LG_LogMessage(), LG_Init()
+//!                   has to be called before
+//! @param [in] file  where LOG_SINK_TEXT writes, it isn't closed
+//!
+//! @return false if the log is already started or the thread can't start.
+//-----------------------------------------------------------------------------
+bool startLog(LogSink sink, FILE* file)
+{
+    assert(sink == LOG_SINK_HTML || file != nullptr);
+
+    std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+    if (ASYNC_LOG.isRunning.load(std::memory_order_relaxed)) { return false; }
+
+    ASYNC_LOG.sink       = sink;
+    ASYNC_LOG.file       = file;
+    ASYNC_LOG.startTime  = getLogTime();
+    ASYNC_LOG.isStopping = false;
+
+    try
+    {
+        ASYNC_LOG.thread = std::thread(logLoop);
+    }
+    catch (...)
+    {
+        return false;
+    }
+
+    ASYNC_LOG.isRunning.store(true, std::memory_order_release);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes out all the records and stops the thread, the records logged after
+//! it go to stderr.
+//-----------------------------------------------------------------------------
+void stopLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+        if (!ASYNC_LOG.isRunning.load(std::memory_order_relaxed)) { return; }
+
+        ASYNC_LOG.isStopping = true;
+    }
+
+    ASYNC_LOG.wakeup.notify_one();
+    ASYNC_LOG.thread.join();
+
+    std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+    ASYNC_LOG.isRunning.store(false, std::memory_order_release);
+    drainRings();
+}
+
+//-----------------------------------------------------------------------------
+//! Writes out the records logged so far, blocks until they are written.
+//-----------------------------------------------------------------------------
+void flushLog()
+{
+    std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+    if (ASYNC_LOG.isRunning.load(std::memory_order_relaxed)) { drainRings(); }
+}
+
+//-----------------------------------------------------------------------------
+//! LG_LogMessage() serialized with the log thread, the message is cut to
+//! LOG_MAX_LINE_LENGTH.
+//-----------------------------------------------------------------------------
+void logMessage(const char* format, LG_StyleClass styleClass, ...)
+{
+    assert(format != nullptr);
+
+    char line[LOG_MAX_LINE_LENGTH] = {};
+
+    va_list args;
+    va_start(args, styleClass);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+    LG_LogMessage("%s", styleClass, line);
+}
+
+void pushLogRecord(const LogSite* site, const LogArg* args, size_t argsCount)
+{
+    assert(site != nullptr);
+    assert(argsCount <= LOG_MAX_ARGS);
+
+    if (!ASYNC_LOG.isRunning.load(std::memory_order_acquire))
+    {
+        char line[LOG_MAX_LINE_LENGTH] = {};
+        formatRecord(line, sizeof(line), site, args, argsCount);
+
+        fprintf(stderr, "%s: %s\n", LOG_LEVEL_NAMES[site->level], line);
+        return;
+    }
+
+    LogRing* ring = getThreadRing();
+    if (ring == nullptr) { return; }
+
+    size_t head = ring->head.load(std::memory_order_relaxed);
+    size_t used = head - ring->tail.load(std::memory_order_acquire);
+
+    if (used == LOG_RING_CAPACITY)
+    {
+        ring->droppedCount++;
+        return;
+    }
+
+    LogRecord* record = &ring->records[head % LOG_RING_CAPACITY];
+
+    record->site         = site;
+    record->time         = getLogTime();
+    record->droppedCount = ring->droppedCount;
+    record->argsCount    = argsCount;
+    for (size_t i = 0; i < argsCount; i++) { record->args[i] = args[i]; }
+
+    ring->droppedCount = 0;
+    ring->head.store(head + 1, std::memory_order_release);
+
+    // notify_one() doesn't make a syscall when the log thread isn't waiting
+    if (used + 1 == LOG_RING_CAPACITY * 3 / 4) { ASYNC_LOG.wakeup.notify_one(); }
+}
+
+//-----------------------------------------------------------------------------
+//! @return ring of the calling thread, registered on the first call, nullptr
+//!         if there's no memory for it.
+//-----------------------------------------------------------------------------
+LogRing* getThreadRing()
+{
+    if (LOG_OWNER.ring != nullptr) { return LOG_OWNER.ring; }
+
+    LogRing* ring = new (std::nothrow) LogRing();
+    CHECK_NULL(ring, return nullptr);
+
+    std::lock_guard<std::mutex> lock(ASYNC_LOG.mutex);
+
+    ring->next      = ASYNC_LOG.rings;
+    ASYNC_LOG.rings = ring;
+    LOG_OWNER.ring  = ring;
+
+    return ring;
+}
+
+uint64_t getLogTime()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+void logLoop()
+{
+    std::unique_lock<std::mutex> lock(ASYNC_LOG.mutex);
+
+    while (!ASYNC_LOG.isStopping)
+    {
+        ASYNC_LOG.wakeup.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL_MS));
+
+        drainRings();
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the records of all the rings and frees the rings of the threads
+//! that have exited, the log's mutex has to be locked.
+//-----------------------------------------------------------------------------
+void drainRings()
+{
+    LogRing** link = &ASYNC_LOG.rings;
+
+    while (*link != nullptr)
+    {
+        LogRing* ring = *link;
+
+        // read before the records, a ring orphaned after this is drained the
+        // next time
+        bool   isOrphaned = ring->isOrphaned.load(std::memory_order_acquire);
+        size_t head       = ring->head.load(std::memory_order_acquire);
+        size_t tail       = ring->tail.load(std::memory_order_relaxed);
+
+        for (; tail != head; tail++)
+        {
+            writeRecord(&ring->records[tail % LOG_RING_CAPACITY]);
+        }
+
+        ring->tail.store(tail, std::memory_order_release);
+
+        if (isOrphaned)
+        {
+            *link = ring->next;
+            delete ring;
+        }
+        else
+        {
+            link = &ring->next;
+        }
+    }
+
+    if (ASYNC_LOG.sink == LOG_SINK_TEXT && ASYNC_LOG.file != nullptr) { fflush(ASYNC_LOG.file); }
+}
+
+void writeRecord(const LogRecord* record)
+{
+    assert(record != nullptr);
+
+    char line[LOG_MAX_LINE_LENGTH] = {};
+    formatRecord(line, sizeof(line), record->site, record->args, record->argsCount);
+
+    const char* levelName = LOG_LEVEL_NAMES[record->site->level];
+    double      time      = (double) (record->time - ASYNC_LOG.startTime) / 1e9;
+
+    if (ASYNC_LOG.sink == LOG_SINK_TEXT)
+    {
+        if (record->droppedCount != 0)
+        {
+            fprintf(ASYNC_LOG.file, "%.6f warning: %zu records dropped\n", time, record->droppedCount);
+        }
+
+        fprintf(ASYNC_LOG.file, "%.6f %s: %s\n", time, levelName, line);
+        return;
+    }
+
+    if (record->droppedCount != 0)
+    {
+        LG_LogMessage("%zu records dropped", LG_STYLE_CLASS_ERROR, record->droppedCount);
+    }
+
+    LG_LogMessage("%.6f %s: %s", record->site->level >= LOG_LEVEL_WARNING ? LG_STYLE_CLASS_ERROR :
+                                                                             LG_STYLE_CLASS_DEFAULT,
+                  time, levelName, line);
+}
+
+//-----------------------------------------------------------------------------
+//! Formats the record like snprintf(), each conversion takes the next
+//! argument with the length modifier of its stored type.
+//!
+//! @return length of the text, it's cut to size - 1.
+//-----------------------------------------------------------------------------
+size_t formatRecord(char* buffer, size_t size, const LogSite* site, const LogArg* args, size_t argsCount)
+{
+    assert(buffer != nullptr);
+    assert(size   != 0);
+    assert(site   != nullptr);
+
+    const char* format   = site->format;
+    size_t      length   = 0;
+    size_t      argIndex = 0;
+
+    while (*format != '\0' && length + 1 < size)
+    {
+        if (*format != '%' || format[1] == '%')
+        {
+            buffer[length++] = *format;
+            format += *format == '%' ? 2 : 1;
+            continue;
+        }
+
+        char   spec[LOG_MAX_SPEC_LENGTH] = "%";
+        size_t specLength                = 1;
+
+        for (format++; *format != '\0' && strchr("-+ #0123456789.", *format) != nullptr; format++)
+        {
+            if (specLength + 4 < sizeof(spec)) { spec[specLength++] = *format; }
+        }
+
+        // the stored type decides the length modifier
+        while (*format != '\0' && strchr("hljztL", *format) != nullptr) { format++; }
+
+        char conversion = *format;
+        if (conversion == '\0') { break; }
+        format++;
+
+        if (argIndex == argsCount) { break; }
+
+        length += formatArg(buffer + length, size - length, spec, specLength, conversion, &args[argIndex++]);
+    }
+
+    buffer[length] = '\0';
+
+    return length;
+}
+
+size_t formatArg(char* buffer, size_t size, const char* spec, size_t specLength,
+                 char conversion, const LogArg* arg)
+{
+    assert(buffer != nullptr);
+    assert(spec   != nullptr);
+    assert(arg    != nullptr);
+
+    char fullSpec[LOG_MAX_SPEC_LENGTH] = {};
+    memcpy(fullSpec, spec, specLength);
+
+    bool isSigned = conversion == 'd' || conversion == 'i';
+    int  written  = 0;
+
+    switch (arg->type)
+    {
+        case LOG_ARG_INT:
+        case LOG_ARG_UINT:
+            if (conversion == 'c')
+            {
+                fullSpec[specLength] = 'c';
+                written = snprintf(buffer, size, fullSpec, (int) arg->value.i);
+                break;
+            }
+
+            fullSpec[specLength]     = 'l';
+            fullSpec[specLength + 1] = 'l';
+            fullSpec[specLength + 2] = conversion;
+
+            if (isSigned) { written = snprintf(buffer, size, fullSpec, arg->value.i); }
+            else          { written = snprintf(buffer, size, fullSpec, arg->value.u); }
+            break;
+
+        case LOG_ARG_DOUBLE:
+            fullSpec[specLength] = conversion;
+            written = snprintf(buffer, size, fullSpec, arg->value.d);
+            break;
+
+        case LOG_ARG_STRING:
+            if (conversion == 's')
+            {
+                fullSpec[specLength] = 's';
+                written = snprintf(buffer, size, fullSpec, arg->value.s != nullptr ? arg->value.s : "(null)");
+                break;
+            }
+
+            fullSpec[specLength] = 'p';
+            written = snprintf(buffer, size, fullSpec, arg->value.p);
+            break;
+
+        case LOG_ARG_POINTER:
+            fullSpec[specLength] = 'p';
+            written = snprintf(buffer, size, fullSpec, arg->value.p);
+            break;
+
+        default:
+            assert(! "VALID TYPE");
+            break;
+    }
+
+    if (written < 0) { return 0; }
+
+    return (size_t) written < size ? (size_t) written : size - 1;
+}
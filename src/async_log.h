@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../libs/log_generator.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup ASYNC_LOG Logging from the hot paths
+//!
+//! LOG_DEBUG(), LOG_INFO(), LOG_WARNING() and LOG_ERROR() take a printf
+//! format and up to LOG_MAX_ARGS numbers, pointers or strings. They don't
+//! format anything: the call site and the raw arguments are put into a ring
+//! buffer of the calling thread, without locks or syscalls. A background
+//! thread takes the records out of all the rings, formats them and writes
+//! them through LG_LogMessage() to log/log.html, or as plain text to a file.
+//!
+//! Levels below LOG_MIN_LEVEL are compiled out, their arguments aren't even
+//! evaluated. Formats are checked by the compiler like printf's ones, but
+//! '*' widths aren't supported.
+//!
+//! @attention Strings are stored as pointers, so they have to live until
+//!            the log is flushed (literals, interned names, argv).
+//!
+//! A full ring drops the new records and counts them, the count is written
+//! with the next record of the thread. Records logged while the log isn't
+//! started are written to stderr right away.
+//!
+//! logMessage() is LG_LogMessage() for the code off the hot paths, it formats
+//! and writes the message right away, under the lock the log thread writes
+//! with. LG_LogMessage() isn't to be called directly: log/log.html would be
+//! written by two threads at once.
+//!
+//! @addtogroup ASYNC_LOG
+//! @{
+
+#define LOG_LEVEL_DEBUG   0
+#define LOG_LEVEL_INFO    1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR   3
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+static const size_t LOG_MAX_ARGS        = 6;
+static const size_t LOG_RING_CAPACITY   = 1024;
+static const size_t LOG_MAX_LINE_LENGTH = 512;
+
+//! Records are written every LOG_FLUSH_INTERVAL_MS or as soon as a ring is
+//! three quarters full.
+static const int    LOG_FLUSH_INTERVAL_MS = 50;
+
+enum LogSink
+{
+    LOG_SINK_HTML,
+    LOG_SINK_TEXT
+};
+
+enum LogArgType
+{
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STRING,
+    LOG_ARG_POINTER
+};
+
+struct LogSite
+{
+    const char* format;
+    int         level;
+    const char* file;
+    int         line;
+};
+
+//! Converts every argument type printf takes, so the macros can put the
+//! arguments into an array.
+struct LogArg
+{
+    LogArgType type = LOG_ARG_INT;
+
+    union
+    {
+        long long          i;
+        unsigned long long u;
+        double             d;
+        const char*        s;
+        const void*        p;
+    } value = {};
+
+    LogArg() {}
+    LogArg(int                value) : type(LOG_ARG_INT)     { this->value.i = value; }
+    LogArg(long               value) : type(LOG_ARG_INT)     { this->value.i = value; }
+    LogArg(long long          value) : type(LOG_ARG_INT)     { this->value.i = value; }
+    LogArg(unsigned           value) : type(LOG_ARG_UINT)    { this->value.u = value; }
+    LogArg(unsigned long      value) : type(LOG_ARG_UINT)    { this->value.u = value; }
+    LogArg(unsigned long long value) : type(LOG_ARG_UINT)    { this->value.u = value; }
+    LogArg(double             value) : type(LOG_ARG_DOUBLE)  { this->value.d = value; }
+    LogArg(const char*        value) : type(LOG_ARG_STRING)  { this->value.s = value; }
+    LogArg(const void*        value) : type(LOG_ARG_POINTER) { this->value.p = value; }
+};
+
+#define LOG_RECORD(level, format, ...)                                           \
+    do                                                                           \
+    {                                                                            \
+        static const LogSite logSite   = { format, level, __FILE__, __LINE__ };  \
+        const LogArg         logArgs[] = { LogArg() __VA_OPT__(,) __VA_ARGS__ }; \
+        const size_t         argsCount = sizeof(logArgs) / sizeof(LogArg) - 1;   \
+        static_assert(argsCount <= LOG_MAX_ARGS, "Too many log arguments");      \
+                                                                                 \
+        pushLogRecord(&logSite, logArgs + 1, argsCount);                         \
+                                                                                 \
+        if (false) { printf(format __VA_OPT__(,) __VA_ARGS__); }                 \
+    } while (0)
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)   LOG_RECORD(LOG_LEVEL_DEBUG,   __VA_ARGS__)
+#else
+#define LOG_DEBUG(...)   ((void) 0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...)    LOG_RECORD(LOG_LEVEL_INFO,    __VA_ARGS__)
+#else
+#define LOG_INFO(...)    ((void) 0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARNING
+#define LOG_WARNING(...) LOG_RECORD(LOG_LEVEL_WARNING, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void) 0)
+#endif
+
+#define LOG_ERROR(...)   LOG_RECORD(LOG_LEVEL_ERROR,   __VA_ARGS__)
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool   startLog      (LogSink sink, FILE* file);
+void   stopLog       ();
+void   flushLog      ();
+
+void   logMessage    (const char* format, LG_StyleClass styleClass, ...);
+
+void   pushLogRecord (const LogSite* site, const LogArg* args, size_t argsCount);
+size_t formatRecord  (char* buffer, size_t size, const LogSite* site, const LogArg* args, size_t argsCount);
@@ -0,0 +1,377 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "batch_loader.h"
+#include "instrumentation.h"
+#include "thread_pool.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+//! Part of the file parsed by a single task, line numbers are chunk local
+//! until the chunks are joined.
+struct BatchChunk
+{
+    const char*   text;
+    size_t        size;
+
+    BatchLine*    lines;
+    size_t        linesCount;
+    size_t        capacity;
+    size_t        textLinesCount;
+    size_t        errorsCount;
+
+    NodeArena     arena;
+    StringBuilder errors;
+    bool          isLoaded;
+};
+
+size_t splitChunks (BatchChunk* chunks, const char* text, size_t size);
+void   parseChunk  (void* chunk);
+bool   pushLine    (BatchChunk* chunk, const char* line, size_t length, size_t lineNumber);
+bool   joinChunks  (BatchResult* result, BatchChunk* chunks, size_t chunksCount);
+bool   parseText   (BatchResult* result, const char* text, size_t size, size_t threadsCount);
+
+bool loadExpressionBatch(BatchResult* result, const char* filename)
+{
+    return loadExpressionBatch(result, filename, 1);
+}
+
+//-----------------------------------------------------------------------------
+//! @param [out] result
+//! @param [in]  filename
+//! @param [in]  threadsCount  0 for defaultThreadsCount(), 1 parses on the
+//!                            calling thread
+//!
+//! @return false if the file can't be read or there isn't enough memory,
+//!         syntax errors are reported per line.
+//-----------------------------------------------------------------------------
+bool loadExpressionBatch(BatchResult* result, const char* filename, size_t threadsCount)
+{
+    assert(result   != nullptr);
+    assert(filename != nullptr);
+
+    INSTR_PHASE(PHASE_LOAD);
+
+    *result = {};
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        fprintf(stderr, "Unable to open file '%s'.\n", filename);
+        return false;
+    }
+
+    struct stat fileStat = {};
+    if (fstat(fd, &fileStat) == -1)
+    {
+        fprintf(stderr, "Unable to get the size of file '%s'.\n", filename);
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = (size_t) fileStat.st_size;
+    if (fileSize == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    void* text = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (text == MAP_FAILED)
+    {
+        fprintf(stderr, "Unable to map file '%s'.\n", filename);
+        return false;
+    }
+
+    madvise(text, fileSize, MADV_SEQUENTIAL);
+
+    auto start = std::chrono::steady_clock::now();
+
+    bool isLoaded = parseText(result, (const char*) text, fileSize, threadsCount);
+
+    result->bytesCount   = fileSize;
+    result->parseSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    munmap(text, fileSize);
+
+    if (!isLoaded)
+    {
+        fprintf(stderr, "Unable to load whole file '%s'.\n", filename);
+        destroy(result);
+    }
+
+    return isLoaded;
+}
+
+bool parseText(BatchResult* result, const char* text, size_t size, size_t threadsCount)
+{
+    assert(result != nullptr);
+    assert(text   != nullptr);
+
+    BatchChunk* chunks = (BatchChunk*) calloc(size / BATCH_CHUNK_SIZE + 1, sizeof(BatchChunk));
+    CHECK_NULL(chunks, return false);
+
+    size_t chunksCount = splitChunks(chunks, text, size);
+
+    if (threadsCount == 0)          { threadsCount = defaultThreadsCount(); }
+    if (threadsCount > chunksCount) { threadsCount = chunksCount; }
+
+    ThreadPool pool = {};
+    if (threadsCount > 1 && construct(&pool, threadsCount) == nullptr) { threadsCount = 1; }
+
+    result->threadsCount = threadsCount;
+
+    if (threadsCount > 1)
+    {
+        size_t submitted = 0;
+        while (submitted < chunksCount && submitTask(&pool, parseChunk, &chunks[submitted])) { submitted++; }
+
+        waitTasks(&pool);
+        destroy(&pool);
+
+        // whatever couldn't be submitted is parsed here
+        for (size_t i = submitted; i < chunksCount; i++) { parseChunk(&chunks[i]); }
+    }
+    else
+    {
+        for (size_t i = 0; i < chunksCount; i++) { parseChunk(&chunks[i]); }
+    }
+
+    bool isLoaded = joinChunks(result, chunks, chunksCount);
+
+    free(chunks);
+
+    return isLoaded;
+}
+
+//-----------------------------------------------------------------------------
+//! Cuts the text into chunks of at least BATCH_CHUNK_SIZE bytes (except the
+//! last one), every chunk but the last one ends with '\n'.
+//!
+//! @return number of chunks, at most size / BATCH_CHUNK_SIZE + 1.
+//-----------------------------------------------------------------------------
+size_t splitChunks(BatchChunk* chunks, const char* text, size_t size)
+{
+    assert(chunks != nullptr);
+    assert(text   != nullptr);
+
+    size_t chunksCount = 0;
+
+    for (size_t start = 0; start < size; )
+    {
+        size_t end = start + BATCH_CHUNK_SIZE < size ? start + BATCH_CHUNK_SIZE : size;
+
+        const char* newline = (const char*) memchr(text + end - 1, '\n', size - end + 1);
+        end = newline != nullptr ? newline - text + 1 : size;
+
+        chunks[chunksCount].text = text + start;
+        chunks[chunksCount].size = end - start;
+        chunksCount++;
+
+        start = end;
+    }
+
+    return chunksCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Parses all the lines of a chunk into the chunk's own arena. The last line
+//! of the file isn't followed by '\n' if the file doesn't end with one, so
+//! that line is parsed from a null terminated copy rather than letting the
+//! number parsing look past the end of the mapping.
+//-----------------------------------------------------------------------------
+void parseChunk(void* chunkPtr)
+{
+    assert(chunkPtr != nullptr);
+
+    BatchChunk* chunk = (BatchChunk*) chunkPtr;
+
+    construct(&chunk->arena);
+    construct(&chunk->errors);
+
+    NodeArena* previousArena = setNodeArena(&chunk->arena);
+
+    const char* textEnd    = chunk->text + chunk->size;
+    size_t      lineNumber = 0;
+
+    chunk->isLoaded = true;
+
+    for (const char* line = chunk->text; line < textEnd && chunk->isLoaded; )
+    {
+        lineNumber++;
+
+        const char* lineEnd = (const char*) memchr(line, '\n', textEnd - line);
+
+        if (lineEnd == nullptr)
+        {
+            size_t length   = textEnd - line;
+            char*  lastLine = (char*) calloc(length + 1, sizeof(char));
+
+            if (lastLine == nullptr) { chunk->isLoaded = false; break; }
+
+            memcpy(lastLine, line, length);
+
+            chunk->isLoaded = pushLine(chunk, lastLine, length, lineNumber);
+            free(lastLine);
+
+            break;
+        }
+
+        chunk->isLoaded = pushLine(chunk, line, lineEnd - line, lineNumber);
+
+        line = lineEnd + 1;
+    }
+
+    chunk->textLinesCount = lineNumber;
+
+    setNodeArena(previousArena);
+}
+
+bool pushLine(BatchChunk* chunk, const char* line, size_t length, size_t lineNumber)
+{
+    assert(chunk != nullptr);
+    assert(line  != nullptr);
+
+    if (length > 0 && line[length - 1] == '\r') { length--; }
+    if (strspn(line, " \t") >= length)          { return true; }
+
+    if (chunk->linesCount == chunk->capacity)
+    {
+        size_t     capacity = chunk->capacity == 0 ? BATCH_INIT_CAPACITY : 2 * chunk->capacity;
+        BatchLine* lines    = (BatchLine*) realloc(chunk->lines, capacity * sizeof(BatchLine));
+        CHECK_NULL(lines, return false);
+
+        chunk->lines    = lines;
+        chunk->capacity = capacity;
+    }
+
+    ExprTree   tree   = {};
+    ParseError status = parseExpression(&tree, line, length, &chunk->errors);
+
+    if (status != PARSE_NO_ERROR)
+    {
+        // the nodes stay in the arena until the whole result is destroyed
+        tree.root = nullptr;
+        chunk->errorsCount++;
+    }
+    else
+    {
+        INSTR_TREE_SIZES(PHASE_LOAD, 0, instrTreeSize(tree.root));
+    }
+
+    chunk->lines[chunk->linesCount++] = { tree.root, lineNumber, status };
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Moves the chunk results into the batch result in file order, the chunks
+//! are left empty.
+//-----------------------------------------------------------------------------
+bool joinChunks(BatchResult* result, BatchChunk* chunks, size_t chunksCount)
+{
+    assert(result != nullptr);
+    assert(chunks != nullptr);
+
+    bool   isLoaded   = true;
+    size_t linesCount = 0;
+
+    for (size_t i = 0; i < chunksCount; i++)
+    {
+        isLoaded   &= chunks[i].isLoaded;
+        linesCount += chunks[i].linesCount;
+    }
+
+    result->lines  = (BatchLine*) calloc(linesCount + 1, sizeof(BatchLine));
+    result->arenas = (NodeArena*) calloc(chunksCount,    sizeof(NodeArena));
+
+    if (result->lines == nullptr || result->arenas == nullptr) { isLoaded = false; }
+
+    size_t lineOffset = 0;
+
+    for (size_t i = 0; i < chunksCount; i++)
+    {
+        BatchChunk* chunk = &chunks[i];
+
+        if (isLoaded)
+        {
+            for (size_t j = 0; j < chunk->linesCount; j++)
+            {
+                BatchLine* line = &result->lines[result->linesCount++];
+
+                *line             = chunk->lines[j];
+                line->lineNumber += lineOffset;
+            }
+
+            result->arenas[result->arenasCount++] = chunk->arena;
+            result->errorsCount                  += chunk->errorsCount;
+
+            isLoaded = appendString(&result->errors, getString(&chunk->errors), chunk->errors.length);
+        }
+        else
+        {
+            destroy(&chunk->arena);
+        }
+
+        lineOffset += chunk->textLinesCount;
+
+        free(chunk->lines);
+        destroy(&chunk->errors);
+
+        *chunk = {};
+    }
+
+    return isLoaded;
+}
+
+void destroy(BatchResult* result)
+{
+    assert(result != nullptr);
+
+    // trees may have been changed after loading, which mixes heap nodes in
+    for (size_t i = 0; i < result->linesCount; i++)
+    {
+        destroySubtree(result->lines[i].root);
+    }
+
+    for (size_t i = 0; i < result->arenasCount; i++)
+    {
+        destroy(&result->arenas[i]);
+    }
+
+    free(result->lines);
+    free(result->arenas);
+    destroy(&result->errors);
+
+    *result = {};
+}
+
+//-----------------------------------------------------------------------------
+//! @return parse throughput in MB/s (10^6 bytes).
+//-----------------------------------------------------------------------------
+double batchThroughput(const BatchResult* result)
+{
+    assert(result != nullptr);
+
+    if (result->parseSeconds <= 0) { return 0; }
+
+    return (double) result->bytesCount / 1e6 / result->parseSeconds;
+}
+
+void printBatchStats(const BatchResult* result, FILE* file)
+{
+    assert(result != nullptr);
+    assert(file   != nullptr);
+
+    fprintf(file, "Parsed %zu expressions (%zu with errors), %zu bytes in %.3f s on %zu threads: %.1f MB/s\n",
+            result->linesCount, result->errorsCount, result->bytesCount, result->parseSeconds,
+            result->threadsCount, batchThroughput(result));
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdio.h>
+#include "expression_tree.h"
+#include "expression_loader.h"
+#include "string_builder.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup BATCH_LOADER Loading files with one expression per line
+//!
+//! The file is mapped into memory and every line is parsed right from the
+//! mapping, lines aren't copied. Empty lines are skipped, '\r' of Windows
+//! line endings is ignored.
+//!
+//! The file is split into newline aligned chunks of about BATCH_CHUNK_SIZE
+//! bytes which are parsed in parallel, each into its own node arena and error
+//! sink. Chunk results are joined in file order, so the result doesn't depend
+//! on the number of threads.
+//!
+//! @addtogroup BATCH_LOADER
+//! @{
+
+struct BatchLine
+{
+    ETNode*    root       = nullptr;
+    size_t     lineNumber = 0;
+    ParseError status     = PARSE_NO_ERROR;
+};
+
+//! Trees of the lines live in the arenas, they are freed with the result.
+struct BatchResult
+{
+    BatchLine*    lines        = nullptr;
+    size_t        linesCount   = 0;
+    size_t        errorsCount  = 0;
+
+    NodeArena*    arenas       = nullptr;
+    size_t        arenasCount  = 0;
+
+    StringBuilder errors       = {};
+
+    size_t        bytesCount   = 0;
+    size_t        threadsCount = 0;
+    double        parseSeconds = 0;
+};
+
+static const size_t BATCH_INIT_CAPACITY = 1024;
+static const size_t BATCH_CHUNK_SIZE    = 1 << 20;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool   loadExpressionBatch (BatchResult* result, const char* filename);
+bool   loadExpressionBatch (BatchResult* result, const char* filename, size_t threadsCount);
+void   destroy             (BatchResult* result);
+
+double batchThroughput     (const BatchResult* result);
+void   printBatchStats     (const BatchResult* result, FILE* file);
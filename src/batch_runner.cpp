@@ -0,0 +1,643 @@
+#include <assert.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "batch_runner.h"
+#include "differentiation.h"
+#include "expression_cse.h"
+#include "expression_loader.h"
+#include "expression_simplifier.h"
+#include "result_cache.h"
+#include "string_builder.h"
+#include "symbol_table.h"
+#include "taylor_expansion.h"
+#include "thread_pool.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t BATCH_MAX_PATH_LENGTH = 4096;
+static const char*  BATCH_STDIN_NAME      = "-";
+
+//! Stage of every operation's transform, the simplification comes after it.
+static const ProfileStage BATCH_STAGES[BATCH_OPERATIONS_COUNT] = { STAGE_DIFFERENTIATE, STAGE_SIMPLIFY,
+                                                                   STAGE_TAYLOR,        STAGE_EVALUATE };
+
+//! Lines of the window are stored one after another without the '\n's.
+struct BatchWindow
+{
+    StringBuilder text;
+    size_t*       lineStarts;
+    size_t        linesCount;
+
+    char*         line;
+    size_t        lineCapacity;
+};
+
+struct BatchTask
+{
+    const BatchConfig* config;
+    const BatchWindow* window;
+    size_t             firstLine;
+    size_t             linesCount;
+
+    StringBuilder      output;
+    StringBuilder      errors;
+    double*            varValues;
+    size_t             varValuesCount;
+    bool               isOk;
+
+    //! number of the first line in the whole batch, for the profile
+    size_t             firstLineNumber;
+    StringBuilder      profileText;
+    Profile            profileTotal;
+};
+
+struct BatchRun
+{
+    const BatchConfig* config;
+    FILE*              output;
+
+    ThreadPool         pool;
+    BatchWindow        window;
+    BatchTask*         tasks;
+    size_t             tasksCount;
+
+    size_t             linesDone;
+    PerfCounters       counters;          //!< only tell the totals which counters are open
+    Profile            profileTotal;
+};
+
+BatchRun* construct        (BatchRun* run, const BatchConfig* config, FILE* output);
+void      destroy          (BatchRun* run);
+
+bool      runInput         (BatchRun* run, const char* input);
+bool      runDirectory     (BatchRun* run, const char* dirname);
+bool      runStream        (BatchRun* run, FILE* file);
+bool      readWindow       (BatchWindow* window, FILE* file);
+bool      processWindow    (BatchRun* run);
+void      runTask          (void* taskPtr);
+bool      runLine          (BatchTask* task, const char* line, size_t length, PerfCounters* counters,
+                            Profile* profile);
+bool      reserveVarValues (BatchTask* task);
+ETNode*   transformTree    (const BatchConfig* config, ETNode* root, double* varValues);
+bool      writeProfileTotal(BatchRun* run);
+int       compareNames     (const void* name1, const void* name2);
+
+//-----------------------------------------------------------------------------
+//! @return operation by its name, BATCH_OPERATION_INVALID if there's none.
+//-----------------------------------------------------------------------------
+BatchOperation getBatchOperation(const char* name)
+{
+    assert(name != nullptr);
+
+    for (int i = 0; i < BATCH_OPERATIONS_COUNT; i++)
+    {
+        if (strcmp(name, BATCH_OPERATIONS[i]) == 0) { return (BatchOperation) i; }
+    }
+
+    return BATCH_OPERATION_INVALID;
+}
+
+//-----------------------------------------------------------------------------
+//! Runs the operation on every line of the inputs, one after another.
+//!
+//! @param [in] config
+//! @param [in] inputs       files, directories or "-"
+//! @param [in] inputsCount  0 reads the standard input
+//! @param [in] output
+//!
+//! @return false if an input can't be read or the output can't be written,
+//!         the other inputs are still processed.
+//-----------------------------------------------------------------------------
+bool runBatch(const BatchConfig* config, const char* const* inputs, size_t inputsCount, FILE* output)
+{
+    assert(config != nullptr);
+    assert(output != nullptr);
+    assert(inputs != nullptr || inputsCount == 0);
+
+    if (config->operation == BATCH_TAYLOR && config->point != (double) (int) config->point)
+    {
+        logMessage("Taylor expansion point has to be an integer, not %lg.", LG_STYLE_CLASS_ERROR, config->point);
+        return false;
+    }
+
+    BatchRun run = {};
+    if (construct(&run, config, output) == nullptr)
+    {
+        logMessage("Not enough memory for the batch.", LG_STYLE_CLASS_ERROR);
+        return false;
+    }
+
+    bool isOk = true;
+
+    if (inputsCount == 0) { isOk = runInput(&run, BATCH_STDIN_NAME); }
+
+    for (size_t i = 0; i < inputsCount; i++)
+    {
+        isOk = runInput(&run, inputs[i]) && isOk;
+    }
+
+    if (config->profile != nullptr) { isOk = writeProfileTotal(&run) && isOk; }
+
+    destroy(&run);
+
+    return isOk;
+}
+
+BatchRun* construct(BatchRun* run, const BatchConfig* config, FILE* output)
+{
+    assert(run    != nullptr);
+    assert(config != nullptr);
+    assert(output != nullptr);
+
+    *run = {};
+
+    run->config = config;
+    run->output = output;
+
+    if (construct(&run->pool, config->threadsCount) == nullptr) { return nullptr; }
+
+    if (config->profile != nullptr) { construct(&run->counters); }
+
+    run->tasksCount = run->pool.threadsCount * BATCH_CHUNKS_PER_THREAD;
+    run->tasks      = (BatchTask*) calloc(run->tasksCount, sizeof(BatchTask));
+
+    run->window.lineStarts = (size_t*) calloc(BATCH_WINDOW_LINES + 1, sizeof(size_t));
+
+    bool isConstructed = run->tasks != nullptr && run->window.lineStarts != nullptr &&
+                         construct(&run->window.text) != nullptr;
+
+    for (size_t i = 0; i < run->tasksCount && isConstructed; i++)
+    {
+        BatchTask* task = &run->tasks[i];
+
+        task->config         = config;
+        task->window         = &run->window;
+        task->varValues      = (double*) calloc(SINGLE_LETTER_VARIABLES_COUNT, sizeof(double));
+        task->varValuesCount = SINGLE_LETTER_VARIABLES_COUNT;
+
+        isConstructed = task->varValues != nullptr && construct(&task->output) != nullptr &&
+                        construct(&task->errors) != nullptr && construct(&task->profileText) != nullptr;
+    }
+
+    if (!isConstructed)
+    {
+        destroy(run);
+        return nullptr;
+    }
+
+    return run;
+}
+
+void destroy(BatchRun* run)
+{
+    assert(run != nullptr);
+
+    if (run->pool.state != nullptr) { destroy(&run->pool); }
+
+    destroy(&run->counters);
+
+    for (size_t i = 0; run->tasks != nullptr && i < run->tasksCount; i++)
+    {
+        destroy(&run->tasks[i].output);
+        destroy(&run->tasks[i].errors);
+        destroy(&run->tasks[i].profileText);
+        free(run->tasks[i].varValues);
+    }
+
+    free(run->tasks);
+
+    destroy(&run->window.text);
+    free(run->window.lineStarts);
+    free(run->window.line);
+
+    *run = {};
+}
+
+bool runInput(BatchRun* run, const char* input)
+{
+    assert(run   != nullptr);
+    assert(input != nullptr);
+
+    if (strcmp(input, BATCH_STDIN_NAME) == 0) { return runStream(run, stdin); }
+
+    struct stat inputStat = {};
+    if (stat(input, &inputStat) == -1)
+    {
+        logMessage("Unable to open '%s'.", LG_STYLE_CLASS_ERROR, input);
+        return false;
+    }
+
+    if (S_ISDIR(inputStat.st_mode)) { return runDirectory(run, input); }
+
+    FILE* file = fopen(input, "r");
+    if (file == nullptr)
+    {
+        logMessage("Unable to open '%s'.", LG_STYLE_CLASS_ERROR, input);
+        return false;
+    }
+
+    bool isOk = runStream(run, file);
+
+    fclose(file);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Runs the regular files of the directory sorted by name, so the output
+//! doesn't depend on the order readdir() lists them in.
+//-----------------------------------------------------------------------------
+bool runDirectory(BatchRun* run, const char* dirname)
+{
+    assert(run     != nullptr);
+    assert(dirname != nullptr);
+
+    DIR* dir = opendir(dirname);
+    if (dir == nullptr)
+    {
+        logMessage("Unable to open directory '%s'.", LG_STYLE_CLASS_ERROR, dirname);
+        return false;
+    }
+
+    char** names         = nullptr;
+    size_t namesCount    = 0;
+    size_t namesCapacity = 0;
+    bool   isOk          = true;
+
+    for (dirent* entry = readdir(dir); entry != nullptr && isOk; entry = readdir(dir))
+    {
+        if (entry->d_name[0] == '.') { continue; }
+
+        char path[BATCH_MAX_PATH_LENGTH] = {};
+        snprintf(path, sizeof(path), "%s/%s", dirname, entry->d_name);
+
+        struct stat entryStat = {};
+        if (stat(path, &entryStat) == -1 || !S_ISREG(entryStat.st_mode)) { continue; }
+
+        if (namesCount == namesCapacity)
+        {
+            size_t capacity = namesCapacity == 0 ? 16 : 2 * namesCapacity;
+            char** newNames = (char**) realloc(names, capacity * sizeof(char*));
+            CHECK_NULL(newNames, isOk = false; break);
+
+            names         = newNames;
+            namesCapacity = capacity;
+        }
+
+        names[namesCount] = strdup(path);
+        CHECK_NULL(names[namesCount], isOk = false; break);
+
+        namesCount++;
+    }
+
+    closedir(dir);
+
+    if (!isOk) { logMessage("Not enough memory to list '%s'.", LG_STYLE_CLASS_ERROR, dirname); }
+
+    qsort(names, namesCount, sizeof(char*), compareNames);
+
+    for (size_t i = 0; i < namesCount && isOk; i++)
+    {
+        isOk = runInput(run, names[i]) && isOk;
+    }
+
+    for (size_t i = 0; i < namesCount; i++) { free(names[i]); }
+    free(names);
+
+    return isOk;
+}
+
+int compareNames(const void* name1, const void* name2)
+{
+    return strcmp(*(const char* const*) name1, *(const char* const*) name2);
+}
+
+bool runStream(BatchRun* run, FILE* file)
+{
+    assert(run  != nullptr);
+    assert(file != nullptr);
+
+    while (true)
+    {
+        if (!readWindow(&run->window, file))
+        {
+            logMessage("Not enough memory to read the input.", LG_STYLE_CLASS_ERROR);
+            return false;
+        }
+
+        if (run->window.linesCount == 0) { break; }
+
+        if (!processWindow(run)) { return false; }
+    }
+
+    if (ferror(file))
+    {
+        logMessage("Unable to read the input.", LG_STYLE_CLASS_ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads up to BATCH_WINDOW_LINES lines, none at the end of the file.
+//!
+//! @return false if there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool readWindow(BatchWindow* window, FILE* file)
+{
+    assert(window != nullptr);
+    assert(file   != nullptr);
+
+    clear(&window->text);
+    window->linesCount = 0;
+
+    while (window->linesCount < BATCH_WINDOW_LINES)
+    {
+        ssize_t length = getline(&window->line, &window->lineCapacity, file);
+        if (length == -1) { break; }
+
+        if (length > 0 && window->line[length - 1] == '\n') { length--; }
+
+        window->lineStarts[window->linesCount++] = window->text.length;
+
+        if (!appendString(&window->text, window->line, (size_t) length)) { return false; }
+    }
+
+    window->lineStarts[window->linesCount] = window->text.length;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Splits the window between the tasks, waits for them and writes their
+//! output in order.
+//-----------------------------------------------------------------------------
+bool processWindow(BatchRun* run)
+{
+    assert(run != nullptr);
+
+    size_t linesCount = run->window.linesCount;
+    size_t chunkSize  = (linesCount + run->tasksCount - 1) / run->tasksCount;
+    size_t firstLine  = 0;
+
+    for (size_t i = 0; i < run->tasksCount; i++)
+    {
+        BatchTask* task = &run->tasks[i];
+
+        size_t linesLeft = linesCount - firstLine;
+
+        task->firstLine       = firstLine;
+        task->firstLineNumber = run->linesDone + firstLine + 1;
+        task->linesCount      = linesLeft < chunkSize ? linesLeft : chunkSize;
+        firstLine            += task->linesCount;
+
+        clear(&task->output);
+        clear(&task->profileText);
+        task->profileTotal = {};
+
+        if (task->linesCount == 0) { continue; }
+
+        // a task that can't be queued is run right here
+        if (!submitTask(&run->pool, runTask, task)) { runTask(task); }
+    }
+
+    waitTasks(&run->pool);
+
+    bool isOk = true;
+
+    for (size_t i = 0; i < run->tasksCount && isOk; i++)
+    {
+        const BatchTask* task = &run->tasks[i];
+
+        if (!task->isOk && task->linesCount != 0)
+        {
+            logMessage("Not enough memory for the batch output.", LG_STYLE_CLASS_ERROR);
+            isOk = false;
+        }
+
+        isOk = isOk && fwrite(task->output.buffer, 1, task->output.length, run->output) == task->output.length;
+
+        if (isOk && run->config->profile != nullptr)
+        {
+            size_t length = task->profileText.length;
+            isOk = fwrite(task->profileText.buffer, 1, length, run->config->profile) == length;
+
+            addProfile(&run->profileTotal, &task->profileTotal);
+        }
+    }
+
+    run->linesDone += linesCount;
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! The counters are opened here, a group can only be read on the thread it's
+//! been opened on.
+//-----------------------------------------------------------------------------
+void runTask(void* taskPtr)
+{
+    BatchTask* task = (BatchTask*) taskPtr;
+    assert(task != nullptr);
+
+    const BatchWindow* window      = task->window;
+    bool               isProfiling = task->config->profile != nullptr;
+
+    PerfCounters counters = {};
+    if (isProfiling) { construct(&counters); }
+
+    task->isOk = true;
+
+    for (size_t i = task->firstLine; i < task->firstLine + task->linesCount && task->isOk; i++)
+    {
+        const char* line   = window->text.buffer + window->lineStarts[i];
+        size_t      length = window->lineStarts[i + 1] - window->lineStarts[i];
+
+        Profile profile = {};
+
+        if (isProfiling) { startStage(&counters); }
+
+        task->isOk = runLine(task, line, length, isProfiling ? &counters : nullptr, &profile);
+
+        if (isProfiling && task->isOk)
+        {
+            task->isOk = appendFormat(&task->profileText, "{\"line\":%zu,\"stages\":",
+                                      task->firstLineNumber + i - task->firstLine) &&
+                         writeProfile(&task->profileText, &counters, &profile) &&
+                         appendString(&task->profileText, "}\n");
+
+            addProfile(&task->profileTotal, &profile);
+        }
+    }
+
+    destroy(&counters);
+}
+
+//! Measures the stage if the line is profiled.
+#define END_STAGE(stage) if (counters != nullptr) { endStage(counters, &profile->stages[stage]); }
+
+//-----------------------------------------------------------------------------
+//! Appends the result of the line and a '\n' to the task's output.
+//!
+//! @param [in,out] task
+//! @param [in]     line
+//! @param [in]     length
+//! @param [in,out] counters  nullptr not to measure the stages
+//! @param [out]    profile
+//!
+//! @return false if there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool runLine(BatchTask* task, const char* line, size_t length, PerfCounters* counters, Profile* profile)
+{
+    assert(task    != nullptr);
+    assert(line    != nullptr);
+    assert(profile != nullptr);
+
+    const BatchConfig* config = task->config;
+    ExprTree           tree   = {};
+    bool               isOk   = true;
+
+    clear(&task->errors);
+
+    ParseError status = parseExpression(&tree, line, length, &task->errors);
+    END_STAGE(STAGE_PARSE);
+
+    if (status == PARSE_NO_ERROR && !reserveVarValues(task))
+    {
+        destroySubtree(tree.root);
+        return false;
+    }
+
+    if (status == PARSE_NO_ERROR)
+    {
+        ETNode* result = transformTree(config, tree.root, task->varValues);
+        END_STAGE(BATCH_STAGES[config->operation]);
+
+        if (result != nullptr && config->operation != BATCH_EVALUATE)
+        {
+            cachedSimplifyTree(result);
+            END_STAGE(STAGE_SIMPLIFY);
+        }
+
+        isOk = result != nullptr && writeExpression(&task->output, result, config->format);
+        END_STAGE(STAGE_EMIT);
+
+        destroySubtree(result);
+        destroySubtree(tree.root);
+    }
+
+    return isOk && appendChar(&task->output, '\n');
+}
+
+#undef END_STAGE
+
+//-----------------------------------------------------------------------------
+//! Grows the task's values to variablesCount(), the new ones are 0.
+//!
+//! @return false if there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool reserveVarValues(BatchTask* task)
+{
+    assert(task != nullptr);
+
+    size_t count = variablesCount();
+    if (count <= task->varValuesCount) { return true; }
+
+    double* varValues = (double*) realloc(task->varValues, count * sizeof(double));
+    CHECK_NULL(varValues, return false);
+
+    memset(varValues + task->varValuesCount, 0, (count - task->varValuesCount) * sizeof(double));
+
+    task->varValues      = varValues;
+    task->varValuesCount = count;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Runs the operation of the config on root through the result cache, root
+//! isn't changed, so it can be shared between threads.
+//!
+//! @param [in] config
+//! @param [in] root
+//! @param [in] varValues  variablesCount() values, evaluate sets 'x' and
+//!                        the temporaries of the let-bound form
+//!
+//! @return new tree, nullptr if there isn't enough memory.
+//-----------------------------------------------------------------------------
+ETNode* applyOperation(const BatchConfig* config, ETNode* root, double* varValues)
+{
+    assert(config != nullptr);
+
+    ETNode* result = transformTree(config, root, varValues);
+
+    if (result != nullptr && config->operation != BATCH_EVALUATE) { cachedSimplifyTree(result); }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//! applyOperation() without the simplification of the result.
+//-----------------------------------------------------------------------------
+ETNode* transformTree(const BatchConfig* config, ETNode* root, double* varValues)
+{
+    assert(config    != nullptr);
+    assert(root      != nullptr);
+    assert(varValues != nullptr);
+
+    switch (config->operation)
+    {
+        case BATCH_DIFFERENTIATE:
+            return cachedDifferentiate(root);
+
+        case BATCH_SIMPLIFY:
+            return copyTree(root);
+
+        case BATCH_TAYLOR:
+            return cachedTaylorExpansion(root, (int) config->point, config->order);
+
+        case BATCH_EVALUATE:
+        {
+            // repeated subtrees are evaluated once
+            LetExpr letExpr = {};
+            if (!eliminateCommonSubexprs(&letExpr, root, CSE_EVALUATE_MIN_SIZE))
+            {
+                destroy(&letExpr);
+                return nullptr;
+            }
+
+            varValues['x'] = config->point;
+            double value   = evaluateLetExpr(&letExpr, varValues);
+
+            destroy(&letExpr);
+
+            return newNode(TYPE_NUMBER, { value }, nullptr, nullptr);
+        }
+
+        default:
+            assert(! "VALID OPERATION");
+            return nullptr;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the sums of the stages of all the lines as the last profile line.
+//-----------------------------------------------------------------------------
+bool writeProfileTotal(BatchRun* run)
+{
+    assert(run                  != nullptr);
+    assert(run->config->profile != nullptr);
+
+    FILE* file = run->config->profile;
+
+    fprintf(file, "{\"lines\":%zu,\"stages\":", run->linesDone);
+    writeProfile(file, &run->counters, &run->profileTotal);
+    fprintf(file, "}\n");
+
+    return !ferror(file);
+}
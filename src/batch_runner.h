@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdio.h>
+#include "expression_tree.h"
+#include "expression_writer.h"
+#include "perf_counters.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup BATCH_RUNNER Many expressions in one process
+//!
+//! The inputs are files, directories (their regular files, by name, not
+//! recursively) and "-" for the standard input, every line is an expression.
+//! The lines are read in windows of BATCH_WINDOW_LINES, a window is split into
+//! chunks that the workers parse, transform and write into their own
+//! buffers, and the buffers are written out in order. So the output has a
+//! line per input line in the input order whatever the number of threads,
+//! and only a window is held in memory.
+//!
+//! A line that doesn't parse gets an empty line.
+//!
+//! With profile set, every task opens its own group of hardware counters on
+//! the worker it runs on and measures the stages of its lines: parse, the
+//! operation (differentiate, taylor, evaluate, or simplify, which is a copy),
+//! simplify and emit. A JSON line per input line, in the input order, goes to
+//! profile, and one with the totals at the end.
+//!
+//! Operations:
+//!
+//!     differentiate  simplified derivative by x
+//!     simplify       the expression simplified
+//!     taylor         Taylor polynomial at x = point up to x^order, point has
+//!                    to be an integer
+//!     evaluate       value at x = point, the other variables are 0
+//!
+//! @addtogroup BATCH_RUNNER
+//! @{
+
+enum BatchOperation
+{
+    BATCH_OPERATION_INVALID = -1,
+
+    BATCH_DIFFERENTIATE,
+    BATCH_SIMPLIFY,
+    BATCH_TAYLOR,
+    BATCH_EVALUATE,
+
+    BATCH_OPERATIONS_COUNT
+};
+
+static const char* BATCH_OPERATIONS[BATCH_OPERATIONS_COUNT] = { "differentiate", "simplify", "taylor", "evaluate" };
+
+static const size_t BATCH_WINDOW_LINES       = 1 << 14;
+static const size_t BATCH_CHUNKS_PER_THREAD  = 4;
+
+struct BatchConfig
+{
+    BatchOperation operation    = BATCH_DIFFERENTIATE;
+    ExprFormat     format       = EXPR_FORMAT_INFIX;
+    size_t         threadsCount = 0;
+    double         point        = 0;
+    size_t         order        = 5;
+    FILE*          profile      = nullptr;          //!< nullptr not to profile
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+BatchOperation getBatchOperation (const char* name);
+bool           runBatch          (const BatchConfig* config, const char* const* inputs, size_t inputsCount,
+                                  FILE* output);
+ETNode*        applyOperation    (const BatchConfig* config, ETNode* root, double* varValues);
@@ -1,21 +1,58 @@
 #include <assert.h>
 #include "math_syntax.h"
 #include "differentiation.h"
+#include "instrumentation.h"
+#include "polynomial.h"
 
 #define LEFT  root->left
 #define RIGHT root->right
 
-#define dL (*differentiate(LEFT))
-#define dR (*differentiate(RIGHT))
+#define dL (*differentiateNode(LEFT))
+#define dR (*differentiateNode(RIGHT))
 #define L  (*copyTree(LEFT))
 #define R  (*copyTree(RIGHT))
 
 #define RETURN(arg) return &(arg)
 
+ETNode* differentiateNode (ETNode* root);
+
 ETNode* differentiate(ETNode* root)
 {
     assert(root != nullptr);
 
+    INSTR_PHASE(PHASE_DIFFERENTIATE);
+
+    ETNode* derivative = differentiateNode(root);
+
+    // rational functions of x are differentiated on their coefficients, so
+    // the quotient rule doesn't leave nested denominators behind, unless the
+    // expanded form comes out larger
+    ETNode* rational = differentiateRational(root, 'x');
+    if (rational != nullptr)
+    {
+        size_t size = 0;
+        treeSize(derivative, &size);
+
+        if (isTreeLarger(rational, size))
+        {
+            destroySubtree(rational);
+        }
+        else
+        {
+            destroySubtree(derivative);
+            derivative = rational;
+        }
+    }
+
+    INSTR_TREE_SIZES(PHASE_DIFFERENTIATE, instrTreeSize(root), instrTreeSize(derivative));
+
+    return derivative;
+}
+
+ETNode* differentiateNode(ETNode* root)
+{
+    assert(root != nullptr);
+
     Operation operation = isTypeOp(root) ? root->data.op : OP_INVALID;
 
     if (root->type == TYPE_NUMBER || (isTypeOp(root) && !hasVariable(root, 'x')))
@@ -0,0 +1,804 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "expression_binary.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t  VARINT_MAX_SIZE       = 10;
+static const size_t  BIN_INIT_BUFFER_SIZE  = 4096;
+static const size_t  BIN_INIT_STACK_SIZE   = 64;
+static const uint8_t BIN_TAG_TYPE_MASK     = 0x3;
+static const int     BIN_TAG_OP_SHIFT      = 2;
+
+//! Distinct constants in order of appearance, the hash table maps the bits of
+//! a constant to its index + 1.
+struct ConstantPool
+{
+    double*   values;
+    size_t    count;
+    size_t    capacity;
+
+    uint64_t* keys;
+    size_t*   slots;
+    size_t    slotsCount;
+};
+
+//! Variable names in order of appearance, fileIds maps an id of this process
+//! to the id in the file (0 if the name hasn't been seen yet).
+struct SymbolPool
+{
+    int*   fileIds;
+    int*   ids;
+    size_t idsCount;
+    size_t count;
+    size_t namesSize;
+};
+
+//! The node array is written from the end of the buffer to its beginning, so
+//! that the length of a left subtree is known by the time its parent is.
+struct BinWriter
+{
+    uint8_t* buffer;
+    size_t   size;
+    size_t   written;
+};
+
+struct SaveFrame
+{
+    const ETNode* node;
+    size_t        leftEnd;
+    int           stage;
+};
+
+struct EvalFrame
+{
+    Operation operation;
+    bool      hasLeft;
+    double    left;
+};
+
+struct RebuildFrame
+{
+    ETNode* node;
+    bool    hasLeft;
+};
+
+uint64_t mixKey         (uint64_t key);
+size_t  encodeVarint    (uint64_t value, uint8_t* bytes);
+bool    decodeVarint    (const uint8_t* bytes, size_t size, size_t* offset, uint64_t* value);
+bool    internConstant  (ConstantPool* pool, double value, size_t* index);
+void    destroyPool     (ConstantPool* pool);
+int     internSymbol    (SymbolPool* symbols, int id);
+void    destroyPool     (SymbolPool* symbols);
+bool    writeBackward   (BinWriter* writer, const uint8_t* bytes, size_t count);
+bool    writeLeaf       (BinWriter* writer, ConstantPool* pool, SymbolPool* symbols, const ETNode* node);
+bool    writeNodes      (BinWriter* writer, ConstantPool* pool, SymbolPool* symbols, const ETNode* root);
+bool    writeSymbols    (FILE* file, const SymbolPool* symbols);
+bool    readSymbols     (ExprBinView* view);
+bool    growStack       (void** stack, size_t* capacity, size_t elementSize);
+
+uint64_t mixKey(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ull;
+    key ^= key >> 33;
+
+    return key;
+}
+
+size_t encodeVarint(uint64_t value, uint8_t* bytes)
+{
+    assert(bytes != nullptr);
+
+    size_t size = 0;
+
+    while (value >= 0x80)
+    {
+        bytes[size++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+
+    bytes[size++] = (uint8_t) value;
+
+    return size;
+}
+
+bool decodeVarint(const uint8_t* bytes, size_t size, size_t* offset, uint64_t* value)
+{
+    assert(bytes  != nullptr);
+    assert(offset != nullptr);
+    assert(value  != nullptr);
+
+    *value = 0;
+
+    for (size_t i = 0; i < VARINT_MAX_SIZE && *offset < size; i++)
+    {
+        uint8_t byte = bytes[(*offset)++];
+
+        *value |= (uint64_t) (byte & 0x7F) << (7 * i);
+
+        if ((byte & 0x80) == 0) { return true; }
+    }
+
+    return false;
+}
+
+bool internConstant(ConstantPool* pool, double value, size_t* index)
+{
+    assert(pool  != nullptr);
+    assert(index != nullptr);
+
+    if (2 * (pool->count + 1) > pool->slotsCount)
+    {
+        size_t  slotsCount = pool->slotsCount == 0 ? 64 : 2 * pool->slotsCount;
+        size_t* slots      = (size_t*)   calloc(slotsCount, sizeof(size_t));
+        uint64_t* keys     = (uint64_t*) calloc(slotsCount, sizeof(uint64_t));
+
+        if (slots == nullptr || keys == nullptr)
+        {
+            free(slots);
+            free(keys);
+            return false;
+        }
+
+        for (size_t i = 0; i < pool->slotsCount; i++)
+        {
+            if (pool->slots[i] == 0) { continue; }
+
+            size_t slot = mixKey(pool->keys[i]) & (slotsCount - 1);
+            while (slots[slot] != 0) { slot = (slot + 1) & (slotsCount - 1); }
+
+            slots[slot] = pool->slots[i];
+            keys[slot]  = pool->keys[i];
+        }
+
+        free(pool->slots);
+        free(pool->keys);
+
+        pool->slots      = slots;
+        pool->keys       = keys;
+        pool->slotsCount = slotsCount;
+    }
+
+    uint64_t key = 0;
+    memcpy(&key, &value, sizeof(double));
+
+    size_t slot = mixKey(key) & (pool->slotsCount - 1);
+
+    for (; pool->slots[slot] != 0; slot = (slot + 1) & (pool->slotsCount - 1))
+    {
+        if (pool->keys[slot] == key)
+        {
+            *index = pool->slots[slot] - 1;
+            return true;
+        }
+    }
+
+    if (pool->count == pool->capacity)
+    {
+        size_t  capacity = pool->capacity == 0 ? 64 : 2 * pool->capacity;
+        double* values   = (double*) realloc(pool->values, capacity * sizeof(double));
+        CHECK_NULL(values, return false);
+
+        pool->values   = values;
+        pool->capacity = capacity;
+    }
+
+    pool->values[pool->count] = value;
+    pool->keys[slot]          = key;
+    pool->slots[slot]         = ++pool->count;
+
+    *index = pool->count - 1;
+
+    return true;
+}
+
+void destroyPool(ConstantPool* pool)
+{
+    assert(pool != nullptr);
+
+    free(pool->values);
+    free(pool->keys);
+    free(pool->slots);
+
+    *pool = {};
+}
+
+//-----------------------------------------------------------------------------
+//! @return id of the variable in the file or VARIABLE_INVALID_ID if there
+//!         isn't enough memory.
+//-----------------------------------------------------------------------------
+int internSymbol(SymbolPool* symbols, int id)
+{
+    assert(symbols != nullptr);
+    assert(isVariableId(id));
+
+    if (id < SINGLE_LETTER_VARIABLES_COUNT) { return id; }
+
+    // the ids of the tree being written are all below variablesCount() by now
+    if (symbols->fileIds == nullptr)
+    {
+        symbols->idsCount = variablesCount();
+        symbols->fileIds  = (int*) calloc(symbols->idsCount, sizeof(int));
+        symbols->ids      = (int*) calloc(symbols->idsCount, sizeof(int));
+
+        if (symbols->fileIds == nullptr || symbols->ids == nullptr)
+        {
+            destroyPool(symbols);
+            return VARIABLE_INVALID_ID;
+        }
+    }
+
+    assert((size_t) id < symbols->idsCount);
+
+    if (symbols->fileIds[id] == 0)
+    {
+        symbols->fileIds[id]            = SINGLE_LETTER_VARIABLES_COUNT + (int) symbols->count;
+        symbols->ids[symbols->count++]  = id;
+        symbols->namesSize             += strlen(getVariableName(id)) + 1;
+    }
+
+    return symbols->fileIds[id];
+}
+
+void destroyPool(SymbolPool* symbols)
+{
+    assert(symbols != nullptr);
+
+    free(symbols->fileIds);
+    free(symbols->ids);
+
+    *symbols = {};
+}
+
+bool writeBackward(BinWriter* writer, const uint8_t* bytes, size_t count)
+{
+    assert(writer != nullptr);
+    assert(bytes  != nullptr);
+
+    if (writer->written + count > writer->size)
+    {
+        size_t size = writer->size == 0 ? BIN_INIT_BUFFER_SIZE : writer->size;
+        while (writer->written + count > size) { size *= 2; }
+
+        uint8_t* buffer = (uint8_t*) malloc(size);
+        CHECK_NULL(buffer, return false);
+
+        if (writer->buffer != nullptr)
+        {
+            memcpy(buffer + size - writer->written, writer->buffer + writer->size - writer->written, writer->written);
+            free(writer->buffer);
+        }
+
+        writer->buffer = buffer;
+        writer->size   = size;
+    }
+
+    writer->written += count;
+    memcpy(writer->buffer + writer->size - writer->written, bytes, count);
+
+    return true;
+}
+
+bool writeLeaf(BinWriter* writer, ConstantPool* pool, SymbolPool* symbols, const ETNode* node)
+{
+    assert(writer  != nullptr);
+    assert(pool    != nullptr);
+    assert(symbols != nullptr);
+    assert(node    != nullptr);
+
+    uint8_t bytes[1 + VARINT_MAX_SIZE] = { (uint8_t) node->type };
+    size_t  size                       = 1;
+
+    if (node->type == TYPE_NUMBER)
+    {
+        size_t index = 0;
+        if (!internConstant(pool, node->data.number, &index)) { return false; }
+
+        size += encodeVarint(index, bytes + 1);
+    }
+    else
+    {
+        int fileId = internSymbol(symbols, node->data.var);
+        if (fileId == VARIABLE_INVALID_ID) { return false; }
+
+        size += encodeVarint((uint64_t) fileId, bytes + 1);
+    }
+
+    return writeBackward(writer, bytes, size);
+}
+
+bool growStack(void** stack, size_t* capacity, size_t elementSize)
+{
+    assert(stack    != nullptr);
+    assert(capacity != nullptr);
+
+    size_t newCapacity = *capacity == 0 ? BIN_INIT_STACK_SIZE : 2 * *capacity;
+    void*  newStack    = realloc(*stack, newCapacity * elementSize);
+    CHECK_NULL(newStack, return false);
+
+    *stack    = newStack;
+    *capacity = newCapacity;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the subtree in reverse preorder (right subtree, left subtree, node)
+//! with an explicit stack, so the depth of the tree doesn't matter.
+//-----------------------------------------------------------------------------
+bool writeNodes(BinWriter* writer, ConstantPool* pool, SymbolPool* symbols, const ETNode* root)
+{
+    assert(writer  != nullptr);
+    assert(pool    != nullptr);
+    assert(symbols != nullptr);
+    assert(root    != nullptr);
+
+    SaveFrame* stack    = nullptr;
+    size_t     capacity = 0;
+    size_t     depth    = 0;
+    bool       isOk     = growStack((void**) &stack, &capacity, sizeof(SaveFrame));
+
+    if (isOk) { stack[depth++] = { root, 0, 0 }; }
+
+    while (isOk && depth > 0)
+    {
+        SaveFrame*    frame = &stack[depth - 1];
+        const ETNode* node  = frame->node;
+
+        if (node->type != TYPE_OP)
+        {
+            isOk = writeLeaf(writer, pool, symbols, node);
+            depth--;
+            continue;
+        }
+
+        const ETNode* next = nullptr;
+
+        switch (frame->stage++)
+        {
+            case 0:
+                next = node->right;
+                break;
+
+            case 1:
+                frame->leftEnd = writer->written;
+                next           = node->left;
+                break;
+
+            default:
+            {
+                uint8_t tag = (uint8_t) (TYPE_OP | (node->data.op << BIN_TAG_OP_SHIFT));
+
+                if (!isOperationUnary(node->data.op))
+                {
+                    uint8_t length[VARINT_MAX_SIZE] = {};
+                    isOk = writeBackward(writer, length, encodeVarint(writer->written - frame->leftEnd, length));
+                }
+
+                isOk = isOk && writeBackward(writer, &tag, 1);
+
+                depth--;
+                continue;
+            }
+        }
+
+        if (next == nullptr) { continue; }
+
+        if (depth == capacity && !growStack((void**) &stack, &capacity, sizeof(SaveFrame)))
+        {
+            isOk = false;
+            break;
+        }
+
+        stack[depth++] = { next, 0, 0 };
+    }
+
+    free(stack);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! @return false if the file can't be written or there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool saveExprBin(const ETNode* root, const char* filename)
+{
+    assert(root     != nullptr);
+    assert(filename != nullptr);
+
+    ConstantPool pool    = {};
+    SymbolPool   symbols = {};
+    BinWriter    writer  = {};
+
+    if (!writeNodes(&writer, &pool, &symbols, root))
+    {
+        printf("Not enough memory to save the tree to '%s'.\n", filename);
+
+        destroyPool(&pool);
+        destroyPool(&symbols);
+        free(writer.buffer);
+
+        return false;
+    }
+
+    ExprBinHeader header  = {};
+    header.fileHeader     = { EXPR_BIN_SIGNATURE, EXPR_BIN_VERSION };
+    header.symbolsCount   = (uint32_t) symbols.count;
+    header.constantsCount = pool.count;
+    header.symbolsSize    = symbols.namesSize;
+    header.nodesSize      = writer.written;
+
+    FILE* file = fopen(filename, "wb");
+    bool  isOk = file != nullptr;
+
+    isOk = isOk && fwrite(&header,      sizeof(header), 1,              file) == 1;
+    isOk = isOk && fwrite(pool.values,  sizeof(double), pool.count,     file) == pool.count;
+    isOk = isOk && writeSymbols(file, &symbols);
+    isOk = isOk && fwrite(writer.buffer + writer.size - writer.written, 1, writer.written, file) == writer.written;
+
+    if (file != nullptr && fclose(file) != 0) { isOk = false; }
+
+    if (!isOk) { printf("Unable to write file '%s'.\n", filename); }
+
+    destroyPool(&pool);
+    destroyPool(&symbols);
+    free(writer.buffer);
+
+    return isOk;
+}
+
+bool writeSymbols(FILE* file, const SymbolPool* symbols)
+{
+    assert(file    != nullptr);
+    assert(symbols != nullptr);
+
+    for (size_t i = 0; i < symbols->count; i++)
+    {
+        const char* name = getVariableName(symbols->ids[i]);
+
+        if (fwrite(name, sizeof(char), strlen(name) + 1, file) != strlen(name) + 1) { return false; }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Maps the file and checks its header and section sizes. The nodes are
+//! checked as they are read.
+//-----------------------------------------------------------------------------
+bool openExprBin(ExprBinView* view, const char* filename)
+{
+    assert(view     != nullptr);
+    assert(filename != nullptr);
+
+    *view = {};
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+    {
+        printf("Unable to open file '%s'.\n", filename);
+        return false;
+    }
+
+    struct stat fileStat = {};
+    bool        isOk     = fstat(fd, &fileStat) == 0 && (size_t) fileStat.st_size >= sizeof(ExprBinHeader);
+
+    void* mapping = MAP_FAILED;
+    if (isOk) { mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0); }
+
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        printf("Unable to map file '%s'.\n", filename);
+        return false;
+    }
+
+    view->mapping     = mapping;
+    view->mappingSize = fileStat.st_size;
+    view->header      = (const ExprBinHeader*) mapping;
+
+    const ExprBinHeader* header   = view->header;
+    size_t               dataSize = view->mappingSize - sizeof(ExprBinHeader);
+
+    isOk = header->fileHeader.signature == EXPR_BIN_SIGNATURE && header->fileHeader.version == EXPR_BIN_VERSION &&
+           header->constantsCount <= dataSize / sizeof(double) &&
+           header->symbolsSize    <= dataSize - header->constantsCount * sizeof(double) &&
+           header->nodesSize      == dataSize - header->constantsCount * sizeof(double) - header->symbolsSize &&
+           header->nodesSize      != 0;
+
+    if (isOk)
+    {
+        view->constantsCount = header->constantsCount;
+        view->constants      = (const double*) (header + 1);
+        view->symbolsCount   = header->symbolsCount;
+        view->symbolsSize    = header->symbolsSize;
+        view->symbols        = (const char*) (view->constants + view->constantsCount);
+        view->nodesSize      = header->nodesSize;
+        view->nodes          = (const uint8_t*) (view->symbols + view->symbolsSize);
+
+        isOk = readSymbols(view);
+    }
+
+    if (!isOk)
+    {
+        printf("File '%s' isn't a valid expression tree of version %d.\n", filename, EXPR_BIN_VERSION);
+        closeExprBin(view);
+
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Interns the names of the symbol section.
+//!
+//! @return false if the section is malformed or the names don't fit.
+//-----------------------------------------------------------------------------
+bool readSymbols(ExprBinView* view)
+{
+    assert(view != nullptr);
+
+    if (view->symbolsCount == 0) { return view->symbolsSize == 0; }
+
+    view->variableIds = (int*) calloc(view->symbolsCount, sizeof(int));
+    CHECK_NULL(view->variableIds, return false);
+
+    const char* name       = view->symbols;
+    const char* symbolsEnd = view->symbols + view->symbolsSize;
+
+    for (size_t i = 0; i < view->symbolsCount; i++)
+    {
+        const char* nameEnd = (const char*) memchr(name, '\0', symbolsEnd - name);
+        if (nameEnd == nullptr) { return false; }
+
+        view->variableIds[i] = internVariable(name, nameEnd - name);
+        if (view->variableIds[i] == VARIABLE_INVALID_ID) { return false; }
+
+        name = nameEnd + 1;
+    }
+
+    return name == symbolsEnd;
+}
+
+void closeExprBin(ExprBinView* view)
+{
+    assert(view != nullptr);
+
+    if (view->mapping != nullptr) { munmap(view->mapping, view->mappingSize); }
+
+    free(view->variableIds);
+
+    *view = {};
+}
+
+//-----------------------------------------------------------------------------
+//! Decodes the node at the offset.
+//!
+//! @return false if the node is malformed or out of the node array.
+//-----------------------------------------------------------------------------
+bool readBinNode(const ExprBinView* view, size_t offset, BinNode* node)
+{
+    assert(view != nullptr);
+    assert(node != nullptr);
+
+    if (offset >= view->nodesSize) { return false; }
+
+    uint8_t  tag   = view->nodes[offset++];
+    uint64_t value = 0;
+
+    node->type  = (NodeType) (tag & BIN_TAG_TYPE_MASK);
+    node->left  = BIN_NO_CHILD;
+    node->right = BIN_NO_CHILD;
+    node->end   = offset;
+
+    switch (node->type)
+    {
+        case TYPE_NUMBER:
+            if (!decodeVarint(view->nodes, view->nodesSize, &offset, &value) || value >= view->constantsCount)
+            {
+                return false;
+            }
+
+            node->data.number = view->constants[value];
+            node->end         = offset;
+            return true;
+
+        case TYPE_VAR:
+            if (!decodeVarint(view->nodes, view->nodesSize, &offset, &value)) { return false; }
+
+            if (value >= SINGLE_LETTER_VARIABLES_COUNT)
+            {
+                value -= SINGLE_LETTER_VARIABLES_COUNT;
+                if (value >= view->symbolsCount) { return false; }
+
+                node->data.var = view->variableIds[value];
+            }
+            else
+            {
+                node->data.var = (int) value;
+                if (!isVariableId(node->data.var)) { return false; }
+            }
+
+            node->end = offset;
+            return true;
+
+        case TYPE_OP:
+            node->data.op = (Operation) (tag >> BIN_TAG_OP_SHIFT);
+            if (node->data.op >= OPERATIONS_COUNT) { return false; }
+
+            if (isOperationUnary(node->data.op))
+            {
+                node->right = offset;
+                return offset < view->nodesSize;
+            }
+
+            if (!decodeVarint(view->nodes, view->nodesSize, &offset, &value)) { return false; }
+
+            node->end   = offset;
+            node->left  = offset;
+            node->right = offset + value;
+
+            return node->right < view->nodesSize && node->right > node->left;
+
+        case TYPE_INVALID:
+        default:
+            return false;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Evaluates the tree right in the mapping. Preorder is prefix notation, so
+//! the nodes are read front to back once, with a stack of the operations
+//! waiting for their arguments.
+//!
+//! @param [in]  view
+//! @param [in]  varValues  variablesCount() values indexed by variable
+//! @param [out] value
+//!
+//! @return false if the node array is malformed.
+//-----------------------------------------------------------------------------
+bool evaluateBin(const ExprBinView* view, const double* varValues, double* value)
+{
+    assert(view      != nullptr);
+    assert(varValues != nullptr);
+    assert(value     != nullptr);
+
+    EvalFrame* stack    = nullptr;
+    size_t     capacity = 0;
+    size_t     depth    = 0;
+    size_t     offset   = 0;
+    bool       isDone   = false;
+    bool       isOk     = true;
+
+    while (isOk && !isDone)
+    {
+        BinNode node = {};
+        if (!readBinNode(view, offset, &node)) { isOk = false; break; }
+
+        if (node.type == TYPE_OP)
+        {
+            if (depth == capacity && !growStack((void**) &stack, &capacity, sizeof(EvalFrame))) { isOk = false; break; }
+
+            stack[depth++] = { node.data.op, false, 0 };
+            offset         = node.end;
+
+            continue;
+        }
+
+        double result = node.type == TYPE_NUMBER ? node.data.number : varValues[node.data.var];
+
+        // the value completes the operations on top of the stack one by one
+        // until one of them still waits for its right argument
+        while (depth > 0)
+        {
+            EvalFrame* frame = &stack[depth - 1];
+
+            if (isOperationUnary(frame->operation))
+            {
+                result = evaluateUnary(frame->operation, result);
+            }
+            else if (!frame->hasLeft)
+            {
+                frame->hasLeft = true;
+                frame->left    = result;
+                break;
+            }
+            else
+            {
+                result = evaluateBinary(frame->operation, frame->left, result);
+            }
+
+            depth--;
+        }
+
+        if (depth == 0)
+        {
+            *value = result;
+            isDone = true;
+        }
+
+        offset = node.end;
+    }
+
+    free(stack);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Builds a pointer tree from the view.
+//!
+//! @return root or nullptr if the node array is malformed.
+//-----------------------------------------------------------------------------
+ETNode* rebuildTree(const ExprBinView* view)
+{
+    assert(view != nullptr);
+
+    RebuildFrame* stack    = nullptr;
+    size_t        capacity = 0;
+    size_t        depth    = 0;
+    size_t        offset   = 0;
+    ETNode*       root     = nullptr;
+    bool          isOk     = true;
+
+    do
+    {
+        BinNode node = {};
+        isOk = readBinNode(view, offset, &node);
+
+        ETNode* newTreeNode = isOk ? newNode(node.type, node.data, nullptr, nullptr) : nullptr;
+        if (newTreeNode == nullptr) { isOk = false; break; }
+
+        if (depth == 0)
+        {
+            root = newTreeNode;
+        }
+        else
+        {
+            RebuildFrame* parent = &stack[depth - 1];
+
+            if (!isOperationUnary(parent->node->data.op) && !parent->hasLeft)
+            {
+                parent->node->left = newTreeNode;
+                parent->hasLeft    = true;
+            }
+            else
+            {
+                parent->node->right = newTreeNode;
+                depth--;
+            }
+
+            newTreeNode->parent = parent->node;
+        }
+
+        if (node.type == TYPE_OP)
+        {
+            if (depth == capacity && !growStack((void**) &stack, &capacity, sizeof(RebuildFrame))) { isOk = false; break; }
+
+            stack[depth++] = { newTreeNode, false };
+        }
+
+        offset = node.end;
+    } while (depth > 0);
+
+    free(stack);
+
+    if (!isOk)
+    {
+        destroySubtree(root);
+        return nullptr;
+    }
+
+    return root;
+}
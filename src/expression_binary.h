@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include "../libs/file_manager.h"
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup EXPRESSION_BINARY Binary expression tree format
+//!
+//! File layout (native byte order):
+//!
+//!     ExprBinHeader
+//!     double  constants[constantsCount]    - every distinct number once
+//!     char    symbols[symbolsSize]         - symbolsCount null terminated
+//!                                            variable names
+//!     uint8_t nodes[nodesSize]             - the tree in preorder
+//!
+//! A node starts with a tag byte: the node type in the low 2 bits and the
+//! operation in the rest. Numbers are followed by a varint index into the
+//! constant pool, variables by a varint id: one letter variables keep their
+//! ids, SINGLE_LETTER_VARIABLES_COUNT + i stands for the i-th name of the
+//! symbol section. The names are interned again when the file is opened, as
+//! ids of longer names differ between runs. Binary operations are followed by
+//! a varint byte length of the left subtree, which lets a reader jump right to
+//! the right child. Unary operations are followed by their argument right
+//! away.
+//!
+//! A loaded file is only mapped into memory, evaluating and walking it works
+//! on the mapping directly.
+//!
+//! @addtogroup EXPRESSION_BINARY
+//! @{
+
+static const short EXPR_BIN_SIGNATURE = 0x5445; // "ET"
+static const short EXPR_BIN_VERSION   = 2;
+
+struct ExprBinHeader
+{
+    BinFileHeader fileHeader     = {};
+    uint32_t      symbolsCount   = 0;
+    uint64_t      constantsCount = 0;
+    uint64_t      symbolsSize    = 0;
+    uint64_t      nodesSize      = 0;
+};
+
+//! Read-only view of a mapped file, variableIds are the ids the names of the
+//! symbol section have got in this process.
+struct ExprBinView
+{
+    const ExprBinHeader* header         = nullptr;
+    const double*        constants      = nullptr;
+    const char*          symbols        = nullptr;
+    const uint8_t*       nodes          = nullptr;
+    size_t               constantsCount = 0;
+    size_t               symbolsCount   = 0;
+    size_t               symbolsSize    = 0;
+    size_t               nodesSize      = 0;
+
+    int*                 variableIds    = nullptr;
+
+    void*                mapping        = nullptr;
+    size_t               mappingSize    = 0;
+};
+
+//! Node of a view, children are offsets in the node array or BIN_NO_CHILD,
+//! end is the offset right after the node's own bytes (the next node in
+//! preorder).
+struct BinNode
+{
+    NodeType   type  = TYPE_INVALID;
+    ETNodeData data  = {};
+    size_t     left  = 0;
+    size_t     right = 0;
+    size_t     end   = 0;
+};
+
+static const size_t BIN_NO_CHILD = (size_t) -1;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool    saveExprBin    (const ETNode* root, const char* filename);
+bool    openExprBin    (ExprBinView* view, const char* filename);
+void    closeExprBin   (ExprBinView* view);
+
+bool    readBinNode    (const ExprBinView* view, size_t offset, BinNode* node);
+bool    evaluateBin    (const ExprBinView* view, const double* varValues, double* value);
+ETNode* rebuildTree    (const ExprBinView* view);
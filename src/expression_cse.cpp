@@ -0,0 +1,347 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expression_cse.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t CSE_NO_CLASS = (size_t) -1;
+
+//! Class of structurally equal subtrees, node is the first one met.
+struct CSEClass
+{
+    const ETNode* node;
+    uint64_t      hash;
+    size_t        left;
+    size_t        right;
+    size_t        refs;
+    size_t        size;
+    int           name;
+};
+
+//! Hash-consing table, slots hold class index + 1 (0 is an empty slot).
+struct CSETable
+{
+    CSEClass* classes;
+    size_t    count;
+    size_t    capacity;
+
+    size_t*   slots;
+    size_t    slotsCount;
+};
+
+bool    constructTable  (CSETable* table, size_t capacity);
+void    destroyTable    (CSETable* table);
+bool    sameNodeData    (const ETNode* node1, const ETNode* node2);
+size_t  internSubtree   (CSETable* table, const ETNode* node);
+size_t  chooseBindings  (CSETable* table, size_t minSize, bool* usedNames);
+ETNode* buildLetTree    (const CSETable* table, size_t id, bool isDefinition);
+
+bool constructTable(CSETable* table, size_t capacity)
+{
+    assert(table != nullptr);
+
+    size_t slotsCount = 16;
+    while (slotsCount < 2 * capacity) { slotsCount *= 2; }
+
+    table->classes    = (CSEClass*) calloc(capacity, sizeof(CSEClass));
+    table->count      = 0;
+    table->capacity   = capacity;
+    table->slots      = (size_t*) calloc(slotsCount, sizeof(size_t));
+    table->slotsCount = slotsCount;
+
+    return table->classes != nullptr && table->slots != nullptr;
+}
+
+void destroyTable(CSETable* table)
+{
+    assert(table != nullptr);
+
+    free(table->classes);
+    free(table->slots);
+
+    table->classes = nullptr;
+    table->slots   = nullptr;
+}
+
+bool sameNodeData(const ETNode* node1, const ETNode* node2)
+{
+    assert(node1 != nullptr);
+    assert(node2 != nullptr);
+
+    if (node1->type != node2->type) { return false; }
+
+    if (node1->type == TYPE_NUMBER)
+    {
+        return memcmp(&node1->data.number, &node2->data.number, sizeof(double)) == 0 ||
+               (node1->data.number == 0 && node2->data.number == 0);
+    }
+
+    return equalData(node1->type, node1->data, node2->data);
+}
+
+//-----------------------------------------------------------------------------
+//! Finds (or creates) the class of the subtree. As children are interned
+//! first, two subtrees are equal iff their root data and children classes
+//! are, so the comparison doesn't have to walk the subtrees. Every new class
+//! adds a reference to the classes of its children, so in the end refs is
+//! exactly the number of places a class is used in the let-bound form.
+//!
+//! @return class index or CSE_NO_CLASS for an empty subtree.
+//-----------------------------------------------------------------------------
+size_t internSubtree(CSETable* table, const ETNode* node)
+{
+    assert(table != nullptr);
+
+    if (node == nullptr) { return CSE_NO_CLASS; }
+
+    size_t left  = internSubtree(table, node->left);
+    size_t right = internSubtree(table, node->right);
+
+    uint64_t hash = hashNode(node, left  == CSE_NO_CLASS ? 0 : table->classes[left].hash,
+                                   right == CSE_NO_CLASS ? 0 : table->classes[right].hash);
+
+    size_t mask = table->slotsCount - 1;
+    size_t slot = hash & mask;
+
+    for (; table->slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        size_t    id  = table->slots[slot] - 1;
+        CSEClass* cls = &table->classes[id];
+
+        if (cls->hash == hash && cls->left == left && cls->right == right && sameNodeData(cls->node, node))
+        {
+            return id;
+        }
+    }
+
+    assert(table->count < table->capacity);
+
+    size_t    id  = table->count++;
+    CSEClass* cls = &table->classes[id];
+
+    cls->node  = node;
+    cls->hash  = hash;
+    cls->left  = left;
+    cls->right = right;
+    cls->refs  = 0;
+    cls->size  = 1;
+    cls->name  = 0;
+
+    if (left  != CSE_NO_CLASS) { table->classes[left].refs++;  cls->size += table->classes[left].size;  }
+    if (right != CSE_NO_CLASS) { table->classes[right].refs++; cls->size += table->classes[right].size; }
+
+    table->slots[slot] = id + 1;
+
+    return id;
+}
+
+struct CSECandidate
+{
+    size_t id;
+    size_t savings;
+};
+
+int compareCandidates(const void* candidate1, const void* candidate2)
+{
+    size_t savings1 = ((const CSECandidate*) candidate1)->savings;
+    size_t savings2 = ((const CSECandidate*) candidate2)->savings;
+
+    return (savings1 < savings2) - (savings1 > savings2);
+}
+
+//-----------------------------------------------------------------------------
+//! Picks the classes that become temporaries: operations used more than once
+//! with at least minSize nodes. If there are more of them than free names, the
+//! ones saving the most nodes win. Names are given in class order, which is
+//! the post-order of first occurrences, so every temporary only refers to the
+//! ones named before it.
+//!
+//! @return number of chosen temporaries.
+//-----------------------------------------------------------------------------
+size_t chooseBindings(CSETable* table, size_t minSize, bool* usedNames)
+{
+    assert(table     != nullptr);
+    assert(usedNames != nullptr);
+
+    CSECandidate* candidates = (CSECandidate*) calloc(table->count, sizeof(CSECandidate));
+    CHECK_NULL(candidates, return 0);
+
+    size_t candidatesCount = 0;
+    for (size_t id = 0; id < table->count; id++)
+    {
+        CSEClass* cls = &table->classes[id];
+
+        if (cls->refs >= 2 && cls->size >= minSize && cls->node->type == TYPE_OP)
+        {
+            candidates[candidatesCount++] = { id, (cls->refs - 1) * (cls->size - 1) };
+        }
+    }
+
+    size_t freeNames = 0;
+    for (size_t i = 0; i < CSE_MAX_BINDINGS; i++)
+    {
+        if (!usedNames[i]) { freeNames++; }
+    }
+
+    if (candidatesCount > freeNames)
+    {
+        qsort(candidates, candidatesCount, sizeof(CSECandidate), compareCandidates);
+        candidatesCount = freeNames;
+    }
+
+    for (size_t i = 0; i < candidatesCount; i++)
+    {
+        table->classes[candidates[i].id].name = 1;
+    }
+
+    free(candidates);
+
+    size_t nameIndex = 0;
+    for (size_t id = 0; id < table->count; id++)
+    {
+        if (table->classes[id].name == 0) { continue; }
+
+        while (usedNames[nameIndex]) { nameIndex++; }
+
+        table->classes[id].name = CSE_FIRST_NAME + (int) nameIndex;
+        usedNames[nameIndex]    = true;
+    }
+
+    return candidatesCount;
+}
+
+ETNode* buildLetTree(const CSETable* table, size_t id, bool isDefinition)
+{
+    assert(table != nullptr);
+
+    if (id == CSE_NO_CLASS) { return nullptr; }
+
+    const CSEClass* cls = &table->classes[id];
+
+    if (cls->name != 0 && !isDefinition)
+    {
+        return newNode(TYPE_VAR, { .var = cls->name }, nullptr, nullptr);
+    }
+
+    return newNode(cls->node->type, cls->node->data, buildLetTree(table, cls->left,  false),
+                                                      buildLetTree(table, cls->right, false));
+}
+
+//-----------------------------------------------------------------------------
+//! Finds repeated subtrees by their structural hash and binds each of them to
+//! a named temporary. The source tree isn't changed, the let-bound form is
+//! built from new nodes.
+//!
+//! @param [out] letExpr
+//! @param [in]  root
+//! @param [in]  minSize  smallest subtree (in nodes) worth a temporary
+//!
+//! @return false if there wasn't enough memory.
+//-----------------------------------------------------------------------------
+bool eliminateCommonSubexprs(LetExpr* letExpr, const ETNode* root, size_t minSize)
+{
+    assert(letExpr != nullptr);
+    assert(root    != nullptr);
+
+    size_t size = 0;
+    treeSize(root, &size);
+
+    CSETable table = {};
+    if (!constructTable(&table, size))
+    {
+        destroyTable(&table);
+        return false;
+    }
+
+    size_t rootId = internSubtree(&table, root);
+    table.classes[rootId].refs++;
+
+    bool usedNames[CSE_MAX_BINDINGS] = {};
+    for (size_t id = 0; id < table.count; id++)
+    {
+        const ETNode* node = table.classes[id].node;
+        if (node->type == TYPE_VAR && node->data.var >= CSE_FIRST_NAME && node->data.var < CSE_FIRST_NAME + (int) CSE_MAX_BINDINGS)
+        {
+            usedNames[node->data.var - CSE_FIRST_NAME] = true;
+        }
+    }
+
+    size_t bindingsCount = chooseBindings(&table, minSize, usedNames);
+
+    letExpr->bindings      = (LetBinding*) calloc(bindingsCount + 1, sizeof(LetBinding));
+    letExpr->bindingsCount = 0;
+
+    if (letExpr->bindings == nullptr)
+    {
+        destroyTable(&table);
+        return false;
+    }
+
+    for (size_t id = 0; id < table.count; id++)
+    {
+        const CSEClass* cls = &table.classes[id];
+        if (cls->name == 0) { continue; }
+
+        letExpr->bindings[letExpr->bindingsCount++] = { cls->name, buildLetTree(&table, id, true), cls->refs };
+    }
+
+    letExpr->result = buildLetTree(&table, rootId, true);
+
+    destroyTable(&table);
+
+    return true;
+}
+
+void destroy(LetExpr* letExpr)
+{
+    assert(letExpr != nullptr);
+
+    for (size_t i = 0; i < letExpr->bindingsCount; i++)
+    {
+        destroySubtree(letExpr->bindings[i].value);
+    }
+
+    free(letExpr->bindings);
+    destroySubtree(letExpr->result);
+
+    letExpr->bindings      = nullptr;
+    letExpr->bindingsCount = 0;
+    letExpr->result        = nullptr;
+}
+
+//-----------------------------------------------------------------------------
+//! Evaluates every temporary once, in order, storing it into its variable
+//! slot, then evaluates the result. The slots get their old values back, so
+//! the next expression evaluated with the same values doesn't see them.
+//!
+//! @param [in]     letExpr
+//! @param [in,out] varValues  variablesCount() values indexed by variable
+//!
+//! @return value of the expression.
+//-----------------------------------------------------------------------------
+double evaluateLetExpr(const LetExpr* letExpr, double* varValues)
+{
+    assert(letExpr   != nullptr);
+    assert(varValues != nullptr);
+    assert(letExpr->bindingsCount <= CSE_MAX_BINDINGS);
+
+    double saved[CSE_MAX_BINDINGS] = {};
+
+    for (size_t i = 0; i < letExpr->bindingsCount; i++)
+    {
+        const LetBinding* binding = &letExpr->bindings[i];
+
+        saved[i]                 = varValues[binding->name];
+        varValues[binding->name] = evaluateSubtree(binding->value, varValues);
+    }
+
+    double value = evaluateSubtree(letExpr->result, varValues);
+
+    for (size_t i = 0; i < letExpr->bindingsCount; i++)
+    {
+        varValues[letExpr->bindings[i].name] = saved[i];
+    }
+
+    return value;
+}
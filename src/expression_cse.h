@@ -0,0 +1,40 @@
+#pragma once
+
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup CSE Common subexpression elimination
+//! @addtogroup CSE
+//! @{
+
+//! Named temporary, its value may refer to the temporaries bound before it.
+struct LetBinding
+{
+    int     name  = 0;
+    ETNode* value = nullptr;
+    size_t  uses  = 0;
+};
+
+//! Let-bound form of an expression: temporaries in evaluation order followed
+//! by the result, all of them refer to temporaries as variables.
+struct LetExpr
+{
+    LetBinding* bindings      = nullptr;
+    size_t      bindingsCount = 0;
+    ETNode*     result        = nullptr;
+};
+
+//! Temporaries are named with the capital letters not used in the expression.
+static const char   CSE_FIRST_NAME   = 'A';
+static const size_t CSE_MAX_BINDINGS = 26;
+
+//! Smallest subtree bound to a temporary for evaluation, a smaller one costs
+//! about as much to evaluate again as to look up.
+static const size_t CSE_EVALUATE_MIN_SIZE = 3;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool   eliminateCommonSubexprs (LetExpr* letExpr, const ETNode* root, size_t minSize);
+void   destroy                 (LetExpr* letExpr);
+double evaluateLetExpr         (const LetExpr* letExpr, double* varValues);
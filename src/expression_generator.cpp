@@ -0,0 +1,422 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expression_generator.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+//! The nodes still to generate and the text to write between them, in
+//! reverse order. A frame is a literal if text isn't nullptr.
+struct GeneratorFrame
+{
+    const char* text;
+    ETNode**    slot;       //!< where the node goes in a tree
+    ETNode*     parent;
+    size_t      nodesCount; //!< of the subtree
+    size_t      depth;
+};
+
+struct Generator
+{
+    const GeneratorConfig* config;
+    uint64_t               state;
+
+    double                 weightsSum;
+    double                 unaryWeightsSum;
+    size_t                 variablesCount;
+
+    GeneratorFrame*        stack;
+    size_t                 stackSize;
+    size_t                 stackCapacity;
+};
+
+//! Operands have no nodes for a leaf, the only one of a unary operation is
+//! the right one.
+struct GeneratedNode
+{
+    NodeType   type;
+    ETNodeData data;
+    size_t     leftCount;
+    size_t     rightCount;
+};
+
+Generator* construct     (Generator* generator, const GeneratorConfig* config);
+void       destroy       (Generator* generator);
+
+bool       pushFrame     (Generator* generator, const GeneratorFrame* frame);
+bool       pushNode      (Generator* generator, ETNode** slot, ETNode* parent, size_t nodesCount, size_t depth);
+bool       pushText      (Generator* generator, const char* text);
+void       pickNode      (Generator* generator, size_t nodesCount, size_t depth, GeneratedNode* node);
+Operation  pickOperation (Generator* generator, bool isUnaryOnly);
+void       pickLeaf      (Generator* generator, GeneratedNode* node);
+
+uint64_t   nextRandom    (Generator* generator);
+double     nextUniform   (Generator* generator);
+
+GeneratorShape getGeneratorShape(const char* name)
+{
+    assert(name != nullptr);
+
+    for (int i = 0; i < GENERATOR_SHAPES_COUNT; i++)
+    {
+        if (strcmp(name, GENERATOR_SHAPES[i]) == 0) { return (GeneratorShape) i; }
+    }
+
+    return GENERATOR_SHAPE_INVALID;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether the shape is known, the weights and the density aren't
+//! negative (nor NaN), the density is at most 1, and there are variables,
+//! all of them valid, if the density isn't 0.
+//-----------------------------------------------------------------------------
+bool isGeneratorConfigValid(const GeneratorConfig* config)
+{
+    assert(config != nullptr);
+
+    if (config->shape <= GENERATOR_SHAPE_INVALID || config->shape >= GENERATOR_SHAPES_COUNT) { return false; }
+
+    for (int i = 0; i < OPERATIONS_COUNT; i++)
+    {
+        if (!(config->opWeights[i] >= 0)) { return false; }
+    }
+
+    if (!(config->variableDensity >= 0 && config->variableDensity <= 1)) { return false; }
+    if (config->variableDensity == 0) { return true; }
+
+    if (config->variables == nullptr || config->variables[0] == '\0') { return false; }
+
+    for (const char* variable = config->variables; *variable != '\0'; variable++)
+    {
+        if (!isVariable(*variable)) { return false; }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in] config valid config
+//!
+//! @return new tree or nullptr if there's no memory.
+//-----------------------------------------------------------------------------
+ETNode* generateExpression(const GeneratorConfig* config)
+{
+    assert(config != nullptr);
+    assert(isGeneratorConfigValid(config));
+
+    if (config->nodesCount == 0) { return nullptr; }
+
+    Generator generator = {};
+    CHECK_NULL(construct(&generator, config), return nullptr);
+
+    ETNode* root = nullptr;
+    bool    isOk = pushNode(&generator, &root, nullptr, config->nodesCount, 0);
+
+    while (isOk && generator.stackSize > 0)
+    {
+        GeneratorFrame frame = generator.stack[--generator.stackSize];
+        GeneratedNode  node  = {};
+
+        pickNode(&generator, frame.nodesCount, frame.depth, &node);
+
+        ETNode* newTreeNode = newNode(node.type, node.data, nullptr, nullptr);
+        if (newTreeNode == nullptr) { isOk = false; break; }
+
+        newTreeNode->parent = frame.parent;
+        *frame.slot         = newTreeNode;
+
+        if (node.rightCount > 0)
+        {
+            isOk = pushNode(&generator, &newTreeNode->right, newTreeNode, node.rightCount, frame.depth + 1);
+        }
+
+        if (isOk && node.leftCount > 0)
+        {
+            isOk = pushNode(&generator, &newTreeNode->left, newTreeNode, node.leftCount, frame.depth + 1);
+        }
+    }
+
+    destroy(&generator);
+
+    if (!isOk)
+    {
+        destroySubtree(root);
+        return nullptr;
+    }
+
+    return root;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the expression generateExpression() would make, without a '\n'.
+//! The operands of binary operations are in brackets.
+//!
+//! @param [out] file
+//! @param [in]  config valid config
+//!
+//! @return false if there's no memory or the file fails.
+//-----------------------------------------------------------------------------
+bool writeRandomExpression(FILE* file, const GeneratorConfig* config)
+{
+    assert(file   != nullptr);
+    assert(config != nullptr);
+    assert(isGeneratorConfigValid(config));
+
+    if (config->nodesCount == 0) { return true; }
+
+    Generator generator = {};
+    CHECK_NULL(construct(&generator, config), return false);
+
+    bool isOk = pushNode(&generator, nullptr, nullptr, config->nodesCount, 0);
+
+    while (isOk && generator.stackSize > 0)
+    {
+        GeneratorFrame frame = generator.stack[--generator.stackSize];
+
+        if (frame.text != nullptr)
+        {
+            fputs(frame.text, file);
+            continue;
+        }
+
+        GeneratedNode node = {};
+        pickNode(&generator, frame.nodesCount, frame.depth, &node);
+
+        if (node.type == TYPE_NUMBER)
+        {
+            fprintf(file, "%d", (int) node.data.number);
+        }
+        else if (node.type == TYPE_VAR)
+        {
+            fputc(node.data.var, file);
+        }
+        else if (node.leftCount == 0)
+        {
+            // op(right)
+            fprintf(file, "%s(", OPERATIONS[node.data.op]);
+
+            isOk = pushText(&generator, ")") &&
+                   pushNode(&generator, nullptr, nullptr, node.rightCount, frame.depth + 1);
+        }
+        else
+        {
+            // (left) op (right)
+            fputc('(', file);
+
+            isOk = pushText(&generator, ")") &&
+                   pushNode(&generator, nullptr, nullptr, node.rightCount, frame.depth + 1) &&
+                   pushText(&generator, " (") &&
+                   pushText(&generator, OPERATIONS[node.data.op]) &&
+                   pushText(&generator, ") ") &&
+                   pushNode(&generator, nullptr, nullptr, node.leftCount, frame.depth + 1);
+        }
+    }
+
+    destroy(&generator);
+
+    return isOk && !ferror(file);
+}
+
+Generator* construct(Generator* generator, const GeneratorConfig* config)
+{
+    assert(generator != nullptr);
+    assert(config    != nullptr);
+
+    generator->config = config;
+    generator->state  = config->seed;
+
+    generator->weightsSum      = 0;
+    generator->unaryWeightsSum = 0;
+
+    for (int i = 0; i < OPERATIONS_COUNT; i++)
+    {
+        generator->weightsSum += config->opWeights[i];
+
+        if (isOperationUnary((Operation) i)) { generator->unaryWeightsSum += config->opWeights[i]; }
+    }
+
+    generator->variablesCount = config->variableDensity == 0 ? 0 : strlen(config->variables);
+
+    generator->stack = (GeneratorFrame*) calloc(GENERATOR_STACK_INIT_SIZE, sizeof(GeneratorFrame));
+    CHECK_NULL(generator->stack, return nullptr);
+
+    generator->stackSize     = 0;
+    generator->stackCapacity = GENERATOR_STACK_INIT_SIZE;
+
+    return generator;
+}
+
+void destroy(Generator* generator)
+{
+    assert(generator != nullptr);
+
+    free(generator->stack);
+
+    generator->stack         = nullptr;
+    generator->stackSize     = 0;
+    generator->stackCapacity = 0;
+}
+
+bool pushFrame(Generator* generator, const GeneratorFrame* frame)
+{
+    assert(generator != nullptr);
+    assert(frame     != nullptr);
+
+    if (generator->stackSize == generator->stackCapacity)
+    {
+        GeneratorFrame* newStack = (GeneratorFrame*) realloc(generator->stack,
+                                                             2 * generator->stackCapacity * sizeof(GeneratorFrame));
+        CHECK_NULL(newStack, return false);
+
+        generator->stack          = newStack;
+        generator->stackCapacity *= 2;
+    }
+
+    generator->stack[generator->stackSize++] = *frame;
+
+    return true;
+}
+
+bool pushNode(Generator* generator, ETNode** slot, ETNode* parent, size_t nodesCount, size_t depth)
+{
+    GeneratorFrame frame = { nullptr, slot, parent, nodesCount, depth };
+
+    return pushFrame(generator, &frame);
+}
+
+bool pushText(Generator* generator, const char* text)
+{
+    assert(text != nullptr);
+
+    GeneratorFrame frame = { text, nullptr, nullptr, 0, 0 };
+
+    return pushFrame(generator, &frame);
+}
+
+//-----------------------------------------------------------------------------
+//! Picks the node and splits the rest of the nodes between its operands.
+//-----------------------------------------------------------------------------
+void pickNode(Generator* generator, size_t nodesCount, size_t depth, GeneratedNode* node)
+{
+    assert(generator  != nullptr);
+    assert(node       != nullptr);
+    assert(nodesCount > 0);
+
+    size_t    maxDepth  = generator->config->maxDepth;
+    Operation operation = OP_INVALID;
+
+    if (nodesCount > 1 && (maxDepth == 0 || depth + 1 < maxDepth))
+    {
+        operation = pickOperation(generator, nodesCount == 2);
+    }
+
+    if (operation == OP_INVALID)
+    {
+        pickLeaf(generator, node);
+        return;
+    }
+
+    node->type    = TYPE_OP;
+    node->data.op = operation;
+
+    if (isOperationUnary(operation))
+    {
+        node->leftCount  = 0;
+        node->rightCount = nodesCount - 1;
+        return;
+    }
+
+    size_t operandsCount = nodesCount - 1;
+
+    switch (generator->config->shape)
+    {
+        case GENERATOR_BALANCED:
+            node->leftCount = operandsCount / 2;
+            break;
+
+        case GENERATOR_LEFT_DEEP:
+            node->leftCount = operandsCount - 1;
+            break;
+
+        case GENERATOR_RANDOM:
+            node->leftCount = 1 + nextRandom(generator) % (operandsCount - 1);
+            break;
+
+        case GENERATOR_SHAPE_INVALID:
+        case GENERATOR_SHAPES_COUNT:
+        default:
+            assert(!"Invalid shape");
+            break;
+    }
+
+    node->rightCount = operandsCount - node->leftCount;
+}
+
+//-----------------------------------------------------------------------------
+//! @return operation picked by the weights or OP_INVALID if they are all 0.
+//-----------------------------------------------------------------------------
+Operation pickOperation(Generator* generator, bool isUnaryOnly)
+{
+    assert(generator != nullptr);
+
+    const double* weights = generator->config->opWeights;
+    double        sum     = isUnaryOnly ? generator->unaryWeightsSum : generator->weightsSum;
+
+    if (sum <= 0) { return OP_INVALID; }
+
+    double    value     = nextUniform(generator) * sum;
+    Operation operation = OP_INVALID;
+
+    for (int i = isUnaryOnly ? UNARY_OPERATIONS_START : 0; i < OPERATIONS_COUNT; i++)
+    {
+        if (weights[i] == 0) { continue; }
+
+        // the last one takes what rounding leaves
+        operation = (Operation) i;
+        if (value < weights[i]) { break; }
+
+        value -= weights[i];
+    }
+
+    return operation;
+}
+
+void pickLeaf(Generator* generator, GeneratedNode* node)
+{
+    assert(generator != nullptr);
+    assert(node      != nullptr);
+
+    node->leftCount  = 0;
+    node->rightCount = 0;
+
+    if (nextUniform(generator) < generator->config->variableDensity)
+    {
+        node->type     = TYPE_VAR;
+        node->data.var = generator->config->variables[nextRandom(generator) % generator->variablesCount];
+        return;
+    }
+
+    node->type        = TYPE_NUMBER;
+    node->data.number = (double) (1 + nextRandom(generator) % GENERATOR_MAX_NUMBER);
+}
+
+//-----------------------------------------------------------------------------
+//! splitmix64, so the nearby seeds give unrelated expressions.
+//-----------------------------------------------------------------------------
+uint64_t nextRandom(Generator* generator)
+{
+    assert(generator != nullptr);
+
+    uint64_t value = (generator->state += 0x9E3779B97F4A7C15);
+
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+
+    return value ^ (value >> 31);
+}
+
+//! @return value in [0, 1).
+double nextUniform(Generator* generator)
+{
+    return (double) (nextRandom(generator) >> 11) * 0x1.0p-53;
+}
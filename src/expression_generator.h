@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup EXPRESSION_GENERATOR Random expressions
+//!
+//! Generates a random expression of exactly nodesCount nodes, as a tree or
+//! as text that parseExpression() reads back into the same tree. The same
+//! config, seed included, gives the same expression both ways.
+//!
+//! Nodes are made top down. A node with room for two children is an
+//! operation picked by opWeights, with one it's a unary operation, and the
+//! rest are leaves: a variable from variables with the probability
+//! variableDensity, an integer from 1 to GENERATOR_MAX_NUMBER otherwise. The
+//! shape decides how the nodes of a binary operation are split between its
+//! operands:
+//!
+//!     balanced   evenly
+//!     left-deep  the right operand is a leaf, so the depth is about the
+//!                number of nodes
+//!     random     uniformly
+//!
+//! The expression has at most maxDepth levels, the nodes of the last one are
+//! leaves whatever room they have, so it may have fewer nodes then. So may
+//! it without unary operations in the mix, where a node has room for only
+//! one child.
+//!
+//! Nothing is recursive, the expressions of any depth are generated. Most of
+//! the tree functions are recursive though, so deep trees are better made in
+//! a NodeArena (see setNodeArena()) and dropped with it than destroyed.
+//!
+//! @addtogroup EXPRESSION_GENERATOR
+//! @{
+
+enum GeneratorShape
+{
+    GENERATOR_SHAPE_INVALID = -1,
+
+    GENERATOR_BALANCED,
+    GENERATOR_LEFT_DEEP,
+    GENERATOR_RANDOM,
+
+    GENERATOR_SHAPES_COUNT
+};
+
+static const char* GENERATOR_SHAPES[GENERATOR_SHAPES_COUNT] = { "balanced", "left-deep", "random" };
+
+static const int    GENERATOR_MAX_NUMBER      = 9;
+static const size_t GENERATOR_STACK_INIT_SIZE = 64;
+
+struct GeneratorConfig
+{
+    uint64_t       seed            = 0;
+    size_t         nodesCount      = 100;
+    size_t         maxDepth        = 0;                 //!< 0 for no limit
+    GeneratorShape shape           = GENERATOR_RANDOM;
+    double         opWeights[OPERATIONS_COUNT] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+    double         variableDensity = 0.5;
+    const char*    variables       = "x";               //!< one letter each
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+GeneratorShape getGeneratorShape     (const char* name);
+bool           isGeneratorConfigValid(const GeneratorConfig* config);
+
+ETNode*        generateExpression    (const GeneratorConfig* config);
+bool           writeRandomExpression (FILE* file, const GeneratorConfig* config);
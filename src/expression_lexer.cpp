@@ -0,0 +1,484 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+#include "expression_lexer.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+enum CharClass : unsigned char
+{
+    CHAR_INVALID,
+
+    CHAR_SPACE,
+    CHAR_DIGIT,
+    CHAR_DOT,
+    CHAR_ALPHA,
+    CHAR_OPERATION,
+    CHAR_OPEN_BRACKET,
+    CHAR_CLOSE_BRACKET,
+    CHAR_NEWLINE
+};
+
+struct CharTable
+{
+    CharClass classes[256];
+    Operation operations[256];
+};
+
+constexpr CharTable makeCharTable()
+{
+    CharTable table = {};
+
+    for (int symbol = 0; symbol < 256; symbol++) { table.operations[symbol] = OP_INVALID; }
+
+    for (int symbol = '0'; symbol <= '9'; symbol++) { table.classes[symbol] = CHAR_DIGIT; }
+    for (int symbol = 'a'; symbol <= 'z'; symbol++) { table.classes[symbol] = CHAR_ALPHA; }
+    for (int symbol = 'A'; symbol <= 'Z'; symbol++) { table.classes[symbol] = CHAR_ALPHA; }
+
+    table.classes[' ']  = CHAR_SPACE;
+    table.classes['\t'] = CHAR_SPACE;
+    table.classes['.']  = CHAR_DOT;
+    table.classes['(']  = CHAR_OPEN_BRACKET;
+    table.classes[')']  = CHAR_CLOSE_BRACKET;
+    table.classes['\n'] = CHAR_NEWLINE;
+    table.classes['\r'] = CHAR_NEWLINE;
+
+    const char      symbols[]    = { '+',    '-',    '*',    '/',    '^'    };
+    const Operation operations[] = { OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_POW };
+
+    for (size_t i = 0; i < sizeof(symbols); i++)
+    {
+        table.classes[(unsigned char) symbols[i]]    = CHAR_OPERATION;
+        table.operations[(unsigned char) symbols[i]] = operations[i];
+    }
+
+    return table;
+}
+
+static constexpr CharTable CHAR_TABLE = makeCharTable();
+
+//-----------------------------------------------------------------------------
+//! Names of the unary operations, the constants and inf. The hash of the first
+//! char, the last char and the length has no collisions on them, so a name is
+//! looked up with a single comparison.
+//-----------------------------------------------------------------------------
+struct Keyword
+{
+    const char* name;
+    size_t      length;
+    TokenType   type;
+    ETNodeData  data;
+};
+
+struct KeywordTable
+{
+    Keyword keywords[32];
+    size_t  maxLength;
+};
+
+static const size_t   KEYWORD_HASH_MASK = 31;
+static const size_t   NUMBER_MAX_LENGTH = 64;
+
+//! No token depends on more characters after it than this.
+static const size_t   LEXER_LOOKAHEAD   = 8;
+
+KeywordTable makeKeywordTable ();
+size_t       keywordHash      (const char* name, size_t length);
+void         addKeyword       (KeywordTable* table, const char* name, size_t length, TokenType type, ETNodeData data);
+bool         findKeyword      (const char* name, size_t length, Token* token);
+bool         refill           (Lexer* lexer);
+Token        scanToken        (Lexer* lexer);
+bool         scanNumber       (Lexer* lexer, Token* token);
+void         scanName         (Lexer* lexer, Token* token);
+
+static const KeywordTable KEYWORD_TABLE = makeKeywordTable();
+
+size_t keywordHash(const char* name, size_t length)
+{
+    assert(name   != nullptr);
+    assert(length != 0);
+
+    return ((unsigned char) name[0] + 2 * (unsigned char) name[length - 1] + length) & KEYWORD_HASH_MASK;
+}
+
+void addKeyword(KeywordTable* table, const char* name, size_t length, TokenType type, ETNodeData data)
+{
+    assert(table != nullptr);
+    assert(name  != nullptr);
+
+    Keyword* keyword = &table->keywords[keywordHash(name, length)];
+
+    // a new keyword needs a new hash if this fails
+    assert(keyword->name == nullptr);
+
+    *keyword = { name, length, type, data };
+
+    if (length > table->maxLength) { table->maxLength = length; }
+}
+
+KeywordTable makeKeywordTable()
+{
+    KeywordTable table = {};
+
+    for (int op = UNARY_OPERATIONS_START; op < OPERATIONS_COUNT; op++)
+    {
+        addKeyword(&table, OPERATIONS[op], strlen(OPERATIONS[op]), TOKEN_OPERATION, { .op = (Operation) op });
+    }
+
+    for (size_t i = 0; i < CONSTANTS_COUNT; i++)
+    {
+        addKeyword(&table, CONSTANTS[i].name, CONSTANTS[i].nameLength, TOKEN_NUMBER, { .number = CONSTANTS[i].value });
+    }
+
+    addKeyword(&table, INFINITY_NAME, INFINITY_NAME_LENGTH, TOKEN_NUMBER, { .number = INFINITY });
+
+    return table;
+}
+
+bool findKeyword(const char* name, size_t length, Token* token)
+{
+    assert(name  != nullptr);
+    assert(token != nullptr);
+
+    const Keyword* keyword = &KEYWORD_TABLE.keywords[keywordHash(name, length)];
+
+    if (keyword->length != length || memcmp(keyword->name, name, length) != 0) { return false; }
+
+    token->type   = keyword->type;
+    token->data   = keyword->data;
+    token->length = length;
+
+    return true;
+}
+
+Lexer* construct(Lexer* lexer, const char* text, size_t length)
+{
+    CHECK_NULL(lexer, return nullptr);
+    assert(text != nullptr);
+
+    lexer->text              = text;
+    lexer->length            = length;
+    lexer->ofs               = 0;
+    lexer->isOperandExpected = true;
+    lexer->stream            = nullptr;
+    lexer->buffer            = nullptr;
+    lexer->capacity          = 0;
+    lexer->streamOffset      = 0;
+
+    return lexer;
+}
+
+//-----------------------------------------------------------------------------
+//! Makes the lexer read the text from the stream through a buffer of
+//! bufferSize bytes. The buffer only grows if a single token doesn't fit in
+//! it. The stream is read up to the end of the first line.
+//!
+//! @return lexer or nullptr if there isn't enough memory.
+//-----------------------------------------------------------------------------
+Lexer* construct(Lexer* lexer, FILE* stream, size_t bufferSize)
+{
+    CHECK_NULL(lexer, return nullptr);
+    assert(stream     != nullptr);
+    assert(bufferSize != 0);
+
+    char* buffer = (char*) calloc(bufferSize, sizeof(char));
+    CHECK_NULL(buffer, return nullptr);
+
+    construct(lexer, buffer, 0);
+
+    lexer->stream       = stream;
+    lexer->buffer       = buffer;
+    lexer->capacity     = bufferSize;
+    lexer->streamOffset = 0;
+
+    return lexer;
+}
+
+void destroy(Lexer* lexer)
+{
+    assert(lexer != nullptr);
+
+    free(lexer->buffer);
+
+    *lexer = {};
+}
+
+//-----------------------------------------------------------------------------
+//! Drops the text before the current position and reads more of the stream
+//! into the freed space. The buffer is doubled if there's nothing to drop.
+//!
+//! @return false if nothing has been read.
+//-----------------------------------------------------------------------------
+bool refill(Lexer* lexer)
+{
+    assert(lexer != nullptr);
+
+    if (lexer->stream == nullptr || feof(lexer->stream) || ferror(lexer->stream)) { return false; }
+
+    size_t kept = lexer->length - lexer->ofs;
+
+    memmove(lexer->buffer, lexer->buffer + lexer->ofs, kept);
+
+    lexer->streamOffset += lexer->ofs;
+    lexer->ofs           = 0;
+    lexer->length        = kept;
+
+    if (kept == lexer->capacity)
+    {
+        char* buffer = (char*) realloc(lexer->buffer, 2 * lexer->capacity);
+        CHECK_NULL(buffer, return false);
+
+        lexer->buffer    = buffer;
+        lexer->capacity *= 2;
+    }
+
+    lexer->text = lexer->buffer;
+
+    size_t read = fread(lexer->buffer + kept, sizeof(char), lexer->capacity - kept, lexer->stream);
+    lexer->length += read;
+
+    return read > 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the next token, TOKEN_END is returned again and again after the end
+//! of the text or its first line. Unknown characters and names become
+//! TOKEN_INVALID. Token offsets are counted from the start of the text, even
+//! if it's read from a stream.
+//-----------------------------------------------------------------------------
+Token nextToken(Lexer* lexer)
+{
+    assert(lexer       != nullptr);
+    assert(lexer->text != nullptr);
+
+    while (true)
+    {
+        while (lexer->ofs < lexer->length && CHAR_TABLE.classes[(unsigned char) lexer->text[lexer->ofs]] == CHAR_SPACE)
+        {
+            lexer->ofs++;
+        }
+
+        if (lexer->ofs < lexer->length || !refill(lexer)) { break; }
+    }
+
+    Token token = scanToken(lexer);
+
+    // a token close to the end of the buffer may go on in the stream (e.g. '1'
+    // of '1e-2'), so it's scanned again once more of the stream has been read
+    while (lexer->ofs + token.length + LEXER_LOOKAHEAD > lexer->length && refill(lexer))
+    {
+        token = scanToken(lexer);
+    }
+
+    // names are interned only now, a rescanned name may have grown
+    if (token.type == TOKEN_VARIABLE && token.data.var == VARIABLE_INVALID_ID)
+    {
+        token.data.var = internVariable(lexer->text + lexer->ofs, token.length);
+
+        if (token.data.var == VARIABLE_INVALID_ID) { token.type = TOKEN_INVALID; }
+    }
+
+    token.ofs                = lexer->streamOffset + lexer->ofs;
+    lexer->ofs              += token.length;
+    lexer->isOperandExpected = token.type == TOKEN_OPERATION || token.type == TOKEN_OPEN_BRACKET;
+
+    return token;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether the text is exactly one variable name, as the lexer reads
+//!         it in an expression. The name isn't interned.
+//-----------------------------------------------------------------------------
+bool isVariableName(const char* name, size_t length)
+{
+    assert(name != nullptr);
+
+    Lexer lexer = {};
+    construct(&lexer, name, length);
+
+    Token token = scanToken(&lexer);
+
+    return token.type == TOKEN_VARIABLE && token.length == length;
+}
+
+Token scanToken(Lexer* lexer)
+{
+    assert(lexer != nullptr);
+
+    Token token  = {};
+    token.length = 1;
+
+    if (lexer->ofs >= lexer->length)
+    {
+        token.type   = TOKEN_END;
+        token.length = 0;
+
+        return token;
+    }
+
+    unsigned char symbol = (unsigned char) lexer->text[lexer->ofs];
+
+    switch (CHAR_TABLE.classes[symbol])
+    {
+        case CHAR_DIGIT:
+        case CHAR_DOT:
+            scanNumber(lexer, &token);
+            break;
+
+        case CHAR_ALPHA:
+            scanName(lexer, &token);
+            break;
+
+        case CHAR_OPERATION:
+            if (!lexer->isOperandExpected || (symbol != '+' && symbol != '-') || !scanNumber(lexer, &token))
+            {
+                token.type    = TOKEN_OPERATION;
+                token.data.op = CHAR_TABLE.operations[symbol];
+                token.length  = 1;
+            }
+            break;
+
+        case CHAR_OPEN_BRACKET:
+            token.type = TOKEN_OPEN_BRACKET;
+            break;
+
+        case CHAR_CLOSE_BRACKET:
+            token.type = TOKEN_CLOSE_BRACKET;
+            break;
+
+        case CHAR_NEWLINE:
+            token.type   = TOKEN_END;
+            token.length = 0;
+            break;
+
+        case CHAR_INVALID:
+        case CHAR_SPACE:
+        default:
+            token.type = TOKEN_INVALID;
+            break;
+    }
+
+    return token;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads a number, possibly with a sign right before it, in decimal or in
+//! hexadecimal with "0x" (0x10, 0x1.8p3). A signed infinity is read here
+//! too, inf alone is a keyword.
+//!
+//! @return false if there's no number at the current position, the token
+//!         becomes TOKEN_INVALID then.
+//-----------------------------------------------------------------------------
+bool scanNumber(Lexer* lexer, Token* token)
+{
+    assert(lexer != nullptr);
+    assert(token != nullptr);
+
+    const char* start  = lexer->text + lexer->ofs;
+    const char* end    = lexer->text + lexer->length;
+    const char* digits = *start == '+' || *start == '-' ? start + 1 : start;
+
+    // from_chars takes '-' but not '+'
+    const char* first  = *start == '+' ? start + 1 : start;
+
+    token->type = TOKEN_INVALID;
+
+    if (digits != start && (size_t) (end - digits) >= INFINITY_NAME_LENGTH &&
+        strncmp(digits, INFINITY_NAME, INFINITY_NAME_LENGTH) == 0)
+    {
+        token->type        = TOKEN_NUMBER;
+        token->data.number = *start == '-' ? -INFINITY : INFINITY;
+        token->length      = (size_t) (digits - start) + INFINITY_NAME_LENGTH;
+
+        return true;
+    }
+
+    if (digits == end || (CHAR_TABLE.classes[(unsigned char) *digits] != CHAR_DIGIT &&
+                          CHAR_TABLE.classes[(unsigned char) *digits] != CHAR_DOT))
+    {
+        return false;
+    }
+
+    double                 value  = 0;
+    std::from_chars_result result = {};
+
+    // hexadecimal like strtod() reads it, from_chars takes no "0x" and would
+    // take a sign after it
+    bool isHex = end - digits > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') &&
+                 (isxdigit((unsigned char) digits[2]) || digits[2] == '.');
+
+    if (isHex)
+    {
+        result = std::from_chars(digits + 2, end, value, std::chars_format::hex);
+        if (*start == '-') { value = -value; }
+    }
+
+    if (!isHex || result.ec == std::errc::invalid_argument) { result = std::from_chars(first, end, value); }
+
+    if (result.ec == std::errc::invalid_argument) { return false; }
+
+    // from_chars doesn't give the overflowed value, strtod does
+    if (result.ec == std::errc::result_out_of_range)
+    {
+        char   number[NUMBER_MAX_LENGTH] = {};
+        size_t numberLength              = (size_t) (result.ptr - first);
+
+        if (numberLength >= NUMBER_MAX_LENGTH) { numberLength = NUMBER_MAX_LENGTH - 1; }
+
+        memcpy(number, first, numberLength);
+        value = strtod(number, nullptr);
+    }
+
+    token->type        = TOKEN_NUMBER;
+    token->data.number = value;
+    token->length      = (size_t) (result.ptr - start);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Reads a name: a constant, a variable or a unary operation. As before, an
+//! operation may be glued to its argument ('sinx' is 'sin(x)'), so a longer
+//! variable name can't start with the name of an operation. The id of a
+//! longer name is left to nextToken().
+//-----------------------------------------------------------------------------
+void scanName(Lexer* lexer, Token* token)
+{
+    assert(lexer != nullptr);
+    assert(token != nullptr);
+
+    const char* name       = lexer->text + lexer->ofs;
+    size_t      restLength = lexer->length - lexer->ofs;
+    size_t      length     = 1;
+
+    // names longer than any keyword are only scanned to the end if they don't
+    // start with an operation, so long chains like 'sinsinsin...x' stay linear
+    while (length < restLength && length <= KEYWORD_TABLE.maxLength &&
+           CHAR_TABLE.classes[(unsigned char) name[length]] == CHAR_ALPHA) { length++; }
+
+    if (length <= KEYWORD_TABLE.maxLength && findKeyword(name, length, token)) { return; }
+
+    if (length == 1 && isVariable(name[0]))
+    {
+        token->type     = TOKEN_VARIABLE;
+        token->data.var = (unsigned char) name[0];
+        token->length   = 1;
+
+        return;
+    }
+
+    size_t prefixLength = length - 1 < KEYWORD_TABLE.maxLength ? length - 1 : KEYWORD_TABLE.maxLength;
+
+    for (; prefixLength > 0; prefixLength--)
+    {
+        if (findKeyword(name, prefixLength, token) && token->type == TOKEN_OPERATION) { return; }
+    }
+
+    while (length < restLength && CHAR_TABLE.classes[(unsigned char) name[length]] == CHAR_ALPHA) { length++; }
+
+    token->type     = length <= VARIABLE_NAME_MAX_LENGTH ? TOKEN_VARIABLE : TOKEN_INVALID;
+    token->data.var = VARIABLE_INVALID_ID;
+    token->length   = length;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdio.h>
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup EXPRESSION_LEXER Expression tokenizer
+//!
+//! Splits an expression into tokens on demand. Characters are classified with
+//! a lookup table, names of functions and constants are recognized with a
+//! perfect hash and numbers are read with std::from_chars, so the result
+//! doesn't depend on the locale. Hexadecimal numbers (0x10, 0x1.8p3) are
+//! read like strtod() reads them.
+//!
+//! A '+' or '-' right before a number is a part of the number if an operand
+//! is expected there (at the start, after '(' or after an operation), which
+//! gives the same '2*-3' and 'x^-1' the parser has always accepted.
+//!
+//! Variables may have names of up to VARIABLE_NAME_MAX_LENGTH letters, the
+//! names are interned into the symbol table.
+//!
+//! The text is either a buffer or a stream read through a refillable buffer,
+//! tokens may cross refills. A line break ends the text in both cases.
+//!
+//! @addtogroup EXPRESSION_LEXER
+//! @{
+
+enum TokenType
+{
+    TOKEN_INVALID,
+
+    TOKEN_END,
+    TOKEN_NUMBER,
+    TOKEN_VARIABLE,
+    TOKEN_OPERATION,
+    TOKEN_OPEN_BRACKET,
+    TOKEN_CLOSE_BRACKET
+};
+
+//! data is the number, variable or operation of the token.
+struct Token
+{
+    TokenType  type   = TOKEN_INVALID;
+    ETNodeData data   = {};
+
+    size_t     ofs    = 0;
+    size_t     length = 0;
+};
+
+//! For streams text is the buffer and streamOffset is the number of bytes
+//! dropped from its beginning.
+struct Lexer
+{
+    const char* text              = nullptr;
+    size_t      length            = 0;
+    size_t      ofs               = 0;
+    bool        isOperandExpected = true;
+
+    FILE*       stream            = nullptr;
+    char*       buffer            = nullptr;
+    size_t      capacity          = 0;
+    size_t      streamOffset      = 0;
+};
+
+static const size_t LEXER_BUFFER_SIZE = 1 << 16;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+Lexer* construct (Lexer* lexer, const char* text, size_t length);
+Lexer* construct (Lexer* lexer, FILE* stream, size_t bufferSize);
+void   destroy   (Lexer* lexer);
+Token  nextToken (Lexer* lexer);
+
+bool   isVariableName (const char* name, size_t length);
@@ -1,102 +1,100 @@
 #include <assert.h>
-#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "../libs/log_generator.h"
-#include "../libs/file_manager.h"
+#include "async_log.h"
+#include "expression_lexer.h"
 #include "expression_loader.h"
+#include "instrumentation.h"
+#include "string_builder.h"
 
-enum ParseError
+//! Marks an open bracket on the operations stack.
+static const Operation OPEN_BRACKET_MARK     = OP_INVALID;
+static const size_t    PARSE_STACK_INIT_SIZE = 64;
+
+//! Both stacks start in the buffers and move to the heap when they outgrow
+//! them, so the nesting depth is only limited by memory.
+struct ParseStacks
 {
-    PARSE_NO_ERROR,
-    PARSE_UNFINISHED_EXPRESSION,
-    PARSE_UNKNOWN_OPERATION,
-    PARSE_NO_OPENING_BRACKET,
-    PARSE_NO_CLOSING_BRACKET,
-    PARSE_NO_NUMBER_FOUND
+    ETNode**   operands;
+    size_t     operandsCount;
+    size_t     operandsCapacity;
+
+    Operation* operations;
+    size_t     operationsCount;
+    size_t     operationsCapacity;
+    size_t     openBracketsCount;
+
+    ETNode*    operandsBuffer[PARSE_STACK_INIT_SIZE];
+    Operation  operationsBuffer[PARSE_STACK_INIT_SIZE];
 };
 
 struct Parser
 {
-    const char* expression;
-    size_t      ofs;
-    ParseError  status;
+    Lexer          lexer;
+    Token          token;
+    ParseStacks    stacks;
+
+    const char*    expression;
+    size_t         length;
+    ParseError     status;
+
+    StringBuilder* errors;
 };
 
 bool        loadExpression  (ExprTree* tree, const char* filename);
 
 ParseError  parseExpression (ExprTree* tree, const char* expression);
-void        requireSymbol   (Parser* parser, char symbol, ParseError error);
-ETNode*     getExpression   (Parser* parser);
-ETNode*     getTerm         (Parser* parser);
-ETNode*     getPower        (Parser* parser);
-ETNode*     getFactor       (Parser* parser);
-ETNode*     getUnaryOp      (Parser* parser);
-
-ETNode*     getNumber       (Parser* parser);
-ETNode*     getConstant     (Parser* parser);
-ETNode*     getVariable     (Parser* parser);
-
-void        skipSpaces      (Parser* parser);
-
-void        incrOffset      (Parser* parser, size_t delta);
-char        curSymbol       (Parser* parser);
-const char* curPosition     (Parser* parser);
+ParseError  parseExpression (ExprTree* tree, const char* expression, size_t length, StringBuilder* errors);
+ParseError  parseExpression (ExprTree* tree, FILE* stream, StringBuilder* errors);
+ETNode*     parseTokens     (Parser* parser);
+bool        parseOperand    (Parser* parser);
+bool        parseOperator   (Parser* parser, bool* isFinished);
+int         precedence      (Operation operation);
+
+void        initStacks      (ParseStacks* stacks);
+void        destroyStacks   (ParseStacks* stacks);
+bool        pushOperand     (Parser* parser, ETNode* operand);
+bool        pushOperation   (Parser* parser, Operation operation);
+void*       growStack       (void* stack, const void* buffer, size_t* capacity, size_t elementSize);
+void        reduceTop       (Parser* parser);
+void        reduceUntil     (Parser* parser, int minPrecedence);
 
 const char* errorString     (ParseError error);
 void        syntaxError     (Parser* parser, ParseError error);
 
+//-----------------------------------------------------------------------------
+//! Parses the first line of the file, "-" is the standard input. The file is
+//! streamed, so only the tree itself has to fit in memory.
+//-----------------------------------------------------------------------------
 bool loadExpression(ExprTree* tree, const char* filename)
 {
     assert(tree     != nullptr);
     assert(filename != nullptr);
 
-    FILE* file = fopen(filename, "r");
-    if (file == nullptr) 
-    {
-        printf("Unable to open file '%s'.\n", filename);
-        return false;  
-    }
-
-    size_t fileSize   = getFileSize(filename);
-    size_t exprLength = 0;
-
-    // allocating fileSize + 1 to be able to put '\0' at the end
-    char* exprBuffer = (char*) calloc(fileSize + 1, sizeof(char));
-    if (exprBuffer == nullptr) 
-    {
-        printf("Unable to load whole file '%s'\n.", filename);
-        fclose(file);
-        return false;  
-    }
+    INSTR_PHASE(PHASE_LOAD);
 
-    exprLength = fread(exprBuffer, sizeof(char), fileSize, file);
+    bool  isStdin = strcmp(filename, STDIN_FILE_NAME) == 0;
+    FILE* file    = isStdin ? stdin : fopen(filename, "r");
 
-    if (exprLength == 0)
+    if (file == nullptr) 
     {
-        printf("File '%s' is empty.\n", filename);
-        fclose(file);
-        free(exprBuffer);
+        fprintf(stderr, "Unable to open file '%s'.\n", filename);
         return false;  
     }
 
-    char* lineEnd = strchr(exprBuffer, '\n');
-    if (lineEnd != nullptr) { exprLength = lineEnd - exprBuffer; }
+    ParseError status = parseExpression(tree, file, nullptr);
 
-    exprBuffer[exprLength] = '\0';
+    if (!isStdin) { fclose(file); }
 
-    if (parseExpression(tree, exprBuffer) != PARSE_NO_ERROR)
+    if (status != PARSE_NO_ERROR)
     {
-        LG_LogMessage("Expression tree hasn't been constructed correctly.", LG_STYLE_CLASS_ERROR, filename);
-
-        fclose(file);
-        free(exprBuffer);
-
+        logMessage("Expression tree hasn't been constructed correctly.", LG_STYLE_CLASS_ERROR, filename);
         return false;  
     }
 
-    fclose(file);
-    free(exprBuffer);
+    INSTR_TREE_SIZES(PHASE_LOAD, 0, instrTreeSize(tree->root));
 
     return true;
 }
@@ -106,247 +104,397 @@ ParseError parseExpression(ExprTree* tree, const char* expression)
     assert(tree       != nullptr);
     assert(expression != nullptr);
 
-    Parser parser = { expression, 0, PARSE_NO_ERROR };
+    return parseExpression(tree, expression, strlen(expression), nullptr);
+}
 
-    ETNode* root = getExpression(&parser);
-    requireSymbol(&parser, '\0', PARSE_UNFINISHED_EXPRESSION);
+//-----------------------------------------------------------------------------
+//! Parses the first length characters of the expression, so that lines can be
+//! parsed right from a bigger buffer without copying them.
+//!
+//! Parsing doesn't touch any shared state, so different threads can parse at
+//! the same time if each of them has its own error sink.
+//!
+//! @param [out] tree
+//! @param [in]  expression
+//! @param [in]  length
+//! @param [out] errors      syntax error messages go here, nullptr for stdout
+//!
+//! @return parsing status, tree->root is nullptr on errors.
+//-----------------------------------------------------------------------------
+ParseError parseExpression(ExprTree* tree, const char* expression, size_t length, StringBuilder* errors)
+{
+    assert(tree       != nullptr);
+    assert(expression != nullptr);
 
-    tree->root = root;
+    Parser parser     = {};
+    parser.expression = expression;
+    parser.length     = length;
+    parser.status     = PARSE_NO_ERROR;
+    parser.errors     = errors;
 
-    return parser.status;
-}
+    construct(&parser.lexer, expression, length);
+    initStacks(&parser.stacks);
 
-void requireSymbol(Parser* parser, char symbol, ParseError error)
-{
-    assert(parser != nullptr);
+    tree->root = parseTokens(&parser);
 
-    if (curSymbol(parser) != symbol) { syntaxError(parser, error); }
+    destroyStacks(&parser.stacks);
+
+    return parser.status;
 }
 
-ETNode* getExpression(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Parses the first line of the stream reading it through a fixed size
+//! buffer, so the text is never held in memory as a whole. Works on pipes, the
+//! size of the input doesn't have to be known.
+//!
+//! @param [out] tree
+//! @param [in]  stream
+//! @param [out] errors  syntax error messages go here, nullptr for stdout
+//!
+//! @return parsing status, tree->root is nullptr on errors.
+//-----------------------------------------------------------------------------
+ParseError parseExpression(ExprTree* tree, FILE* stream, StringBuilder* errors)
 {
-    assert(parser != nullptr);
+    assert(tree   != nullptr);
+    assert(stream != nullptr);
 
-    ETNode* value1 = getTerm(parser);
+    Parser parser = {};
+    parser.status = PARSE_NO_ERROR;
+    parser.errors = errors;
 
-    while (curSymbol(parser) == '+' || curSymbol(parser) == '-')
+    if (construct(&parser.lexer, stream, LEXER_BUFFER_SIZE) == nullptr)
     {
-        char operation = curSymbol(parser);
-        incrOffset(parser, 1);
-
-        ETNode* value2 = getTerm(parser);
+        tree->root = nullptr;
+        syntaxError(&parser, PARSE_NO_MEMORY);
 
-        if (operation == '+') { value1 = newNode(TYPE_OP, { .op = OP_ADD }, value1, value2); }
-        else                  { value1 = newNode(TYPE_OP, { .op = OP_SUB }, value1, value2); }
+        return parser.status;
     }
 
-    return value1;
+    initStacks(&parser.stacks);
+
+    tree->root = parseTokens(&parser);
+
+    destroyStacks(&parser.stacks);
+    destroy(&parser.lexer);
+
+    return parser.status;
 }
 
-ETNode* getTerm(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Shunting-yard over the grammar
+//!
+//!     Expression = Term  {('+' | '-') Term}
+//!     Term       = Power {('*' | '/') Power}
+//!     Power      = Factor {'^' Factor}
+//!     Factor     = '(' Expression ')' | Number | Variable | UnaryOp Factor
+//!
+//! with all the binary operations left associative. Unary operations bind
+//! tighter than anything else, as they only take a factor. Parsing stops at
+//! the first error.
+//!
+//! @return root of the tree, nullptr on errors.
+//-----------------------------------------------------------------------------
+ETNode* parseTokens(Parser* parser)
 {
     assert(parser != nullptr);
 
-    ETNode* value1 = getPower(parser);
+    bool isOperandExpected = true;
+    bool isFinished        = false;
 
-    while (curSymbol(parser) == '*' || curSymbol(parser) == '/')
+    while (!isFinished && parser->status == PARSE_NO_ERROR)
     {
-        char operation = curSymbol(parser);
-        incrOffset(parser, 1);
+        parser->token = nextToken(&parser->lexer);
+
+        if (isOperandExpected) { isOperandExpected = parseOperand(parser);              }
+        else                   { isOperandExpected = parseOperator(parser, &isFinished); }
+    }
 
-        ETNode* value2 = getPower(parser);
+    ParseStacks* stacks = &parser->stacks;
 
-        if (operation == '*') { value1 = newNode(TYPE_OP, { .op = OP_MUL }, value1, value2); }
-        else                  { value1 = newNode(TYPE_OP, { .op = OP_DIV }, value1, value2); }
+    if (parser->status != PARSE_NO_ERROR)
+    {
+        for (size_t i = 0; i < stacks->operandsCount; i++) { destroySubtree(stacks->operands[i]); }
+
+        return nullptr;
     }
 
-    return value1;
+    assert(stacks->operandsCount   == 1);
+    assert(stacks->operationsCount == 0);
+
+    return stacks->operands[0];
 }
 
-ETNode* getPower(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Handles a token where a factor has to start.
+//!
+//! @return whether or not an operand is still expected.
+//-----------------------------------------------------------------------------
+bool parseOperand(Parser* parser)
 {
     assert(parser != nullptr);
 
-    ETNode* value1 = getFactor(parser);
+    Token* token = &parser->token;
 
-    while (curSymbol(parser) == '^')
+    switch (token->type)
     {
-        incrOffset(parser, 1);
+        case TOKEN_OPEN_BRACKET:
+            parser->stacks.openBracketsCount++;
+            pushOperation(parser, OPEN_BRACKET_MARK);
+            return true;
+
+        case TOKEN_NUMBER:
+            pushOperand(parser, newNode(TYPE_NUMBER, token->data, nullptr, nullptr));
+            return false;
+
+        case TOKEN_VARIABLE:
+            pushOperand(parser, newNode(TYPE_VAR, token->data, nullptr, nullptr));
+            return false;
+
+        case TOKEN_OPERATION:
+            if (isOperationUnary(token->data.op))
+            {
+                pushOperation(parser, token->data.op);
+                return true;
+            }
 
-        value1 = newNode(TYPE_OP, { .op = OP_POW }, value1, getFactor(parser));
-    }
+            syntaxError(parser, PARSE_UNKNOWN_OPERATION);
+            return true;
 
-    return value1;
+        case TOKEN_INVALID:
+        case TOKEN_END:
+        case TOKEN_CLOSE_BRACKET:
+        default:
+            syntaxError(parser, PARSE_UNKNOWN_OPERATION);
+            return true;
+    }
 }
 
-ETNode* getFactor(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Handles a token after a complete factor. Anything that can't continue the
+//! expression ends it: that's an unclosed bracket if there is one and an
+//! unfinished expression otherwise.
+//!
+//! @return whether or not an operand is expected next.
+//-----------------------------------------------------------------------------
+bool parseOperator(Parser* parser, bool* isFinished)
 {
-    assert(parser != nullptr);
+    assert(parser     != nullptr);
+    assert(isFinished != nullptr);
 
-    ETNode* value = 0;
+    Token*       token  = &parser->token;
+    ParseStacks* stacks = &parser->stacks;
 
-    if (curSymbol(parser) == '(')
+    if (token->type == TOKEN_OPERATION && !isOperationUnary(token->data.op))
     {
-        incrOffset(parser, 1);
+        int tokenPrecedence = precedence(token->data.op);
 
-        value = getExpression(parser);
-        requireSymbol(parser, ')', PARSE_NO_CLOSING_BRACKET);
+        // all the binary operations are left associative
+        reduceUntil(parser, tokenPrecedence);
+        pushOperation(parser, token->data.op);
 
-        incrOffset(parser, 1);
+        return true;
     }
-    else
+
+    if (token->type == TOKEN_CLOSE_BRACKET && stacks->openBracketsCount > 0)
     {
-        value = getNumber(parser);
+        reduceUntil(parser, 0);
 
-        if (value == nullptr) { value = getConstant(parser); }
-        if (value == nullptr) { value = getVariable(parser); }
-        if (value == nullptr) { value = getUnaryOp(parser);  }
+        assert(stacks->operations[stacks->operationsCount - 1] == OPEN_BRACKET_MARK);
+
+        stacks->operationsCount--;
+        stacks->openBracketsCount--;
+
+        return false;
     }
 
-    return value;
+    if (stacks->openBracketsCount > 0)
+    {
+        syntaxError(parser, PARSE_NO_CLOSING_BRACKET);
+        return false;
+    }
+
+    if (token->type != TOKEN_END)
+    {
+        syntaxError(parser, PARSE_UNFINISHED_EXPRESSION);
+        return false;
+    }
+
+    reduceUntil(parser, 0);
+    *isFinished = true;
+
+    return false;
 }
 
-ETNode* getUnaryOp(Parser* parser)
+int precedence(Operation operation)
 {
-    assert(parser != nullptr);
+    switch (operation)
+    {
+        case OP_ADD:
+        case OP_SUB:
+            return 1;
 
-    bool        valid     = false;
-    const char* curPos    = curPosition(parser);
-    Operation   operation = OP_INVALID;
+        case OP_MUL:
+        case OP_DIV:
+            return 2;
 
-    for (size_t i = UNARY_OPERATIONS_START; i < OPERATIONS_COUNT; i++)
-    {   
-        size_t length = strlen(OPERATIONS[i]);
+        case OP_POW:
+            return 3;
 
-        if (strncmp(curPos, OPERATIONS[i], length) == 0)
-        {
-            operation = (Operation) i;
-            valid     = true;
+        case OP_INVALID:
+            return 0;
 
-            incrOffset(parser, length);
-            continue;
-        }
+        case OP_LOG:
+        case OP_EXP:
+        case OP_SIN:
+        case OP_COS:
+        case OP_TAN:
+        case OPERATIONS_COUNT:
+        default:
+            return 4;
     }
+}
 
-    if (!valid) { syntaxError(parser, PARSE_UNKNOWN_OPERATION); }
+void initStacks(ParseStacks* stacks)
+{
+    assert(stacks != nullptr);
 
-    ETNode* value = getFactor(parser);
+    stacks->operands           = stacks->operandsBuffer;
+    stacks->operandsCount      = 0;
+    stacks->operandsCapacity   = PARSE_STACK_INIT_SIZE;
 
-    switch (operation)
-    {
-        case OP_LOG: 
-            value = newNode(TYPE_OP, { .op = OP_LOG }, nullptr, value);
-            break;
-
-        case OP_EXP: 
-            value = newNode(TYPE_OP, { .op = OP_EXP }, nullptr, value);
-            break;
- 
-        case OP_SIN: 
-            value = newNode(TYPE_OP, { .op = OP_SIN }, nullptr, value);
-            break;
-
-        case OP_COS: 
-            value = newNode(TYPE_OP, { .op = OP_COS }, nullptr, value);
-            break;
+    stacks->operations         = stacks->operationsBuffer;
+    stacks->operationsCount    = 0;
+    stacks->operationsCapacity = PARSE_STACK_INIT_SIZE;
+    stacks->openBracketsCount  = 0;
+}
 
-        case OP_TAN:
-            value = newNode(TYPE_OP, { .op = OP_TAN }, nullptr, value);
-            break;
+void destroyStacks(ParseStacks* stacks)
+{
+    assert(stacks != nullptr);
 
-        default:
-            syntaxError(parser, PARSE_UNKNOWN_OPERATION);
-            break;
-    }
+    if (stacks->operands   != stacks->operandsBuffer)   { free(stacks->operands);   }
+    if (stacks->operations != stacks->operationsBuffer) { free(stacks->operations); }
 
-    return value;
+    initStacks(stacks);
 }
 
-ETNode* getNumber(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Doubles the capacity of a stack, copying it out of its buffer the first
+//! time.
+//-----------------------------------------------------------------------------
+void* growStack(void* stack, const void* buffer, size_t* capacity, size_t elementSize)
 {
-    assert(parser != nullptr);
+    assert(capacity != nullptr);
 
-    char*  numberEnd = nullptr;
-    double value     = strtod(curPosition(parser), &numberEnd);
+    size_t newCapacity = 2 * *capacity;
+    void*  newStack    = nullptr;
 
-    if (numberEnd == curPosition(parser)) { return nullptr; }
+    if (stack == buffer)
+    {
+        newStack = calloc(newCapacity, elementSize);
+        if (newStack != nullptr) { memcpy(newStack, stack, *capacity * elementSize); }
+    }
+    else
+    {
+        newStack = realloc(stack, newCapacity * elementSize);
+    }
 
-    incrOffset(parser, numberEnd - curPosition(parser));
+    if (newStack != nullptr) { *capacity = newCapacity; }
 
-    return newNode(TYPE_NUMBER, { .number = value }, nullptr, nullptr);
+    return newStack;
 }
 
-ETNode* getConstant(Parser* parser)
+bool pushOperand(Parser* parser, ETNode* operand)
 {
     assert(parser != nullptr);
 
-    size_t length = 0;
+    ParseStacks* stacks = &parser->stacks;
 
-    for (size_t i = 0; i < CONSTANTS_COUNT; i++)
+    if (operand == nullptr) 
     {
-        length = CONSTANTS[i].nameLength;
+        syntaxError(parser, PARSE_NO_MEMORY);
+        return false;
+    }
 
-        if (strncmp(curPosition(parser), CONSTANTS[i].name, length) == 0)
+    if (stacks->operandsCount == stacks->operandsCapacity)
+    {
+        ETNode** operands = (ETNode**) growStack(stacks->operands, stacks->operandsBuffer, 
+                                                 &stacks->operandsCapacity, sizeof(ETNode*));
+        if (operands == nullptr)
         {
-            incrOffset(parser, length);
-
-            return newNode(TYPE_NUMBER, { .number = CONSTANTS[i].value }, nullptr, nullptr);
+            destroySubtree(operand);
+            syntaxError(parser, PARSE_NO_MEMORY);
+            return false;
         }
+
+        stacks->operands = operands;
     }
 
-    return nullptr;
+    stacks->operands[stacks->operandsCount++] = operand;
+
+    return true;
 }
 
-ETNode* getVariable(Parser* parser)
+bool pushOperation(Parser* parser, Operation operation)
 {
     assert(parser != nullptr);
 
-    char symbol = curSymbol(parser);
-    if (isVariable(symbol))
-    {
-        char nextSymbol = curPosition(parser)[1];
-        if (nextSymbol != '\0' && isalpha(nextSymbol)) { return nullptr; }
+    ParseStacks* stacks = &parser->stacks;
 
-        incrOffset(parser, 1);
+    if (stacks->operationsCount == stacks->operationsCapacity)
+    {
+        Operation* operations = (Operation*) growStack(stacks->operations, stacks->operationsBuffer, 
+                                                       &stacks->operationsCapacity, sizeof(Operation));
+        if (operations == nullptr)
+        {
+            syntaxError(parser, PARSE_NO_MEMORY);
+            return false;
+        }
 
-        return newNode(TYPE_VAR, { .var = symbol }, nullptr, nullptr);
+        stacks->operations = operations;
     }
 
-    return nullptr;
+    stacks->operations[stacks->operationsCount++] = operation;
+
+    return true;
 }
 
-void skipSpaces(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Applies the operation on top of the stack to its operands.
+//-----------------------------------------------------------------------------
+void reduceTop(Parser* parser)
 {
-    assert(parser             != nullptr);
-    assert(parser->expression != nullptr);
+    assert(parser != nullptr);
 
-    parser->ofs += strspn(curPosition(parser), " \t");
-}
+    ParseStacks* stacks    = &parser->stacks;
+    Operation    operation = stacks->operations[--stacks->operationsCount];
 
-void incrOffset(Parser* parser, size_t delta)
-{
-    assert(parser             != nullptr);
-    assert(parser->expression != nullptr);
+    ETNode* right = stacks->operands[--stacks->operandsCount];
+    ETNode* left  = nullptr;
 
-    parser->ofs += delta;
+    if (!isOperationUnary(operation)) { left = stacks->operands[--stacks->operandsCount]; }
 
-    skipSpaces(parser);
+    pushOperand(parser, newNode(TYPE_OP, { .op = operation }, left, right));
 }
 
-char curSymbol(Parser* parser)
+//-----------------------------------------------------------------------------
+//! Applies the operations on top of the stack while their precedence is at
+//! least minPrecedence, stopping at an open bracket.
+//-----------------------------------------------------------------------------
+void reduceUntil(Parser* parser, int minPrecedence)
 {
-    assert(parser             != nullptr);
-    assert(parser->expression != nullptr);
+    assert(parser != nullptr);
 
-    return *curPosition(parser);
-}
+    ParseStacks* stacks = &parser->stacks;
 
-const char* curPosition(Parser* parser)
-{
-    assert(parser             != nullptr);
-    assert(parser->expression != nullptr);
+    while (stacks->operationsCount > 0 && parser->status == PARSE_NO_ERROR)
+    {
+        Operation operation = stacks->operations[stacks->operationsCount - 1];
 
-    return &(parser->expression[parser->ofs]);
+        if (operation == OPEN_BRACKET_MARK || precedence(operation) < minPrecedence) { break; }
+
+        reduceTop(parser);
+    }
 }
 
 const char* errorString(ParseError error)
@@ -359,6 +507,7 @@ const char* errorString(ParseError error)
         case PARSE_NO_OPENING_BRACKET:    return "no opening bracket found";
         case PARSE_NO_CLOSING_BRACKET:    return "no closing bracket found";
         case PARSE_NO_NUMBER_FOUND:       return "expected a number";
+        case PARSE_NO_MEMORY:             return "not enough memory";
     }
 
     return nullptr;
@@ -368,17 +517,30 @@ void syntaxError(Parser* parser, ParseError error)
 {
     assert(parser != nullptr);
 
-    if (error == PARSE_NO_ERROR) { return; }
+    // only the first error is reported, the rest are usually caused by it
+    if (error == PARSE_NO_ERROR || parser->status != PARSE_NO_ERROR) { return; }
 
     parser->status = error;
 
-    printf("SYNTAX ERROR: %s\n", errorString(error));
-    printf("%s\n", parser->expression);
+    StringBuilder  stdoutErrors = {};
+    StringBuilder* errors       = parser->errors != nullptr ? parser->errors : &stdoutErrors;
+
+    appendFormat(errors, "SYNTAX ERROR: %s\n", errorString(error));
 
-    for (size_t i = 0; i < parser->ofs; i++)
+    // a streamed expression isn't kept, so only the position can be shown
+    if (parser->expression != nullptr)
     {
-        putchar(' ');
+        appendFormat(errors, "%.*s\n", (int) parser->length, parser->expression);
+        appendFormat(errors, "%*s^\n", (int) parser->token.ofs, "");
+    }
+    else
+    {
+        appendFormat(errors, "at offset %zu\n", parser->token.ofs);
     }
 
-    printf("^\n");
-}
\ No newline at end of file
+    if (parser->errors == nullptr)
+    {
+        fputs(getString(&stdoutErrors), stdout);
+        destroy(&stdoutErrors);
+    }
+}
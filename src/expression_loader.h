@@ -1,5 +1,28 @@
 #pragma once
 
+#include <stdio.h>
 #include "expression_tree.h"
+#include "string_builder.h"
 
-bool loadExpression(ExprTree* tree, const char* filename);
\ No newline at end of file
+//! loadExpression() reads the standard input instead of a file with this name.
+static const char* STDIN_FILE_NAME = "-";
+
+enum ParseError
+{
+    PARSE_NO_ERROR,
+    PARSE_UNFINISHED_EXPRESSION,
+    PARSE_UNKNOWN_OPERATION,
+    PARSE_NO_OPENING_BRACKET,
+    PARSE_NO_CLOSING_BRACKET,
+    PARSE_NO_NUMBER_FOUND,
+    PARSE_NO_MEMORY
+};
+
+bool       loadExpression  (ExprTree* tree, const char* filename);
+ParseError parseExpression (ExprTree* tree, const char* expression);
+ParseError parseExpression (ExprTree* tree, const char* expression, size_t length, StringBuilder* errors);
+ParseError parseExpression (ExprTree* tree, FILE* stream, StringBuilder* errors);
+
+//! Binding strength of a binary operation in the infix text, higher binds
+//! tighter. All of them are left associative.
+int        precedence      (Operation operation);
\ No newline at end of file
@@ -0,0 +1,860 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "batch_runner.h"
+#include "expression_lexer.h"
+#include "expression_loader.h"
+#include "expression_server.h"
+#include "expression_writer.h"
+#include "instrumentation.h"
+#include "math_syntax.h"
+#include "result_cache.h"
+#include "string_builder.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const char*  SERVER_STATS_OPERATION = "stats";
+static const size_t SERVER_DEFAULT_ORDER   = 5;
+
+enum ServerField
+{
+    FIELD_ID,
+    FIELD_OPERATION,
+    FIELD_VARIABLE,
+    FIELD_ORDER,
+    FIELD_POINT,
+    FIELD_FORMAT,
+    FIELD_EXPRESSION,
+
+    FIELDS_COUNT
+};
+
+//! Parsed tree of an expression with 'x' and the variable swapped, so the
+//! operations, which all work on x, work on the variable.
+struct WarmEntry
+{
+    uint64_t hash;
+    char*    text;
+    size_t   length;
+    int      variable;
+    ETNode*  root;
+    size_t   refsCount;     //!< requests using the root, it's replaced only at 0
+};
+
+//! Frames are read by the connection's thread and answered by the workers,
+//! mutex guards the writes and inFlightCount.
+struct ServerConnection
+{
+    int                     inFd;
+    int                     outFd;
+    bool                    isSocket;
+
+    std::thread             thread;
+    std::mutex              mutex;
+    std::condition_variable hasFinished;
+    size_t                  inFlightCount;
+    bool                    isBroken;       //!< a write has failed, the rest are skipped
+    std::atomic<bool>       isClosed;
+
+    ServerConnection*       next;
+};
+
+struct ServerRequest
+{
+    ServerConnection* connection;
+    uint64_t          startTime;
+    char*             frame;
+    size_t            length;
+};
+
+struct Server
+{
+    ThreadPool            pool;
+    ServerConnection*     connections;
+
+    std::mutex            warmMutex;
+    WarmEntry*            warmEntries;
+
+    std::atomic<uint64_t> requestsCount;
+    std::atomic<uint64_t> errorsCount;
+    std::atomic<uint64_t> warmHits;
+    std::atomic<uint64_t> warmMisses;
+    std::atomic<uint64_t> latencies[BATCH_OPERATIONS_COUNT][SERVER_LATENCY_BUCKETS];
+    std::atomic<uint64_t> latencyTotals[BATCH_OPERATIONS_COUNT];
+};
+
+static Server                SERVER       = {};
+static volatile sig_atomic_t SERVER_STOP  = 0;
+
+bool      serveSocket       (const char* socketPath);
+void      stopServer        (int signal);
+void      reapConnections   (bool isStopping);
+void      connectionLoop    (ServerConnection* connection);
+bool      readAll           (int fd, void* buffer, size_t size);
+bool      writeAll          (int fd, const void* buffer, size_t size);
+bool      writeFrame        (ServerConnection* connection, StringBuilder* frame);
+void      runRequest        (void* requestPtr);
+bool      handleRequest     (char* fields[FIELDS_COUNT], StringBuilder* response, BatchOperation* operation);
+int       findNewVariable   (const char* name, size_t nameLength, const char* text, size_t length,
+                             StringBuilder* response);
+void      markLetters       (const ETNode* root, bool* isUsed);
+bool      runOperation      (const BatchConfig* config, int variable, const char* text, size_t length,
+                             StringBuilder* response);
+ETNode*   acquireWarm       (const char* text, size_t length, int variable, WarmEntry** entry,
+                             StringBuilder* response);
+void      releaseWarm       (WarmEntry* entry, ETNode* root);
+void      swapVariables     (ETNode* root, int variable1, int variable2);
+uint64_t  hashText          (const char* text, size_t length, int variable);
+void      addLatency        (BatchOperation operation, uint64_t nanoseconds);
+bool      writeServerStats  (StringBuilder* response);
+uint64_t  getPercentile     (const uint64_t* buckets, uint64_t count, double fraction);
+
+//-----------------------------------------------------------------------------
+//! Serves until the standard input ends or, with a socket, until SIGINT or
+//! SIGTERM. The requests still running are answered before it returns.
+//!
+//! @return false if the server can't start.
+//-----------------------------------------------------------------------------
+bool runServer(const ServerConfig* config)
+{
+    assert(config != nullptr);
+
+    SERVER.warmEntries = (WarmEntry*) calloc(SERVER_WARM_SLOTS, sizeof(WarmEntry));
+    CHECK_NULL(SERVER.warmEntries, return false);
+
+    if (construct(&SERVER.pool, config->threadsCount) == nullptr)
+    {
+        logMessage("Unable to start the server's threads.", LG_STYLE_CLASS_ERROR);
+        free(SERVER.warmEntries);
+        return false;
+    }
+
+    // a client that has gone away is only a failed write
+    signal(SIGPIPE, SIG_IGN);
+
+    bool isServed = true;
+
+    if (config->socketPath != nullptr)
+    {
+        isServed = serveSocket(config->socketPath);
+    }
+    else
+    {
+        ServerConnection* connection = new (std::nothrow) ServerConnection();
+        CHECK_NULL(connection, isServed = false);
+
+        if (connection != nullptr)
+        {
+            connection->inFd  = STDIN_FILENO;
+            connection->outFd = STDOUT_FILENO;
+
+            connectionLoop(connection);
+            delete connection;
+        }
+    }
+
+    destroy(&SERVER.pool);
+
+    for (size_t i = 0; i < SERVER_WARM_SLOTS; i++)
+    {
+        free(SERVER.warmEntries[i].text);
+        destroySubtree(SERVER.warmEntries[i].root);
+    }
+
+    free(SERVER.warmEntries);
+    SERVER.warmEntries = nullptr;
+
+    return isServed;
+}
+
+bool serveSocket(const char* socketPath)
+{
+    assert(socketPath != nullptr);
+
+    sockaddr_un address = {};
+    address.sun_family  = AF_UNIX;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        logMessage("Socket path '%s' is too long.", LG_STYLE_CLASS_ERROR, socketPath);
+        return false;
+    }
+
+    strcpy(address.sun_path, socketPath);
+
+    // only a socket left by a previous run is removed
+    struct stat socketStat = {};
+    if (lstat(socketPath, &socketStat) == 0 && S_ISSOCK(socketStat.st_mode)) { unlink(socketPath); }
+
+    int listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (listenFd == -1 || bind(listenFd, (const sockaddr*) &address, sizeof(address)) == -1 ||
+        listen(listenFd, SERVER_LISTEN_BACKLOG) == -1)
+    {
+        logMessage("Unable to listen on '%s': %s.", LG_STYLE_CLASS_ERROR, socketPath, strerror(errno));
+        if (listenFd != -1) { close(listenFd); }
+        return false;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = stopServer;
+    sigaction(SIGINT,  &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // the signal may go to any thread, so accept() can't rely on EINTR
+    pollfd listenPoll = { listenFd, POLLIN, 0 };
+
+    while (!SERVER_STOP)
+    {
+        reapConnections(false);
+
+        if (poll(&listenPoll, 1, SERVER_POLL_INTERVAL_MS) <= 0) { continue; }
+
+        int connectionFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connectionFd == -1) { continue; }
+
+        ServerConnection* connection = new (std::nothrow) ServerConnection();
+        CHECK_NULL(connection, close(connectionFd); continue);
+
+        connection->inFd     = connectionFd;
+        connection->outFd    = connectionFd;
+        connection->isSocket = true;
+
+        try
+        {
+            connection->thread = std::thread(connectionLoop, connection);
+        }
+        catch (...)
+        {
+            close(connectionFd);
+            delete connection;
+            continue;
+        }
+
+        connection->next   = SERVER.connections;
+        SERVER.connections = connection;
+    }
+
+    reapConnections(true);
+
+    close(listenFd);
+    unlink(socketPath);
+
+    return true;
+}
+
+void stopServer(int signal)
+{
+    (void) signal;
+
+    SERVER_STOP = 1;
+}
+
+//-----------------------------------------------------------------------------
+//! Joins the connections that are closed, and with isStopping stops reading
+//! all the others and joins them too.
+//-----------------------------------------------------------------------------
+void reapConnections(bool isStopping)
+{
+    ServerConnection** link = &SERVER.connections;
+
+    while (*link != nullptr)
+    {
+        ServerConnection* connection = *link;
+
+        if (isStopping) { shutdown(connection->inFd, SHUT_RD); }
+
+        if (!isStopping && !connection->isClosed.load(std::memory_order_acquire))
+        {
+            link = &connection->next;
+            continue;
+        }
+
+        connection->thread.join();
+
+        *link = connection->next;
+        delete connection;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Reads the frames and hands them to the pool until the input ends, then
+//! waits for their responses.
+//-----------------------------------------------------------------------------
+void connectionLoop(ServerConnection* connection)
+{
+    assert(connection != nullptr);
+
+    while (true)
+    {
+        uint32_t length = 0;
+        if (!readAll(connection->inFd, &length, sizeof(length))) { break; }
+
+        length = ntohl(length);
+
+        if (length > SERVER_MAX_FRAME_LENGTH)
+        {
+            LOG_ERROR("Frame of %u bytes is over the limit, closing the connection.", length);
+            break;
+        }
+
+        ServerRequest* request = (ServerRequest*) calloc(1, sizeof(ServerRequest));
+        char*          frame   = (char*) calloc(length + 1, sizeof(char));
+
+        if (request == nullptr || frame == nullptr)
+        {
+            LOG_ERROR("Not enough memory for a frame of %u bytes.", length);
+            free(request);
+            free(frame);
+            break;
+        }
+
+        request->connection = connection;
+        request->startTime  = getInstrTime();
+        request->frame      = frame;
+        request->length     = length;
+
+        if (!readAll(connection->inFd, frame, length))
+        {
+            free(request);
+            free(frame);
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(connection->mutex);
+
+            connection->hasFinished.wait(lock, [connection]
+                                               { return connection->inFlightCount < SERVER_MAX_IN_FLIGHT; });
+            connection->inFlightCount++;
+        }
+
+        if (!submitTask(&SERVER.pool, runRequest, request)) { runRequest(request); }
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(connection->mutex);
+
+        connection->hasFinished.wait(lock, [connection] { return connection->inFlightCount == 0; });
+    }
+
+    if (connection->isSocket) { close(connection->inFd); }
+
+    connection->isClosed.store(true, std::memory_order_release);
+}
+
+bool readAll(int fd, void* buffer, size_t size)
+{
+    assert(buffer != nullptr);
+
+    char* bytes = (char*) buffer;
+
+    while (size > 0)
+    {
+        ssize_t readCount = read(fd, bytes, size);
+
+        if (readCount == -1 && errno == EINTR) { continue; }
+        if (readCount <= 0)                    { return false; }
+
+        bytes += readCount;
+        size  -= (size_t) readCount;
+    }
+
+    return true;
+}
+
+bool writeAll(int fd, const void* buffer, size_t size)
+{
+    assert(buffer != nullptr);
+
+    const char* bytes = (const char*) buffer;
+
+    while (size > 0)
+    {
+        ssize_t writtenCount = write(fd, bytes, size);
+
+        if (writtenCount == -1 && errno == EINTR) { continue; }
+        if (writtenCount <= 0)                    { return false; }
+
+        bytes += writtenCount;
+        size  -= (size_t) writtenCount;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in] frame  starts with sizeof(uint32_t) bytes for the length
+//!
+//! @return false if the client can't be written to anymore.
+//-----------------------------------------------------------------------------
+bool writeFrame(ServerConnection* connection, StringBuilder* frame)
+{
+    assert(connection != nullptr);
+    assert(frame      != nullptr);
+
+    uint32_t length = htonl((uint32_t) (frame->length - sizeof(uint32_t)));
+    memcpy(frame->buffer, &length, sizeof(length));
+
+    std::lock_guard<std::mutex> lock(connection->mutex);
+
+    if (connection->isBroken) { return true; }
+
+    if (!writeAll(connection->outFd, frame->buffer, frame->length))
+    {
+        LOG_WARNING("Unable to write a response, errno %d, dropping the rest.", errno);
+        connection->isBroken = true;
+    }
+
+    return !connection->isBroken;
+}
+
+void runRequest(void* requestPtr)
+{
+    ServerRequest* request = (ServerRequest*) requestPtr;
+    assert(request != nullptr);
+
+    ServerConnection* connection = request->connection;
+
+    char* fields[FIELDS_COUNT] = {};
+    char* field                = request->frame;
+
+    // the expression takes the rest of the frame, tabs included
+    for (size_t i = 0; i < FIELDS_COUNT && field != nullptr; i++)
+    {
+        fields[i] = field;
+        field     = i + 1 < FIELDS_COUNT ? strchr(field, '\t') : nullptr;
+
+        if (field != nullptr) { *field++ = '\0'; }
+    }
+
+    StringBuilder response = {};
+    BatchOperation operation = BATCH_OPERATION_INVALID;
+
+    bool isBuilt = construct(&response) != nullptr && appendString(&response, "\0\0\0\0", sizeof(uint32_t)) &&
+                   appendString(&response, fields[FIELD_ID]) && appendChar(&response, '\t');
+
+    if (isBuilt)
+    {
+        size_t statusStart = response.length;
+
+        if (!handleRequest(fields, &response, &operation))
+        {
+            SERVER.errorsCount.fetch_add(1, std::memory_order_relaxed);
+
+            // anything but an error message is a response cut short by the lack of memory
+            if (strncmp(response.buffer + statusStart, "error\t", strlen("error\t")) != 0)
+            {
+                truncate(&response, statusStart);
+                appendString(&response, "error\tnot enough memory");
+            }
+        }
+
+        writeFrame(connection, &response);
+    }
+    else
+    {
+        LOG_ERROR("Not enough memory for a response.");
+    }
+
+    SERVER.requestsCount.fetch_add(1, std::memory_order_relaxed);
+
+    if (operation != BATCH_OPERATION_INVALID) { addLatency(operation, getInstrTime() - request->startTime); }
+
+    destroy(&response);
+    free(request->frame);
+    free(request);
+
+    std::lock_guard<std::mutex> lock(connection->mutex);
+
+    connection->inFlightCount--;
+    connection->hasFinished.notify_all();
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the status and the result or the error message to the response.
+//!
+//! @param [out] operation  the request's operation if it's valid
+//!
+//! @return false on errors.
+//-----------------------------------------------------------------------------
+bool handleRequest(char* fields[FIELDS_COUNT], StringBuilder* response, BatchOperation* operation)
+{
+    assert(fields    != nullptr);
+    assert(response  != nullptr);
+    assert(operation != nullptr);
+
+    #define ERROR_RESPONSE(message)                                                   \
+        { appendString(response, "error\t" message); return false; }
+
+    if (fields[FIELD_OPERATION] == nullptr) { ERROR_RESPONSE("no operation"); }
+
+    if (strcmp(fields[FIELD_OPERATION], SERVER_STATS_OPERATION) == 0)
+    {
+        return appendString(response, "ok\t") && writeServerStats(response);
+    }
+
+    BatchConfig config = {};
+    char*       end    = nullptr;
+
+    config.operation = getBatchOperation(fields[FIELD_OPERATION]);
+    if (config.operation == BATCH_OPERATION_INVALID) { ERROR_RESPONSE("unknown operation"); }
+
+    if (fields[FIELD_EXPRESSION] == nullptr) { ERROR_RESPONSE("expected 7 fields"); }
+
+    *operation = config.operation;
+
+    config.order = SERVER_DEFAULT_ORDER;
+    if (*fields[FIELD_ORDER] != '\0')
+    {
+        config.order = strtoul(fields[FIELD_ORDER], &end, 10);
+        if (*end != '\0' || *fields[FIELD_ORDER] == '-') { ERROR_RESPONSE("invalid order"); }
+    }
+
+    if (*fields[FIELD_POINT] != '\0')
+    {
+        config.point = strtod(fields[FIELD_POINT], &end);
+        if (*end != '\0' || !isfinite(config.point)) { ERROR_RESPONSE("invalid point"); }
+    }
+
+    if (config.operation == BATCH_TAYLOR && config.point != (double) (int) config.point)
+    {
+        ERROR_RESPONSE("taylor point has to be an integer");
+    }
+
+    if (*fields[FIELD_FORMAT] != '\0')
+    {
+        config.format = getExprFormat(fields[FIELD_FORMAT]);
+        if (config.format == EXPR_FORMAT_INVALID) { ERROR_RESPONSE("unknown format"); }
+    }
+
+    const char* name       = fields[FIELD_VARIABLE];
+    size_t      nameLength = strlen(name);
+
+    // the name isn't interned, clients can't fill the symbol table
+    if (nameLength != 0 && !isVariableName(name, nameLength)) { ERROR_RESPONSE("invalid variable"); }
+
+    const char* text     = fields[FIELD_EXPRESSION];
+    size_t      length   = strlen(text);
+    int         variable = nameLength == 0 ? 'x' : findVariable(name, nameLength);
+
+    if (variable == VARIABLE_INVALID_ID)
+    {
+        variable = findNewVariable(name, nameLength, text, length, response);
+        if (variable == VARIABLE_INVALID_ID) { return false; }
+    }
+
+    #undef ERROR_RESPONSE
+
+    return runOperation(&config, variable, text, length, response);
+}
+
+//-----------------------------------------------------------------------------
+//! Finds the variable of a name that hasn't been interned before the request.
+//! Parsing interns the names of the expression, so if it's still unknown
+//! after that, the expression doesn't depend on it. A letter the expression
+//! doesn't use stands for it then.
+//!
+//! @param [out] response  gets the parse errors
+//!
+//! @return id of the variable, VARIABLE_INVALID_ID on errors.
+//-----------------------------------------------------------------------------
+int findNewVariable(const char* name, size_t nameLength, const char* text, size_t length, StringBuilder* response)
+{
+    assert(name     != nullptr);
+    assert(text     != nullptr);
+    assert(response != nullptr);
+
+    WarmEntry* entry = nullptr;
+
+    ETNode* root = acquireWarm(text, length, 'x', &entry, response);
+    CHECK_NULL(root, return VARIABLE_INVALID_ID);
+
+    int variable = findVariable(name, nameLength);
+
+    bool isUsed[SINGLE_LETTER_VARIABLES_COUNT] = {};
+    if (variable == VARIABLE_INVALID_ID) { markLetters(root, isUsed); }
+
+    releaseWarm(entry, root);
+
+    for (int letter = 0; letter < SINGLE_LETTER_VARIABLES_COUNT && variable == VARIABLE_INVALID_ID; letter++)
+    {
+        if (isVariable((char) letter) && !isUsed[letter] && letter != 'x') { variable = letter; }
+    }
+
+    if (variable == VARIABLE_INVALID_ID) { appendString(response, "error\tno letter is left for the variable"); }
+
+    return variable;
+}
+
+void markLetters(const ETNode* root, bool* isUsed)
+{
+    assert(isUsed != nullptr);
+
+    if (root == nullptr) { return; }
+
+    if (isTypeVar(root) && root->data.var < SINGLE_LETTER_VARIABLES_COUNT) { isUsed[root->data.var] = true; }
+
+    markLetters(root->left,  isUsed);
+    markLetters(root->right, isUsed);
+}
+
+bool runOperation(const BatchConfig* config, int variable, const char* text, size_t length,
+                  StringBuilder* response)
+{
+    assert(config   != nullptr);
+    assert(text     != nullptr);
+    assert(response != nullptr);
+
+    WarmEntry* entry = nullptr;
+
+    ETNode* root = acquireWarm(text, length, variable, &entry, response);
+    CHECK_NULL(root, return false);
+
+    double* varValues = (double*) calloc(variablesCount(), sizeof(double));
+    ETNode* result    = varValues == nullptr ? nullptr : applyOperation(config, root, varValues);
+
+    releaseWarm(entry, root);
+    free(varValues);
+
+    CHECK_NULL(result, return false);
+
+    swapVariables(result, 'x', variable);
+
+    bool isWritten = appendString(response, "ok\t") && writeExpression(response, result, config->format);
+
+    destroySubtree(result);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Finds the parsed expression in the warm table or parses it and puts it
+//! there, unless the slot's tree is being used.
+//!
+//! @param [out] entry     the entry to release the tree to, nullptr if the
+//!                        tree isn't in the table
+//! @param [out] response  gets the parse errors
+//!
+//! @return the tree with 'x' and the variable swapped, nullptr on errors.
+//-----------------------------------------------------------------------------
+ETNode* acquireWarm(const char* text, size_t length, int variable, WarmEntry** entry, StringBuilder* response)
+{
+    assert(text     != nullptr);
+    assert(entry    != nullptr);
+    assert(response != nullptr);
+
+    uint64_t   hash = hashText(text, length, variable);
+    WarmEntry* slot = &SERVER.warmEntries[hash % SERVER_WARM_SLOTS];
+
+    {
+        std::lock_guard<std::mutex> lock(SERVER.warmMutex);
+
+        if (slot->root != nullptr && slot->hash == hash && slot->variable == variable &&
+            slot->length == length && memcmp(slot->text, text, length) == 0)
+        {
+            SERVER.warmHits.fetch_add(1, std::memory_order_relaxed);
+            slot->refsCount++;
+
+            *entry = slot;
+            return slot->root;
+        }
+    }
+
+    SERVER.warmMisses.fetch_add(1, std::memory_order_relaxed);
+
+    StringBuilder errors = {};
+    CHECK_NULL(construct(&errors), return nullptr);
+
+    ExprTree tree = {};
+    if (parseExpression(&tree, text, length, &errors) != PARSE_NO_ERROR)
+    {
+        appendString(response, "error\t");
+        appendString(response, errors.buffer, errors.length);
+        destroy(&errors);
+
+        return nullptr;
+    }
+
+    destroy(&errors);
+
+    swapVariables(tree.root, 'x', variable);
+
+    char* textCopy = (char*) calloc(length + 1, sizeof(char));
+    if (textCopy != nullptr) { memcpy(textCopy, text, length); }
+
+    char*   oldText = nullptr;
+    ETNode* oldRoot = nullptr;
+
+    *entry = nullptr;
+
+    if (textCopy != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(SERVER.warmMutex);
+
+        if (slot->refsCount == 0)
+        {
+            oldText = slot->text;
+            oldRoot = slot->root;
+
+            *slot = { hash, textCopy, length, variable, tree.root, 1 };
+            *entry = slot;
+        }
+    }
+
+    // the old tree can be big, it's freed outside of the lock
+    if (*entry == nullptr) { free(textCopy); }
+    free(oldText);
+    destroySubtree(oldRoot);
+
+    return tree.root;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in] entry  nullptr frees root
+//-----------------------------------------------------------------------------
+void releaseWarm(WarmEntry* entry, ETNode* root)
+{
+    if (entry == nullptr)
+    {
+        destroySubtree(root);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(SERVER.warmMutex);
+
+    assert(entry->refsCount > 0);
+    entry->refsCount--;
+}
+
+void swapVariables(ETNode* root, int variable1, int variable2)
+{
+    if (root == nullptr || variable1 == variable2) { return; }
+
+    if (isTypeVar(root))
+    {
+        if      (root->data.var == variable1) { root->data.var = variable2; }
+        else if (root->data.var == variable2) { root->data.var = variable1; }
+    }
+
+    swapVariables(root->left,  variable1, variable2);
+    swapVariables(root->right, variable1, variable2);
+}
+
+//! FNV-1a of the text and the variable.
+uint64_t hashText(const char* text, size_t length, int variable)
+{
+    assert(text != nullptr);
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (uint8_t) text[i]) * 0x100000001b3ull;
+    }
+
+    return (hash ^ (uint64_t) variable) * 0x100000001b3ull;
+}
+
+void addLatency(BatchOperation operation, uint64_t nanoseconds)
+{
+    assert(operation >= 0 && operation < BATCH_OPERATIONS_COUNT);
+
+    uint64_t microseconds = nanoseconds / 1000;
+    size_t   bucket       = 0;
+
+    while (bucket + 1 < SERVER_LATENCY_BUCKETS && (microseconds >> bucket) != 0) { bucket++; }
+
+    SERVER.latencies[operation][bucket].fetch_add(1, std::memory_order_relaxed);
+    SERVER.latencyTotals[operation].fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+bool writeServerStats(StringBuilder* response)
+{
+    assert(response != nullptr);
+
+    bool isWritten = appendFormat(response, "{\"requests\":%llu,\"errors\":%llu,"
+                                            "\"warm\":{\"hits\":%llu,\"misses\":%llu},\"latency\":{",
+                                  (unsigned long long) SERVER.requestsCount.load(std::memory_order_relaxed),
+                                  (unsigned long long) SERVER.errorsCount.load(std::memory_order_relaxed),
+                                  (unsigned long long) SERVER.warmHits.load(std::memory_order_relaxed),
+                                  (unsigned long long) SERVER.warmMisses.load(std::memory_order_relaxed));
+
+    for (size_t operation = 0; operation < BATCH_OPERATIONS_COUNT && isWritten; operation++)
+    {
+        uint64_t buckets[SERVER_LATENCY_BUCKETS] = {};
+        uint64_t count                           = 0;
+
+        for (size_t i = 0; i < SERVER_LATENCY_BUCKETS; i++)
+        {
+            buckets[i] = SERVER.latencies[operation][i].load(std::memory_order_relaxed);
+            count     += buckets[i];
+        }
+
+        uint64_t total = SERVER.latencyTotals[operation].load(std::memory_order_relaxed);
+
+        isWritten = appendFormat(response, "%s\"%s\":{\"count\":%llu,\"meanUs\":%.3f,"
+                                           "\"p50Us\":%llu,\"p90Us\":%llu,\"p99Us\":%llu,\"buckets\":[",
+                                 operation == 0 ? "" : ",", BATCH_OPERATIONS[operation], (unsigned long long) count,
+                                 count == 0 ? 0.0 : (double) total / (double) count / 1000.0,
+                                 (unsigned long long) getPercentile(buckets, count, 0.5),
+                                 (unsigned long long) getPercentile(buckets, count, 0.9),
+                                 (unsigned long long) getPercentile(buckets, count, 0.99));
+
+        for (size_t i = 0; i < SERVER_LATENCY_BUCKETS && isWritten; i++)
+        {
+            isWritten = appendFormat(response, "%s%llu", i == 0 ? "" : ",", (unsigned long long) buckets[i]);
+        }
+
+        isWritten = isWritten && appendString(response, "]}");
+    }
+
+    isWritten = isWritten && appendChar(response, '}');
+
+    if (isResultCacheOpen())
+    {
+        isWritten = isWritten && appendString(response, ",\"cache\":") && writeCacheStats(response);
+    }
+
+    return isWritten && appendChar(response, '}');
+}
+
+//-----------------------------------------------------------------------------
+//! @return upper bound in microseconds of the bucket the percentile is in.
+//-----------------------------------------------------------------------------
+uint64_t getPercentile(const uint64_t* buckets, uint64_t count, double fraction)
+{
+    assert(buckets != nullptr);
+
+    if (count == 0) { return 0; }
+
+    uint64_t rank       = (uint64_t) ceil(fraction * (double) count);
+    uint64_t cumulative = 0;
+
+    for (size_t i = 0; i < SERVER_LATENCY_BUCKETS; i++)
+    {
+        cumulative += buckets[i];
+
+        if (cumulative >= rank) { return 1ull << i; }
+    }
+
+    return 1ull << (SERVER_LATENCY_BUCKETS - 1);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+//! @defgroup EXPRESSION_SERVER Long-running server
+//!
+//! Serves requests over a Unix domain socket, a thread per connection, or
+//! over the standard input and output. Every message is a frame: a 4 byte
+//! big-endian length and that many bytes of tab separated fields.
+//!
+//! Request:
+//!
+//!     id  operation  variable  order  point  format  expression
+//!
+//!     id          anything without tabs, echoed in the response
+//!     operation   differentiate, simplify, taylor, evaluate (see
+//!                 BATCH_RUNNER) or stats
+//!     variable    the variable of the operation, x if empty
+//!     order       Taylor polynomial degree, 5 if empty
+//!     point       Taylor or evaluation point, 0 if empty
+//!     format      output format (see EXPRESSION_WRITER), infix if empty
+//!     expression  the rest of the frame, tabs included
+//!
+//! A stats request needs only the id and the operation.
+//!
+//! Response:
+//!
+//!     id  ok     result
+//!     id  error  message
+//!
+//! A connection may send up to SERVER_MAX_IN_FLIGHT requests without waiting
+//! for the responses. They run on a shared thread pool and are answered as
+//! they finish, so the responses may come in any order. A client has to read
+//! the responses while it's sending, the connection stops reading once the
+//! limit is reached.
+//!
+//! Parsed expressions are kept in a table of SERVER_WARM_SLOTS trees keyed by
+//! the text and the variable, so a repeated expression isn't parsed again.
+//!
+//! The stats response is a JSON object with the request, warm table and
+//! result cache counters, and a latency histogram for every operation: bucket i counts
+//! the requests that took less than 2^i microseconds (and at least 2^(i-1)),
+//! from the frame read to the response written.
+//!
+//! @addtogroup EXPRESSION_SERVER
+//! @{
+
+static const uint32_t SERVER_MAX_FRAME_LENGTH  = 1 << 24;
+static const size_t   SERVER_MAX_IN_FLIGHT     = 64;
+static const size_t   SERVER_WARM_SLOTS        = 1024;
+static const size_t   SERVER_LATENCY_BUCKETS   = 32;
+
+static const int      SERVER_LISTEN_BACKLOG    = 64;
+static const int      SERVER_POLL_INTERVAL_MS  = 200;
+
+struct ServerConfig
+{
+    const char* socketPath   = nullptr;     //!< nullptr for stdin and stdout
+    size_t      threadsCount = 0;
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool runServer (const ServerConfig* config);
@@ -1,12 +1,40 @@
 #include <assert.h>
 #include <stdio.h>
+#include <chrono>
 #include "expression_simplifier.h"
-#include "utilib.h"
+#include "instrumentation.h"
 
+//! The clock is only looked at once in this many node visits.
+static const size_t SIMPLIFY_CLOCK_PERIOD = 256;
+
+static const RuleSet* SIMPLIFY_RULES = nullptr;
+
+struct SimplifyContext
+{
+    const SimplifyBudget*                 budget;
+    SimplifyStats*                        stats;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+bool isOutOfBudget     (SimplifyContext* context);
+bool canRewrite        (SimplifyContext* context);
 void simplifyNode      (ETNode* node, NodeType newType, ETNodeData data);
 void simplifyNode      (ETNode* node, ETNode* child);
-bool simplifyOps       (ETNode* root);
-bool precalcConstExprs (ETNode* root);
+bool simplifyOps       (SimplifyContext* context, ETNode* root);
+bool simplifyRules     (SimplifyContext* context, ETNode* root);
+bool precalcConstExprs (SimplifyContext* context, ETNode* root, bool* isConstExpr, double* value);
+
+//-----------------------------------------------------------------------------
+//! Makes simplifyTree() use the rule set instead of SIMPLIFY_EXPRS. The rule
+//! set has to outlive all the simplifications, nullptr restores the built-in
+//! identities.
+//-----------------------------------------------------------------------------
+void setSimplifyRules(const RuleSet* ruleSet)
+{
+    SIMPLIFY_RULES = ruleSet;
+
+    INSTR_RULES(ruleSet);
+}
 
 void simplifyTree(ExprTree* tree)
 {
@@ -19,8 +47,123 @@ void simplifyTree(ETNode* root)
 {
     assert(root != nullptr);
 
-    while (precalcConstExprs(root) || simplifyOps(root))
-        ;
+    simplifyTree(root, nullptr, nullptr);
+}
+
+//-----------------------------------------------------------------------------
+//! Simplifies the tree until nothing changes or the budget runs out. Every
+//! rewrite is done in place and keeps the tree valid and equivalent to the
+//! original one, so on exhaustion the tree is simply left as simplified as it
+//! has got by then.
+//!
+//! @param [in]  root
+//! @param [in]  budget  limits, nullptr for no limits
+//! @param [out] stats   may be nullptr
+//!
+//! @return true if the simplification has finished, false if it's been cut
+//!         short by the budget.
+//-----------------------------------------------------------------------------
+bool simplifyTree(ETNode* root, const SimplifyBudget* budget, SimplifyStats* stats)
+{
+    assert(root != nullptr);
+
+    INSTR_PHASE(PHASE_SIMPLIFY);
+
+    SimplifyBudget noBudget   = {};
+    SimplifyStats  localStats = {};
+
+    SimplifyContext context = {};
+    context.budget          = budget != nullptr ? budget : &noBudget;
+    context.stats           = stats  != nullptr ? stats  : &localStats;
+
+    *context.stats = {};
+
+    if (context.budget->maxSeconds > 0)
+    {
+        context.deadline = std::chrono::steady_clock::now() +
+                           std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(context.budget->maxSeconds));
+    }
+
+    size_t sizeBefore = 0;
+    treeSize(root, &sizeBefore);
+
+    bool   isConstExpr = false;
+    double value       = 0;
+    bool   isChanged   = true;
+
+    while (isChanged && !context.stats->isExhausted)
+    {
+        context.stats->passes++;
+
+        isChanged = precalcConstExprs(&context, root, &isConstExpr, &value);
+
+        if (!isChanged)
+        {
+            isChanged = SIMPLIFY_RULES != nullptr ? simplifyRules(&context, root) : simplifyOps(&context, root);
+        }
+    }
+
+    size_t sizeAfter = 0;
+    treeSize(root, &sizeAfter);
+
+    context.stats->nodesRemoved = sizeBefore > sizeAfter ? sizeBefore - sizeAfter : 0;
+
+    INSTR_TREE_SIZES(PHASE_SIMPLIFY, sizeBefore, sizeAfter);
+    INSTR_COUNT(COUNTER_SIMPLIFY_PASSES,  context.stats->passes);
+    INSTR_COUNT(COUNTER_CONSTANTS_FOLDED, context.stats->constantsFolded);
+    INSTR_COUNT(COUNTER_RULES_FIRED,      context.stats->rulesFired);
+
+    return !context.stats->isExhausted;
+}
+
+//-----------------------------------------------------------------------------
+//! Counts a node visit and checks all the limits.
+//!
+//! @return whether or not the simplification has to stop.
+//-----------------------------------------------------------------------------
+bool isOutOfBudget(SimplifyContext* context)
+{
+    assert(context != nullptr);
+
+    const SimplifyBudget* budget = context->budget;
+    SimplifyStats*        stats  = context->stats;
+
+    if (stats->isExhausted) { return true; }
+
+    stats->visits++;
+
+    if (budget->maxVisits > 0 && stats->visits >= budget->maxVisits)
+    {
+        stats->isExhausted = true;
+    }
+
+    if (budget->maxSeconds > 0 && stats->visits % SIMPLIFY_CLOCK_PERIOD == 0 &&
+        std::chrono::steady_clock::now() >= context->deadline)
+    {
+        stats->isExhausted = true;
+    }
+
+    return stats->isExhausted;
+}
+
+//-----------------------------------------------------------------------------
+//! Checks the rewrite limit right before a rewrite, so that it's never
+//! exceeded even by rewrites done on the way back up the tree.
+//-----------------------------------------------------------------------------
+bool canRewrite(SimplifyContext* context)
+{
+    assert(context != nullptr);
+
+    const SimplifyBudget* budget = context->budget;
+    SimplifyStats*        stats  = context->stats;
+
+    if (budget->maxRewrites > 0 && stats->rulesFired + stats->constantsFolded >= budget->maxRewrites)
+    {
+        stats->isExhausted = true;
+    }
+
+    return !stats->isExhausted;
 }
 
 void simplifyNode(ETNode* node, NodeType newType, ETNodeData data)
@@ -53,15 +196,19 @@ void simplifyNode(ETNode* node, ETNode* child)
 #define SIMPLIFY(otherSide) if (isIdentityType(simplifyType))                            \
                                 simplifyNode(root, root->otherSide);                     \
                             else                                                         \
-                                simplifyNode(root, TYPE_NUMBER, { simplifyType.result });
+                                simplifyNode(root, TYPE_NUMBER, { simplifyType.result });\
+                            context->stats->rulesFired++;                                \
+                            INSTR_SIMPLIFY_HIT(i);
 
-bool simplifyOps(ETNode* root)
+bool simplifyOps(SimplifyContext* context, ETNode* root)
 {
-    if (root == nullptr) { return false; }
+    assert(context != nullptr);
 
-    bool isChanged = simplifyOps(root->left) || simplifyOps(root->right);
+    if (root == nullptr || isOutOfBudget(context)) { return false; }
 
-    if (isTypeOp(root))
+    bool isChanged = simplifyOps(context, root->left) || simplifyOps(context, root->right);
+
+    if (isTypeOp(root) && canRewrite(context))
     {
         Operation         operation      = root->data.op;
         SimplifyExpr      simplifyType   = {}; 
@@ -84,7 +231,7 @@ bool simplifyOps(ETNode* root)
             }
 
             if ((simplifyTarget == SAT_SND || simplifyTarget == SAT_ANY) && isTypeNumber(root->right) && 
-                dcompare(root->right->data.number, simplifyType.arg) == 0)
+                root->right->data.number == simplifyType.arg)
             {
                 SIMPLIFY(left)
                 isChanged = true;
@@ -92,7 +239,7 @@ bool simplifyOps(ETNode* root)
             }
 
             if ((simplifyTarget == SAT_FST || simplifyTarget == SAT_ANY) && isTypeNumber(root->left) && 
-                dcompare(root->left->data.number, simplifyType.arg) == 0)
+                root->left->data.number == simplifyType.arg)
             {
                 SIMPLIFY(right)
                 isChanged = true;
@@ -106,41 +253,101 @@ bool simplifyOps(ETNode* root)
 
 #undef SIMPLIFY
 
-// just garbage value that has to not be equal to either +-1 or 0
-const double GARBAGE_VALUE_FOR_PRECALC = 22022002;
+bool simplifyRules(SimplifyContext* context, ETNode* root)
+{
+    assert(context != nullptr);
+
+    if (root == nullptr || isOutOfBudget(context)) { return false; }
+
+    bool isChanged = simplifyRules(context, root->left);
+    isChanged      = simplifyRules(context, root->right) || isChanged;
+
+    if (!isTypeOp(root) || !canRewrite(context)) { return isChanged; }
+
+    ETNode*            bindings[RULE_MAX_VARIABLES] = {};
+    const RewriteRule* rule                         = matchRules(SIMPLIFY_RULES, root, bindings);
+
+    if (rule != nullptr && rewriteNode(rule, root, bindings))
+    {
+        context->stats->rulesFired++;
+        INSTR_RULE_HIT(rule - SIMPLIFY_RULES->rules);
+        isChanged = true;
+    }
+
+    return isChanged;
+}
 
 //-----------------------------------------------------------------------------
-//! Precalculates all expressions with constants (e.g. '2+19' -> '21').
+//! Precalculates all expressions with constants (e.g. '2+19' -> '21'). The
+//! values of constant subexpressions are passed up the tree, so every node is
+//! evaluated once per pass.
 //!
-//! @param [in] root
+//! @param [in]  context
+//! @param [in]  root
+//! @param [out] isConstExpr  whether or not the subtree has no variables
+//! @param [out] value        value of the subtree if it's constant
 //!
 //! @return whether or not there have been any changes in the subtree.
 //-----------------------------------------------------------------------------
-bool precalcConstExprs(ETNode* root)
+bool precalcConstExprs(SimplifyContext* context, ETNode* root, bool* isConstExpr, double* value)
 {
-    if (root == nullptr) { return false; }
+    assert(context     != nullptr);
+    assert(isConstExpr != nullptr);
+    assert(value       != nullptr);
+
+    *isConstExpr = false;
+
+    if (root == nullptr || isOutOfBudget(context)) { return false; }
+
+    if (isTypeNumber(root))
+    {
+        *isConstExpr = true;
+        *value       = root->data.number;
+        return false;
+    }
+
+    if (!isTypeOp(root)) { return false; }
 
-    ETNode* left   = root->left;
-    ETNode* right  = root->right;
+    ETNode* left  = root->left;
+    ETNode* right = root->right;
 
-    bool isChanged = precalcConstExprs(root->left) || precalcConstExprs(root->right);
+    bool   isLeftConst  = false;
+    bool   isRightConst = false;
+    double leftValue    = 0;
+    double rightValue   = 0;
 
-    if (!isTypeOp(root) || hasVariable(root, 'x')) { return isChanged; } 
+    bool isChanged = precalcConstExprs(context, left,  &isLeftConst,  &leftValue);
+    isChanged      = precalcConstExprs(context, right, &isRightConst, &rightValue) || isChanged;
+
+    if (left == nullptr) { isLeftConst = true; }
+
+    if (!isLeftConst || !isRightConst || context->stats->isExhausted) { return isChanged; }
 
     Operation operation = root->data.op;
-    double    value     = evaluateSubtree(root); 
 
-    if ((operation == OP_ADD || operation == OP_SUB || operation == OP_MUL) && 
-        isTypeNumber(left) && isTypeNumber(right) &&
-        !isConstant(left->data.number) && !isConstant(right->data.number))
+    *isConstExpr = true;
+    *value       = isOperationUnary(operation) ? evaluateUnary(operation, rightValue) :
+                                                 evaluateBinary(operation, leftValue, rightValue);
+
+    double folded = *value;
+    bool   isFold = false;
+
+    if      (*value ==  0.0) { folded =  0.0; isFold = true; }
+    else if (*value ==  1.0) { folded =  1.0; isFold = true; }
+    else if (*value == -1.0) { folded = -1.0; isFold = true; }
+    else if ((operation == OP_ADD || operation == OP_SUB || operation == OP_MUL) && 
+             isTypeNumber(left) && isTypeNumber(right) &&
+             !isConstant(left->data.number) && !isConstant(right->data.number))
     {
-        simplifyNode(root, TYPE_NUMBER, { evaluateBinary(operation, left->data.number, right->data.number) });
-        isChanged = true;
+        isFold = true;
     }
 
-    if (dcompare(value,  0.0) == 0) { simplifyNode(root, TYPE_NUMBER, { 0.0}); return true; }
-    if (dcompare(value,  1.0) == 0) { simplifyNode(root, TYPE_NUMBER, { 1.0}); return true; }
-    if (dcompare(value, -1.0) == 0) { simplifyNode(root, TYPE_NUMBER, {-1.0}); return true; }
+    if (!isFold || !canRewrite(context)) { return isChanged; }
 
-    return isChanged;
+    simplifyNode(root, TYPE_NUMBER, { folded });
+    context->stats->constantsFolded++;
+
+    *value = folded;
+
+    return true;
 }
\ No newline at end of file
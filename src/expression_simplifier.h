@@ -1,6 +1,7 @@
 #pragma once
 
 #include "expression_tree.h"
+#include "rewrite_rules.h"
 
 //----------------------------------------------------------------------------- 
 //! @defgroup MATH_SIMPIFYING Simplifying specification
@@ -52,8 +53,28 @@ static const SimplifyExpr SIMPLIFY_EXPRS[SIMPLIFY_EXPRS_COUNT] =
                                 {OP_EXP, SAT_SND, 1,       E_CONST               }
                             };
 
+//! Limits of a single simplifyTree() call, zeros mean no limit.
+struct SimplifyBudget
+{
+    size_t maxRewrites = 0;
+    size_t maxVisits   = 0;
+    double maxSeconds  = 0;
+};
+
+struct SimplifyStats
+{
+    size_t rulesFired      = 0;
+    size_t constantsFolded = 0;
+    size_t nodesRemoved    = 0;
+    size_t passes          = 0;
+    size_t visits          = 0;
+    bool   isExhausted     = false;
+};
+
 //! @}
 //-----------------------------------------------------------------------------
 
-void simplifyTree(ExprTree* tree);
-void simplifyTree(ETNode* root);
+void setSimplifyRules (const RuleSet* ruleSet);
+void simplifyTree     (ExprTree* tree);
+void simplifyTree     (ETNode* root);
+bool simplifyTree     (ETNode* root, const SimplifyBudget* budget, SimplifyStats* stats);
@@ -1,20 +1,29 @@
 #include <assert.h>
-#include <direct.h>
 #include <stdlib.h>
 #include <string.h>
 #include "expression_tree.h"
-#include "utilib.h"
+#include "instrumentation.h"
+#include "latex_renderer.h"
+#include "output_names.h"
+#include "render_queue.h"
 
 const size_t MAX_FILENAME_LENGTH = 128;
-const size_t MAX_COMMAND_LENGTH  = 256;
 
 #define CHECK_NULL(value, action) if (value == nullptr) { action; }
 
-void graphDumpSubtree      (FILE* file, ETNode* node);
+struct NodeArenaBlock
+{
+    NodeArenaBlock* next;
+    ETNode          nodes[NODE_ARENA_BLOCK_SIZE];
+};
+
+static thread_local NodeArena*    NODE_ARENA     = nullptr;
+static thread_local LatexRenderer LATEX_RENDERER = {};
 
-bool skipFirstParentheses  (ETNode* operationNode);
-bool skipSecondParentheses (ETNode* operationNode);
-void latexDumpSubtree      (FILE* file, ETNode* node);
+void     graphDumpSubtree  (FILE* file, ETNode* node);
+uint64_t mixHash           (uint64_t value);
+size_t   countNodesUpTo    (const ETNode* node, size_t limit);
+ETNode*  arenaNewNode      (NodeArena* arena);
 
 ETNode& operator + (const ETNode& tree1, const ETNode& tree2)
 {
@@ -85,8 +94,81 @@ void deleteTree(ExprTree* tree)
     free(tree);
 }
 
+NodeArena* construct(NodeArena* arena)
+{
+    CHECK_NULL(arena, return nullptr);
+
+    arena->blocks     = nullptr;
+    arena->blockUsed  = 0;
+    arena->nodesCount = 0;
+
+    return arena;
+}
+
+//-----------------------------------------------------------------------------
+//! Frees all the nodes of the arena, trees built in it mustn't be used after.
+//-----------------------------------------------------------------------------
+void destroy(NodeArena* arena)
+{
+    assert(arena != nullptr);
+
+    INSTR_COUNT(COUNTER_NODES_FREED, arena->nodesCount);
+
+    NodeArenaBlock* block = arena->blocks;
+    while (block != nullptr)
+    {
+        NodeArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->blocks     = nullptr;
+    arena->blockUsed  = 0;
+    arena->nodesCount = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Makes newNode() on the calling thread allocate from the arena, nullptr
+//! returns it to the heap.
+//!
+//! @return previous arena of the thread.
+//-----------------------------------------------------------------------------
+NodeArena* setNodeArena(NodeArena* arena)
+{
+    NodeArena* previous = NODE_ARENA;
+    NODE_ARENA = arena;
+
+    return previous;
+}
+
+ETNode* arenaNewNode(NodeArena* arena)
+{
+    assert(arena != nullptr);
+
+    if (arena->blocks == nullptr || arena->blockUsed == NODE_ARENA_BLOCK_SIZE)
+    {
+        NodeArenaBlock* block = (NodeArenaBlock*) calloc(1, sizeof(NodeArenaBlock));
+        CHECK_NULL(block, return nullptr);
+
+        block->next      = arena->blocks;
+        arena->blocks    = block;
+        arena->blockUsed = 0;
+    }
+
+    ETNode* node  = &arena->blocks->nodes[arena->blockUsed++];
+    node->inArena = true;
+
+    arena->nodesCount++;
+
+    return node;
+}
+
 ETNode* newNode()
 {
+    INSTR_COUNT(COUNTER_NODES_ALLOCATED, 1);
+
+    if (NODE_ARENA != nullptr) { return arenaNewNode(NODE_ARENA); }
+
     return (ETNode*) calloc(1, sizeof(ETNode));
 }
 
@@ -116,6 +198,9 @@ void deleteNode(ETNode* node)
     node->left   = nullptr;
     node->right  = nullptr;
 
+    if (node->inArena) { return; }
+
+    INSTR_COUNT(COUNTER_NODES_FREED, 1);
     free(node);
 }
 
@@ -150,6 +235,25 @@ void treeSize(const ETNode* node, size_t* size)
     treeSize(node->right, size);
 }
 
+//-----------------------------------------------------------------------------
+//! @return whether the subtree has more than size nodes, it's counted only up
+//!         to that, so the check is O(size) however big the subtree is.
+//-----------------------------------------------------------------------------
+bool isTreeLarger(const ETNode* node, size_t size)
+{
+    return countNodesUpTo(node, size + 1) > size;
+}
+
+size_t countNodesUpTo(const ETNode* node, size_t limit)
+{
+    if (node == nullptr || limit == 0) { return 0; }
+
+    size_t count = 1 + countNodesUpTo(node->left, limit - 1);
+    if (count < limit) { count += countNodesUpTo(node->right, limit - count); }
+
+    return count;
+}
+
 bool isLeft(const ETNode* node)
 {
     assert(node         != nullptr);
@@ -198,11 +302,6 @@ bool areTreesEqual(ETNode* root1, ETNode* root2)
     if (root1 == nullptr && root2 == nullptr) { return true;  }
     if (root1 == nullptr || root2 == nullptr) { return false; }
 
-    if (root1->type == TYPE_NUMBER && root2->type == TYPE_NUMBER)
-    {
-        return dcompare(root1->data.number, root2->data.number) == 0;
-    }
-
     return root1->type == root2->type                       && 
            equalData(root1->type, root1->data, root2->data) &&
            areTreesEqual(root1->left, root2->left)          &&
@@ -230,11 +329,86 @@ double evaluateSubtree(ETNode* root)
     return 0;
 }
 
-void substitute(ETNode* root, char variable, double value)
+double evaluateSubtree(ETNode* root, const double* varValues)
+{
+    assert(root      != nullptr);
+    assert(varValues != nullptr);
+
+    switch (root->type)
+    {
+        case TYPE_NUMBER: return root->data.number;
+        case TYPE_VAR:    return varValues[root->data.var];
+        case TYPE_OP:     break;
+
+        default:          return 0;
+    }
+
+    Operation operation = root->data.op;
+
+    if (isOperationUnary(operation))
+    {
+        return evaluateUnary(operation, evaluateSubtree(root->right, varValues));
+    }
+
+    return evaluateBinary(operation, evaluateSubtree(root->left, varValues), evaluateSubtree(root->right, varValues));
+}
+
+uint64_t mixHash(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDull;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ull;
+    value ^= value >> 33;
+
+    return value;
+}
+
+//-----------------------------------------------------------------------------
+//! Structural hash of a node given the hashes of its children (0 stands for
+//! no child). Numbers are hashed by their exact bits, so only trees with
+//! bit-identical numbers are guaranteed to get equal hashes.
+//-----------------------------------------------------------------------------
+uint64_t hashNode(const ETNode* node, uint64_t leftHash, uint64_t rightHash)
+{
+    assert(node != nullptr);
+
+    uint64_t data = 0;
+
+    switch (node->type)
+    {
+        case TYPE_NUMBER:
+        {
+            double number = node->data.number == 0 ? 0 : node->data.number;
+            memcpy(&data, &number, sizeof(data));
+            break;
+        }
+
+        case TYPE_VAR: data = (uint64_t) node->data.var;      break;
+        case TYPE_OP:  data = (uint64_t) node->data.op;       break;
+
+        default:       break;
+    }
+
+    uint64_t hash = mixHash(data ^ ((uint64_t) node->type << 56));
+    hash = mixHash(hash ^ (leftHash  * 0x9E3779B97F4A7C15ull));
+    hash = mixHash(hash ^ (rightHash + 0x632BE59BD9B4E019ull));
+
+    return hash;
+}
+
+uint64_t hashSubtree(const ETNode* root)
+{
+    if (root == nullptr) { return 0; }
+
+    return hashNode(root, hashSubtree(root->left), hashSubtree(root->right));
+}
+
+void substitute(ETNode* root, int variable, double value)
 {
     if (root == nullptr) { return; }
 
-    assert(isVariable(variable));
+    assert(isVariableId(variable));
 
     if (isTypeVar(root) && root->data.var == variable)
     {
@@ -246,7 +420,7 @@ void substitute(ETNode* root, char variable, double value)
     substitute(root->right, variable, value);
 }
 
-bool hasVariable(ETNode* root, char variable)
+bool hasVariable(ETNode* root, int variable)
 {
     if (root == nullptr) { return false; }
 
@@ -271,7 +445,7 @@ void setData(ETNode* node, double number)
     node->data.number = number;
 }
 
-void setData(ETNode* node, char var)
+void setData(ETNode* node, int var)
 {
     assert(node != nullptr);
 
@@ -287,30 +461,6 @@ void setData(ETNode* node, Operation op)
     node->data.op = op;
 }
 
-int counterFileUpdate(const char* filename)
-{
-    assert(filename != nullptr);
-
-    int count = 0;
-
-    FILE* counterFile = fopen(filename, "r+");
-    if (counterFile == nullptr)
-    {
-        counterFile = fopen(filename, "w");
-        count = -1;
-    }
-    else
-    {
-        fscanf(counterFile, "%u", &count);
-        fseek(counterFile, 0, SEEK_SET);
-    }
-
-    fprintf(counterFile, "%u", count + 1);
-    fclose(counterFile);
-
-    return count;
-}
-
 void graphDump(ExprTree* tree)
 {
     assert(tree != nullptr);
@@ -322,16 +472,14 @@ void graphDump(ETNode* root)
 {
     assert(root != nullptr);
 
-    int count = counterFileUpdate("log/tree_dumps/graph/count.cnt");
+    INSTR_PHASE(PHASE_WRITE);
 
-    char textFilename[MAX_FILENAME_LENGTH] = {};
-    snprintf(textFilename, sizeof(textFilename), "%s%u.txt", "log/tree_dumps/graph/text/tree", count);
+    OutputName name = {};
+    FILE*      file = createOutputFile(&name, "log/tree_dumps/graph/text/", "tree", ".txt");
+    CHECK_NULL(file, return);
 
     char imageFilename[MAX_FILENAME_LENGTH] = {};
-    snprintf(imageFilename, sizeof(imageFilename), "%s%u.svg", "log/tree_dumps/graph/img/tree", count);
-
-    FILE* file = fopen(textFilename, "w");
-    assert(file != nullptr);
+    snprintf(imageFilename, sizeof(imageFilename), "log/tree_dumps/graph/img/%s.svg", name.stem);
 
     fprintf(file,
             "digraph structs {\n"
@@ -344,13 +492,7 @@ void graphDump(ETNode* root)
 
     fclose(file);
 
-    char dotCmd[MAX_COMMAND_LENGTH] = {};
-
-    snprintf(dotCmd, sizeof(dotCmd), "dot -Tsvg %s -o %s", textFilename, imageFilename);
-    system(dotCmd);
-
-    snprintf(dotCmd, sizeof(dotCmd), "start %s", imageFilename);
-    system(dotCmd);
+    if (getRenderQueue() != nullptr) { enqueueDot(getRenderQueue(), name.path, imageFilename); }
 }
 
 void graphDumpSubtree(FILE* file, ETNode* node)
@@ -379,7 +521,7 @@ void graphDumpSubtree(FILE* file, ETNode* node)
             break;
 
         case TYPE_VAR:
-            fprintf(file, "<<B><I>%c</I></B>>, color=\"#367ACC\", fillcolor=\"#E0F5FF\", fontcolor=\"#4881CC\"];\n", node->data.var);
+            fprintf(file, "<<B><I>%s</I></B>>, color=\"#367ACC\", fillcolor=\"#E0F5FF\", fontcolor=\"#4881CC\"];\n", getVariableName(node->data.var));
             break;
 
         case TYPE_OP:
@@ -418,16 +560,11 @@ void latexDump(ETNode* root)
 {
     assert(root != nullptr);
 
-    int count = counterFileUpdate("log/tree_dumps/latex/count.cnt");
-
-    const char* texDir = "log/tree_dumps/latex/text/";
-    const char* pdfDir = "log/tree_dumps/latex/pdf";
+    INSTR_PHASE(PHASE_WRITE);
 
-    char filename[MAX_FILENAME_LENGTH] = {};
-    snprintf(filename, sizeof(filename), "%stree%u.tex", texDir, count);
-
-    FILE* file = fopen(filename, "w");
-    assert(file != nullptr);
+    OutputName name = {};
+    FILE*      file = createOutputFile(&name, "log/tree_dumps/latex/text/", "tree", ".tex");
+    CHECK_NULL(file, return);
 
     fprintf(file, "\\documentclass{article}\n"
                   "\\begin{document}\n"
@@ -440,238 +577,39 @@ void latexDump(ETNode* root)
 
     fclose(file);
 
-    char dir[MAX_COMMAND_LENGTH] = {};
-    _getcwd(dir, sizeof(dir));
-
-    char cmd[MAX_COMMAND_LENGTH] = {};
-    snprintf(cmd, sizeof(cmd), "pdflatex --output-directory=%s/%s --job-name=tree%u %s > nul", dir, pdfDir, count, filename);
-
-    // printf("cmd = '%s'\n", cmd);
-
-    system(cmd);
-
-    snprintf(cmd, sizeof(cmd), "start %s/tree%u.pdf", pdfDir, count);
-    system(cmd);
-}
-
-#define IS_ADD         op == OP_ADD
-#define IS_SUB         op == OP_SUB
-#define IS_MUL         op == OP_MUL
-#define IS_DIV         op == OP_DIV
-#define IS_POW         op == OP_POW
-#define IS_EXP         op == OP_EXP
-#define IS_ADD_SUB_MUL (op == OP_ADD || op == OP_SUB || op == OP_MUL)
-
-bool skipFirstParentheses(ETNode* operationNode)
-{
-    assert(operationNode       != nullptr);
-    assert(operationNode->type == TYPE_OP);
-    assert(operationNode->left != nullptr);
-
-    Operation op = operationNode->data.op;
-
-    if (IS_MUL && isTypeNumber(operationNode->left) && dcompare(operationNode->left->data.number, 0) < 0) { return false; }
-    if (IS_MUL || isTypeOp(operationNode->left) && operationNode->left->data.op == OP_DIV)                { return true; }
-
-    return !isTypeOp(operationNode->left) || IS_ADD || IS_SUB;
-}
-
-bool skipSecondParentheses(ETNode* operationNode)
-{
-    assert(operationNode        != nullptr);
-    assert(operationNode->type  == TYPE_OP);
-    assert(operationNode->right != nullptr);
-
-    Operation op = operationNode->data.op;
-
-    if ((IS_ADD || IS_SUB) && isTypeOp(operationNode->right))                                                { return true; }
-    if (IS_MUL)                                                                                              { return true; }
-    if (IS_ADD_SUB_MUL && isTypeOp(operationNode->right) && isOperationUnary(operationNode->right->data.op)) { return true; }
-    if (isTypeOp(operationNode->right) && operationNode->right->data.op == OP_DIV)                           { return true; }
-
-    return !isTypeOp(operationNode->right) || IS_POW || IS_EXP;
+    if (getRenderQueue() != nullptr)
+    {
+        enqueueLatex(getRenderQueue(), name.path, "log/tree_dumps/latex/pdf", name.stem);
+    }
 }
 
-#undef IS_ADD        
-#undef IS_SUB        
-#undef IS_MUL        
-#undef IS_DIV        
-#undef IS_POW        
-#undef IS_EXP        
-#undef IS_ADD_SUB_MUL
-
 void latexDumpSubtree(FILE* file, ETNode* node)
 {
-    assert(file != nullptr);
-    if (node == nullptr) { return; }
-
-    if (node->type == TYPE_OP && !isOperationUnary(node->data.op))
-    {
-        if (node->data.op == OP_DIV)
-        {
-            fprintf(file, "\\frac{");
-            latexDumpSubtree(file, node->left);
-
-            fprintf(file, "}{");
-            latexDumpSubtree(file, node->right);
-            fprintf(file, "}");
-
-            return;
-        }   
-
-        bool skipFirst = skipFirstParentheses(node);
-
-        fprintf(file, "{");
-        if (!skipFirst) { fprintf(file, "("); }
-        
-        latexDumpSubtree(file, node->left);
-
-        if (!skipFirst) { fprintf(file, ")"); }
-        fprintf(file, "} ");
-    }
-
-    if (node->type == TYPE_NUMBER)
-    {
-        const char* constant = getConstantName(node->data.number);
-
-        if (constant == nullptr) 
-        { 
-            fprintf(file, "%lg", node->data.number);
-        }
-        else
-        {
-            if (strlen(constant) > 1) { fprintf(file, "\\%s", constant); }
-            else                      { fprintf(file, "%s",   constant); }
-        }
-    }  
-    else if (node->type == TYPE_VAR)
-    {
-        fprintf(file, "%c", node->data.var);
-    }
-    else if (node->type == TYPE_OP)
-    {
-        bool skipSecond = skipSecondParentheses(node);
-
-        switch (node->data.op)
-        {
-            case OP_ADD: { fprintf(file, " + ");      break; }
-            case OP_SUB: { fprintf(file, " - ");      break; }
-            case OP_MUL: { fprintf(file, " \\cdot "); break; }
-            case OP_POW: { fprintf(file, " ^ ");      break; }
-            case OP_LOG: { fprintf(file, " \\ln");    break; }
-            case OP_EXP: { fprintf(file, "{e}^");     break; }
-            case OP_SIN: { fprintf(file, "\\sin");    break; } 
-            case OP_COS: { fprintf(file, "\\cos");    break; }
-            case OP_TAN: { fprintf(file, "\\tan");    break; }
-
-            default:     { break; }
-        }
-
-        fprintf(file, "{");
-        if (!skipSecond) { fprintf(file, "("); }
-
-        latexDumpSubtree(file, node->right);
-        
-        if (!skipSecond) { fprintf(file, ")"); }
-        fprintf(file, "}");
-    }
-    else
-    {
-        fprintf(file, "ERROR: invalid node type");
-    }
+    latexDumpSubtree(file, node, nullptr, 0);
 }
 
+//-----------------------------------------------------------------------------
+//! Renders the subtree with this thread's renderer, so the cache is shared by
+//! all the dumps of a thread.
+//!
+//! @param [in] file
+//! @param [in] node
+//! @param [in] substitutions       nullptr if there are none
+//! @param [in] substitutionsCount
+//-----------------------------------------------------------------------------
 void latexDumpSubtree(FILE* file, ETNode* node, Substitution* substitutions, size_t substitutionsCount)
 {
     assert(file != nullptr);
-    assert(substitutions != nullptr);
-    if (node == nullptr) { return; }
-
-    printf("SUBS = %u\n", substitutionsCount);
-
-    for (size_t i = 0; i < substitutionsCount; i++)
-    {
-        printf("LOL, node = %p, sub[i] %p\n", node, substitutions[i].root);
-        if (node == substitutions[i].root)
-        {
-            fprintf(file, "%c", substitutions[i].letter);
-            printf("FOUND node->type = %d\n", node->type);
-            return;
-        }
-    }
 
-    if (node->type == TYPE_OP && !isOperationUnary(node->data.op))
-    {
-        if (node->data.op == OP_DIV)
-        {
-            fprintf(file, "\\frac{");
-            latexDumpSubtree(file, node->left, substitutions, substitutionsCount);
-
-            fprintf(file, "}{");
-            latexDumpSubtree(file, node->right, substitutions, substitutionsCount);
-            fprintf(file, "}");
-
-            return;
-        }   
-
-        bool skipFirst = skipFirstParentheses(node);
-
-        fprintf(file, "{");
-        if (!skipFirst) { fprintf(file, "("); }
-        
-        latexDumpSubtree(file, node->left, substitutions, substitutionsCount);
+    // without a cache the renderer still works, just slower
+    if (LATEX_RENDERER.cache == nullptr) { construct(&LATEX_RENDERER); }
 
-        if (!skipFirst) { fprintf(file, ")"); }
-        fprintf(file, "} ");
-    }
-
-    if (node->type == TYPE_NUMBER)
-    {
-        const char* constant = getConstantName(node->data.number);
-
-        if (constant == nullptr) 
-        { 
-            fprintf(file, "%lg", node->data.number);
-        }
-        else
-        {
-            if (strlen(constant) > 1) { fprintf(file, "\\%s", constant); }
-            else                      { fprintf(file, "%s",   constant); }
-        }
-    }  
-    else if (node->type == TYPE_VAR)
+    if (!setSubstitutions(&LATEX_RENDERER, substitutions, substitutionsCount) ||
+        !renderLatex(&LATEX_RENDERER, node))
     {
-        fprintf(file, "%c", node->data.var);
+        printf("Not enough memory to render the tree.\n");
     }
-    else if (node->type == TYPE_OP)
-    {
-        bool skipSecond = skipSecondParentheses(node);
 
-        switch (node->data.op)
-        {
-            case OP_ADD: { fprintf(file, " + ");      break; }
-            case OP_SUB: { fprintf(file, " - ");      break; }
-            case OP_MUL: { fprintf(file, " \\cdot "); break; }
-            case OP_POW: { fprintf(file, " ^ ");      break; }
-            case OP_LOG: { fprintf(file, " \\ln");    break; }
-            case OP_EXP: { fprintf(file, "{e}^");     break; }
-            case OP_SIN: { fprintf(file, "\\sin");    break; } 
-            case OP_COS: { fprintf(file, "\\cos");    break; }
-            case OP_TAN: { fprintf(file, "\\tan");    break; }
-
-            default:     { break; }
-        }
-
-        fprintf(file, "{");
-        if (!skipSecond) { fprintf(file, "("); }
-
-        latexDumpSubtree(file, node->right, substitutions, substitutionsCount);
-        
-        if (!skipSecond) { fprintf(file, ")"); }
-        fprintf(file, "}");
-    }
-    else
-    {
-        fprintf(file, "ERROR: invalid node type");
-    }
+    flushLatex(&LATEX_RENDERER, file);
+    setSubstitutions(&LATEX_RENDERER, nullptr, 0);
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include "math_syntax.h"
+#include "symbol_table.h"
 
 enum NodeType
 {
@@ -16,14 +18,15 @@ enum NodeType
 union ETNodeData
 {
     double    number;
-    char      var;
+    int       var;
     Operation op;
 };
 
 struct ETNode
 {
-    NodeType   type   = TYPE_INVALID;
-    ETNodeData data   = {};
+    NodeType   type    = TYPE_INVALID;
+    bool       inArena = false;
+    ETNodeData data    = {};
 
     ETNode*    parent = nullptr;
     ETNode*    left   = nullptr;
@@ -41,6 +44,20 @@ struct ExprTree
     ETNode* root = nullptr;
 };
 
+struct NodeArenaBlock;
+
+//! Nodes allocated by blocks and freed all at once with the arena. While an
+//! arena is set for a thread with setNodeArena(), newNode() on that thread
+//! takes nodes from it and deleteNode() leaves them to it.
+struct NodeArena
+{
+    NodeArenaBlock* blocks     = nullptr;
+    size_t          blockUsed  = 0;
+    size_t          nodesCount = 0;
+};
+
+static const size_t NODE_ARENA_BLOCK_SIZE = 4096;
+
 #define UNARY_OP(operation, arg) *newNode(TYPE_OP, { .op = OP_##operation }, nullptr,          (ETNode*) &(arg))
 #define BINARY_OP(operation)     *newNode(TYPE_OP, { .op = OP_##operation }, (ETNode*) &tree1, (ETNode*) &tree2)
 
@@ -66,6 +83,10 @@ void      destroySubtree   (ETNode* root);
 ExprTree* newTree          ();
 void      deleteTree       (ExprTree* tree);
 
+NodeArena* construct    (NodeArena* arena);
+void       destroy      (NodeArena* arena);
+NodeArena* setNodeArena (NodeArena* arena);
+
 ETNode*   newNode          ();
 ETNode*   newNode          (NodeType type, ETNodeData data, ETNode* left, ETNode* right);
 void      deleteNode       (ETNode* node);
@@ -73,6 +94,7 @@ void      deleteNode       (ETNode* node);
 void      copyNode         (ETNode* dest, const ETNode* src);
 ETNode*   copyTree         (const ETNode* node);
 void      treeSize         (const ETNode* node, size_t* size);
+bool      isTreeLarger     (const ETNode* node, size_t size);
 
 bool      isLeft           (const ETNode* node);
 bool      isTypeNumber     (const ETNode* node);
@@ -82,12 +104,15 @@ bool      isTypeOp         (const ETNode* node);
 bool      equalData        (NodeType type, ETNodeData data1, ETNodeData data2);
 bool      areTreesEqual    (ETNode* root1, ETNode* root2);
 double    evaluateSubtree  (ETNode* root);
-void      substitute       (ETNode* root, char variable, double value);
-bool      hasVariable      (ETNode* root, char variable);
+double    evaluateSubtree  (ETNode* root, const double* varValues);
+uint64_t  hashNode         (const ETNode* node, uint64_t leftHash, uint64_t rightHash);
+uint64_t  hashSubtree      (const ETNode* root);
+void      substitute       (ETNode* root, int variable, double value);
+bool      hasVariable      (ETNode* root, int variable);
 
 void      setData          (ETNode* node, NodeType type, ETNodeData data);
 void      setData          (ETNode* node, double number);
-void      setData          (ETNode* node, char var);
+void      setData          (ETNode* node, int var);
 void      setData          (ETNode* node, Operation op);
 
 void      graphDump        (ExprTree* tree);
@@ -96,4 +121,3 @@ void      latexDump        (ExprTree* tree);
 void      latexDump        (ETNode* root);
 void      latexDumpSubtree (FILE* file, ETNode* node);
 void      latexDumpSubtree (FILE* file, ETNode* node, Substitution* substitutions, size_t substitutionsCount);
-int       counterFileUpdate(const char* filename);
\ No newline at end of file
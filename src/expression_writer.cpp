@@ -0,0 +1,448 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+#include "expression_loader.h"
+#include "expression_writer.h"
+#include "instrumentation.h"
+#include "math_syntax.h"
+
+#define WRITE(literal) writeText(writer, literal, sizeof(literal) - 1)
+
+static const size_t WRITER_INIT_STACK_SIZE = 64;
+static const size_t WRITER_NUMBER_LENGTH   = 64;
+
+static const char* MATHML_NAMESPACE = "http://www.w3.org/1998/Math/MathML";
+
+static const char* MATHML_OPERATIONS[OPERATIONS_COUNT] =
+                        {
+                            "<plus/>", "<minus/>", "<times/>", "<divide/>",
+                            "<power/>",
+                            "<ln/>", "<exp/>",
+                            "<sin/>", "<cos/>", "<tan/>"
+                        };
+
+static const char* MATHML_CONSTANTS[CONSTANTS_COUNT] = { "<pi/>", "<exponentiale/>" };
+
+//! Text goes to the file if there is one and to the builder otherwise.
+struct ExprWriter
+{
+    FILE*          file;
+    StringBuilder* builder;
+    ExprFormat     format;
+
+    char           buffer[EXPR_WRITER_BUFFER_SIZE];
+    size_t         length;
+    bool           isOk;
+};
+
+//! Stage 0 writes the node's opening, 1 goes between its children and 2
+//! closes it. isWrapped puts an infix operation into parentheses.
+struct WriteFrame
+{
+    const ETNode* node;
+    int           stage;
+    bool          isWrapped;
+};
+
+bool writeExpression (ExprWriter* writer, const ETNode* root);
+bool writeTree       (ExprWriter* writer, const ETNode* root);
+void writeOpen       (ExprWriter* writer, const ETNode* node, bool isWrapped);
+void writeMiddle     (ExprWriter* writer, const ETNode* node);
+void writeClose      (ExprWriter* writer, const ETNode* node, bool isWrapped);
+void writeNumber     (ExprWriter* writer, double number);
+bool isWrappedInfix  (const ETNode* parent, const ETNode* child, bool isLeftChild);
+
+bool writeText       (ExprWriter* writer, const char* text, size_t length);
+bool writeText       (ExprWriter* writer, const char* text);
+bool flushWriter     (ExprWriter* writer);
+
+//-----------------------------------------------------------------------------
+//! @return format with the name, EXPR_FORMAT_INVALID if there's none.
+//-----------------------------------------------------------------------------
+ExprFormat getExprFormat(const char* name)
+{
+    assert(name != nullptr);
+
+    for (int i = 0; i < EXPR_FORMATS_COUNT; i++)
+    {
+        if (strcmp(name, EXPR_FORMATS[i]) == 0) { return (ExprFormat) i; }
+    }
+
+    return EXPR_FORMAT_INVALID;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the tree in the format, without a trailing newline.
+//!
+//! @return false if the write fails or there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool writeExpression(FILE* file, const ETNode* root, ExprFormat format)
+{
+    assert(file != nullptr);
+
+    // the buffer is left uninitialized, it's only read up to length
+    ExprWriter writer;
+    writer.file    = file;
+    writer.builder = nullptr;
+    writer.format  = format;
+    writer.length  = 0;
+
+    return writeExpression(&writer, root);
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the tree in the format to the builder.
+//-----------------------------------------------------------------------------
+bool writeExpression(StringBuilder* builder, const ETNode* root, ExprFormat format)
+{
+    assert(builder != nullptr);
+
+    ExprWriter writer;
+    writer.file    = nullptr;
+    writer.builder = builder;
+    writer.format  = format;
+    writer.length  = 0;
+
+    return writeExpression(&writer, root);
+}
+
+bool writeExpression(ExprWriter* writer, const ETNode* root)
+{
+    assert(writer         != nullptr);
+    assert(writer->format >  EXPR_FORMAT_INVALID);
+    assert(writer->format <  EXPR_FORMATS_COUNT);
+
+    INSTR_PHASE(PHASE_WRITE);
+
+    writer->isOk = true;
+
+    if (writer->format == EXPR_FORMAT_MATHML)
+    {
+        WRITE("<math xmlns=\"");
+        writeText(writer, MATHML_NAMESPACE);
+        WRITE("\">");
+    }
+
+    if (root != nullptr) { writeTree(writer, root); }
+
+    if (writer->format == EXPR_FORMAT_MATHML) { WRITE("</math>"); }
+
+    return flushWriter(writer) && writer->isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Walks the tree in a single pass with an explicit stack, which is only
+//! taken from the heap for trees deeper than WRITER_INIT_STACK_SIZE.
+//-----------------------------------------------------------------------------
+bool writeTree(ExprWriter* writer, const ETNode* root)
+{
+    assert(writer != nullptr);
+    assert(root   != nullptr);
+
+    WriteFrame  initStack[WRITER_INIT_STACK_SIZE] = {};
+    WriteFrame* stack                             = initStack;
+    size_t      capacity                          = WRITER_INIT_STACK_SIZE;
+    size_t      count                             = 0;
+
+    stack[count++] = { root, 0, false };
+
+    while (count > 0 && writer->isOk)
+    {
+        WriteFrame*   frame = &stack[count - 1];
+        const ETNode* node  = frame->node;
+        const ETNode* child = nullptr;
+        bool          isOp  = node->type == TYPE_OP;
+
+        if (frame->stage == 0)
+        {
+            writeOpen(writer, node, frame->isWrapped);
+
+            frame->stage = 1;
+            child        = isOp ? node->left : nullptr;
+        }
+        else if (frame->stage == 1)
+        {
+            if (isOp && node->left != nullptr) { writeMiddle(writer, node); }
+
+            frame->stage = 2;
+            child        = isOp ? node->right : nullptr;
+        }
+        else
+        {
+            writeClose(writer, node, frame->isWrapped);
+
+            count--;
+            continue;
+        }
+
+        if (child == nullptr) { continue; }
+
+        bool isWrapped = writer->format == EXPR_FORMAT_INFIX && isWrappedInfix(node, child, frame->stage == 1);
+
+        if (count == capacity)
+        {
+            WriteFrame* newStack = (WriteFrame*) (stack == initStack ? malloc(2 * capacity * sizeof(WriteFrame)) :
+                                                                      realloc(stack, 2 * capacity * sizeof(WriteFrame)));
+            if (newStack == nullptr)
+            {
+                writer->isOk = false;
+                break;
+            }
+
+            if (stack == initStack) { memcpy(newStack, initStack, sizeof(initStack)); }
+
+            stack     = newStack;
+            capacity *= 2;
+        }
+
+        stack[count++] = { child, 0, isWrapped };
+    }
+
+    if (stack != initStack) { free(stack); }
+
+    return writer->isOk;
+}
+
+void writeOpen(ExprWriter* writer, const ETNode* node, bool isWrapped)
+{
+    assert(writer != nullptr);
+    assert(node   != nullptr);
+
+    if (node->type == TYPE_NUMBER)
+    {
+        writeNumber(writer, node->data.number);
+        return;
+    }
+
+    if (node->type == TYPE_VAR)
+    {
+        const char* name = getVariableName(node->data.var);
+
+        switch (writer->format)
+        {
+            case EXPR_FORMAT_JSON:   WRITE("{\"var\":\""); writeText(writer, name); WRITE("\"}");   break;
+            case EXPR_FORMAT_MATHML: WRITE("<ci>");        writeText(writer, name); WRITE("</ci>"); break;
+
+            case EXPR_FORMAT_INFIX:
+            case EXPR_FORMAT_SEXPR:
+            case EXPR_FORMAT_INVALID:
+            case EXPR_FORMATS_COUNT:
+            default:                 writeText(writer, name);                                      break;
+        }
+
+        return;
+    }
+
+    if (node->type != TYPE_OP)
+    {
+        writer->isOk = false;
+        return;
+    }
+
+    const char* operation = OPERATIONS[node->data.op];
+
+    switch (writer->format)
+    {
+        case EXPR_FORMAT_INFIX:
+            if (isWrapped) { WRITE("("); }
+            if (isOperationUnary(node->data.op)) { writeText(writer, operation); WRITE("("); }
+            break;
+
+        case EXPR_FORMAT_JSON:
+            WRITE("{\"op\":\"");
+            writeText(writer, operation);
+            WRITE("\",\"args\":[");
+            break;
+
+        case EXPR_FORMAT_SEXPR:
+            WRITE("(");
+            writeText(writer, operation);
+            WRITE(" ");
+            break;
+
+        case EXPR_FORMAT_MATHML:
+            WRITE("<apply>");
+            writeText(writer, MATHML_OPERATIONS[node->data.op]);
+            break;
+
+        case EXPR_FORMAT_INVALID:
+        case EXPR_FORMATS_COUNT:
+        default:
+            break;
+    }
+}
+
+void writeMiddle(ExprWriter* writer, const ETNode* node)
+{
+    assert(writer != nullptr);
+    assert(node   != nullptr);
+
+    switch (writer->format)
+    {
+        case EXPR_FORMAT_INFIX: writeText(writer, OPERATIONS[node->data.op]); break;
+        case EXPR_FORMAT_JSON:  WRITE(",");                                   break;
+        case EXPR_FORMAT_SEXPR: WRITE(" ");                                   break;
+
+        case EXPR_FORMAT_MATHML:
+        case EXPR_FORMAT_INVALID:
+        case EXPR_FORMATS_COUNT:
+        default:                                                              break;
+    }
+}
+
+void writeClose(ExprWriter* writer, const ETNode* node, bool isWrapped)
+{
+    assert(writer != nullptr);
+    assert(node   != nullptr);
+
+    if (node->type != TYPE_OP) { return; }
+
+    switch (writer->format)
+    {
+        case EXPR_FORMAT_INFIX:
+            if (isOperationUnary(node->data.op)) { WRITE(")"); }
+            if (isWrapped)                       { WRITE(")"); }
+            break;
+
+        case EXPR_FORMAT_JSON:   WRITE("]}");       break;
+        case EXPR_FORMAT_SEXPR:  WRITE(")");        break;
+        case EXPR_FORMAT_MATHML: WRITE("</apply>"); break;
+
+        case EXPR_FORMAT_INVALID:
+        case EXPR_FORMATS_COUNT:
+        default:                                    break;
+    }
+}
+
+void writeNumber(ExprWriter* writer, double number)
+{
+    assert(writer != nullptr);
+
+    if (!isfinite(number))
+    {
+        switch (writer->format)
+        {
+            case EXPR_FORMAT_JSON:
+                WRITE("{\"num\":null}");
+                return;
+
+            case EXPR_FORMAT_MATHML:
+                if (isnan(number))   { WRITE("<notanumber/>");                         }
+                else if (number > 0) { WRITE("<infinity/>");                           }
+                else                 { WRITE("<apply><minus/><infinity/></apply>");    }
+                return;
+
+            // to_chars() writes inf and -inf, which the lexer reads back
+            case EXPR_FORMAT_INFIX:
+            case EXPR_FORMAT_SEXPR:
+            case EXPR_FORMAT_INVALID:
+            case EXPR_FORMATS_COUNT:
+            default:
+                break;
+        }
+    }
+
+    // JSON keeps the value, the other formats name the constants like LaTeX
+    const char* constant = writer->format != EXPR_FORMAT_JSON ? getConstantName(number) : nullptr;
+
+    if (constant != nullptr)
+    {
+        for (size_t i = 0; i < CONSTANTS_COUNT && writer->format == EXPR_FORMAT_MATHML; i++)
+        {
+            if (CONSTANTS[i].name == constant) { constant = MATHML_CONSTANTS[i]; }
+        }
+
+        writeText(writer, constant);
+        return;
+    }
+
+    char                 digits[WRITER_NUMBER_LENGTH] = {};
+    std::to_chars_result result                       = std::to_chars(digits, digits + sizeof(digits), number);
+
+    switch (writer->format)
+    {
+        case EXPR_FORMAT_JSON:   WRITE("{\"num\":"); break;
+        case EXPR_FORMAT_MATHML: WRITE("<cn>");      break;
+
+        case EXPR_FORMAT_INFIX:
+        case EXPR_FORMAT_SEXPR:
+        case EXPR_FORMAT_INVALID:
+        case EXPR_FORMATS_COUNT:
+        default:                                     break;
+    }
+
+    writeText(writer, digits, result.ptr - digits);
+
+    if (writer->format == EXPR_FORMAT_JSON)   { WRITE("}");     }
+    if (writer->format == EXPR_FORMAT_MATHML) { WRITE("</cn>"); }
+}
+
+//-----------------------------------------------------------------------------
+//! Binary operations are parsed left associative, so a child of the same
+//! precedence only needs parentheses on the right.
+//-----------------------------------------------------------------------------
+bool isWrappedInfix(const ETNode* parent, const ETNode* child, bool isLeftChild)
+{
+    assert(parent       != nullptr);
+    assert(child        != nullptr);
+    assert(parent->type == TYPE_OP);
+
+    // a signed number is read as a whole wherever an operand is expected
+    if (isOperationUnary(parent->data.op) || child->type != TYPE_OP || isOperationUnary(child->data.op))
+    {
+        return false;
+    }
+
+    int parentPrecedence = precedence(parent->data.op);
+    int childPrecedence  = precedence(child->data.op);
+
+    return childPrecedence < parentPrecedence || (!isLeftChild && childPrecedence == parentPrecedence);
+}
+
+bool writeText(ExprWriter* writer, const char* text)
+{
+    assert(text != nullptr);
+
+    return writeText(writer, text, strlen(text));
+}
+
+bool writeText(ExprWriter* writer, const char* text, size_t length)
+{
+    assert(writer != nullptr);
+    assert(text   != nullptr);
+
+    if (writer->length + length > EXPR_WRITER_BUFFER_SIZE && !flushWriter(writer)) { return false; }
+
+    if (length > EXPR_WRITER_BUFFER_SIZE)
+    {
+        writer->isOk = writer->file != nullptr ? fwrite(text, sizeof(char), length, writer->file) == length :
+                                                 appendString(writer->builder, text, length);
+        return writer->isOk;
+    }
+
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+
+    return true;
+}
+
+bool flushWriter(ExprWriter* writer)
+{
+    assert(writer != nullptr);
+
+    size_t length = writer->length;
+    writer->length = 0;
+
+    if (length == 0) { return true; }
+
+    bool isWritten = writer->file != nullptr ? fwrite(writer->buffer, sizeof(char), length, writer->file) == length :
+                                               appendString(writer->builder, writer->buffer, length);
+
+    if (!isWritten) { writer->isOk = false; }
+
+    return isWritten;
+}
+
+#undef WRITE
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdio.h>
+#include "expression_tree.h"
+#include "string_builder.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup EXPRESSION_WRITER Machine-readable output formats
+//!
+//! Formats, for sin(x)+2:
+//!
+//!     infix   sin(x)+2                    - only the parentheses needed, the
+//!                                           text can be parsed back
+//!     json    {"op":"+","args":[{"op":"sin","args":[{"var":"x"}]},{"num":2}]}
+//!     sexpr   (+ (sin x) 2)
+//!     mathml  <math xmlns="..."><apply><plus/><apply><sin/><ci>x</ci></apply>
+//!             <cn>2</cn></apply></math>  (content MathML, on one line)
+//!
+//! Numbers are written with the shortest text that reads back to the same
+//! double, the constants by their names (<pi/> and <exponentiale/> in
+//! MathML) and the infinities as inf and -inf. JSON keeps the constants'
+//! values, and has no infinities and NaNs, they are written as null.
+//!
+//! The tree is walked once with an explicit stack, so the depth isn't limited
+//! by the call stack, and the text goes through a fixed buffer right to the
+//! file or the string builder.
+//!
+//! @addtogroup EXPRESSION_WRITER
+//! @{
+
+enum ExprFormat
+{
+    EXPR_FORMAT_INVALID = -1,
+
+    EXPR_FORMAT_INFIX,
+    EXPR_FORMAT_JSON,
+    EXPR_FORMAT_SEXPR,
+    EXPR_FORMAT_MATHML,
+
+    EXPR_FORMATS_COUNT
+};
+
+static const char* EXPR_FORMATS[EXPR_FORMATS_COUNT] = { "infix", "json", "sexpr", "mathml" };
+
+static const size_t EXPR_WRITER_BUFFER_SIZE = 1 << 14;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+ExprFormat getExprFormat   (const char* name);
+bool       writeExpression (FILE* file, const ETNode* root, ExprFormat format);
+bool       writeExpression (StringBuilder* builder, const ETNode* root, ExprFormat format);
@@ -1,18 +1,30 @@
 #include <assert.h>
-#include <direct.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include "../libs/log_generator.h"
+#include "async_log.h"
 #include "funnyentific_paper.h"
 #include "expression_simplifier.h"
+#include "expression_cse.h"
+#include "instrumentation.h"
+#include "latex_renderer.h"
+#include "output_names.h"
+#include "render_queue.h"
 #include "utilib.h"
 
-const size_t MAX_FILENAME_LENGTH   = 256;
-const size_t MAX_COMMAND_LENGTH    = 512;
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
 
-const size_t MIN_SUBSTITUTION_SIZE = 15;
-const size_t MAX_SUBSTITUTION_SIZE = 20;
-const size_t MAX_SUBSTITUTIONS     = 16;
+const size_t MIN_SUBSTITUTION_SIZE = 4;
+
+const size_t PAPER_INIT_CAPACITY   = 64;
+
+//! Room left for the note on the omitted steps when the paper is cut.
+const size_t MAX_NOTE_LENGTH       = 128;
+
+const size_t MAX_PLACEHOLDER_LENGTH = 64;
 
 const size_t MESSAGES_DERIVATIVE_NUMBER_COUNT = 4;
 const char*  MESSAGES_DERIVATIVE_NUMBER[] = { "Derivative of a constant is always zero",
@@ -62,63 +74,455 @@ const char*  MESSAGES_SIMPLIFICATION[] = { "The stars tell me it's true",
                                            "May the Divines spare my soul",
                                            "And this is" };
 
+//! A placeholder stands for every subtree equal to its own, the size guards
+//! against hash collisions. Nodes can't be told apart by address, the
+//! simplifications free and reuse them.
+struct PlaceholderSlot
+{
+    uint64_t hash      = 0;
+    size_t   size      = 0;
+    size_t   id        = 0;                 //!< 0 in an empty slot
+    long     definedAt = -1;                //!< offset of its "Let", -1 if it has none
+};
+
+//! Where the placeholder's name is written in the file.
+struct PlaceholderRef
+{
+    long   offset = 0;
+    size_t id     = 0;
+};
+
+//! The paper can be cut at any of cutPoints, the first one is where the
+//! steps start and the others are where they end.
+struct Paper
+{
+    FILE*            file              = nullptr;
+    PaperConfig      config            = {};
+    LatexRenderer    renderer          = {};
+
+    long*            cutPoints         = nullptr;
+    size_t           cutPointsCount    = 0;
+    size_t           cutPointsCapacity = 0;
+
+    size_t           stepsCount        = 0;
+    size_t           omittedCount      = 0;
+    bool             isOverBudget      = false;
+
+    PlaceholderSlot* placeholders      = nullptr;
+    size_t           placeholdersCount = 0;
+    size_t           slotsCount        = 0;
+
+    PlaceholderRef*  refs              = nullptr;
+    size_t           refsCount         = 0;
+    size_t           refsCapacity      = 0;
+
+    //! offset in the file of the text being rendered
+    long             renderOffset      = 0;
+};
+
+Paper*  construct             (Paper* paper, FILE* file, const PaperConfig* config);
+void    destroy               (Paper* paper);
+
+size_t  placeholderId         (const ETNode* node, void* arg);
+size_t  findPlaceholder       (Paper* paper, uint64_t hash, size_t size);
+bool    growPlaceholders      (Paper* paper);
+bool    addPlaceholderRef     (Paper* paper, size_t id);
+bool    eraseUndefinedRefs    (Paper* paper, long end);
+uint64_t hashPlaceholder     (const ETNode* node, size_t* size);
+
+bool    beginStep             (Paper* paper, const ETNode* root, const char** messages, size_t count);
+bool    beginSimplification   (Paper* paper, const ETNode* root);
+void    endStep               (Paper* paper);
+void    addCutPoint           (Paper* paper);
+bool    isInline              (const Paper* paper, const ETNode* node);
+void    writeLatex            (Paper* paper, const ETNode* node);
+
 void    writeHeader           (FILE* file);
 void    writeFooter           (FILE* file);
-void    writeBody             (FILE* file, ETNode* root);
+bool    writeBody             (Paper* paper, ETNode* root);
+bool    writeTail             (Paper* paper, ETNode* root, ETNode* derivative);
 void    writeSection          (FILE* file, const char* name);
 void    writeRandomMessage    (FILE* file, const char** messages, size_t count);
 
-ETNode* writeDerivative       (FILE* file, ETNode* root);
-ETNode* writeDerivativeNumber (FILE* file, ETNode* root);
-ETNode* writeDerivativeVar    (FILE* file, ETNode* root);
-ETNode* writeDerivativeAddSub (FILE* file, ETNode* root);
-ETNode* writeDerivativeMul    (FILE* file, ETNode* root);
-ETNode* writeDerivativeDiv    (FILE* file, ETNode* root);
-ETNode* writeDerivativePow    (FILE* file, ETNode* root);
-ETNode* writeDerivativeLog    (FILE* file, ETNode* root);
-ETNode* writeDerivativeExp    (FILE* file, ETNode* root);
-ETNode* writeDerivativeSin    (FILE* file, ETNode* root);
-ETNode* writeDerivativeCos    (FILE* file, ETNode* root);
-ETNode* writeDerivativeTan    (FILE* file, ETNode* root);
-
-void    writeResult           (FILE* file, ETNode* root);
-void    makeSubstitutions     (ETNode* node, Substitution* substitutions, size_t* substitutionsCount);
+ETNode* writeDerivative       (Paper* paper, ETNode* root);
+ETNode* writeDerivativeNumber (Paper* paper, ETNode* root);
+ETNode* writeDerivativeVar    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeAddSub (Paper* paper, ETNode* root);
+ETNode* writeDerivativeMul    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeDiv    (Paper* paper, ETNode* root);
+ETNode* writeDerivativePow    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeLog    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeExp    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeSin    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeCos    (Paper* paper, ETNode* root);
+ETNode* writeDerivativeTan    (Paper* paper, ETNode* root);
+
+void    writeResult           (Paper* paper, ETNode* root);
 
 void    simplifyNode          (FILE* file, ETNode* node, NodeType newType, ETNodeData data);
 void    simplifyNode          (FILE* file, ETNode* node, ETNode* child);
-bool    simplifyOps           (FILE* file, ETNode* root);
-bool    precalcConstExprs     (FILE* file, ETNode* root);
+bool    simplifyOps           (Paper* paper, ETNode* root);
+bool    precalcConstExprs     (Paper* paper, ETNode* root);
+bool    precalcConstExprs     (Paper* paper, ETNode* root, bool* hasX);
 
 void makeScientificPaper(ETNode* root)
 {
-    assert(root != nullptr);
+    makeScientificPaper(root, &DEFAULT_PAPER_CONFIG);
+}
 
-    int count = counterFileUpdate("log/tree_dumps/latex/count.cnt");
+bool makeScientificPaper(ETNode* root, const PaperConfig* config)
+{
+    assert(root   != nullptr);
+    assert(config != nullptr);
 
-    const char* texDir = "log/tree_dumps/latex/text/";
-    const char* pdfDir = "log/tree_dumps/latex/pdf";
+    INSTR_PHASE(PHASE_WRITE);
 
-    char filename[MAX_FILENAME_LENGTH] = {};
-    snprintf(filename, sizeof(filename), "%stree%u.tex", texDir, count);
+    OutputName name = {};
+    FILE*      file = createOutputFile(&name, "log/tree_dumps/latex/text/", "tree", ".tex");
+    CHECK_NULL(file, return false);
 
-    FILE* file = fopen(filename, "w");
-    assert(file != nullptr);
+    Paper paper = {};
+    if (construct(&paper, file, config) == nullptr)
+    {
+        fclose(file);
+        return false;
+    }
 
     writeHeader(file);
-    writeBody(file, root);
-    writeFooter(file);
+    bool isWritten = writeBody(&paper, root);
 
+    destroy(&paper);
     fclose(file);
 
-    char dir[MAX_COMMAND_LENGTH] = {};
-    _getcwd(dir, sizeof(dir));
+    if (!isWritten) { return false; }
+
+    if (getRenderQueue() != nullptr)
+    {
+        enqueueLatex(getRenderQueue(), name.path, "log/tree_dumps/latex/pdf", name.stem);
+    }
+
+    return true;
+}
+
+Paper* construct(Paper* paper, FILE* file, const PaperConfig* config)
+{
+    assert(paper  != nullptr);
+    assert(file   != nullptr);
+    assert(config != nullptr);
+
+    *paper = {};
+
+    paper->cutPoints = (long*) calloc(PAPER_INIT_CAPACITY, sizeof(long));
+    CHECK_NULL(paper->cutPoints, return nullptr);
+
+    if (construct(&paper->renderer) == nullptr)
+    {
+        destroy(paper);
+        return nullptr;
+    }
+
+    paper->file              = file;
+    paper->config            = *config;
+    paper->cutPointsCapacity = PAPER_INIT_CAPACITY;
+
+    setElision(&paper->renderer, config->maxInlineSize, placeholderId, paper);
+
+    return paper;
+}
+
+void destroy(Paper* paper)
+{
+    assert(paper != nullptr);
+
+    destroy(&paper->renderer);
+    free(paper->cutPoints);
+    free(paper->placeholders);
+    free(paper->refs);
+
+    *paper = {};
+}
+
+//-----------------------------------------------------------------------------
+//! Placeholder ids are given by structure, starting from 1, so a subtree and
+//! the ones equal to it keep their name through the paper. Every use of a
+//! name is recorded, writeTail() erases the ones left undefined.
+//!
+//! @return id of the node's placeholder, 0 if there isn't enough memory.
+//-----------------------------------------------------------------------------
+size_t placeholderId(const ETNode* node, void* arg)
+{
+    assert(node != nullptr);
+    assert(arg  != nullptr);
+
+    Paper* paper = (Paper*) arg;
+
+    if (2 * (paper->placeholdersCount + 1) > paper->slotsCount && !growPlaceholders(paper)) { return 0; }
+
+    size_t           size = 0;
+    uint64_t         hash = hashPlaceholder(node, &size);
+    PlaceholderSlot* slot = &paper->placeholders[findPlaceholder(paper, hash, size)];
+
+    if (slot->id == 0) { *slot = { hash, size, ++paper->placeholdersCount, -1 }; }
+
+    return addPlaceholderRef(paper, slot->id) ? slot->id : 0;
+}
+
+//-----------------------------------------------------------------------------
+//! @return slot of the subtree or the empty slot where it would go.
+//-----------------------------------------------------------------------------
+size_t findPlaceholder(Paper* paper, uint64_t hash, size_t size)
+{
+    assert(paper             != nullptr);
+    assert(paper->slotsCount != 0);
+
+    size_t slot = (size_t) hash & (paper->slotsCount - 1);
+
+    while (paper->placeholders[slot].id != 0 &&
+           (paper->placeholders[slot].hash != hash || paper->placeholders[slot].size != size))
+    {
+        slot = (slot + 1) & (paper->slotsCount - 1);
+    }
+
+    return slot;
+}
+
+bool growPlaceholders(Paper* paper)
+{
+    assert(paper != nullptr);
+
+    size_t           oldSlotsCount = paper->slotsCount;
+    PlaceholderSlot* oldSlots      = paper->placeholders;
+
+    size_t           slotsCount    = oldSlotsCount != 0 ? 2 * oldSlotsCount : PAPER_INIT_CAPACITY;
+    PlaceholderSlot* slots         = (PlaceholderSlot*) calloc(slotsCount, sizeof(PlaceholderSlot));
+    CHECK_NULL(slots, return false);
+
+    paper->placeholders = slots;
+    paper->slotsCount   = slotsCount;
+
+    for (size_t i = 0; i < oldSlotsCount; i++)
+    {
+        if (oldSlots[i].id != 0) { slots[findPlaceholder(paper, oldSlots[i].hash, oldSlots[i].size)] = oldSlots[i]; }
+    }
+
+    free(oldSlots);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Records that the placeholder's name is about to be appended to the text
+//! being rendered.
+//-----------------------------------------------------------------------------
+bool addPlaceholderRef(Paper* paper, size_t id)
+{
+    assert(paper != nullptr);
+
+    if (paper->refsCount == paper->refsCapacity)
+    {
+        size_t          capacity = paper->refsCapacity != 0 ? 2 * paper->refsCapacity : PAPER_INIT_CAPACITY;
+        PlaceholderRef* refs     = (PlaceholderRef*) realloc(paper->refs, capacity * sizeof(PlaceholderRef));
+        CHECK_NULL(refs, return false);
+
+        paper->refs         = refs;
+        paper->refsCapacity = capacity;
+    }
+
+    long offset = paper->renderOffset + (long) paper->renderer.output.length;
+
+    paper->refs[paper->refsCount++] = { offset, id };
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! A placeholder used before end but not defined there, because its step was
+//! omitted or cut, or because its subtree never gets a step (e.g. it's inside
+//! a constant), is overwritten by \ldots. The spaces that pad it to the
+//! length of the name are ignored in math mode.
+//!
+//! @return false if the file can't be written.
+//-----------------------------------------------------------------------------
+bool eraseUndefinedRefs(Paper* paper, long end)
+{
+    assert(paper != nullptr);
+
+    long* definedAt = (long*) calloc(paper->placeholdersCount + 1, sizeof(long));
+    CHECK_NULL(definedAt, return false);
+
+    for (size_t i = 0; i < paper->slotsCount; i++)
+    {
+        if (paper->placeholders[i].id != 0) { definedAt[paper->placeholders[i].id] = paper->placeholders[i].definedAt; }
+    }
+
+    bool isWritten = true;
+
+    for (size_t i = 0; i < paper->refsCount && isWritten; i++)
+    {
+        PlaceholderRef ref = paper->refs[i];
+        if (ref.offset >= end || (definedAt[ref.id] >= 0 && definedAt[ref.id] < end)) { continue; }
+
+        char name[MAX_PLACEHOLDER_LENGTH] = {};
+        int  length = snprintf(name, sizeof(name), "\\mathcal{E}_{%zu}", ref.id);
+
+        isWritten = fseek(paper->file, ref.offset, SEEK_SET) == 0 &&
+                    fprintf(paper->file, "%-*s", length, "\\ldots") == length;
+    }
+
+    free(definedAt);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! hashSubtree() that counts the nodes along the way.
+//-----------------------------------------------------------------------------
+uint64_t hashPlaceholder(const ETNode* node, size_t* size)
+{
+    assert(size != nullptr);
+
+    if (node == nullptr) { return 0; }
 
-    char cmd[MAX_COMMAND_LENGTH] = {};
-    snprintf(cmd, sizeof(cmd), "pdflatex --output-directory=%s/%s --job-name=tree%u %s", dir, pdfDir, count, filename);
-    system(cmd);
+    (*size)++;
 
-    snprintf(cmd, sizeof(cmd), "start %s/tree%u.pdf", pdfDir, count);
-    system(cmd);
+    uint64_t leftHash  = hashPlaceholder(node->left,  size);
+    uint64_t rightHash = hashPlaceholder(node->right, size);
+
+    return hashNode(node, leftHash, rightHash);
+}
+
+//-----------------------------------------------------------------------------
+//! Starts a detailed step about the subtree, if the paper has room for one.
+//! The step's own subtree is written in full one level deep, and its
+//! placeholder is defined first if it already has one.
+//!
+//! @param [in,out] paper
+//! @param [in]     root
+//! @param [in]     messages  nullptr to start the step without a message
+//! @param [in]     count
+//!
+//! @return whether the step has to be written, it's ended by endStep() then.
+//-----------------------------------------------------------------------------
+bool beginStep(Paper* paper, const ETNode* root, const char** messages, size_t count)
+{
+    assert(paper != nullptr);
+    assert(root  != nullptr);
+
+    size_t maxSteps = paper->config.maxDetailedSteps;
+
+    if (paper->isOverBudget || (maxSteps != 0 && paper->stepsCount >= maxSteps))
+    {
+        paper->omittedCount++;
+        return false;
+    }
+
+    paper->renderer.expandedNode = root;
+
+    // only a subtree too large to be inline has a placeholder
+    if (paper->slotsCount != 0 && !isInline(paper, root))
+    {
+        size_t           size = 0;
+        uint64_t         hash = hashPlaceholder(root, &size);
+        PlaceholderSlot* slot = &paper->placeholders[findPlaceholder(paper, hash, size)];
+
+        if (slot->id != 0 && slot->definedAt < 0)
+        {
+            slot->definedAt = ftell(paper->file);
+
+            fprintf(paper->file, "Let $$\\mathcal{E}_{%zu}=", slot->id);
+            writeLatex(paper, root);
+            fprintf(paper->file, "$$\n\n");
+        }
+    }
+
+    if (messages != nullptr) { writeRandomMessage(paper->file, messages, count); }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Simplifications of large subtrees are only counted, their placeholders
+//! would never be defined.
+//-----------------------------------------------------------------------------
+bool beginSimplification(Paper* paper, const ETNode* root)
+{
+    assert(paper != nullptr);
+    assert(root  != nullptr);
+
+    if (!isInline(paper, root))
+    {
+        paper->omittedCount++;
+        return false;
+    }
+
+    return beginStep(paper, root, MESSAGES_SIMPLIFICATION, MESSAGES_SIMPLIFICATION_COUNT);
+}
+
+//-----------------------------------------------------------------------------
+//! Once the paper has outgrown the budget no more steps are started, the
+//! ones that don't fit are cut by writeTail().
+//-----------------------------------------------------------------------------
+void endStep(Paper* paper)
+{
+    assert(paper != nullptr);
+
+    paper->stepsCount++;
+
+    addCutPoint(paper);
+}
+
+void addCutPoint(Paper* paper)
+{
+    assert(paper != nullptr);
+
+    long offset = ftell(paper->file);
+
+    // without a place to cut at the paper can't go on
+    if (offset < 0)
+    {
+        paper->isOverBudget = true;
+        return;
+    }
+
+    if (paper->config.maxBytes != 0 && (size_t) offset > paper->config.maxBytes) { paper->isOverBudget = true; }
+
+    if (paper->cutPointsCount == paper->cutPointsCapacity)
+    {
+        size_t capacity  = 2 * paper->cutPointsCapacity;
+        long*  cutPoints = (long*) realloc(paper->cutPoints, capacity * sizeof(long));
+
+        if (cutPoints == nullptr)
+        {
+            paper->isOverBudget = true;
+            return;
+        }
+
+        paper->cutPoints         = cutPoints;
+        paper->cutPointsCapacity = capacity;
+    }
+
+    paper->cutPoints[paper->cutPointsCount++] = offset;
+}
+
+bool isInline(const Paper* paper, const ETNode* node)
+{
+    assert(paper != nullptr);
+
+    return paper->config.maxInlineSize == 0 || !isTreeLarger(node, paper->config.maxInlineSize);
+}
+
+void writeLatex(Paper* paper, const ETNode* node)
+{
+    assert(paper != nullptr);
+
+    paper->renderOffset = ftell(paper->file);
+
+    if (!renderLatex(&paper->renderer, node))
+    {
+        logMessage("Not enough memory to render the tree.", LG_STYLE_CLASS_ERROR);
+    }
+
+    flushLatex(&paper->renderer, paper->file);
 }
 
 void writeHeader(FILE* file)
@@ -150,6 +554,7 @@ void writeHeader(FILE* file)
                   "$$f^{'}(a)=\\lim_{h\\to0}{\\frac{f(a+h)-f(a)}{h}}$$\n\n");
 }
 
+
 void writeFooter(FILE* file)
 {
     assert(file != nullptr);
@@ -157,45 +562,128 @@ void writeFooter(FILE* file)
     fprintf(file, "\\end{document}");
 }
 
-void writeBody(FILE* file, ETNode* root)
+bool writeBody(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
+
+    FILE* file = paper->file;
 
     writeSection(file, "Taking the derivative");
+    addCutPoint(paper);
 
     srand(time(NULL)); 
 
-    // while (precalcConstExprs(file, root) || simplifyOps(file, root))
+    // while (precalcConstExprs(paper, root) || simplifyOps(paper, root))
     //     ;
 
-    ETNode* derivative = writeDerivative(file, root);
+    ETNode* derivative = writeDerivative(paper, root);
     assert(derivative != nullptr);
 
-    fprintf(file, "So the result is:\n\n$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=");
-    latexDumpSubtree(file, derivative);
-    fprintf(file, "$$\n\n");
+    // the derivative is written in full, a node takes at least a byte
+    size_t maxBytes = paper->config.maxBytes;
+
+    if ((maxBytes == 0 || !isTreeLarger(derivative, maxBytes)) && beginStep(paper, root, nullptr, 0))
+    {
+        fprintf(file, "So the result is:\n\n$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=");
+
+        setElision(&paper->renderer, 0, nullptr, nullptr);
+        writeLatex(paper, derivative);
+        setElision(&paper->renderer, paper->config.maxInlineSize, placeholderId, paper);
 
-    while (precalcConstExprs(file, derivative) || simplifyOps(file, derivative))
+        fprintf(file, "$$\n\n");
+
+        endStep(paper);
+    }
+
+    while (precalcConstExprs(paper, derivative) || simplifyOps(paper, derivative))
         ;
 
-    fprintf(file, "So the result is:\n\n$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=");
+    bool isWritten = writeTail(paper, root, derivative);
 
-    writeResult(file, derivative);
+    destroySubtree(derivative);
 
-    writeSection(file, "References");
-    fprintf(file, "\\begin{enumerate}\n"
-                  "\\item Calculus textbook\n"
-                  "\\item Wikipedia (oh yeah, this devil's den)\n"
-                  "\\item Sbornik zadach on calculus by Kudryavzev\n"
-                  "\\item Moskalev Nikita (makes not obvious things ochevom)\n"
-                  "\\item Mikhail Shishatsky (the best mentor of all time)\n"
-                  "\\item My github https://github.com/tralf-strues\n"
-                  "\\end{enumerate}\n");
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the result, the references and the footer after the last step that
+//! leaves room for them within the budget, with a note on the steps omitted.
+//! The result is written in full even if it doesn't fit by itself.
+//!
+//! @return false if the paper can't be written.
+//-----------------------------------------------------------------------------
+bool writeTail(Paper* paper, ETNode* root, ETNode* derivative)
+{
+    assert(paper      != nullptr);
+    assert(root       != nullptr);
+    assert(derivative != nullptr);
+    assert(paper->cutPointsCount != 0);
+
+    char*  tail       = nullptr;
+    size_t tailLength = 0;
+
+    FILE* file     = paper->file;
+    FILE* tailFile = open_memstream(&tail, &tailLength);
+    CHECK_NULL(tailFile, return false);
+
+    paper->file = tailFile;
+    setElision(&paper->renderer, 0, nullptr, nullptr);
+
+    fprintf(tailFile, "So the result is:\n\n$$(");
+    writeLatex(paper, root);
+    fprintf(tailFile, ")'=");
+
+    writeResult(paper, derivative);
+
+    writeSection(tailFile, "References");
+    fprintf(tailFile, "\\begin{enumerate}\n"
+                      "\\item Calculus textbook\n"
+                      "\\item Wikipedia (oh yeah, this devil's den)\n"
+                      "\\item Sbornik zadach on calculus by Kudryavzev\n"
+                      "\\item Moskalev Nikita (makes not obvious things ochevom)\n"
+                      "\\item Mikhail Shishatsky (the best mentor of all time)\n"
+                      "\\item My github https://github.com/tralf-strues\n"
+                      "\\end{enumerate}\n");
+
+    writeFooter(tailFile);
+
+    fclose(tailFile);
+    paper->file = file;
+
+    size_t maxBytes = paper->config.maxBytes;
+    size_t cut      = paper->cutPointsCount - 1;
+
+    while (maxBytes != 0 && cut > 0 && (size_t) paper->cutPoints[cut] + MAX_NOTE_LENGTH + tailLength > maxBytes)
+    {
+        cut--;
+    }
+
+    if (maxBytes != 0 && (size_t) paper->cutPoints[cut] + MAX_NOTE_LENGTH + tailLength > maxBytes)
+    {
+        logMessage("The result doesn't fit into %zu bytes, the paper is written longer.",
+                   LG_STYLE_CLASS_ERROR, maxBytes);
+    }
+
+    size_t omittedCount = paper->omittedCount + paper->cutPointsCount - 1 - cut;
+
+    bool isWritten = eraseUndefinedRefs(paper, paper->cutPoints[cut]);
+
+    fseek(file, paper->cutPoints[cut], SEEK_SET);
+
+    if (omittedCount > 0) { fprintf(file, "The other %zu steps are left to the reader.\n\n", omittedCount); }
+
+    isWritten = isWritten && fwrite(tail, sizeof(char), tailLength, file) == tailLength;
+    free(tail);
+
+    // the steps cut may have been longer than what replaces them
+    isWritten = isWritten && fflush(file) == 0 && ftruncate(fileno(file), ftell(file)) == 0;
+
+    if (!isWritten) { logMessage("Unable to write the paper.", LG_STYLE_CLASS_ERROR); }
+
+    return isWritten;
 }
 
 void writeSection(FILE* file, const char* name)
@@ -217,48 +705,48 @@ void writeRandomMessage(FILE* file, const char** messages, size_t count)
 #define LEFT  root->left
 #define RIGHT root->right
 
-#define dL (*writeDerivative(file, LEFT))
-#define dR (*writeDerivative(file, RIGHT))
+#define dL (*writeDerivative(paper, LEFT))
+#define dR (*writeDerivative(paper, RIGHT))
 #define L  (*copyTree(LEFT))
 #define R  (*copyTree(RIGHT))
 
 #define RETURN(arg) return &(arg)
 
-ETNode* writeDerivative(FILE* file, ETNode* root)
+ETNode* writeDerivative(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
     Operation operation = isTypeOp(root) ? root->data.op : OP_INVALID;
 
     if (root->type == TYPE_NUMBER || (isTypeOp(root) && !hasVariable(root, 'x')))
     {
-        return writeDerivativeNumber(file, root);
+        return writeDerivativeNumber(paper, root);
     }
 
     if (root->type == TYPE_VAR)
     {
-        return writeDerivativeVar(file, root);
+        return writeDerivativeVar(paper, root);
     }
 
     assert(isTypeOp(root));
 
     switch (operation)
     {
-        case OP_ADD: return writeDerivativeAddSub(file, root);
-        case OP_SUB: return writeDerivativeAddSub(file, root);
+        case OP_ADD: return writeDerivativeAddSub(paper, root);
+        case OP_SUB: return writeDerivativeAddSub(paper, root);
 
-        case OP_MUL: return writeDerivativeMul(file, root);
-        case OP_DIV: return writeDerivativeDiv(file, root);
+        case OP_MUL: return writeDerivativeMul(paper, root);
+        case OP_DIV: return writeDerivativeDiv(paper, root);
 
-        case OP_POW: return writeDerivativePow(file, root);
+        case OP_POW: return writeDerivativePow(paper, root);
 
-        case OP_LOG: return writeDerivativeLog(file, root);
-        case OP_EXP: return writeDerivativeExp(file, root);    
+        case OP_LOG: return writeDerivativeLog(paper, root);
+        case OP_EXP: return writeDerivativeExp(paper, root);    
 
-        case OP_SIN: return writeDerivativeSin(file, root);
-        case OP_COS: return writeDerivativeCos(file, root);
-        case OP_TAN: return writeDerivativeTan(file, root);
+        case OP_SIN: return writeDerivativeSin(paper, root);
+        case OP_COS: return writeDerivativeCos(paper, root);
+        case OP_TAN: return writeDerivativeTan(paper, root);
 
         default:     return nullptr;
     }
@@ -266,295 +754,342 @@ ETNode* writeDerivative(FILE* file, ETNode* root)
     return nullptr;
 }
 
-ETNode* writeDerivativeNumber(FILE* file, ETNode* root)
+ETNode* writeDerivativeNumber(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_NUMBER, MESSAGES_DERIVATIVE_NUMBER_COUNT);
+    ETNode* derivative = newNode(TYPE_NUMBER, { 0.0 }, nullptr, nullptr);
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=");
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_NUMBER, MESSAGES_DERIVATIVE_NUMBER_COUNT))
+    {
+        FILE* file = paper->file;
 
-    ETNode* derivative = newNode(TYPE_NUMBER, { 0.0 }, nullptr, nullptr);
-    latexDumpSubtree(file, derivative);
-    fprintf(file, "$$\n\n");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=");
+        writeLatex(paper, derivative);
+        fprintf(file, "$$\n\n");
+
+        endStep(paper);
+    }
 
     return derivative;
 }
 
-ETNode* writeDerivativeVar(FILE* file, ETNode* root)
+ETNode* writeDerivativeVar(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_VAR, MESSAGES_DERIVATIVE_VAR_COUNT);
+    ETNode* derivative = newNode(TYPE_NUMBER, { 1.0 }, nullptr, nullptr);
 
-    fprintf(file, "$$");
-    latexDumpSubtree(file, root);
-    fprintf(file, "'=");
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_VAR, MESSAGES_DERIVATIVE_VAR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    ETNode* derivative = newNode(TYPE_NUMBER, { 1.0 }, nullptr, nullptr);
-    latexDumpSubtree(file, derivative);
-    fprintf(file, "$$\n\n");
+        fprintf(file, "$$");
+        writeLatex(paper, root);
+        fprintf(file, "'=");
+        writeLatex(paper, derivative);
+        fprintf(file, "$$\n\n");
+
+        endStep(paper);
+    }
 
     return derivative;
 }
 
-ETNode* writeDerivativeAddSub(FILE* file, ETNode* root)
+ETNode* writeDerivativeAddSub(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
+
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_ADD, MESSAGES_DERIVATIVE_ADD_COUNT))
+    {
+        FILE* file = paper->file;
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_ADD, MESSAGES_DERIVATIVE_ADD_COUNT);
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=(");
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=(");
+        writeLatex(paper, LEFT);
+        fprintf(file, ")'%c(", root->data.op == OP_ADD ? '+' : '-');
 
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")'%c(", root->data.op == OP_ADD ? '+' : '-');
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        endStep(paper);
+    }
 
     RETURN(root->data.op == OP_ADD ? dL + dR : dL - dR);
 }
 
-ETNode* writeDerivativeMul(FILE* file, ETNode* root)
+ETNode* writeDerivativeMul(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_MUL, MESSAGES_DERIVATIVE_MUL_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_MUL, MESSAGES_DERIVATIVE_MUL_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=(");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=(");
 
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")'\\cdot ");
-    latexDumpSubtree(file, RIGHT);
+        writeLatex(paper, LEFT);
+        fprintf(file, ")'\\cdot ");
+        writeLatex(paper, RIGHT);
 
-    fprintf(file, "+");
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, "\\cdot (");
-    latexDumpSubtree(file, RIGHT);
+        fprintf(file, "+");
+        writeLatex(paper, LEFT);
+        fprintf(file, "\\cdot (");
+        writeLatex(paper, RIGHT);
 
-    fprintf(file, ")'$$\n\n");
+        fprintf(file, ")'$$\n\n");
+
+        endStep(paper);
+    }
 
     RETURN((dL * R) + (L * dR));
 }
 
-ETNode* writeDerivativeDiv(FILE* file, ETNode* root)
+ETNode* writeDerivativeDiv(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_DIV, MESSAGES_DERIVATIVE_DIV_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_DIV, MESSAGES_DERIVATIVE_DIV_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=\\frac{(");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=\\frac{(");
 
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")'\\cdot (");
-    latexDumpSubtree(file, RIGHT);
+        writeLatex(paper, LEFT);
+        fprintf(file, ")'\\cdot (");
+        writeLatex(paper, RIGHT);
 
-    fprintf(file, ")-(");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")\\cdot(");
-    latexDumpSubtree(file, LEFT);
+        fprintf(file, ")-(");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")\\cdot(");
+        writeLatex(paper, LEFT);
 
-    fprintf(file, ")}{(");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")^2}$$\n\n");
+        fprintf(file, ")}{(");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")^2}$$\n\n");
+
+        endStep(paper);
+    }
 
     RETURN((dL * R - L * dR) / (R ^ NUM(2)));
 }
 
-ETNode* writeDerivativePow(FILE* file, ETNode* root)
+ETNode* writeDerivativePow(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_POW, MESSAGES_DERIVATIVE_POW_COUNT);
+    bool isConstPower = !hasVariable(RIGHT, 'x');
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=(");
-
-    if (!hasVariable(RIGHT, 'x'))
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_POW, MESSAGES_DERIVATIVE_POW_COUNT))
     {
-        latexDumpSubtree(file, RIGHT);
-        fprintf(file, ")\\cdot (");
-        latexDumpSubtree(file, LEFT);
-        fprintf(file, ")^{");
-        latexDumpSubtree(file, RIGHT);
-        fprintf(file, "-1}\\cdot (");
-        latexDumpSubtree(file, LEFT);
-        fprintf(file, ")'$$\n\n");
+        FILE* file = paper->file;
+
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=(");
 
-        RETURN(R * (L ^ (R - NUM(1))) * dL);
+        if (isConstPower)
+        {
+            writeLatex(paper, RIGHT);
+            fprintf(file, ")\\cdot (");
+            writeLatex(paper, LEFT);
+            fprintf(file, ")^{");
+            writeLatex(paper, RIGHT);
+            fprintf(file, "-1}\\cdot (");
+            writeLatex(paper, LEFT);
+            fprintf(file, ")'$$\n\n");
+        }
+        else
+        {
+            writeLatex(paper, LEFT);
+            fprintf(file, ")^{");
+            writeLatex(paper, RIGHT);
+            fprintf(file, "}\\cdot ((");
+            writeLatex(paper, RIGHT);
+            fprintf(file, ")'\\cdot \\log(");
+            writeLatex(paper, LEFT);
+            fprintf(file, ")+\\frac{(");
+            writeLatex(paper, RIGHT);
+            fprintf(file, ")\\cdot (");
+            writeLatex(paper, LEFT);
+            fprintf(file, ")'}{");
+            writeLatex(paper, LEFT);
+            fprintf(file, "})$$\n\n");
+        }
+
+        endStep(paper);
     }
 
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")^{");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, "}\\cdot ((");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'\\cdot \\log(");
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")+\\frac{(");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")\\cdot (");
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, ")'}{");
-    latexDumpSubtree(file, LEFT);
-    fprintf(file, "})$$\n\n");
+    if (isConstPower) { RETURN(R * (L ^ (R - NUM(1))) * dL); }
 
     RETURN((L ^ R) * (dR * LOG(L) + R * dL / L));
 }
 
-ETNode* writeDerivativeLog(FILE* file, ETNode* root)
+ETNode* writeDerivativeLog(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=\\frac{1}{");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=\\frac{1}{");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, "}\\cdot (");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        writeLatex(paper, RIGHT);
+        fprintf(file, "}\\cdot (");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
 
+        endStep(paper);
+    }
 
     RETURN((NUM(1) / R) * dR);
 }
 
-ETNode* writeDerivativeExp(FILE* file, ETNode* root)
+ETNode* writeDerivativeExp(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=e^{");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=e^{");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, "}\\cdot (");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        writeLatex(paper, RIGHT);
+        fprintf(file, "}\\cdot (");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
+
+        endStep(paper);
+    }
 
     RETURN(EXP(R) * dR);
 }
 
-ETNode* writeDerivativeSin(FILE* file, ETNode* root)
+ETNode* writeDerivativeSin(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
+
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT);
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=\\cos(");
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=\\cos(");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")\\cdot (");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")\\cdot (");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        endStep(paper);
+    }
 
     RETURN(COS(R) * dR);
 }
 
-ETNode* writeDerivativeCos(FILE* file, ETNode* root)
+ETNode* writeDerivativeCos(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=-1\\cdot \\sin(");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=-1\\cdot \\sin(");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")\\cdot (");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")\\cdot (");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
 
+        endStep(paper);
+    }
 
     RETURN(NUM(-1) * SIN(R) * dR);
 }
 
-ETNode* writeDerivativeTan(FILE* file, ETNode* root)
+ETNode* writeDerivativeTan(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    writeRandomMessage(file, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT);
+    if (beginStep(paper, root, MESSAGES_DERIVATIVE_UNR, MESSAGES_DERIVATIVE_UNR_COUNT))
+    {
+        FILE* file = paper->file;
 
-    fprintf(file, "$$(");
-    latexDumpSubtree(file, root);
-    fprintf(file, ")'=\\frac{1}{(\\cos(");
+        fprintf(file, "$$(");
+        writeLatex(paper, root);
+        fprintf(file, ")'=\\frac{1}{(\\cos(");
 
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, "))^2}\\cdot (");
-    latexDumpSubtree(file, RIGHT);
-    fprintf(file, ")'$$\n\n");
+        writeLatex(paper, RIGHT);
+        fprintf(file, "))^2}\\cdot (");
+        writeLatex(paper, RIGHT);
+        fprintf(file, ")'$$\n\n");
 
+        endStep(paper);
+    }
 
     RETURN((NUM(1) / (COS(R) ^ NUM(2))) * dR);
 }
 
-void writeResult(FILE* file, ETNode* root)
+//-----------------------------------------------------------------------------
+//! Writes the result with every repeated subexpression replaced by a letter,
+//! followed by the list of what the letters stand for.
+//-----------------------------------------------------------------------------
+void writeResult(Paper* paper, ETNode* root)
 {
-    assert(file != nullptr);
-    assert(root != nullptr);
+    assert(paper != nullptr);
+    assert(root  != nullptr);
 
-    Substitution substitutions[MAX_SUBSTITUTIONS] = {};
+    FILE* file = paper->file;
 
-    size_t substitutionsCount = 0;
-    makeSubstitutions(root, substitutions, &substitutionsCount);
+    LetExpr letExpr = {};
+    if (!eliminateCommonSubexprs(&letExpr, root, MIN_SUBSTITUTION_SIZE))
+    {
+        writeLatex(paper, root);
+        fprintf(file, "$$\n\n");
+        return;
+    }
     
-    latexDumpSubtree(file, root, substitutions, substitutionsCount);
+    writeLatex(paper, letExpr.result);
     fprintf(file, "$$\n\n");
     
-    if (substitutionsCount > 0) { fprintf(file, "Where:\n\n"); }
-    for (size_t i = 0; i < substitutionsCount; i++)
+    if (letExpr.bindingsCount > 0) { fprintf(file, "Where:\n\n"); }
+    for (size_t i = 0; i < letExpr.bindingsCount; i++)
     {
-        fprintf(file, "$$%c = ", substitutions[i].letter);
-        latexDumpSubtree(file, substitutions[i].root);
+        fprintf(file, "$$%c = ", letExpr.bindings[i].name);
+        writeLatex(paper, letExpr.bindings[i].value);
         fprintf(file, "$$\n\n");
     }
-}
-
-void makeSubstitutions(ETNode* node, Substitution* substitutions, size_t* substitutionsCount)
-{
-    assert(substitutions != nullptr);
-    assert(substitutionsCount != nullptr);
-
-    if (node == nullptr || (*substitutionsCount) >= MAX_SUBSTITUTIONS) { return; }
-    size_t size = 0;
-    treeSize(node, &size);
 
-    if (size >= MIN_SUBSTITUTION_SIZE && size <= MAX_SUBSTITUTION_SIZE && node->parent != nullptr)
-    {
-        substitutions[*substitutionsCount].root = node;
-        substitutions[*substitutionsCount].letter = 'A' + (*substitutionsCount);
-        (*substitutionsCount)++;
-        return;
-    }
-    makeSubstitutions(node->left, substitutions, substitutionsCount);
-    makeSubstitutions(node->right, substitutions, substitutionsCount);
+    destroy(&letExpr);
 }
 
 void simplifyNode(FILE* file, ETNode* node, NodeType newType, ETNodeData data)
@@ -584,32 +1119,39 @@ void simplifyNode(FILE* file, ETNode* node, ETNode* child)
     deleteNode(child);
 }
 
-#define SIMPLIFY(otherSide) if (isIdentityType(simplifyType))                                                     \
-                            {                                                                                     \
-                                writeRandomMessage(file, MESSAGES_SIMPLIFICATION, MESSAGES_SIMPLIFICATION_COUNT); \
-                                fprintf(file, "$$");                                                              \
-                                latexDumpSubtree(file, root);                                                     \
-                                fprintf(file, "=");                                                               \
-                                simplifyNode(file, root, root->otherSide);                                        \
-                                latexDumpSubtree(file, root);                                                     \
-                                fprintf(file, "$$\n\n");                                                          \
-                            }                                                                                     \
-                            else                                                                                  \
-                            {                                                                                     \
-                                writeRandomMessage(file, MESSAGES_SIMPLIFICATION, MESSAGES_SIMPLIFICATION_COUNT); \
-                                fprintf(file, "$$");                                                              \
-                                latexDumpSubtree(file, root);                                                     \
-                                fprintf(file, "=");                                                               \
-                                simplifyNode(file, root, TYPE_NUMBER, { simplifyType.result });                   \
-                                latexDumpSubtree(file, root);                                                     \
-                                fprintf(file, "$$\n\n");                                                          \
+#define SIMPLIFY(otherSide) {                                                                                 \
+                                bool isDetailed = beginSimplification(paper, root);                               \
+                                if (isDetailed)                                                                   \
+                                {                                                                                 \
+                                    fprintf(paper->file, "$$");                                                   \
+                                    writeLatex(paper, root);                                                      \
+                                    fprintf(paper->file, "=");                                                    \
+                                }                                                                                 \
+                                                                                                                  \
+                                if (isIdentityType(simplifyType))                                                 \
+                                {                                                                                 \
+                                    simplifyNode(paper->file, root, root->otherSide);                             \
+                                }                                                                                 \
+                                else                                                                              \
+                                {                                                                                 \
+                                    simplifyNode(paper->file, root, TYPE_NUMBER, { simplifyType.result });        \
+                                }                                                                                 \
+                                                                                                                  \
+                                if (isDetailed)                                                                   \
+                                {                                                                                 \
+                                    writeLatex(paper, root);                                                      \
+                                    fprintf(paper->file, "$$\n\n");                                               \
+                                    endStep(paper);                                                               \
+                                }                                                                                 \
                             }
 
-bool simplifyOps(FILE* file, ETNode* root)
+bool simplifyOps(Paper* paper, ETNode* root)
 {
     if (root == nullptr) { return false; }
 
-    bool isChanged = simplifyOps(file, root->left) || simplifyOps(file, root->right);
+    // both subtrees are simplified in one pass, so the passes don't grow with the tree
+    bool isChanged = simplifyOps(paper, root->left);
+    isChanged      = simplifyOps(paper, root->right) || isChanged;
 
     if (isTypeOp(root))
     {
@@ -658,13 +1200,24 @@ bool simplifyOps(FILE* file, ETNode* root)
 // just garbage value that has to not be equal to either +-1 or 0
 const double GARBAGE_VALUE_FOR_PRECALC = 22022002;
 
-#define SIMPLIFY(result) writeRandomMessage(file, MESSAGES_SIMPLIFICATION, MESSAGES_SIMPLIFICATION_COUNT); \
-                         fprintf(file, "$$");                                                              \
-                         latexDumpSubtree(file, root);                                                     \
-                         fprintf(file, "=");                                                               \
-                         simplifyNode(file, root, TYPE_NUMBER, {result});                                  \
-                         latexDumpSubtree(file, root);                                                     \
-                         fprintf(file, "$$\n\n");                                                          
+#define SIMPLIFY(result) {                                                                 \
+                             bool isDetailed = beginSimplification(paper, root);            \
+                             if (isDetailed)                                                \
+                             {                                                              \
+                                 fprintf(paper->file, "$$");                                \
+                                 writeLatex(paper, root);                                   \
+                                 fprintf(paper->file, "=");                                 \
+                             }                                                              \
+                                                                                            \
+                             simplifyNode(paper->file, root, TYPE_NUMBER, {result});        \
+                                                                                            \
+                             if (isDetailed)                                                \
+                             {                                                              \
+                                 writeLatex(paper, root);                                   \
+                                 fprintf(paper->file, "$$\n\n");                            \
+                                 endStep(paper);                                            \
+                             }                                                              \
+                         }
 
 //-----------------------------------------------------------------------------
 //! Precalculates all expressions with constants (e.g. '2+19' -> '21').
@@ -673,16 +1226,40 @@ const double GARBAGE_VALUE_FOR_PRECALC = 22022002;
 //!
 //! @return whether or not there have been any changes in the subtree.
 //-----------------------------------------------------------------------------
-bool precalcConstExprs(FILE* file, ETNode* root)
+bool precalcConstExprs(Paper* paper, ETNode* root)
+{
+    bool hasX = false;
+
+    return precalcConstExprs(paper, root, &hasX);
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in]  paper
+//! @param [in]  root
+//! @param [out] hasX   whether the subtree depends on x, it's found along the
+//!                     way, so the pass stays linear
+//-----------------------------------------------------------------------------
+bool precalcConstExprs(Paper* paper, ETNode* root, bool* hasX)
 {
+    assert(hasX != nullptr);
+
+    *hasX = false;
+
     if (root == nullptr) { return false; }
 
-    ETNode* left   = root->left;
-    ETNode* right  = root->right;
+    ETNode* left      = root->left;
+    ETNode* right     = root->right;
+
+    bool    leftHasX  = false;
+    bool    rightHasX = false;
+
+    // both subtrees are precalculated in one pass, so the passes don't grow with the tree
+    bool isChanged = precalcConstExprs(paper, root->left, &leftHasX);
+    isChanged      = precalcConstExprs(paper, root->right, &rightHasX) || isChanged;
 
-    bool isChanged = precalcConstExprs(file, root->left) || precalcConstExprs(file, root->right);
+    *hasX = leftHasX || rightHasX || (isTypeVar(root) && root->data.var == 'x');
 
-    if (!isTypeOp(root) || hasVariable(root, 'x')) { return isChanged; } 
+    if (!isTypeOp(root) || *hasX) { return isChanged; } 
 
 
     Operation operation = root->data.op;
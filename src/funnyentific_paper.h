@@ -1,3 +1,34 @@
 #include "expression_tree.h"
 
-void makeScientificPaper(ETNode* root);
\ No newline at end of file
+//-----------------------------------------------------------------------------
+//! @defgroup PAPER Scientific paper on differentiating an expression
+//!
+//! The steps are streamed to the file as they are taken. Only the first
+//! maxDetailedSteps steps are written, and in a step every subtree of more
+//! than maxInlineSize nodes, except the one being differentiated, is written
+//! as a placeholder \mathcal{E}_{k}, equal subtrees share one. A placeholder
+//! is defined in the step of its subtree, if the paper keeps that step, and
+//! is written as \ldots otherwise.
+//!
+//! The paper is cut after the last whole step that leaves room for the
+//! result section within maxBytes, the result is always written in full.
+//!
+//! Zeros mean no limit.
+//!
+//! @addtogroup PAPER
+//! @{
+
+struct PaperConfig
+{
+    size_t maxDetailedSteps = 0;
+    size_t maxInlineSize    = 0;
+    size_t maxBytes         = 0;
+};
+
+static const PaperConfig DEFAULT_PAPER_CONFIG = { 256, 48, 1 << 24 };
+
+//! @}
+//-----------------------------------------------------------------------------
+
+void makeScientificPaper(ETNode* root);
+bool makeScientificPaper(ETNode* root, const PaperConfig* config);
\ No newline at end of file
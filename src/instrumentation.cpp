@@ -0,0 +1,229 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include "expression_simplifier.h"
+#include "expression_writer.h"
+#include "instrumentation.h"
+
+struct PhaseStats
+{
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> time;
+    std::atomic<uint64_t> nodesIn;
+    std::atomic<uint64_t> nodesOut;
+    std::atomic<uint64_t> maxNodesOut;
+};
+
+struct Instrumentation
+{
+    PhaseStats            phases[PHASES_COUNT];
+    std::atomic<uint64_t> counters[COUNTERS_COUNT];
+    std::atomic<uint64_t> simplifyHits[SIMPLIFY_EXPRS_COUNT];
+
+    const RuleSet*         rules;
+    std::atomic<uint64_t>* ruleHits;
+};
+
+static Instrumentation   INSTRUMENTATION_STATS = {};
+static thread_local bool ACTIVE_PHASES[PHASES_COUNT] = {};
+
+static const char* SIMPLIFY_TARGET_NAMES[] = { "first", "second", "any", "equal" };
+
+//-----------------------------------------------------------------------------
+//! Nested timers of a phase that's already running on the thread do nothing.
+//-----------------------------------------------------------------------------
+PhaseTimer::PhaseTimer(InstrPhase phase)
+{
+    assert(phase < PHASES_COUNT);
+
+    if (ACTIVE_PHASES[phase]) { return; }
+
+    ACTIVE_PHASES[phase] = true;
+
+    this->phase     = phase;
+    this->startTime = getInstrTime();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (phase == PHASES_COUNT) { return; }
+
+    addPhaseTime(phase, getInstrTime() - startTime);
+
+    ACTIVE_PHASES[phase] = false;
+}
+
+//-----------------------------------------------------------------------------
+//! @return monotonic time in nanoseconds.
+//-----------------------------------------------------------------------------
+uint64_t getInstrTime()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+void addPhaseTime(InstrPhase phase, uint64_t time)
+{
+    assert(phase < PHASES_COUNT);
+
+    INSTRUMENTATION_STATS.phases[phase].calls.fetch_add(1,    std::memory_order_relaxed);
+    INSTRUMENTATION_STATS.phases[phase].time.fetch_add(time, std::memory_order_relaxed);
+}
+
+void addInstrCounter(InstrCounter counter, size_t value)
+{
+    assert(counter < COUNTERS_COUNT);
+
+    INSTRUMENTATION_STATS.counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+void addSimplifyHit(size_t index)
+{
+    assert(index < SIMPLIFY_EXPRS_COUNT);
+
+    INSTRUMENTATION_STATS.simplifyHits[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+//! Starts counting the hits of the rules from zero. The set has to outlive
+//! writeInstrumentation(), and can't be changed while the rules are applied.
+//!
+//! @return false if there isn't enough memory, the rules aren't counted then.
+//-----------------------------------------------------------------------------
+bool setInstrRules(const RuleSet* ruleSet)
+{
+    free(INSTRUMENTATION_STATS.ruleHits);
+
+    INSTRUMENTATION_STATS.rules    = nullptr;
+    INSTRUMENTATION_STATS.ruleHits = nullptr;
+
+    if (ruleSet == nullptr || ruleSet->rulesCount == 0) { return true; }
+
+    std::atomic<uint64_t>* ruleHits = (std::atomic<uint64_t>*) calloc(ruleSet->rulesCount, sizeof(std::atomic<uint64_t>));
+    if (ruleHits == nullptr) { return false; }
+
+    INSTRUMENTATION_STATS.rules    = ruleSet;
+    INSTRUMENTATION_STATS.ruleHits = ruleHits;
+
+    return true;
+}
+
+void addRuleHit(size_t index)
+{
+    if (INSTRUMENTATION_STATS.ruleHits == nullptr) { return; }
+
+    assert(index < INSTRUMENTATION_STATS.rules->rulesCount);
+
+    INSTRUMENTATION_STATS.ruleHits[index].fetch_add(1, std::memory_order_relaxed);
+}
+
+void addTreeSizes(InstrPhase phase, size_t sizeBefore, size_t sizeAfter)
+{
+    assert(phase < PHASES_COUNT);
+
+    PhaseStats* stats = &INSTRUMENTATION_STATS.phases[phase];
+
+    stats->nodesIn.fetch_add(sizeBefore, std::memory_order_relaxed);
+    stats->nodesOut.fetch_add(sizeAfter, std::memory_order_relaxed);
+
+    uint64_t maxSize = stats->maxNodesOut.load(std::memory_order_relaxed);
+    while (sizeAfter > maxSize && !stats->maxNodesOut.compare_exchange_weak(maxSize, sizeAfter)) {}
+}
+
+size_t instrTreeSize(const ETNode* root)
+{
+    size_t size = 0;
+    treeSize(root, &size);
+
+    return size;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether or not the program is built with the counters.
+//-----------------------------------------------------------------------------
+bool isInstrumented()
+{
+#ifdef INSTRUMENTATION
+    return true;
+#else
+    return false;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the phases, the counters, the hits of the simplifier's identities
+//! and of the rules as one JSON object followed by a newline, {"instrumented":false} if the program is
+//! built without them.
+//!
+//! @return false if the file can't be written.
+//-----------------------------------------------------------------------------
+bool writeInstrumentation(FILE* file)
+{
+    assert(file != nullptr);
+
+    if (!isInstrumented())
+    {
+        fprintf(file, "{\"instrumented\":false}\n");
+        return !ferror(file);
+    }
+
+    fprintf(file, "{\"instrumented\":true,\"phases\":{");
+
+    for (size_t i = 0; i < PHASES_COUNT; i++)
+    {
+        const PhaseStats* stats = &INSTRUMENTATION_STATS.phases[i];
+
+        fprintf(file, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.9f,"
+                      "\"nodesIn\":%llu,\"nodesOut\":%llu,\"maxNodesOut\":%llu}",
+                i == 0 ? "" : ",", INSTR_PHASE_NAMES[i],
+                (unsigned long long) stats->calls.load(),
+                (double) stats->time.load() / 1e9,
+                (unsigned long long) stats->nodesIn.load(),
+                (unsigned long long) stats->nodesOut.load(),
+                (unsigned long long) stats->maxNodesOut.load());
+    }
+
+    fprintf(file, "},\"counters\":{");
+
+    for (size_t i = 0; i < COUNTERS_COUNT; i++)
+    {
+        fprintf(file, "%s\"%s\":%llu", i == 0 ? "" : ",", INSTR_COUNTER_NAMES[i],
+                (unsigned long long) INSTRUMENTATION_STATS.counters[i].load());
+    }
+
+    fprintf(file, "},\"simplifyExprs\":[");
+
+    for (size_t i = 0; i < SIMPLIFY_EXPRS_COUNT; i++)
+    {
+        const SimplifyExpr* expr = &SIMPLIFY_EXPRS[i];
+
+        fprintf(file, "%s{\"operation\":\"%s\",\"target\":\"%s\",\"arg\":%.17g,\"result\":",
+                i == 0 ? "" : ",", OPERATIONS[expr->operation], SIMPLIFY_TARGET_NAMES[expr->target], expr->arg);
+
+        if (isIdentityType((*expr))) { fprintf(file, "\"identity\""); }
+        else                         { fprintf(file, "%.17g", expr->result); }
+
+        fprintf(file, ",\"hits\":%llu}", (unsigned long long) INSTRUMENTATION_STATS.simplifyHits[i].load());
+    }
+
+    fprintf(file, "],\"rules\":[");
+
+    const RuleSet* rules = INSTRUMENTATION_STATS.rules;
+
+    for (size_t i = 0; rules != nullptr && i < rules->rulesCount; i++)
+    {
+        fprintf(file, "%s{\"rule\":\"", i == 0 ? "" : ",");
+        writeExpression(file, rules->rules[i].pattern, EXPR_FORMAT_INFIX);
+        fprintf(file, " -> ");
+        writeExpression(file, rules->rules[i].replacement, EXPR_FORMAT_INFIX);
+        fprintf(file, "\",\"hits\":%llu}", (unsigned long long) INSTRUMENTATION_STATS.ruleHits[i].load());
+    }
+
+    fprintf(file, "]}\n");
+
+    return !ferror(file);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "expression_tree.h"
+#include "rewrite_rules.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup INSTRUMENTATION Phase timers and counters of the pipeline
+//!
+//! Built with -DINSTRUMENTATION, the INSTR_* macros time the phases with the
+//! monotonic clock and count the nodes, the simplifier's passes, hits of
+//! every SIMPLIFY_EXPRS entry and of every rule of the set passed to
+//! setSimplifyRules(), and the tree sizes going in and out of every phase.
+//! Without it they expand to nothing and their arguments aren't evaluated.
+//!
+//! A phase entered again while it's running on the same thread (recursion,
+//! simplifyTree() called from the paper) isn't counted twice, so the times
+//! are inclusive of the nested phases of other kinds only. Counters are
+//! shared by all the threads.
+//!
+//! writeInstrumentation() writes everything as a single JSON object.
+//!
+//! @addtogroup INSTRUMENTATION
+//! @{
+
+enum InstrPhase
+{
+    PHASE_LOAD,
+    PHASE_DIFFERENTIATE,
+    PHASE_SIMPLIFY,
+    PHASE_WRITE,
+    PHASE_RENDER,   //!< every pdflatex or dot job, they run in parallel
+
+    PHASES_COUNT
+};
+
+static const char* INSTR_PHASE_NAMES[PHASES_COUNT] = { "load", "differentiate", "simplify", "write", "render" };
+
+enum InstrCounter
+{
+    COUNTER_NODES_ALLOCATED,
+    COUNTER_NODES_FREED,
+    COUNTER_SIMPLIFY_PASSES,
+    COUNTER_CONSTANTS_FOLDED,
+    COUNTER_RULES_FIRED,
+
+    COUNTERS_COUNT
+};
+
+static const char* INSTR_COUNTER_NAMES[COUNTERS_COUNT] = { "nodesAllocated", "nodesFreed", "simplifyPasses",
+                                                           "constantsFolded", "rulesFired" };
+
+//! Times the rest of the scope as the phase.
+struct PhaseTimer
+{
+    InstrPhase phase     = PHASES_COUNT;
+    uint64_t   startTime = 0;
+
+    PhaseTimer(InstrPhase phase);
+    ~PhaseTimer();
+};
+
+#define INSTR_CONCAT_(first, second) first##second
+#define INSTR_CONCAT(first, second)  INSTR_CONCAT_(first, second)
+
+#ifdef INSTRUMENTATION
+
+#define INSTR_PHASE(phase)                     PhaseTimer INSTR_CONCAT(phaseTimer, __LINE__)(phase)
+#define INSTR_COUNT(counter, value)            addInstrCounter(counter, value)
+#define INSTR_SIMPLIFY_HIT(index)              addSimplifyHit(index)
+#define INSTR_RULES(ruleSet)                   setInstrRules(ruleSet)
+#define INSTR_RULE_HIT(index)                  addRuleHit(index)
+#define INSTR_TREE_SIZES(phase, before, after) addTreeSizes(phase, before, after)
+#define INSTR_START_TIME(time)                 ((time) = getInstrTime())
+#define INSTR_PHASE_TIME(phase, startTime)     addPhaseTime(phase, getInstrTime() - (startTime))
+
+#else
+
+#define INSTR_PHASE(phase)                     ((void) 0)
+#define INSTR_COUNT(counter, value)            ((void) 0)
+#define INSTR_SIMPLIFY_HIT(index)              ((void) 0)
+#define INSTR_RULES(ruleSet)                   ((void) 0)
+#define INSTR_RULE_HIT(index)                  ((void) 0)
+#define INSTR_TREE_SIZES(phase, before, after) ((void) 0)
+#define INSTR_START_TIME(time)                 ((void) 0)
+#define INSTR_PHASE_TIME(phase, startTime)     ((void) 0)
+
+#endif
+
+//! @}
+//-----------------------------------------------------------------------------
+
+uint64_t getInstrTime         ();
+void     addPhaseTime         (InstrPhase phase, uint64_t time);
+void     addInstrCounter      (InstrCounter counter, size_t value);
+void     addSimplifyHit       (size_t index);
+bool     setInstrRules        (const RuleSet* ruleSet);
+void     addRuleHit           (size_t index);
+void     addTreeSizes         (InstrPhase phase, size_t sizeBefore, size_t sizeAfter);
+size_t   instrTreeSize        (const ETNode* root);
+
+bool     isInstrumented       ();
+bool     writeInstrumentation (FILE* file);
@@ -0,0 +1,535 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <charconv>
+#include "async_log.h"
+#include "latex_renderer.h"
+#include "utilib.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+#define APPEND(literal) appendString(&renderer->output, literal, sizeof(literal) - 1)
+
+//! %lg precision, the output stays the same as with fprintf.
+static const int    LATEX_NUMBER_PRECISION  = 6;
+static const size_t LATEX_NUMBER_MAX_LENGTH = 64;
+
+bool skipFirstParentheses  (const ETNode* operationNode);
+bool skipSecondParentheses (const ETNode* operationNode);
+
+bool renderSubtree         (LatexRenderer* renderer, const ETNode* node, uint64_t* hash);
+bool renderNumber          (LatexRenderer* renderer, double number);
+bool renderVariable        (LatexRenderer* renderer, int variable);
+bool renderOperation       (LatexRenderer* renderer, Operation operation);
+bool renderSubstitution    (LatexRenderer* renderer, const ETNode* node, uint64_t hash, size_t start);
+bool renderElided          (LatexRenderer* renderer, const ETNode* node);
+
+LatexCacheKey    getCacheKey    (const ETNode* root);
+uint64_t         hashCountNodes (const ETNode* node, size_t* size);
+bool             isCacheEntry   (const LatexCacheEntry* entry, const LatexCacheKey* key, const ETNode* root);
+LatexCacheEntry* findCacheEntry (LatexRenderer* renderer, const LatexCacheKey* key, const ETNode* root);
+void             cacheRendered  (LatexRenderer* renderer, const LatexCacheKey* key, const ETNode* root, size_t offset);
+void             clearCache     (LatexRenderer* renderer);
+
+LatexRenderer* construct(LatexRenderer* renderer)
+{
+    assert(renderer != nullptr);
+
+    *renderer = {};
+
+    renderer->cache = (LatexCacheEntry*) calloc(LATEX_CACHE_SLOTS_COUNT, sizeof(LatexCacheEntry));
+    CHECK_NULL(renderer->cache, return nullptr);
+
+    if (construct(&renderer->output) == nullptr || construct(&renderer->cacheText) == nullptr)
+    {
+        destroy(renderer);
+        return nullptr;
+    }
+
+    return renderer;
+}
+
+void destroy(LatexRenderer* renderer)
+{
+    assert(renderer != nullptr);
+
+    if (renderer->cache != nullptr) { clearCache(renderer); }
+
+    destroy(&renderer->output);
+    destroy(&renderer->cacheText);
+    free(renderer->cache);
+    free(renderer->substitutions);
+
+    *renderer = {};
+}
+
+//-----------------------------------------------------------------------------
+//! Puts the substitutions into the renderer's hash table, they have to stay
+//! alive while they are set. Later substitutions of equal subtrees win.
+//!
+//! @param [out] renderer
+//! @param [in]  substitutions       nullptr to render trees as they are
+//! @param [in]  substitutionsCount
+//!
+//! @return false if there isn't enough memory, no substitutions are set then.
+//-----------------------------------------------------------------------------
+bool setSubstitutions(LatexRenderer* renderer, const Substitution* substitutions, size_t substitutionsCount)
+{
+    assert(renderer != nullptr);
+
+    renderer->substitutionsCount = 0;
+
+    if (substitutions == nullptr || substitutionsCount == 0) { return true; }
+
+    size_t slotsCount = 16;
+    while (slotsCount < 2 * substitutionsCount) { slotsCount *= 2; }
+
+    if (slotsCount > renderer->slotsCount)
+    {
+        SubstitutionSlot* slots = (SubstitutionSlot*) calloc(slotsCount, sizeof(SubstitutionSlot));
+        CHECK_NULL(slots, return false);
+
+        free(renderer->substitutions);
+
+        renderer->substitutions = slots;
+        renderer->slotsCount    = slotsCount;
+    }
+    else
+    {
+        slotsCount = renderer->slotsCount;
+        for (size_t i = 0; i < slotsCount; i++) { renderer->substitutions[i] = {}; }
+    }
+
+    for (size_t i = 0; i < substitutionsCount; i++)
+    {
+        uint64_t hash = hashSubtree(substitutions[i].root);
+        size_t   slot = (size_t) hash & (slotsCount - 1);
+
+        while (renderer->substitutions[slot].substitution != nullptr &&
+               !(renderer->substitutions[slot].hash == hash &&
+                 areTreesEqual(renderer->substitutions[slot].substitution->root, substitutions[i].root)))
+        {
+            slot = (slot + 1) & (slotsCount - 1);
+        }
+
+        renderer->substitutions[slot] = { hash, &substitutions[i] };
+    }
+
+    renderer->substitutionsCount = substitutionsCount;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [out] renderer
+//! @param [in]  maxInlineSize  0 to render trees in full
+//! @param [in]  placeholderId
+//! @param [in]  arg            passed to placeholderId
+//-----------------------------------------------------------------------------
+void setElision(LatexRenderer* renderer, size_t maxInlineSize, PlaceholderId placeholderId, void* arg)
+{
+    assert(renderer != nullptr);
+    assert(maxInlineSize == 0 || placeholderId != nullptr);
+
+    renderer->maxInlineSize  = maxInlineSize;
+    renderer->expandedNode   = nullptr;
+    renderer->placeholderId  = placeholderId;
+    renderer->placeholderArg = arg;
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the tree to the output.
+//!
+//! @return false if there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool renderLatex(LatexRenderer* renderer, const ETNode* root)
+{
+    assert(renderer != nullptr);
+
+    if (root == nullptr) { return true; }
+
+    if (renderer->maxInlineSize != 0) { return renderSubtree(renderer, root, nullptr); }
+
+    if (renderer->substitutionsCount != 0)
+    {
+        uint64_t hash = 0;
+        return renderSubtree(renderer, root, &hash);
+    }
+
+    if (renderer->cache == nullptr) { return renderSubtree(renderer, root, nullptr); }
+
+    LatexCacheKey    key   = getCacheKey(root);
+    LatexCacheEntry* entry = findCacheEntry(renderer, &key, root);
+
+    if (entry->length != 0)
+    {
+        return appendString(&renderer->output, getString(&renderer->cacheText) + entry->offset, entry->length);
+    }
+
+    size_t offset = renderer->output.length;
+
+    if (!renderSubtree(renderer, root, nullptr)) { return false; }
+
+    cacheRendered(renderer, &key, root, offset);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the output to the file and empties it.
+//!
+//! @return false if the write fails.
+//-----------------------------------------------------------------------------
+bool flushLatex(LatexRenderer* renderer, FILE* file)
+{
+    assert(renderer != nullptr);
+    assert(file     != nullptr);
+
+    size_t length    = renderer->output.length;
+    bool   isWritten = length == 0 || fwrite(getString(&renderer->output), sizeof(char), length, file) == length;
+
+    clear(&renderer->output);
+
+    return isWritten;
+}
+
+LatexCacheKey getCacheKey(const ETNode* root)
+{
+    assert(root != nullptr);
+
+    LatexCacheKey key = {};
+    key.hash = hashCountNodes(root, &key.size);
+
+    return key;
+}
+
+//! hashSubtree() that counts the nodes on the same walk.
+uint64_t hashCountNodes(const ETNode* node, size_t* size)
+{
+    assert(size != nullptr);
+
+    if (node == nullptr) { return 0; }
+
+    (*size)++;
+
+    uint64_t leftHash  = hashCountNodes(node->left,  size);
+    uint64_t rightHash = hashCountNodes(node->right, size);
+
+    return hashNode(node, leftHash, rightHash);
+}
+
+bool isCacheEntry(const LatexCacheEntry* entry, const LatexCacheKey* key, const ETNode* root)
+{
+    assert(entry != nullptr);
+    assert(key   != nullptr);
+    assert(root  != nullptr);
+
+    return entry->key.hash == key->hash && entry->key.size == key->size &&
+           areTreesEqual(entry->tree, (ETNode*) root);
+}
+
+//-----------------------------------------------------------------------------
+//! @return the entry of the tree or the empty entry where it would go.
+//-----------------------------------------------------------------------------
+LatexCacheEntry* findCacheEntry(LatexRenderer* renderer, const LatexCacheKey* key, const ETNode* root)
+{
+    assert(renderer        != nullptr);
+    assert(renderer->cache != nullptr);
+    assert(key             != nullptr);
+
+    size_t slot = (size_t) key->hash & (LATEX_CACHE_SLOTS_COUNT - 1);
+
+    while (renderer->cache[slot].length != 0 && !isCacheEntry(&renderer->cache[slot], key, root))
+    {
+        slot = (slot + 1) & (LATEX_CACHE_SLOTS_COUNT - 1);
+    }
+
+    return &renderer->cache[slot];
+}
+
+//-----------------------------------------------------------------------------
+//! Copies the text rendered from the offset of the output and the tree into
+//! the cache. A full cache is emptied first, failing to cache isn't an error.
+//-----------------------------------------------------------------------------
+void cacheRendered(LatexRenderer* renderer, const LatexCacheKey* key, const ETNode* root, size_t offset)
+{
+    assert(renderer != nullptr);
+    assert(key      != nullptr);
+    assert(root     != nullptr);
+
+    size_t length = renderer->output.length - offset;
+
+    if (length < LATEX_CACHE_MIN_LENGTH || length > LATEX_CACHE_MAX_TEXT || key->size > LATEX_CACHE_MAX_NODES)
+    {
+        return;
+    }
+
+    if (2 * (renderer->cacheCount + 1) > LATEX_CACHE_SLOTS_COUNT ||
+        renderer->cacheText.length + length > LATEX_CACHE_MAX_TEXT ||
+        renderer->cacheNodes + key->size > LATEX_CACHE_MAX_NODES)
+    {
+        clearCache(renderer);
+    }
+
+    size_t  textOffset = renderer->cacheText.length;
+    ETNode* tree       = copyTree(root);
+    CHECK_NULL(tree, return);
+
+    if (!appendString(&renderer->cacheText, getString(&renderer->output) + offset, length))
+    {
+        destroySubtree(tree);
+        return;
+    }
+
+    *findCacheEntry(renderer, key, root) = { *key, tree, textOffset, length };
+    renderer->cacheCount++;
+    renderer->cacheNodes += key->size;
+}
+
+void clearCache(LatexRenderer* renderer)
+{
+    assert(renderer        != nullptr);
+    assert(renderer->cache != nullptr);
+
+    for (size_t i = 0; i < LATEX_CACHE_SLOTS_COUNT; i++)
+    {
+        destroySubtree(renderer->cache[i].tree);
+        renderer->cache[i] = {};
+    }
+
+    clear(&renderer->cacheText);
+
+    renderer->cacheCount = 0;
+    renderer->cacheNodes = 0;
+}
+
+#define IS_ADD         op == OP_ADD
+#define IS_SUB         op == OP_SUB
+#define IS_MUL         op == OP_MUL
+#define IS_DIV         op == OP_DIV
+#define IS_POW         op == OP_POW
+#define IS_EXP         op == OP_EXP
+#define IS_ADD_SUB_MUL (op == OP_ADD || op == OP_SUB || op == OP_MUL)
+
+bool skipFirstParentheses(const ETNode* operationNode)
+{
+    assert(operationNode       != nullptr);
+    assert(operationNode->type == TYPE_OP);
+    assert(operationNode->left != nullptr);
+
+    Operation op = operationNode->data.op;
+
+    if (IS_MUL && isTypeNumber(operationNode->left) && dcompare(operationNode->left->data.number, 0) < 0) { return false; }
+    if (IS_MUL || isTypeOp(operationNode->left) && operationNode->left->data.op == OP_DIV)                { return true; }
+
+    return !isTypeOp(operationNode->left) || IS_ADD || IS_SUB;
+}
+
+bool skipSecondParentheses(const ETNode* operationNode)
+{
+    assert(operationNode        != nullptr);
+    assert(operationNode->type  == TYPE_OP);
+    assert(operationNode->right != nullptr);
+
+    Operation op = operationNode->data.op;
+
+    if ((IS_ADD || IS_SUB) && isTypeOp(operationNode->right))                                                { return true; }
+    if (IS_MUL)                                                                                              { return true; }
+    if (IS_ADD_SUB_MUL && isTypeOp(operationNode->right) && isOperationUnary(operationNode->right->data.op)) { return true; }
+    if (isTypeOp(operationNode->right) && operationNode->right->data.op == OP_DIV)                           { return true; }
+
+    return !isTypeOp(operationNode->right) || IS_POW || IS_EXP;
+}
+
+#undef IS_ADD
+#undef IS_SUB
+#undef IS_MUL
+#undef IS_DIV
+#undef IS_POW
+#undef IS_EXP
+#undef IS_ADD_SUB_MUL
+
+//-----------------------------------------------------------------------------
+//! @param [in,out] renderer
+//! @param [in]     node
+//! @param [out]    hash      structural hash of the subtree, it's computed only
+//!                           if the pointer isn't nullptr
+//-----------------------------------------------------------------------------
+bool renderSubtree(LatexRenderer* renderer, const ETNode* node, uint64_t* hash)
+{
+    assert(renderer != nullptr);
+
+    if (node == nullptr)
+    {
+        if (hash != nullptr) { *hash = 0; }
+        return true;
+    }
+
+    if (renderer->maxInlineSize != 0 && !renderer->isInlining && node != renderer->expandedNode)
+    {
+        return renderElided(renderer, node);
+    }
+
+    uint64_t  leftHash      = 0;
+    uint64_t  rightHash     = 0;
+    uint64_t* leftHashPtr   = hash != nullptr ? &leftHash  : nullptr;
+    uint64_t* rightHashPtr  = hash != nullptr ? &rightHash : nullptr;
+    size_t    start         = renderer->output.length;
+    bool      isOk          = true;
+
+    if (node->type == TYPE_OP && node->data.op == OP_DIV)
+    {
+        isOk = APPEND("\\frac{") && renderSubtree(renderer, node->left,  leftHashPtr)  &&
+               APPEND("}{")      && renderSubtree(renderer, node->right, rightHashPtr) &&
+               APPEND("}");
+    }
+    else if (node->type == TYPE_OP)
+    {
+        if (!isOperationUnary(node->data.op))
+        {
+            bool skipFirst = skipFirstParentheses(node);
+
+            isOk = APPEND("{") && (skipFirst || APPEND("(")) &&
+                   renderSubtree(renderer, node->left, leftHashPtr) &&
+                   (skipFirst || APPEND(")")) && APPEND("} ");
+        }
+
+        bool skipSecond = skipSecondParentheses(node);
+
+        isOk = isOk && renderOperation(renderer, node->data.op) &&
+               APPEND("{") && (skipSecond || APPEND("(")) &&
+               renderSubtree(renderer, node->right, rightHashPtr) &&
+               (skipSecond || APPEND(")")) && APPEND("}");
+    }
+    else if (node->type == TYPE_NUMBER)
+    {
+        isOk = renderNumber(renderer, node->data.number);
+    }
+    else if (node->type == TYPE_VAR)
+    {
+        isOk = renderVariable(renderer, node->data.var);
+    }
+    else
+    {
+        isOk = APPEND("ERROR: invalid node type");
+    }
+
+    if (!isOk || hash == nullptr) { return isOk; }
+
+    *hash = hashNode(node, leftHash, rightHash);
+
+    return renderSubstitution(renderer, node, *hash, start);
+}
+
+bool renderNumber(LatexRenderer* renderer, double number)
+{
+    assert(renderer != nullptr);
+
+    const char* constant = getConstantName(number);
+
+    if (constant != nullptr)
+    {
+        size_t constantLength = strlen(constant);
+
+        return (constantLength == 1 || APPEND("\\")) &&
+               appendString(&renderer->output, constant, constantLength);
+    }
+
+    char                 digits[LATEX_NUMBER_MAX_LENGTH] = {};
+    std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), number,
+                                                std::chars_format::general, LATEX_NUMBER_PRECISION);
+
+    return appendString(&renderer->output, digits, result.ptr - digits);
+}
+
+//! Names longer than a letter would read as a product of letters in math mode.
+bool renderVariable(LatexRenderer* renderer, int variable)
+{
+    assert(renderer != nullptr);
+
+    if (variable < SINGLE_LETTER_VARIABLES_COUNT) { return appendChar(&renderer->output, (char) variable); }
+
+    return APPEND("\\mathit{") && appendString(&renderer->output, getVariableName(variable)) && APPEND("}");
+}
+
+bool renderOperation(LatexRenderer* renderer, Operation operation)
+{
+    assert(renderer != nullptr);
+
+    switch (operation)
+    {
+        case OP_ADD: return APPEND(" + ");
+        case OP_SUB: return APPEND(" - ");
+        case OP_MUL: return APPEND(" \\cdot ");
+        case OP_POW: return APPEND(" ^ ");
+        case OP_LOG: return APPEND(" \\ln");
+        case OP_EXP: return APPEND("{e}^");
+        case OP_SIN: return APPEND("\\sin");
+        case OP_COS: return APPEND("\\cos");
+        case OP_TAN: return APPEND("\\tan");
+
+        case OP_DIV:
+        case OP_INVALID:
+        case OPERATIONS_COUNT:
+        default:     return true;
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Replaces the text of the subtree rendered from the offset start with the
+//! letter of its substitution, if it has one.
+//-----------------------------------------------------------------------------
+bool renderSubstitution(LatexRenderer* renderer, const ETNode* node, uint64_t hash, size_t start)
+{
+    assert(renderer != nullptr);
+    assert(node     != nullptr);
+
+    size_t slot = (size_t) hash & (renderer->slotsCount - 1);
+
+    for (; renderer->substitutions[slot].substitution != nullptr; slot = (slot + 1) & (renderer->slotsCount - 1))
+    {
+        const Substitution* substitution = renderer->substitutions[slot].substitution;
+
+        if (renderer->substitutions[slot].hash != hash) { continue; }
+
+        if (substitution->root != node && !areTreesEqual((ETNode*) node, substitution->root)) { continue; }
+
+        if (renderer->isTracing)
+        {
+            LOG_DEBUG("LaTeX: subtree %p is substituted with '%c'.", (const void*) node, substitution->letter);
+        }
+
+        truncate(&renderer->output, start);
+
+        return appendChar(&renderer->output, substitution->letter);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Renders a small subtree in full and a large one as its placeholder.
+//-----------------------------------------------------------------------------
+bool renderElided(LatexRenderer* renderer, const ETNode* node)
+{
+    assert(renderer != nullptr);
+    assert(node     != nullptr);
+
+    if (!isTreeLarger(node, renderer->maxInlineSize))
+    {
+        renderer->isInlining = true;
+        bool isOk = renderSubtree(renderer, node, nullptr);
+        renderer->isInlining = false;
+
+        return isOk;
+    }
+
+    char   digits[LATEX_NUMBER_MAX_LENGTH] = {};
+    size_t id                              = renderer->placeholderId(node, renderer->placeholderArg);
+
+    std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), id);
+
+    return APPEND("\\mathcal{E}_{") && appendString(&renderer->output, digits, result.ptr - digits) && APPEND("}");
+}
+
+#undef APPEND
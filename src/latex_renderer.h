@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "expression_tree.h"
+#include "string_builder.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup LATEX_RENDERER LaTeX rendering of expression trees
+//!
+//! Trees are rendered into an in-memory buffer with plain appends, numbers
+//! are formatted with std::to_chars, and the buffer is written out with a
+//! single fwrite by flushLatex().
+//!
+//! The text of every tree passed to renderLatex() is cached by its
+//! structural hash, so rendering the same or an equal tree again is a copy.
+//! The cache keeps a copy of every tree it has the text of, and a hit has to
+//! be equal to it, so a hash collision of different trees is just a miss.
+//!
+//! With substitutions set, a subtree equal to one of theirs (not necessarily
+//! the same node) is rendered as its letter and the cache is bypassed. The
+//! substitutions are kept in a hash table by structural hash, the hashes of
+//! rendered subtrees are computed bottom-up along the way, so a lookup per
+//! node is O(1). Substituted subtrees are traced with LOG_DEBUG() if
+//! isTracing is set.
+//!
+//! With maxInlineSize set, every subtree of more nodes than that, except
+//! expandedNode, is rendered as a placeholder \mathcal{E}_{id} with the id
+//! given by placeholderId, so the text stays small however big the tree is.
+//! The cache and the substitutions aren't used then.
+//!
+//! @addtogroup LATEX_RENDERER
+//! @{
+
+//! Size is checked before the trees are compared on a hit.
+struct LatexCacheKey
+{
+    uint64_t hash = 0;
+    size_t   size = 0;
+};
+
+struct LatexCacheEntry
+{
+    LatexCacheKey key    = {};
+    ETNode*       tree   = nullptr;
+    size_t        offset = 0;
+    size_t        length = 0;
+};
+
+struct SubstitutionSlot
+{
+    uint64_t            hash         = 0;
+    const Substitution* substitution = nullptr;
+};
+
+typedef size_t (*PlaceholderId)(const ETNode* node, void* arg);
+
+struct LatexRenderer
+{
+    StringBuilder       output             = {};
+    bool                isTracing          = false;
+
+    SubstitutionSlot*   substitutions      = nullptr;
+    size_t              substitutionsCount = 0;
+    size_t              slotsCount         = 0;
+
+    LatexCacheEntry*    cache              = nullptr;
+    size_t              cacheCount         = 0;
+    size_t              cacheNodes         = 0;
+    StringBuilder       cacheText          = {};
+
+    size_t              maxInlineSize      = 0;
+    const ETNode*       expandedNode       = nullptr;
+    PlaceholderId       placeholderId      = nullptr;
+    void*               placeholderArg     = nullptr;
+    bool                isInlining         = false;
+};
+
+//! The cache is dropped as a whole once it has this many entries, bytes or
+//! nodes of the trees kept.
+static const size_t LATEX_CACHE_SLOTS_COUNT = 1024;
+static const size_t LATEX_CACHE_MAX_TEXT    = 1 << 22;
+static const size_t LATEX_CACHE_MAX_NODES   = 1 << 18;
+
+//! Shorter texts are cheaper to render than to look up.
+static const size_t LATEX_CACHE_MIN_LENGTH  = 32;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+LatexRenderer* construct        (LatexRenderer* renderer);
+void           destroy          (LatexRenderer* renderer);
+
+bool           setSubstitutions (LatexRenderer* renderer, const Substitution* substitutions, size_t substitutionsCount);
+void           setElision       (LatexRenderer* renderer, size_t maxInlineSize, PlaceholderId placeholderId, void* arg);
+bool           renderLatex      (LatexRenderer* renderer, const ETNode* root);
+bool           flushLatex       (LatexRenderer* renderer, FILE* file);
@@ -15,25 +15,211 @@
 #define UTB_DEFINITIONS
 #include "utilib.h"
 #include "../libs/log_generator.h"
+#include "async_log.h"
 #include "expression_tree.h"
 #include "expression_loader.h"
 #include "expression_simplifier.h"
 #include "differentiation.h"
 #include "taylor_expansion.h"
 #include "funnyentific_paper.h"
+#include "instrumentation.h"
+#include "perf_counters.h"
+#include "render_queue.h"
+#include "batch_loader.h"
+#include "expression_writer.h"
+#include "thread_pool.h"
+#include "batch_runner.h"
+#include "expression_server.h"
+#include "result_cache.h"
+
+static const char* USAGE =
+    "usage: %s <file> [--no-render] [--format=<name> [--profile[=<file>]]] [--stats[=<file>]]\n"
+    "       %s --batch [--op=<operation>] [--format=<name>] [--threads=<n>] [--point=<x>]\n"
+    "          [--order=<n>] [--profile[=<file>]] [--stats[=<file>]] [<file or directory> | -]...\n"
+    "       %s --serve[=<socket>] [--threads=<n>] [--stats[=<file>]]\n"
+    "       --batch and --serve take [--cache-size=<MiB>] [--cache-file=<file>] too\n"
+    "       any of them takes [--rules=<file>]\n";
+
+//! Writes .tex and .dot files without rendering them.
+static const char* NO_RENDER_OPTION = "--no-render";
+
+//! --format=<name> prints the derivative of every line of the input to the
+//! standard output, one per line, instead of writing the paper.
+static const char* FORMAT_OPTION    = "--format=";
+
+//! --stats writes the phase timings and the counters as JSON to stderr at the
+//! exit, --stats=<file> to the file. They are only collected in the builds
+//! with -DINSTRUMENTATION.
+static const char* STATS_OPTION     = "--stats";
+
+//! --profile, with --format or --batch, measures every stage of every
+//! expression with the hardware counters and writes a JSON line per
+//! expression and one with the totals to stderr, --profile=<file> to the
+//! file. With --format the expressions are parsed on the main thread then,
+//! with --batch every worker measures its own lines (see runBatch()).
+static const char* PROFILE_OPTION   = "--profile";
+
+//! --batch runs an operation on every line of all the inputs on a thread
+//! pool, see runBatch(). The standard input is read if there are no inputs.
+static const char* BATCH_OPTION     = "--batch";
+static const char* OPERATION_OPTION = "--op=";
+static const char* THREADS_OPTION   = "--threads=";
+static const char* POINT_OPTION     = "--point=";
+static const char* ORDER_OPTION     = "--order=";
+
+//! --serve answers requests on the standard input and output, see
+//! runServer(), --serve=<socket> on a Unix domain socket. --threads= sets
+//! the workers.
+static const char* SERVE_OPTION     = "--serve";
+
+//! --cache-size=<MiB> keeps the results of the batch and the server in
+//! memory, --cache-file=<file> on the disk too, see openResultCache().
+static const char* CACHE_SIZE_OPTION = "--cache-size=";
+static const char* CACHE_FILE_OPTION = "--cache-file=";
+
+//! --rules=<file> simplifies with the rules of the file instead of the ones
+//! next to the executable, see getDefaultRulesPath(). Unlike the default
+//! rules, the file has to load.
+static const char* RULES_OPTION      = "--rules=";
+
+struct Options
+{
+    bool         isBatch      = false;
+    bool         isRendering  = true;
+    ExprFormat   format       = EXPR_FORMAT_INVALID;
+    BatchConfig  batch        = {};
+    const char*  statsFile    = nullptr;
+    const char*  profileFile  = nullptr;
+    const char*  serveSocket  = nullptr;
+
+    bool         isCaching    = false;
+    size_t       cacheSize    = CACHE_DEFAULT_MEMORY_BUDGET >> 20;
+    const char*  cacheFile    = nullptr;
+
+    const char*  rulesFile    = nullptr;
+
+    const char** inputs       = nullptr;
+    size_t       inputsCount  = 0;
+};
+
+bool        parseOptions      (Options* options, int argc, char* argv[]);
+bool        parseOption       (Options* options, const char* arg);
+const char* getFileOption     (const char* arg, const char* option);
+const char* getValueOption    (const char* arg, const char* option);
+bool        writeDerivatives  (const char* filename, ExprFormat format);
+bool        profileDerivatives(const char* filename, ExprFormat format, const char* profileFile);
+FILE*       openProfile       (const char* profileFile);
+void        closeProfile      (FILE* report);
+bool        writeStats        (const char* filename);
+void        openCache         (const Options* options, const RuleSet* rules);
 
 int main(int argc, char* argv[])
 {
+    Options options = {};
+    options.inputs  = (const char**) calloc((size_t) argc, sizeof(const char*));
+
+    if (options.inputs == nullptr || !parseOptions(&options, argc, argv))
+    {
+        fprintf(stderr, USAGE, argv[0], argv[0], argv[0]);
+        free(options.inputs);
+
+        return -1;
+    }
+
     LG_Init();
+    startLog(LOG_SINK_HTML, nullptr);
+
+    RuleSet rules = {};
+    construct(&rules);
+
+    char        defaultRules[RULES_MAX_PATH_LENGTH] = {};
+    const char* rulesFile = options.rulesFile;
+
+    if (rulesFile == nullptr && getDefaultRulesPath(defaultRules, sizeof(defaultRules))) { rulesFile = defaultRules; }
+
+    if (rulesFile != nullptr && loadRules(&rules, rulesFile))
+    {
+        setSimplifyRules(&rules);
+    }
+    else if (options.rulesFile != nullptr)
+    {
+        logMessage("Unable to load simplification rules from '%s'.", LG_STYLE_CLASS_ERROR, options.rulesFile);
+
+        free(options.inputs);
+        destroy(&rules);
+        stopLog();
+        LG_Close();
+
+        return -1;
+    }
+    else
+    {
+        logMessage("Unable to load simplification rules from '%s', using the built-in ones.",
+                   LG_STYLE_CLASS_ERROR, rulesFile == nullptr ? DEFAULT_RULES_FILE_NAME : rulesFile);
+    }
+
+    const char* filename = options.inputs[0];
+
+    if (options.isBatch || options.serveSocket != nullptr || options.format != EXPR_FORMAT_INVALID)
+    {
+        bool isWritten = false;
+
+        if (options.isCaching) { openCache(&options, &rules); }
+
+        if (options.serveSocket != nullptr)
+        {
+            ServerConfig config = {};
+            config.socketPath   = *options.serveSocket == '\0' ? nullptr : options.serveSocket;
+            config.threadsCount = options.batch.threadsCount;
+
+            isWritten = runServer(&config);
+        }
+        else if (options.isBatch)
+        {
+            options.batch.profile = options.profileFile != nullptr ? openProfile(options.profileFile) : nullptr;
+
+            if (options.profileFile == nullptr || options.batch.profile != nullptr)
+            {
+                isWritten = runBatch(&options.batch, options.inputs, options.inputsCount, stdout);
+            }
+
+            closeProfile(options.batch.profile);
+        }
+        else if (options.profileFile != nullptr)
+        {
+            isWritten = profileDerivatives(filename, options.format, options.profileFile);
+        }
+        else
+        {
+            isWritten = writeDerivatives(filename, options.format);
+        }
+
+        if (options.statsFile != nullptr) { writeStats(options.statsFile); }
+
+        closeResultCache();
+        free(options.inputs);
+        destroy(&rules);
+        stopLog();
+        LG_Close();
+
+        return isWritten ? 0 : -1;
+    }
+
+    RenderQueue renderQueue = {};
+    if (construct(&renderQueue, 0, options.isRendering) != nullptr) { setRenderQueue(&renderQueue); }
 
     ExprTree exprTree = {};
     construct(&exprTree);
 
-    if (!loadExpression(&exprTree, argv[1])) 
+    if (!loadExpression(&exprTree, filename)) 
     { 
-        LG_LogMessage("loadExpression() returned false.", LG_STYLE_CLASS_ERROR);
+        logMessage("loadExpression() returned false.", LG_STYLE_CLASS_ERROR);
 
+        free(options.inputs);
         destroy(&exprTree);
+        destroy(&rules);
+        destroy(&renderQueue);
+        stopLog();
         LG_Close();
 
         return -1; 
@@ -62,8 +248,416 @@ int main(int argc, char* argv[])
     // destroy(&expansion);
     // destroy(&derivTree);
     destroy(&exprTree);
+    destroy(&rules);
+
+    // waits for the renders still running
+    destroy(&renderQueue);
+
+    if (options.statsFile != nullptr) { writeStats(options.statsFile); }
+
+    free(options.inputs);
 
+    stopLog();
     LG_Close();
 
     return 0;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the simplified derivative of every expression of the file in the
+//! format. A line that doesn't parse gets an empty line, so the output lines
+//! match the expressions.
+//-----------------------------------------------------------------------------
+bool writeDerivatives(const char* filename, ExprFormat format)
+{
+    assert(filename != nullptr);
+
+    BatchResult batch = {};
+
+    if (!loadExpressionBatch(&batch, filename, defaultThreadsCount()))
+    {
+        logMessage("Unable to load expressions from '%s'.", LG_STYLE_CLASS_ERROR, filename);
+        return false;
+    }
+
+    if (batch.errorsCount > 0)
+    {
+        logMessage("%zu expressions of '%s' can't be parsed.", LG_STYLE_CLASS_ERROR, batch.errorsCount, filename);
+    }
+
+    bool isWritten = true;
+
+    for (size_t i = 0; i < batch.linesCount && isWritten; i++)
+    {
+        if (batch.lines[i].status == PARSE_NO_ERROR)
+        {
+            ETNode* derivative = differentiate(batch.lines[i].root);
+            simplifyTree(derivative);
+
+            isWritten = writeExpression(stdout, derivative, format);
+
+            destroySubtree(derivative);
+        }
+
+        isWritten = isWritten && putchar('\n') != EOF;
+    }
+
+    destroy(&batch);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! Same output as writeDerivatives(), the file is read and parsed a line at a
+//! time so every stage of every expression can be measured on its own.
+//-----------------------------------------------------------------------------
+bool profileDerivatives(const char* filename, ExprFormat format, const char* profileFile)
+{
+    assert(filename    != nullptr);
+    assert(profileFile != nullptr);
+
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr)
+    {
+        logMessage("Unable to open file '%s'.", LG_STYLE_CLASS_ERROR, filename);
+        return false;
+    }
+
+    FILE* report = openProfile(profileFile);
+    if (report == nullptr)
+    {
+        fclose(file);
+        return false;
+    }
+
+    PerfCounters counters = {};
+    construct(&counters);
+
+    StringBuilder errors = {};
+    construct(&errors);
+
+    Profile total     = {};
+    char*   line      = nullptr;
+    size_t  capacity  = 0;
+    ssize_t length    = 0;
+    size_t  lineIndex = 0;
+    bool    isWritten = true;
+
+    while (isWritten && (length = getline(&line, &capacity, file)) != -1)
+    {
+        if (length > 0 && line[length - 1] == '\n') { length--; }
+
+        Profile profile = {};
+        ExprTree tree   = {};
+
+        clear(&errors);
+        startStage(&counters);
+
+        ParseError status = parseExpression(&tree, line, (size_t) length, &errors);
+        endStage(&counters, &profile.stages[STAGE_PARSE]);
+
+        if (status == PARSE_NO_ERROR)
+        {
+            ETNode* derivative = differentiate(tree.root);
+            endStage(&counters, &profile.stages[STAGE_DIFFERENTIATE]);
+
+            simplifyTree(derivative);
+            endStage(&counters, &profile.stages[STAGE_SIMPLIFY]);
+
+            isWritten = writeExpression(stdout, derivative, format);
+            endStage(&counters, &profile.stages[STAGE_EMIT]);
+
+            destroySubtree(derivative);
+            destroySubtree(tree.root);
+        }
+
+        isWritten = isWritten && putchar('\n') != EOF;
+
+        fprintf(report, "{\"line\":%zu,\"stages\":", ++lineIndex);
+        writeProfile(report, &counters, &profile);
+        fprintf(report, "}\n");
+
+        addProfile(&total, &profile);
+    }
+
+    fprintf(report, "{\"lines\":%zu,\"stages\":", lineIndex);
+    writeProfile(report, &counters, &total);
+    fprintf(report, "}\n");
+
+    free(line);
+    destroy(&errors);
+    destroy(&counters);
+
+    closeProfile(report);
+    fclose(file);
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in] profileFile  "" for stderr
+//-----------------------------------------------------------------------------
+FILE* openProfile(const char* profileFile)
+{
+    assert(profileFile != nullptr);
+
+    FILE* report = *profileFile == '\0' ? stderr : fopen(profileFile, "w");
+    if (report == nullptr) { logMessage("Unable to open '%s' for the profile.", LG_STYLE_CLASS_ERROR, profileFile); }
+
+    return report;
+}
+
+void closeProfile(FILE* report)
+{
+    if (report != nullptr && report != stderr) { fclose(report); }
+}
+
+//-----------------------------------------------------------------------------
+//! The results are cached by the rules too, so a changed rules file doesn't
+//! get the results of the old one from the disk.
+//-----------------------------------------------------------------------------
+void openCache(const Options* options, const RuleSet* rules)
+{
+    assert(options != nullptr);
+    assert(rules   != nullptr);
+
+    CacheConfig config  = {};
+    config.memoryBudget = options->cacheSize << 20;
+    config.diskPath     = options->cacheFile;
+    config.salt         = hashRules(rules);
+
+    if (!openResultCache(&config))
+    {
+        logMessage("Unable to open the result cache, running without it.", LG_STYLE_CLASS_ERROR);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the instrumentation object, and the result cache's stats as another
+//! line if it's open.
+//!
+//! @param [in] filename  "" for stderr
+//-----------------------------------------------------------------------------
+bool writeStats(const char* filename)
+{
+    assert(filename != nullptr);
+
+    FILE* file = *filename == '\0' ? stderr : fopen(filename, "w");
+    if (file == nullptr)
+    {
+        logMessage("Unable to open '%s' for the stats.", LG_STYLE_CLASS_ERROR, filename);
+        return false;
+    }
+
+    bool isWritten = writeInstrumentation(file);
+
+    if (isResultCacheOpen())
+    {
+        StringBuilder cacheStats = {};
+        construct(&cacheStats);
+
+        isWritten = isWritten && writeCacheStats(&cacheStats) &&
+                    fprintf(file, "{\"cache\":%s}\n", cacheStats.buffer) > 0;
+
+        destroy(&cacheStats);
+    }
+
+    if (file != stderr) { fclose(file); }
+
+    return isWritten;
+}
+
+//-----------------------------------------------------------------------------
+//! @return "" for the bare option, the file name for option=<file>, nullptr
+//!         if arg is another option.
+//-----------------------------------------------------------------------------
+const char* getFileOption(const char* arg, const char* option)
+{
+    assert(arg    != nullptr);
+    assert(option != nullptr);
+
+    size_t length = strlen(option);
+
+    if (strncmp(arg, option, length) != 0) { return nullptr; }
+
+    if (arg[length] == '\0') { return arg + length; }
+    if (arg[length] == '=')  { return arg + length + 1; }
+
+    return nullptr;
+}
+
+//-----------------------------------------------------------------------------
+//! @return "" for the bare option, the value for option<value>, nullptr if
+//!         arg is another option.
+//-----------------------------------------------------------------------------
+const char* getValueOption(const char* arg, const char* option)
+{
+    assert(arg    != nullptr);
+    assert(option != nullptr);
+
+    size_t length = strlen(option);
+
+    return strncmp(arg, option, length) == 0 ? arg + length : nullptr;
+}
+
+//-----------------------------------------------------------------------------
+//! Options and inputs go in any order. Without --batch or --serve there has
+//! to be exactly one input.
+//!
+//! @return false with the reason written to stderr if the command line is
+//!         wrong.
+//-----------------------------------------------------------------------------
+bool parseOptions(Options* options, int argc, char* argv[])
+{
+    assert(options         != nullptr);
+    assert(options->inputs != nullptr);
+    assert(argv            != nullptr);
+
+    for (int i = 1; i < argc; i++)
+    {
+        // "-" is the standard input
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            options->inputs[options->inputsCount++] = argv[i];
+            continue;
+        }
+
+        if (!parseOption(options, argv[i])) { return false; }
+    }
+
+    if (options->serveSocket != nullptr)
+    {
+        if (options->isBatch || options->inputsCount != 0 || options->format != EXPR_FORMAT_INVALID ||
+            options->profileFile != nullptr)
+        {
+            fprintf(stderr, "%s takes no inputs, %s, %s or %s.\n", SERVE_OPTION, BATCH_OPTION, FORMAT_OPTION,
+                    PROFILE_OPTION);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (options->isBatch)
+    {
+        if (options->format != EXPR_FORMAT_INVALID) { options->batch.format = options->format; }
+
+        if (!options->isRendering)
+        {
+            fprintf(stderr, "%s can't be used with %s.\n", NO_RENDER_OPTION, BATCH_OPTION);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (options->isCaching)
+    {
+        fprintf(stderr, "%s and %s need %s or %s.\n", CACHE_SIZE_OPTION, CACHE_FILE_OPTION, BATCH_OPTION,
+                SERVE_OPTION);
+        return false;
+    }
+
+    if (options->inputsCount != 1)
+    {
+        fprintf(stderr, "Expected one input file, got %zu.\n", options->inputsCount);
+        return false;
+    }
+
+    if (options->profileFile != nullptr && options->format == EXPR_FORMAT_INVALID)
+    {
+        fprintf(stderr, "%s needs %s.\n", PROFILE_OPTION, FORMAT_OPTION);
+        return false;
+    }
+
+    return true;
+}
+
+bool parseOption(Options* options, const char* arg)
+{
+    assert(options != nullptr);
+    assert(arg     != nullptr);
+
+    const char* value = nullptr;
+    char*       end   = nullptr;
+
+    if (strcmp(arg, NO_RENDER_OPTION) == 0) { options->isRendering = false; return true; }
+    if (strcmp(arg, BATCH_OPTION)     == 0) { options->isBatch     = true;  return true; }
+
+    if ((value = getFileOption(arg, STATS_OPTION))   != nullptr) { options->statsFile   = value; return true; }
+    if ((value = getFileOption(arg, PROFILE_OPTION)) != nullptr) { options->profileFile = value; return true; }
+    if ((value = getFileOption(arg, SERVE_OPTION))   != nullptr) { options->serveSocket = value; return true; }
+
+    if ((value = getValueOption(arg, FORMAT_OPTION)) != nullptr)
+    {
+        options->format = getExprFormat(value);
+        if (options->format == EXPR_FORMAT_INVALID)
+        {
+            fprintf(stderr, "Unknown format '%s'.\n", value);
+            return false;
+        }
+
+        return true;
+    }
+
+    if ((value = getValueOption(arg, CACHE_FILE_OPTION)) != nullptr && *value != '\0')
+    {
+        options->cacheFile = value;
+        options->isCaching = true;
+
+        return true;
+    }
+
+    if ((value = getValueOption(arg, RULES_OPTION)) != nullptr && *value != '\0')
+    {
+        options->rulesFile = value;
+        return true;
+    }
+
+    if ((value = getValueOption(arg, OPERATION_OPTION)) != nullptr)
+    {
+        options->batch.operation = getBatchOperation(value);
+        if (options->batch.operation == BATCH_OPERATION_INVALID)
+        {
+            fprintf(stderr, "Unknown operation '%s'.\n", value);
+            return false;
+        }
+
+        return true;
+    }
+
+    bool isCount = true;
+
+    if ((value = getValueOption(arg, THREADS_OPTION)) != nullptr)
+    {
+        options->batch.threadsCount = strtoul(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, ORDER_OPTION)) != nullptr)
+    {
+        options->batch.order = strtoul(value, &end, 10);
+    }
+    else if ((value = getValueOption(arg, CACHE_SIZE_OPTION)) != nullptr)
+    {
+        options->cacheSize = strtoul(value, &end, 10);
+        options->isCaching = true;
+    }
+    else if ((value = getValueOption(arg, POINT_OPTION)) != nullptr)
+    {
+        options->batch.point = strtod(value, &end);
+        isCount = false;
+    }
+    else
+    {
+        fprintf(stderr, "Unknown option '%s'.\n", arg);
+        return false;
+    }
+
+    // strtoul() takes "-1" too
+    if (*value == '\0' || *end != '\0' || (isCount && *value == '-'))
+    {
+        fprintf(stderr, "Invalid value in '%s'.\n", arg);
+        return false;
+    }
+
+    return true;
+}
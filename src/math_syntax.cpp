@@ -21,14 +21,20 @@ bool isConstant(double value)
     return false;
 }
 
+//-----------------------------------------------------------------------------
+//! The parser stores exactly the constants' values, so they are compared
+//! exactly: a number that only comes close isn't named.
+//!
+//! @return name of the constant, nullptr if the number isn't one.
+//-----------------------------------------------------------------------------
 const char* getConstantName(double constant)
 {
     for (size_t i = 0; i < CONSTANTS_COUNT; i++)
     {
-//        if (dcompare(constant, CONSTANTS[i].value) == 0) 
-//        { 
-//            return CONSTANTS[i].name; 
-//        }
+        if (constant == CONSTANTS[i].value)
+        {
+            return CONSTANTS[i].name;
+        }
     }
 
     return nullptr;
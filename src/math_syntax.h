@@ -23,6 +23,10 @@ static const Constant CONSTANTS[CONSTANTS_COUNT] = {
                                                      { "e",  1, E_CONST  } 
                                                    };
 
+//! Infinities are written and read as inf and -inf.
+static const char*  INFINITY_NAME        = "inf";
+static const size_t INFINITY_NAME_LENGTH = 3;
+
 bool        isConstant      (double value);  
 const char* getConstantName (double constant);
 
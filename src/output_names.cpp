@@ -0,0 +1,69 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "output_names.h"
+
+static std::atomic<size_t> OUTPUT_COUNTER(0);
+
+//-----------------------------------------------------------------------------
+//! Creates a new file named dir + prefix<pid>_<number> + extension.
+//!
+//! @param [out] name
+//! @param [in]  dir        with the trailing '/'
+//! @param [in]  prefix
+//! @param [in]  extension  with the '.'
+//!
+//! @return file opened for writing, nullptr on failure (it's logged).
+//-----------------------------------------------------------------------------
+FILE* createOutputFile(OutputName* name, const char* dir, const char* prefix, const char* extension)
+{
+    assert(name      != nullptr);
+    assert(dir       != nullptr);
+    assert(prefix    != nullptr);
+    assert(extension != nullptr);
+
+    long pid = (long) getpid();
+
+    for (size_t attempt = 0; attempt < OUTPUT_MAX_ATTEMPTS; attempt++)
+    {
+        size_t number = OUTPUT_COUNTER.fetch_add(1, std::memory_order_relaxed);
+
+        int stemLength = snprintf(name->stem, sizeof(name->stem), "%s%ld_%zu", prefix, pid, number);
+        int pathLength = snprintf(name->path, sizeof(name->path), "%s%s%s", dir, name->stem, extension);
+
+        if (stemLength < 0 || (size_t) stemLength >= sizeof(name->stem) ||
+            pathLength < 0 || (size_t) pathLength >= sizeof(name->path))
+        {
+            logMessage("Output file name in '%s' is too long.", LG_STYLE_CLASS_ERROR, dir);
+            return nullptr;
+        }
+
+        int fd = open(name->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd == -1)
+        {
+            if (errno == EEXIST) { continue; }
+
+            logMessage("Unable to create '%s': %s.", LG_STYLE_CLASS_ERROR, name->path, strerror(errno));
+            return nullptr;
+        }
+
+        FILE* file = fdopen(fd, "w");
+        if (file == nullptr)
+        {
+            close(fd);
+            unlink(name->path);
+            return nullptr;
+        }
+
+        return file;
+    }
+
+    logMessage("No free output file name in '%s'.", LG_STYLE_CLASS_ERROR, dir);
+
+    return nullptr;
+}
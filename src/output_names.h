@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdio.h>
+#include "render_queue.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup OUTPUT_NAMES Unique names for the dump files
+//!
+//! A name is <prefix><pid>_<number>. The number comes from an atomic counter
+//! of the process and the pid tells the processes apart, so neither threads
+//! nor processes share any state to get a name. The file is created with
+//! O_EXCL, a name left by an earlier process with the same pid is skipped
+//! rather than overwritten.
+//!
+//! @addtogroup OUTPUT_NAMES
+//! @{
+
+static const size_t OUTPUT_MAX_NAME_LENGTH = 64;
+static const size_t OUTPUT_MAX_ATTEMPTS    = 64;
+
+//! stem is the name without the directory and the extension, it's meant for
+//! the files made from this one (images, pdfs).
+struct OutputName
+{
+    char stem[OUTPUT_MAX_NAME_LENGTH] = {};
+    char path[RENDER_MAX_PATH_LENGTH] = {};
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+FILE* createOutputFile(OutputName* name, const char* dir, const char* prefix, const char* extension);
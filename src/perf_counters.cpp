@@ -0,0 +1,267 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "perf_counters.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+struct PerfEventType
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+static const PerfEventType PERF_EVENT_TYPES[PERF_EVENTS_COUNT] =
+                            {
+                                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES       },
+                                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS     },
+                                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES     },
+                                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES    }
+                            };
+
+//! What read() returns for a group with the times.
+struct PerfGroupRead
+{
+    uint64_t count;
+    uint64_t timeEnabled;
+    uint64_t timeRunning;
+    uint64_t values[PERF_EVENTS_COUNT];
+};
+
+//! Whether the counters the kernel refuses have been logged.
+static std::atomic<bool> PERF_IS_REFUSAL_LOGGED = false;
+
+int      openEvent     (PerfEvent event, int groupFd);
+bool     readCounters  (PerfCounters* counters, uint64_t* values, uint64_t* timeEnabled, uint64_t* timeRunning);
+uint64_t getWallTime   ();
+
+//-----------------------------------------------------------------------------
+//! Opens the counters on the calling thread, they have to be read on it too.
+//!
+//! @return counters, nullptr only if counters is. Whatever the kernel refuses
+//!         is just left closed.
+//-----------------------------------------------------------------------------
+PerfCounters* construct(PerfCounters* counters)
+{
+    CHECK_NULL(counters, return nullptr);
+
+    *counters = {};
+
+    int leaderFd = -1;
+
+    for (size_t i = 0; i < PERF_EVENTS_COUNT; i++)
+    {
+        counters->fds[i] = openEvent((PerfEvent) i, leaderFd);
+
+        if (counters->fds[i] == -1) { continue; }
+
+        if (leaderFd == -1) { leaderFd = counters->fds[i]; }
+        counters->openCount++;
+    }
+
+    if (counters->openCount < PERF_EVENTS_COUNT && !PERF_IS_REFUSAL_LOGGED.exchange(true))
+    {
+        logMessage("%zu of %zu hardware counters are unavailable: %s.", LG_STYLE_CLASS_ERROR,
+                   PERF_EVENTS_COUNT - counters->openCount, (size_t) PERF_EVENTS_COUNT, strerror(errno));
+    }
+
+    if (leaderFd != -1)
+    {
+        ioctl(leaderFd, PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+        ioctl(leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    startStage(counters);
+
+    return counters;
+}
+
+void destroy(PerfCounters* counters)
+{
+    assert(counters != nullptr);
+
+    for (size_t i = 0; i < PERF_EVENTS_COUNT; i++)
+    {
+        if (counters->fds[i] != -1) { close(counters->fds[i]); }
+    }
+
+    *counters = {};
+}
+
+int openEvent(PerfEvent event, int groupFd)
+{
+    perf_event_attr attr = {};
+
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_EVENT_TYPES[event].type;
+    attr.config         = PERF_EVENT_TYPES[event].config;
+    attr.disabled       = groupFd == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC);
+}
+
+//-----------------------------------------------------------------------------
+//! Makes the next endStage() measure from now.
+//-----------------------------------------------------------------------------
+void startStage(PerfCounters* counters)
+{
+    assert(counters != nullptr);
+
+    readCounters(counters, counters->values, &counters->timeEnabled, &counters->timeRunning);
+    counters->wallTime = getWallTime();
+}
+
+//-----------------------------------------------------------------------------
+//! Adds everything since the previous stage to the stage, and starts the next
+//! one.
+//-----------------------------------------------------------------------------
+void endStage(PerfCounters* counters, StageCounters* stage)
+{
+    assert(counters != nullptr);
+    assert(stage    != nullptr);
+
+    uint64_t wallTime    = getWallTime();
+    uint64_t timeEnabled = 0;
+    uint64_t timeRunning = 0;
+    uint64_t values[PERF_EVENTS_COUNT] = {};
+
+    if (readCounters(counters, values, &timeEnabled, &timeRunning))
+    {
+        uint64_t enabled = timeEnabled - counters->timeEnabled;
+        uint64_t running = timeRunning - counters->timeRunning;
+
+        for (size_t i = 0; i < PERF_EVENTS_COUNT; i++)
+        {
+            uint64_t delta = values[i] - counters->values[i];
+
+            // the group has been counting only part of the time
+            if (running != 0 && running < enabled) { delta = (uint64_t) ((double) delta * enabled / running); }
+
+            stage->values[i] += delta;
+        }
+
+        memcpy(counters->values, values, sizeof(values));
+        counters->timeEnabled = timeEnabled;
+        counters->timeRunning = timeRunning;
+    }
+
+    stage->calls++;
+    stage->nanoseconds += wallTime - counters->wallTime;
+
+    counters->wallTime = wallTime;
+}
+
+bool readCounters(PerfCounters* counters, uint64_t* values, uint64_t* timeEnabled, uint64_t* timeRunning)
+{
+    assert(counters    != nullptr);
+    assert(values      != nullptr);
+    assert(timeEnabled != nullptr);
+    assert(timeRunning != nullptr);
+
+    if (counters->openCount == 0) { return false; }
+
+    int leaderFd = -1;
+    for (size_t i = 0; i < PERF_EVENTS_COUNT && leaderFd == -1; i++) { leaderFd = counters->fds[i]; }
+
+    PerfGroupRead groupRead = {};
+    if (read(leaderFd, &groupRead, sizeof(groupRead)) <= 0) { return false; }
+
+    // the group's values are in the order the events have been opened
+    size_t opened = 0;
+    for (size_t i = 0; i < PERF_EVENTS_COUNT; i++)
+    {
+        values[i] = counters->fds[i] != -1 && opened < groupRead.count ? groupRead.values[opened++] : 0;
+    }
+
+    *timeEnabled = groupRead.timeEnabled;
+    *timeRunning = groupRead.timeRunning;
+
+    return true;
+}
+
+uint64_t getWallTime()
+{
+    timespec now = {};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+void addProfile(Profile* total, const Profile* profile)
+{
+    assert(total   != nullptr);
+    assert(profile != nullptr);
+
+    for (size_t stage = 0; stage < STAGES_COUNT; stage++)
+    {
+        total->stages[stage].calls       += profile->stages[stage].calls;
+        total->stages[stage].nanoseconds += profile->stages[stage].nanoseconds;
+
+        for (size_t i = 0; i < PERF_EVENTS_COUNT; i++)
+        {
+            total->stages[stage].values[i] += profile->stages[stage].values[i];
+        }
+    }
+}
+
+void writeProfile(FILE* file, const PerfCounters* counters, const Profile* profile)
+{
+    assert(file     != nullptr);
+    assert(counters != nullptr);
+    assert(profile  != nullptr);
+
+    StringBuilder builder = {};
+
+    if (construct(&builder) != nullptr && writeProfile(&builder, counters, profile))
+    {
+        fwrite(getString(&builder), sizeof(char), builder.length, file);
+    }
+
+    destroy(&builder);
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the stages as a JSON object, the counters that aren't open are
+//! null.
+//!
+//! @return false if there isn't enough memory.
+//-----------------------------------------------------------------------------
+bool writeProfile(StringBuilder* builder, const PerfCounters* counters, const Profile* profile)
+{
+    assert(builder  != nullptr);
+    assert(counters != nullptr);
+    assert(profile  != nullptr);
+
+    bool isOk = appendChar(builder, '{');
+
+    for (size_t stage = 0; stage < STAGES_COUNT && isOk; stage++)
+    {
+        const StageCounters* stageCounters = &profile->stages[stage];
+
+        isOk = appendFormat(builder, "%s\"%s\":{\"calls\":%llu,\"seconds\":%.9f", stage == 0 ? "" : ",",
+                            STAGE_NAMES[stage], (unsigned long long) stageCounters->calls,
+                            (double) stageCounters->nanoseconds / 1e9);
+
+        for (size_t i = 0; i < PERF_EVENTS_COUNT && isOk; i++)
+        {
+            if (counters->fds[i] == -1) { isOk = appendFormat(builder, ",\"%s\":null", PERF_EVENT_NAMES[i]); }
+            else                        { isOk = appendFormat(builder, ",\"%s\":%llu", PERF_EVENT_NAMES[i],
+                                                              (unsigned long long) stageCounters->values[i]); }
+        }
+
+        isOk = isOk && appendChar(builder, '}');
+    }
+
+    return isOk && appendChar(builder, '}');
+}
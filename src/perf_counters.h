@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "string_builder.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup PERF_COUNTERS Hardware counters of the pipeline stages
+//!
+//! The counters are opened with perf_event_open() as one group on the
+//! calling thread, user space only, and are read between the stages, so
+//! every stage gets the difference of two reads. When the kernel
+//! multiplexes the group, the differences are scaled by the time it's been
+//! counting.
+//!
+//! Counters the kernel refuses (no PMU in a container or a VM,
+//! perf_event_paranoid, seccomp) are left closed and reported as null, and
+//! logged once per process. With none of them open only the wall time of the
+//! stages is measured.
+//!
+//! @addtogroup PERF_COUNTERS
+//! @{
+
+enum PerfEvent
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+
+    PERF_EVENTS_COUNT
+};
+
+static const char* PERF_EVENT_NAMES[PERF_EVENTS_COUNT] = { "cycles", "instructions", "cacheMisses", "branchMisses" };
+
+enum ProfileStage
+{
+    STAGE_PARSE,
+    STAGE_DIFFERENTIATE,
+    STAGE_SIMPLIFY,
+    STAGE_TAYLOR,
+    STAGE_EVALUATE,
+    STAGE_EMIT,
+
+    STAGES_COUNT
+};
+
+static const char* STAGE_NAMES[STAGES_COUNT] = { "parse", "differentiate", "simplify", "taylor", "evaluate", "emit" };
+
+struct PerfCounters
+{
+    int      fds[PERF_EVENTS_COUNT]      = { -1, -1, -1, -1 };
+    size_t   openCount                   = 0;
+
+    // the last read, stages are measured from it
+    uint64_t values[PERF_EVENTS_COUNT]   = {};
+    uint64_t timeEnabled                 = 0;
+    uint64_t timeRunning                 = 0;
+    uint64_t wallTime                    = 0;
+};
+
+//! Sums of the differences, events that aren't open stay 0.
+struct StageCounters
+{
+    uint64_t calls                       = 0;
+    uint64_t nanoseconds                 = 0;
+    uint64_t values[PERF_EVENTS_COUNT]   = {};
+};
+
+struct Profile
+{
+    StageCounters stages[STAGES_COUNT]   = {};
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+PerfCounters* construct          (PerfCounters* counters);
+void          destroy            (PerfCounters* counters);
+
+void          startStage         (PerfCounters* counters);
+void          endStage           (PerfCounters* counters, StageCounters* stage);
+void          addProfile         (Profile* total, const Profile* profile);
+
+void          writeProfile       (FILE* file, const PerfCounters* counters, const Profile* profile);
+bool          writeProfile       (StringBuilder* builder, const PerfCounters* counters, const Profile* profile);
@@ -0,0 +1,1052 @@
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "polynomial.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+bool    reserveTerms         (Polynomial* poly, size_t capacity);
+void    swapPolys            (Polynomial* poly1, Polynomial* poly2);
+long    polyLowestPower      (const Polynomial* poly);
+double  polyMaxCoef          (const Polynomial* poly);
+bool    polyShiftDown        (Polynomial* poly, long shift);
+void    polyDivideCoefs      (Polynomial* poly, double divisor);
+void    polyRoundCoefs       (Polynomial* poly);
+bool    polyIsDivisible      (const Polynomial* poly, double divisor);
+bool    polyIsProduct        (const Polynomial* poly, const Polynomial* factor1, const Polynomial* factor2);
+bool    polyGcd              (Polynomial* result, const Polynomial* poly1, const Polynomial* poly2);
+bool    polyMulDense         (Polynomial* result, const Polynomial* poly1, const Polynomial* poly2, size_t span);
+bool    polyMulSparse        (Polynomial* result, const Polynomial* poly1, const Polynomial* poly2);
+int     comparePowersDesc    (const void* term1, const void* term2);
+
+bool    rationalSetConstant  (Rational* rational, double value);
+bool    rationalIsConstant   (const Rational* rational);
+double  rationalConstant     (const Rational* rational);
+bool    rationalCombine      (Rational* result, Operation operation, Rational* left, Rational* right);
+bool    rationalCancel       (Rational* rational, const Polynomial* factor);
+
+ETNode* hornerMulPower       (ETNode* acc, long power, int variable);
+ETNode* hornerAddCoef        (ETNode* acc, double coef);
+
+//-----------------------------------------------------------------------------
+// Polynomial
+//-----------------------------------------------------------------------------
+
+Polynomial* construct(Polynomial* poly)
+{
+    CHECK_NULL(poly, return nullptr);
+
+    poly->terms    = nullptr;
+    poly->count    = 0;
+    poly->capacity = 0;
+
+    return poly;
+}
+
+void destroy(Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    free(poly->terms);
+
+    poly->terms    = nullptr;
+    poly->count    = 0;
+    poly->capacity = 0;
+}
+
+void polyClear(Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    poly->count = 0;
+}
+
+bool reserveTerms(Polynomial* poly, size_t capacity)
+{
+    assert(poly != nullptr);
+
+    if (capacity <= poly->capacity) { return true; }
+
+    if (capacity < 2 * poly->capacity) { capacity = 2 * poly->capacity; }
+
+    PolyTerm* terms = (PolyTerm*) realloc(poly->terms, capacity * sizeof(PolyTerm));
+    CHECK_NULL(terms, return false);
+
+    poly->terms    = terms;
+    poly->capacity = capacity;
+
+    return true;
+}
+
+void swapPolys(Polynomial* poly1, Polynomial* poly2)
+{
+    assert(poly1 != nullptr);
+    assert(poly2 != nullptr);
+
+    Polynomial temp = *poly1;
+    *poly1          = *poly2;
+    *poly2          = temp;
+}
+
+void polyCopy(Polynomial* dest, const Polynomial* src)
+{
+    assert(dest != nullptr);
+    assert(src  != nullptr);
+
+    if (dest == src) { return; }
+
+    polyClear(dest);
+    if (!reserveTerms(dest, src->count)) { return; }
+
+    memcpy(dest->terms, src->terms, src->count * sizeof(PolyTerm));
+    dest->count = src->count;
+}
+
+//-----------------------------------------------------------------------------
+//! Appends a term to the end of the polynomial, so the power has to be lower
+//! than the power of the last term. Zero coefficients are silently skipped.
+//-----------------------------------------------------------------------------
+bool polyPushTerm(Polynomial* poly, long power, double coef)
+{
+    assert(poly  != nullptr);
+    assert(power >= 0);
+    assert(poly->count == 0 || poly->terms[poly->count - 1].power > power);
+
+    if (coef == 0) { return true; }
+
+    if (!reserveTerms(poly, poly->count + 1)) { return false; }
+
+    poly->terms[poly->count++] = { power, coef };
+
+    return true;
+}
+
+bool polySetConstant(Polynomial* poly, double value)
+{
+    assert(poly != nullptr);
+
+    polyClear(poly);
+
+    return polyPushTerm(poly, 0, value);
+}
+
+long polyDegree(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    return poly->count == 0 ? -1 : poly->terms[0].power;
+}
+
+long polyLowestPower(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    return poly->count == 0 ? 0 : poly->terms[poly->count - 1].power;
+}
+
+double polyMaxCoef(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    double max = 0;
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        if (fabs(poly->terms[i].coef) > max) { max = fabs(poly->terms[i].coef); }
+    }
+
+    return max;
+}
+
+bool polyIsZero(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    return poly->count == 0;
+}
+
+bool polyIsConstant(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    return polyDegree(poly) <= 0;
+}
+
+bool polyIsFinite(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        if (!isfinite(poly->terms[i].coef)) { return false; }
+    }
+
+    return true;
+}
+
+double polyConstant(const Polynomial* poly)
+{
+    assert(poly != nullptr);
+    assert(polyIsConstant(poly));
+
+    return poly->count == 0 ? 0 : poly->terms[0].coef;
+}
+
+//-----------------------------------------------------------------------------
+//! result = poly1 + factor2 * poly2. Terms are merged in O(n + m), the result
+//! may be the same object as either of the arguments.
+//-----------------------------------------------------------------------------
+bool polyAdd(Polynomial* result, const Polynomial* poly1, const Polynomial* poly2, double factor2)
+{
+    assert(result != nullptr);
+    assert(poly1  != nullptr);
+    assert(poly2  != nullptr);
+
+    Polynomial sum = {};
+    if (!reserveTerms(&sum, poly1->count + poly2->count)) { return false; }
+
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < poly1->count || j < poly2->count)
+    {
+        if (j == poly2->count || (i < poly1->count && poly1->terms[i].power > poly2->terms[j].power))
+        {
+            polyPushTerm(&sum, poly1->terms[i].power, poly1->terms[i].coef);
+            i++;
+        }
+        else if (i == poly1->count || poly2->terms[j].power > poly1->terms[i].power)
+        {
+            polyPushTerm(&sum, poly2->terms[j].power, factor2 * poly2->terms[j].coef);
+            j++;
+        }
+        else
+        {
+            double coef1 = poly1->terms[i].coef;
+            double coef2 = factor2 * poly2->terms[j].coef;
+            double coef  = coef1 + coef2;
+
+            if (fabs(coef) > POLY_EPSILON * (fabs(coef1) + fabs(coef2)))
+            {
+                polyPushTerm(&sum, poly1->terms[i].power, coef);
+            }
+
+            i++;
+            j++;
+        }
+    }
+
+    swapPolys(result, &sum);
+    destroy(&sum);
+
+    return true;
+}
+
+bool polyMul(Polynomial* result, const Polynomial* poly1, const Polynomial* poly2)
+{
+    assert(result != nullptr);
+    assert(poly1  != nullptr);
+    assert(poly2  != nullptr);
+
+    if (polyIsZero(poly1) || polyIsZero(poly2))
+    {
+        polyClear(result);
+        return true;
+    }
+
+    Polynomial product = {};
+
+    size_t span = (size_t) (polyDegree(poly1) + polyDegree(poly2) - polyLowestPower(poly1) - polyLowestPower(poly2) + 1);
+
+    bool isOk = span <= POLY_DENSE_SPAN ? polyMulDense(&product, poly1, poly2, span) :
+                                          polyMulSparse(&product, poly1, poly2);
+
+    if (isOk) { swapPolys(result, &product); }
+    destroy(&product);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Accumulates products in an array indexed by power. Next to every sum goes
+//! the sum of the absolute values of its products, so that the cancellation
+//! check is relative the same way as in polyAdd().
+//-----------------------------------------------------------------------------
+bool polyMulDense(Polynomial* result, const Polynomial* poly1, const Polynomial* poly2, size_t span)
+{
+    assert(result != nullptr);
+    assert(poly1  != nullptr);
+    assert(poly2  != nullptr);
+
+    double* sums = (double*) calloc(2 * span, sizeof(double));
+    CHECK_NULL(sums, return false);
+
+    double* magnitudes = sums + span;
+    long    lowest     = polyLowestPower(poly1) + polyLowestPower(poly2);
+
+    for (size_t i = 0; i < poly1->count; i++)
+    {
+        for (size_t j = 0; j < poly2->count; j++)
+        {
+            double product = poly1->terms[i].coef * poly2->terms[j].coef;
+            size_t index   = (size_t) (poly1->terms[i].power + poly2->terms[j].power - lowest);
+
+            sums[index]       += product;
+            magnitudes[index] += fabs(product);
+        }
+    }
+
+    bool isOk = reserveTerms(result, span < poly1->count * poly2->count ? span : poly1->count * poly2->count);
+
+    for (size_t index = span; isOk && index-- > 0;)
+    {
+        if (fabs(sums[index]) > POLY_EPSILON * magnitudes[index])
+        {
+            isOk = polyPushTerm(result, (long) index + lowest, sums[index]);
+        }
+    }
+
+    free(sums);
+
+    return isOk;
+}
+
+int comparePowersDesc(const void* term1, const void* term2)
+{
+    long power1 = ((const PolyTerm*) term1)->power;
+    long power2 = ((const PolyTerm*) term2)->power;
+
+    return (power1 < power2) - (power1 > power2);
+}
+
+bool polyMulSparse(Polynomial* result, const Polynomial* poly1, const Polynomial* poly2)
+{
+    assert(result != nullptr);
+    assert(poly1  != nullptr);
+    assert(poly2  != nullptr);
+
+    size_t    productsCount = poly1->count * poly2->count;
+    PolyTerm* products      = (PolyTerm*) calloc(productsCount, sizeof(PolyTerm));
+    CHECK_NULL(products, return false);
+
+    for (size_t i = 0; i < poly1->count; i++)
+    {
+        for (size_t j = 0; j < poly2->count; j++)
+        {
+            products[i * poly2->count + j] = { poly1->terms[i].power + poly2->terms[j].power,
+                                               poly1->terms[i].coef  * poly2->terms[j].coef };
+        }
+    }
+
+    qsort(products, productsCount, sizeof(PolyTerm), comparePowersDesc);
+
+    bool isOk = true;
+    for (size_t i = 0; isOk && i < productsCount;)
+    {
+        double sum       = 0;
+        double magnitude = 0;
+        long   power     = products[i].power;
+
+        for (; i < productsCount && products[i].power == power; i++)
+        {
+            sum       += products[i].coef;
+            magnitude += fabs(products[i].coef);
+        }
+
+        if (fabs(sum) > POLY_EPSILON * magnitude) { isOk = polyPushTerm(result, power, sum); }
+    }
+
+    free(products);
+
+    return isOk;
+}
+
+bool polyPow(Polynomial* result, const Polynomial* poly, long power)
+{
+    assert(result != nullptr);
+    assert(poly   != nullptr);
+    assert(power  >= 0);
+
+    Polynomial base = {};
+    Polynomial acc  = {};
+
+    polyCopy(&base, poly);
+    bool isOk = polySetConstant(&acc, 1);
+
+    while (isOk && power > 0)
+    {
+        if (power & 1) { isOk = polyMul(&acc, &acc, &base); }
+
+        power >>= 1;
+        if (isOk && power > 0) { isOk = polyMul(&base, &base, &base); }
+    }
+
+    if (isOk) { swapPolys(result, &acc); }
+
+    destroy(&base);
+    destroy(&acc);
+
+    return isOk;
+}
+
+bool polyScale(Polynomial* poly, double factor)
+{
+    assert(poly != nullptr);
+
+    if (factor == 0)
+    {
+        polyClear(poly);
+        return true;
+    }
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        poly->terms[i].coef *= factor;
+    }
+
+    return true;
+}
+
+//! Dividing keeps x / x exactly 1, unlike scaling by 1 / x.
+void polyDivideCoefs(Polynomial* poly, double divisor)
+{
+    assert(poly    != nullptr);
+    assert(divisor != 0);
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        poly->terms[i].coef /= divisor;
+    }
+}
+
+void polyRoundCoefs(Polynomial* poly)
+{
+    assert(poly != nullptr);
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        poly->terms[i].coef = round(poly->terms[i].coef);
+    }
+}
+
+//! @return whether every coefficient divided by the divisor is exact.
+bool polyIsDivisible(const Polynomial* poly, double divisor)
+{
+    assert(poly    != nullptr);
+    assert(divisor != 0);
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        double coef = poly->terms[i].coef;
+        if (fma(coef / divisor, divisor, -coef) != 0) { return false; }
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return whether factor1 * factor2 is exactly poly, false if there isn't
+//!         enough memory to check.
+//-----------------------------------------------------------------------------
+bool polyIsProduct(const Polynomial* poly, const Polynomial* factor1, const Polynomial* factor2)
+{
+    assert(poly    != nullptr);
+    assert(factor1 != nullptr);
+    assert(factor2 != nullptr);
+
+    Polynomial product = {};
+
+    bool isEqual = polyMul(&product, factor1, factor2) && product.count == poly->count;
+
+    for (size_t i = 0; isEqual && i < poly->count; i++)
+    {
+        isEqual = product.terms[i].power == poly->terms[i].power && product.terms[i].coef == poly->terms[i].coef;
+    }
+
+    destroy(&product);
+
+    return isEqual;
+}
+
+bool polyShiftDown(Polynomial* poly, long shift)
+{
+    assert(poly != nullptr);
+    assert(shift <= polyLowestPower(poly));
+
+    for (size_t i = 0; i < poly->count; i++)
+    {
+        poly->terms[i].power -= shift;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Long division, dividend = quotient * divisor + remainder.
+//-----------------------------------------------------------------------------
+bool polyDivMod(Polynomial* quotient, Polynomial* remainder, const Polynomial* dividend, const Polynomial* divisor)
+{
+    assert(quotient  != nullptr);
+    assert(remainder != nullptr);
+    assert(dividend  != nullptr);
+    assert(divisor   != nullptr);
+    assert(quotient  != remainder);
+
+    if (polyIsZero(divisor)) { return false; }
+
+    Polynomial rest    = {};
+    Polynomial result  = {};
+    Polynomial shifted = {};
+
+    polyCopy(&rest, dividend);
+    polyCopy(&shifted, divisor);
+
+    long   divisorDegree = polyDegree(divisor);
+    double divisorLead   = divisor->terms[0].coef;
+    bool   isOk          = true;
+
+    while (isOk && polyDegree(&rest) >= divisorDegree)
+    {
+        long   power = polyDegree(&rest) - divisorDegree;
+        double coef  = rest.terms[0].coef / divisorLead;
+
+        isOk = polyPushTerm(&result, power, coef);
+
+        for (size_t i = 0; i < divisor->count; i++)
+        {
+            shifted.terms[i].power = divisor->terms[i].power + power;
+        }
+
+        long leadPower = rest.terms[0].power;
+        if (isOk) { isOk = polyAdd(&rest, &rest, &shifted, -coef); }
+
+        // the leading term has to go away even if rounding left some garbage in it
+        if (isOk && rest.count > 0 && rest.terms[0].power == leadPower)
+        {
+            memmove(rest.terms, rest.terms + 1, (rest.count - 1) * sizeof(PolyTerm));
+            rest.count--;
+        }
+    }
+
+    if (isOk)
+    {
+        swapPolys(quotient,  &result);
+        swapPolys(remainder, &rest);
+    }
+
+    destroy(&rest);
+    destroy(&result);
+    destroy(&shifted);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Euclidean algorithm, the result is monic. A remainder that is tiny compared
+//! to the polynomials it came from is considered zero.
+//-----------------------------------------------------------------------------
+bool polyGcd(Polynomial* result, const Polynomial* poly1, const Polynomial* poly2)
+{
+    assert(result != nullptr);
+    assert(poly1  != nullptr);
+    assert(poly2  != nullptr);
+
+    const double GCD_TOLERANCE = 1e-9;
+
+    Polynomial a         = {};
+    Polynomial b         = {};
+    Polynomial quotient  = {};
+    Polynomial remainder = {};
+
+    polyCopy(&a, poly1);
+    polyCopy(&b, poly2);
+
+    bool isOk = true;
+
+    while (isOk && !polyIsZero(&b))
+    {
+        double scale = polyMaxCoef(&a);
+
+        isOk = polyDivMod(&quotient, &remainder, &a, &b);
+        if (isOk && polyMaxCoef(&remainder) <= GCD_TOLERANCE * scale) { polyClear(&remainder); }
+
+        swapPolys(&a, &b);
+        swapPolys(&b, &remainder);
+    }
+
+    if (isOk && !polyIsZero(&a))
+    {
+        polyScale(&a, 1 / a.terms[0].coef);
+        swapPolys(result, &a);
+    }
+
+    destroy(&a);
+    destroy(&b);
+    destroy(&quotient);
+    destroy(&remainder);
+
+    return isOk;
+}
+
+bool polyDerivative(Polynomial* result, const Polynomial* poly)
+{
+    assert(result != nullptr);
+    assert(poly   != nullptr);
+
+    Polynomial derivative = {};
+    if (!reserveTerms(&derivative, poly->count)) { return false; }
+
+    for (size_t i = 0; i < poly->count && poly->terms[i].power > 0; i++)
+    {
+        polyPushTerm(&derivative, poly->terms[i].power - 1, poly->terms[i].power * poly->terms[i].coef);
+    }
+
+    swapPolys(result, &derivative);
+    destroy(&derivative);
+
+    return true;
+}
+
+double polyEvaluate(const Polynomial* poly, double x)
+{
+    assert(poly != nullptr);
+
+    if (polyIsZero(poly)) { return 0; }
+
+    double value = poly->terms[0].coef;
+    for (size_t i = 1; i < poly->count; i++)
+    {
+        value = value * pow(x, (double) (poly->terms[i - 1].power - poly->terms[i].power)) + poly->terms[i].coef;
+    }
+
+    return value * pow(x, (double) polyLowestPower(poly));
+}
+
+ETNode* hornerMulPower(ETNode* acc, long power, int variable)
+{
+    assert(acc != nullptr);
+
+    if (power == 0) { return acc; }
+
+    ETNode* xPower = power == 1 ? &VAR(variable) : &(VAR(variable) ^ NUM((double) power));
+
+    if (isTypeNumber(acc) && acc->data.number == 1)
+    {
+        deleteNode(acc);
+        return xPower;
+    }
+
+    return &(*acc * *xPower);
+}
+
+ETNode* hornerAddCoef(ETNode* acc, double coef)
+{
+    assert(acc != nullptr);
+
+    if (coef > 0) { return &(*acc + NUM(coef));  }
+    if (coef < 0) { return &(*acc - NUM(-coef)); }
+
+    return acc;
+}
+
+//-----------------------------------------------------------------------------
+//! Builds a_n x^n + ... + a_0 as (...((a_n) x^(n - k) + a_k) x^(k - m) + ...),
+//! so every gap between neighbouring powers costs a single multiplication.
+//-----------------------------------------------------------------------------
+ETNode* polyToHorner(const Polynomial* poly, int variable)
+{
+    assert(poly != nullptr);
+
+    if (polyIsZero(poly)) { return &NUM(0.0); }
+
+    ETNode* acc = &NUM(poly->terms[0].coef);
+    for (size_t i = 1; i < poly->count; i++)
+    {
+        acc = hornerMulPower(acc, poly->terms[i - 1].power - poly->terms[i].power, variable);
+        acc = hornerAddCoef(acc, poly->terms[i].coef);
+    }
+
+    return hornerMulPower(acc, polyLowestPower(poly), variable);
+}
+
+//-----------------------------------------------------------------------------
+// Rational
+//-----------------------------------------------------------------------------
+
+Rational* construct(Rational* rational)
+{
+    CHECK_NULL(rational, return nullptr);
+
+    construct(&rational->numerator);
+    construct(&rational->denominator);
+
+    return rational;
+}
+
+void destroy(Rational* rational)
+{
+    assert(rational != nullptr);
+
+    destroy(&rational->numerator);
+    destroy(&rational->denominator);
+}
+
+bool rationalSetConstant(Rational* rational, double value)
+{
+    assert(rational != nullptr);
+
+    return polySetConstant(&rational->numerator, value) && polySetConstant(&rational->denominator, 1);
+}
+
+bool rationalIsConstant(const Rational* rational)
+{
+    assert(rational != nullptr);
+
+    return polyIsConstant(&rational->numerator) && polyIsConstant(&rational->denominator);
+}
+
+double rationalConstant(const Rational* rational)
+{
+    assert(rational != nullptr);
+    assert(rationalIsConstant(rational));
+
+    return polyConstant(&rational->numerator) / polyConstant(&rational->denominator);
+}
+
+//-----------------------------------------------------------------------------
+//! Divides both parts of the fraction by the factor, but only if it divides
+//! them exactly.
+//!
+//! @return whether the factor has been cancelled.
+//-----------------------------------------------------------------------------
+bool rationalCancel(Rational* rational, const Polynomial* factor)
+{
+    assert(rational != nullptr);
+    assert(factor   != nullptr);
+
+    Polynomial* numerator   = &rational->numerator;
+    Polynomial* denominator = &rational->denominator;
+
+    Polynomial quotient1 = {};
+    Polynomial quotient2 = {};
+    Polynomial remainder = {};
+
+    bool isCancelled = !polyIsZero(factor) &&
+                       polyDivMod(&quotient1, &remainder, numerator,   factor) &&
+                       polyDivMod(&quotient2, &remainder, denominator, factor) &&
+                       polyIsProduct(numerator, &quotient1, factor) && polyIsProduct(denominator, &quotient2, factor);
+
+    if (isCancelled)
+    {
+        swapPolys(numerator,   &quotient1);
+        swapPolys(denominator, &quotient2);
+    }
+
+    destroy(&quotient1);
+    destroy(&quotient2);
+    destroy(&remainder);
+
+    return isCancelled;
+}
+
+//-----------------------------------------------------------------------------
+//! Brings the fraction to its canonical form: common powers of the variable
+//! and (for small enough denominators) the polynomial gcd are cancelled, then
+//! the denominator is made monic. Nothing is rounded on the way: the gcd is
+//! computed in floating point, so it (or its rounded copy) is cancelled only
+//! if it divides the numerator and the denominator exactly, and the leading
+//! coefficient is divided out only if no coefficient gets rounded by it.
+//!
+//! @return false if the denominator is zero.
+//-----------------------------------------------------------------------------
+bool rationalNormalize(Rational* rational)
+{
+    assert(rational != nullptr);
+
+    Polynomial* numerator   = &rational->numerator;
+    Polynomial* denominator = &rational->denominator;
+
+    if (polyIsZero(denominator)) { return false; }
+
+    if (polyIsZero(numerator)) { return polySetConstant(denominator, 1); }
+
+    long shift = polyLowestPower(numerator) < polyLowestPower(denominator) ? polyLowestPower(numerator) :
+                                                                              polyLowestPower(denominator);
+    polyShiftDown(numerator,   shift);
+    polyShiftDown(denominator, shift);
+
+    if (!polyIsConstant(denominator) && polyDegree(denominator) <= POLY_GCD_MAX_DEGREE)
+    {
+        Polynomial gcd = {};
+
+        if (polyGcd(&gcd, numerator, denominator) && polyDegree(&gcd) > 0 && !rationalCancel(rational, &gcd))
+        {
+            // the gcd of integer polynomials usually has integer coefficients
+            // too, it's just the rounding errors of the division that are left
+            polyRoundCoefs(&gcd);
+            rationalCancel(rational, &gcd);
+        }
+
+        destroy(&gcd);
+    }
+
+    double lead = denominator->terms[0].coef;
+    if (polyIsDivisible(numerator, lead) && polyIsDivisible(denominator, lead))
+    {
+        polyDivideCoefs(numerator,   lead);
+        polyDivideCoefs(denominator, lead);
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! (N / D)' = (N' D - N D') / D^2, the quotient rule applied once to the whole
+//! fraction and then normalized, so D^2 collapses with the factors of the
+//! numerator instead of piling up.
+//-----------------------------------------------------------------------------
+bool rationalDerivative(Rational* result, const Rational* rational)
+{
+    assert(result   != nullptr);
+    assert(rational != nullptr);
+    assert(result   != rational);
+
+    const Polynomial* numerator   = &rational->numerator;
+    const Polynomial* denominator = &rational->denominator;
+
+    if (polyIsConstant(denominator))
+    {
+        return polyDerivative(&result->numerator, numerator) &&
+               polySetConstant(&result->denominator, polyConstant(denominator));
+    }
+
+    Polynomial numeratorDeriv   = {};
+    Polynomial denominatorDeriv = {};
+    Polynomial product          = {};
+
+    bool isOk = polyDerivative(&numeratorDeriv,   numerator)                                &&
+                polyDerivative(&denominatorDeriv, denominator)                              &&
+                polyMul(&result->numerator, &numeratorDeriv, denominator)                   &&
+                polyMul(&product, numerator, &denominatorDeriv)                             &&
+                polyAdd(&result->numerator, &result->numerator, &product, -1)               &&
+                polyMul(&result->denominator, denominator, denominator)                     &&
+                rationalNormalize(result);
+
+    destroy(&numeratorDeriv);
+    destroy(&denominatorDeriv);
+    destroy(&product);
+
+    return isOk;
+}
+
+double rationalEvaluate(const Rational* rational, double x)
+{
+    assert(rational != nullptr);
+
+    return polyEvaluate(&rational->numerator, x) / polyEvaluate(&rational->denominator, x);
+}
+
+bool rationalCombine(Rational* result, Operation operation, Rational* left, Rational* right)
+{
+    assert(result != nullptr);
+    assert(left   != nullptr);
+    assert(right  != nullptr);
+
+    Polynomial* numerator   = &result->numerator;
+    Polynomial* denominator = &result->denominator;
+
+    bool isOk = true;
+
+    switch (operation)
+    {
+        case OP_ADD:
+        case OP_SUB:
+        {
+            double factor = operation == OP_ADD ? 1 : -1;
+
+            if (polyIsConstant(&left->denominator) && polyIsConstant(&right->denominator) &&
+                polyConstant(&left->denominator) == polyConstant(&right->denominator))
+            {
+                isOk = polyAdd(numerator, &left->numerator, &right->numerator, factor) &&
+                       polySetConstant(denominator, polyConstant(&left->denominator));
+                break;
+            }
+
+            Polynomial product = {};
+
+            isOk = polyMul(numerator, &left->numerator, &right->denominator)  &&
+                   polyMul(&product, &right->numerator, &left->denominator)   &&
+                   polyAdd(numerator, numerator, &product, factor)            &&
+                   polyMul(denominator, &left->denominator, &right->denominator);
+
+            destroy(&product);
+            break;
+        }
+
+        case OP_MUL:
+            isOk = polyMul(numerator,   &left->numerator,   &right->numerator) &&
+                   polyMul(denominator, &left->denominator, &right->denominator);
+            break;
+
+        case OP_DIV:
+            if (polyIsZero(&right->numerator)) { return false; }
+
+            isOk = polyMul(numerator,   &left->numerator,   &right->denominator) &&
+                   polyMul(denominator, &left->denominator, &right->numerator);
+            break;
+
+        case OP_POW:
+        {
+            if (!rationalIsConstant(right)) { return false; }
+
+            double exponent = rationalConstant(right);
+
+            if (rationalIsConstant(left))
+            {
+                double value = pow(rationalConstant(left), exponent);
+                return isfinite(value) && rationalSetConstant(result, value);
+            }
+
+            if (exponent != floor(exponent) || fabs(exponent) > POLY_MAX_EXPONENT) { return false; }
+
+            long power = (long) fabs(exponent);
+            if (power > POLY_MAX_EXPANDED_POWER && (left->numerator.count > 1 || left->denominator.count > 1))
+            {
+                return false;
+            }
+
+            isOk = polyPow(numerator,   &left->numerator,   power) &&
+                   polyPow(denominator, &left->denominator, power);
+
+            if (exponent < 0) { swapPolys(numerator, denominator); }
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    return isOk && rationalNormalize(result);
+}
+
+//-----------------------------------------------------------------------------
+//! Converts the subtree into a fraction of two polynomials in variable.
+//! Constant subexpressions are folded (e.g. 'sin(5)' becomes a coefficient),
+//! anything else (other variables, transcendental functions of the variable,
+//! non-integer powers of it) makes the conversion fail.
+//!
+//! @return whether or not the subtree is a rational function.
+//-----------------------------------------------------------------------------
+bool rationalFromTree(Rational* rational, const ETNode* root, int variable)
+{
+    assert(rational != nullptr);
+    assert(root     != nullptr);
+
+    switch (root->type)
+    {
+        case TYPE_NUMBER:
+            return isfinite(root->data.number) && rationalSetConstant(rational, root->data.number);
+
+        case TYPE_VAR:
+            if (root->data.var != variable) { return false; }
+
+            polyClear(&rational->numerator);
+            return polyPushTerm(&rational->numerator, 1, 1) && polySetConstant(&rational->denominator, 1);
+
+        case TYPE_OP:
+            break;
+
+        default:
+            return false;
+    }
+
+    Operation operation = root->data.op;
+    Rational  right     = {};
+
+    if (!rationalFromTree(&right, root->right, variable))
+    {
+        destroy(&right);
+        return false;
+    }
+
+    bool isOk = false;
+
+    if (isOperationUnary(operation))
+    {
+        if (rationalIsConstant(&right))
+        {
+            double value = evaluateUnary(operation, rationalConstant(&right));
+            isOk = isfinite(value) && rationalSetConstant(rational, value);
+        }
+    }
+    else
+    {
+        Rational left = {};
+
+        isOk = rationalFromTree(&left, root->left, variable) &&
+               rationalCombine(rational, operation, &left, &right);
+
+        destroy(&left);
+    }
+
+    destroy(&right);
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! The denominator is made monic here if it isn't already, so every printed
+//! coefficient is rounded once instead of on every step of the computation.
+//-----------------------------------------------------------------------------
+ETNode* rationalToTree(const Rational* rational, int variable)
+{
+    assert(rational != nullptr);
+
+    Polynomial numerator   = {};
+    Polynomial denominator = {};
+    polyCopy(&numerator,   &rational->numerator);
+    polyCopy(&denominator, &rational->denominator);
+
+    double lead = denominator.terms[0].coef;
+    polyDivideCoefs(&numerator,   lead);
+    polyDivideCoefs(&denominator, lead);
+
+    ETNode* tree = polyToHorner(&numerator, variable);
+
+    if (!polyIsConstant(&denominator))
+    {
+        tree = &(*tree / *polyToHorner(&denominator, variable));
+    }
+
+    destroy(&numerator);
+    destroy(&denominator);
+
+    return tree;
+}
+
+//-----------------------------------------------------------------------------
+//! Differentiates the subtree directly on its coefficients if it's a rational
+//! function of the variable.
+//!
+//! @return the derivative in Horner form or nullptr if the subtree isn't a
+//!         rational function or the coefficients overflow.
+//-----------------------------------------------------------------------------
+ETNode* differentiateRational(const ETNode* root, int variable)
+{
+    assert(root != nullptr);
+
+    Rational rational   = {};
+    Rational derivative = {};
+    ETNode*  result     = nullptr;
+
+    if (rationalFromTree(&rational, root, variable) && rationalDerivative(&derivative, &rational) &&
+        polyIsFinite(&derivative.numerator) && polyIsFinite(&derivative.denominator))
+    {
+        result = rationalToTree(&derivative, variable);
+    }
+
+    destroy(&rational);
+    destroy(&derivative);
+
+    return result;
+}
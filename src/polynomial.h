@@ -0,0 +1,82 @@
+#pragma once
+
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup POLYNOMIALS Sparse polynomial and rational function normal form
+//! @addtogroup POLYNOMIALS
+//! @{
+
+struct PolyTerm
+{
+    long   power;
+    double coef;
+};
+
+//! Terms are kept sorted by strictly decreasing power, zero coefficients are
+//! never stored (so the zero polynomial has no terms at all).
+struct Polynomial
+{
+    PolyTerm* terms    = nullptr;
+    size_t    count    = 0;
+    size_t    capacity = 0;
+};
+
+//! numerator / denominator, the denominator is kept monic when dividing by its
+//! leading coefficient is exact.
+struct Rational
+{
+    Polynomial numerator   = {};
+    Polynomial denominator = {};
+};
+
+//! Biggest |n| accepted in (...)^n when converting a tree.
+static const long   POLY_MAX_EXPONENT   = 4096;
+
+//! Biggest n for which (...)^n is expanded when the base has more than one
+//! term, the expansion is dense and its coefficients grow like binomials.
+static const long   POLY_MAX_EXPANDED_POWER = 16;
+
+//! Coefficients that cancel down to this fraction of their terms are dropped.
+static const double POLY_EPSILON        = 1e-12;
+
+//! Dense multiplication buffer is used while the result spans at most this many powers.
+static const size_t POLY_DENSE_SPAN     = 1 << 20;
+
+//! Denominators of higher degree aren't reduced by gcd (floating point gcd gets unstable).
+static const long   POLY_GCD_MAX_DEGREE = 64;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+Polynomial* construct          (Polynomial* poly);
+void        destroy            (Polynomial* poly);
+void        polyClear          (Polynomial* poly);
+void        polyCopy           (Polynomial* dest, const Polynomial* src);
+bool        polyPushTerm       (Polynomial* poly, long power, double coef);
+bool        polySetConstant    (Polynomial* poly, double value);
+
+long        polyDegree         (const Polynomial* poly);
+bool        polyIsZero         (const Polynomial* poly);
+bool        polyIsConstant     (const Polynomial* poly);
+bool        polyIsFinite       (const Polynomial* poly);
+double      polyConstant       (const Polynomial* poly);
+
+bool        polyAdd            (Polynomial* result, const Polynomial* poly1, const Polynomial* poly2, double factor2);
+bool        polyMul            (Polynomial* result, const Polynomial* poly1, const Polynomial* poly2);
+bool        polyPow            (Polynomial* result, const Polynomial* poly, long power);
+bool        polyScale          (Polynomial* poly, double factor);
+bool        polyDivMod         (Polynomial* quotient, Polynomial* remainder, const Polynomial* dividend, const Polynomial* divisor);
+bool        polyDerivative     (Polynomial* result, const Polynomial* poly);
+double      polyEvaluate       (const Polynomial* poly, double x);
+ETNode*     polyToHorner       (const Polynomial* poly, int variable);
+
+Rational*   construct          (Rational* rational);
+void        destroy            (Rational* rational);
+bool        rationalNormalize  (Rational* rational);
+bool        rationalDerivative (Rational* result, const Rational* rational);
+double      rationalEvaluate   (const Rational* rational, double x);
+bool        rationalFromTree   (Rational* rational, const ETNode* root, int variable);
+ETNode*     rationalToTree     (const Rational* rational, int variable);
+
+ETNode*     differentiateRational (const ETNode* root, int variable);
@@ -0,0 +1,342 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "instrumentation.h"
+#include "render_queue.h"
+#include "thread_pool.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t RENDER_MAX_ARGS    = 8;
+static const int    RENDER_EXEC_FAILED = 127;
+
+static RenderQueue* RENDER_QUEUE = nullptr;
+
+RenderJob* pushJob      (RenderQueue* queue, RenderJobType type, const char* source);
+bool       startJob     (RenderJob* job);
+bool       reapJob      (RenderQueue* queue, RenderJob* job, bool isBlocking);
+void       finishJob    (RenderQueue* queue, RenderJob* job);
+void       dropFinished (RenderQueue* queue);
+
+//-----------------------------------------------------------------------------
+//! @param [out] queue
+//! @param [in]  maxRunning   0 for defaultThreadsCount()
+//! @param [in]  isRendering  false to only count the jobs
+//-----------------------------------------------------------------------------
+RenderQueue* construct(RenderQueue* queue, size_t maxRunning, bool isRendering)
+{
+    assert(queue != nullptr);
+
+    *queue = {};
+
+    queue->jobs = (RenderJob*) calloc(RENDER_INIT_CAPACITY, sizeof(RenderJob));
+    CHECK_NULL(queue->jobs, return nullptr);
+
+    queue->capacity    = RENDER_INIT_CAPACITY;
+    queue->maxRunning  = maxRunning != 0 ? maxRunning : defaultThreadsCount();
+    queue->isRendering = isRendering;
+
+    return queue;
+}
+
+//-----------------------------------------------------------------------------
+//! Waits for all the jobs, so no child is left behind.
+//-----------------------------------------------------------------------------
+void destroy(RenderQueue* queue)
+{
+    assert(queue != nullptr);
+
+    waitRenders(queue);
+
+    if (RENDER_QUEUE == queue) { RENDER_QUEUE = nullptr; }
+
+    free(queue->jobs);
+
+    *queue = {};
+}
+
+//-----------------------------------------------------------------------------
+//! Sets the queue the dumps enqueue their jobs to, without one they only
+//! write their sources.
+//!
+//! @return previous queue.
+//-----------------------------------------------------------------------------
+RenderQueue* setRenderQueue(RenderQueue* queue)
+{
+    RenderQueue* previousQueue = RENDER_QUEUE;
+    RENDER_QUEUE = queue;
+
+    return previousQueue;
+}
+
+RenderQueue* getRenderQueue()
+{
+    return RENDER_QUEUE;
+}
+
+bool enqueueLatex(RenderQueue* queue, const char* source, const char* outputDir, const char* jobName)
+{
+    assert(queue     != nullptr);
+    assert(outputDir != nullptr);
+    assert(jobName   != nullptr);
+
+    RenderJob* job = pushJob(queue, RENDER_JOB_LATEX, source);
+    CHECK_NULL(job, return false);
+
+    snprintf(job->output,  sizeof(job->output),  "%s", outputDir);
+    snprintf(job->jobName, sizeof(job->jobName), "%s", jobName);
+
+    pollRenders(queue);
+
+    return true;
+}
+
+bool enqueueDot(RenderQueue* queue, const char* source, const char* output)
+{
+    assert(queue  != nullptr);
+    assert(output != nullptr);
+
+    RenderJob* job = pushJob(queue, RENDER_JOB_DOT, source);
+    CHECK_NULL(job, return false);
+
+    snprintf(job->output, sizeof(job->output), "%s", output);
+
+    pollRenders(queue);
+
+    return true;
+}
+
+RenderJob* pushJob(RenderQueue* queue, RenderJobType type, const char* source)
+{
+    assert(queue  != nullptr);
+    assert(source != nullptr);
+
+    if (strlen(source) >= RENDER_MAX_PATH_LENGTH)
+    {
+        logMessage("Render job source name '%s' is too long.", LG_STYLE_CLASS_ERROR, source);
+        return nullptr;
+    }
+
+    if (queue->jobsCount == queue->capacity)
+    {
+        size_t     capacity = 2 * queue->capacity;
+        RenderJob* jobs     = (RenderJob*) realloc(queue->jobs, capacity * sizeof(RenderJob));
+        CHECK_NULL(jobs, return nullptr);
+
+        queue->jobs     = jobs;
+        queue->capacity = capacity;
+    }
+
+    RenderJob* job = &queue->jobs[queue->jobsCount++];
+
+    *job      = {};
+    job->type = type;
+    snprintf(job->source, sizeof(job->source), "%s", source);
+
+    return job;
+}
+
+//-----------------------------------------------------------------------------
+//! Collects the finished jobs and starts pending ones while there are free
+//! places, never blocks.
+//!
+//! @return number of jobs that haven't finished yet.
+//-----------------------------------------------------------------------------
+size_t pollRenders(RenderQueue* queue)
+{
+    assert(queue != nullptr);
+
+    for (size_t i = 0; i < queue->firstPending; i++)
+    {
+        if (queue->jobs[i].state == RENDER_JOB_RUNNING) { reapJob(queue, &queue->jobs[i], false); }
+    }
+
+    while (queue->firstPending < queue->jobsCount && (!queue->isRendering || queue->runningCount < queue->maxRunning))
+    {
+        RenderJob* job = &queue->jobs[queue->firstPending++];
+
+        if (!queue->isRendering)
+        {
+            job->state = RENDER_JOB_SKIPPED;
+            finishJob(queue, job);
+        }
+        else if (startJob(job))
+        {
+            queue->runningCount++;
+        }
+        else
+        {
+            finishJob(queue, job);
+        }
+    }
+
+    dropFinished(queue);
+
+    return queue->jobsCount;
+}
+
+//-----------------------------------------------------------------------------
+//! Blocks until every job has finished.
+//-----------------------------------------------------------------------------
+void waitRenders(RenderQueue* queue)
+{
+    assert(queue != nullptr);
+
+    while (pollRenders(queue) > 0)
+    {
+        // the first running job is the oldest one, waiting for it keeps the
+        // pool busy without spinning
+        for (size_t i = 0; i < queue->firstPending; i++)
+        {
+            if (queue->jobs[i].state == RENDER_JOB_RUNNING)
+            {
+                reapJob(queue, &queue->jobs[i], true);
+                break;
+            }
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Forks and execs the renderer of the job. The child's standard streams go
+//! to /dev/null, so pdflatex can't stop and wait for input.
+//!
+//! @return false if the child can't be started, the job is failed then.
+//-----------------------------------------------------------------------------
+bool startJob(RenderJob* job)
+{
+    assert(job != nullptr);
+
+    char outputDirArg[RENDER_MAX_PATH_LENGTH + 32] = {};
+    char jobNameArg[RENDER_MAX_PATH_LENGTH + 32]   = {};
+
+    const char* args[RENDER_MAX_ARGS] = {};
+
+    if (job->type == RENDER_JOB_LATEX)
+    {
+        snprintf(outputDirArg, sizeof(outputDirArg), "-output-directory=%s", job->output);
+        snprintf(jobNameArg,   sizeof(jobNameArg),   "-jobname=%s",          job->jobName);
+
+        const char* latexArgs[] = { "pdflatex", "-interaction=nonstopmode", "-halt-on-error",
+                                    outputDirArg, jobNameArg, job->source, nullptr };
+
+        memcpy(args, latexArgs, sizeof(latexArgs));
+    }
+    else
+    {
+        const char* dotArgs[] = { "dot", "-Tsvg", job->source, "-o", job->output, nullptr };
+
+        memcpy(args, dotArgs, sizeof(dotArgs));
+    }
+
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        int nullFd = open("/dev/null", O_RDWR);
+
+        if (nullFd != -1)
+        {
+            dup2(nullFd, STDIN_FILENO);
+            dup2(nullFd, STDOUT_FILENO);
+            dup2(nullFd, STDERR_FILENO);
+        }
+
+        execvp(args[0], (char* const*) args);
+        _exit(RENDER_EXEC_FAILED);
+    }
+
+    if (pid == -1)
+    {
+        job->state = RENDER_JOB_FAILED;
+        return false;
+    }
+
+    job->pid   = pid;
+    job->state = RENDER_JOB_RUNNING;
+    INSTR_START_TIME(job->startTime);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return true if the job has finished.
+//-----------------------------------------------------------------------------
+bool reapJob(RenderQueue* queue, RenderJob* job, bool isBlocking)
+{
+    assert(queue != nullptr);
+    assert(job   != nullptr);
+
+    int   status = 0;
+    pid_t pid    = waitpid(job->pid, &status, isBlocking ? 0 : WNOHANG);
+
+    if (pid == 0) { return false; }
+
+    if (pid == -1)
+    {
+        job->state      = RENDER_JOB_FAILED;
+        job->exitStatus = -1;
+    }
+    else
+    {
+        job->exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        job->state      = job->exitStatus == 0 ? RENDER_JOB_DONE : RENDER_JOB_FAILED;
+    }
+
+    INSTR_PHASE_TIME(PHASE_RENDER, job->startTime);
+
+    queue->runningCount--;
+    finishJob(queue, job);
+
+    return true;
+}
+
+void finishJob(RenderQueue* queue, RenderJob* job)
+{
+    assert(queue != nullptr);
+    assert(job   != nullptr);
+
+    queue->finishedCount++;
+    if (job->state == RENDER_JOB_FAILED) { queue->failedCount++; }
+
+    if (queue->callback != nullptr)
+    {
+        queue->callback(job, queue->callbackArg);
+    }
+    else if (job->state == RENDER_JOB_FAILED)
+    {
+        logMessage("Rendering '%s' failed with exit status %d.", LG_STYLE_CLASS_ERROR,
+                   job->source, job->exitStatus);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! Moves the running and the pending jobs to the front, they stay in order.
+//-----------------------------------------------------------------------------
+void dropFinished(RenderQueue* queue)
+{
+    assert(queue != nullptr);
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < queue->jobsCount; i++)
+    {
+        RenderJobState state = queue->jobs[i].state;
+
+        if (state != RENDER_JOB_RUNNING && state != RENDER_JOB_PENDING) { continue; }
+
+        if (i == queue->firstPending) { queue->firstPending = kept; }
+
+        queue->jobs[kept++] = queue->jobs[i];
+    }
+
+    if (queue->firstPending > kept) { queue->firstPending = kept; }
+
+    queue->jobsCount = kept;
+}
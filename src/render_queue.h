@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+//-----------------------------------------------------------------------------
+//! @defgroup RENDER_QUEUE Background rendering of .tex and .dot files
+//!
+//! Dumps only write their sources and enqueue a job. Jobs are run by at most
+//! maxRunning child processes at once (pdflatex or dot, started with
+//! fork/exec, no shell), the queue starts new ones and collects finished
+//! ones whenever it's polled. Each finished job is passed to the callback
+//! with its exit status, failures are logged if there's no callback.
+//!
+//! A queue constructed with isRendering = false only counts the jobs, which
+//! is meant for throughput runs.
+//!
+//! @addtogroup RENDER_QUEUE
+//! @{
+
+enum RenderJobType
+{
+    RENDER_JOB_LATEX,
+    RENDER_JOB_DOT
+};
+
+enum RenderJobState
+{
+    RENDER_JOB_PENDING,
+    RENDER_JOB_RUNNING,
+    RENDER_JOB_DONE,
+    RENDER_JOB_FAILED,
+    RENDER_JOB_SKIPPED
+};
+
+static const size_t RENDER_MAX_PATH_LENGTH = 256;
+
+//! LaTeX jobs render source into outputDir/jobName.pdf, dot jobs render it
+//! into output.
+struct RenderJob
+{
+    RenderJobType  type                            = RENDER_JOB_LATEX;
+    RenderJobState state                           = RENDER_JOB_PENDING;
+    char           source[RENDER_MAX_PATH_LENGTH]  = {};
+    char           output[RENDER_MAX_PATH_LENGTH]  = {};
+    char           jobName[RENDER_MAX_PATH_LENGTH] = {};
+
+    pid_t          pid                             = -1;
+    int            exitStatus                      = 0;
+    uint64_t       startTime                       = 0;
+};
+
+typedef void (*RenderCallback)(const RenderJob* job, void* arg);
+
+struct RenderQueue
+{
+    RenderJob*     jobs          = nullptr;
+    size_t         jobsCount     = 0;
+    size_t         capacity      = 0;
+    size_t         firstPending  = 0;
+
+    size_t         maxRunning    = 0;
+    size_t         runningCount  = 0;
+    size_t         finishedCount = 0;
+    size_t         failedCount   = 0;
+    bool           isRendering   = true;
+
+    RenderCallback callback      = nullptr;
+    void*          callbackArg   = nullptr;
+};
+
+static const size_t RENDER_INIT_CAPACITY = 16;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+RenderQueue* construct      (RenderQueue* queue, size_t maxRunning, bool isRendering);
+void         destroy        (RenderQueue* queue);
+RenderQueue* setRenderQueue (RenderQueue* queue);
+RenderQueue* getRenderQueue ();
+
+bool         enqueueLatex   (RenderQueue* queue, const char* source, const char* outputDir, const char* jobName);
+bool         enqueueDot     (RenderQueue* queue, const char* source, const char* output);
+
+size_t       pollRenders    (RenderQueue* queue);
+void         waitRenders    (RenderQueue* queue);
@@ -0,0 +1,899 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <mutex>
+#include "../libs/log_generator.h"
+#include "async_log.h"
+#include "differentiation.h"
+#include "expression_loader.h"
+#include "expression_simplifier.h"
+#include "expression_writer.h"
+#include "result_cache.h"
+#include "taylor_expansion.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+enum CacheOperation
+{
+    CACHE_DIFFERENTIATE,
+    CACHE_SIMPLIFY,
+    CACHE_TAYLOR
+};
+
+struct CacheKey
+{
+    uint64_t low;
+    uint64_t high;
+};
+
+//! Entries are chained in their bucket and in the LRU list, newest first.
+struct CacheEntry
+{
+    CacheKey    key;
+    ETNode*     result;
+    size_t      bytes;
+
+    CacheEntry* newer;
+    CacheEntry* older;
+    CacheEntry* nextInBucket;
+};
+
+struct CacheFileHeader
+{
+    uint32_t signature;
+    uint32_t version;
+};
+
+//! A record of the log is the header followed by length bytes of infix text.
+struct CacheRecordHeader
+{
+    uint64_t keyLow;
+    uint64_t keyHigh;
+    uint32_t length;
+    uint32_t checksum;
+};
+
+//! Open addressing table of the log's records, offset 0 is an empty slot as
+//! the file header is there.
+struct DiskIndex
+{
+    CacheKey* keys;
+    uint64_t* offsets;
+    size_t    capacity;
+    size_t    count;
+};
+
+struct ResultCache
+{
+    std::mutex        mutex;
+    std::atomic<bool> isOpen;
+
+    size_t            memoryBudget;
+    uint64_t          salt;
+
+    CacheEntry**      buckets;
+    size_t            bucketsCount;
+    CacheEntry*       newest;
+    CacheEntry*       oldest;
+
+    int               diskFd;
+    DiskIndex         index;
+
+    CacheStats        stats;
+};
+
+static ResultCache RESULT_CACHE = {};
+
+bool        openDisk          (const char* path);
+bool        indexDisk         (uint64_t fileSize);
+void        destroyCache      ();
+void        hashCanonical     (const ETNode* node, CacheKey* key);
+CacheKey    makeKey           (const ETNode* root, CacheOperation operation, int64_t param1, uint64_t param2);
+uint64_t    mixCacheHash      (uint64_t value);
+uint64_t    hashVariableName  (const char* name, uint64_t seed);
+int         compareKeys       (const CacheKey* key1, const CacheKey* key2);
+uint32_t    checksumText      (const char* text, size_t length);
+ETNode*     lookupResult      (const CacheKey* key);
+void        storeResult       (const CacheKey* key, const ETNode* result);
+CacheEntry* findEntry         (const CacheKey* key);
+void        insertEntry       (const CacheKey* key, ETNode* result);
+void        unlinkEntry       (CacheEntry* entry);
+void        pushNewest        (CacheEntry* entry);
+void        evictEntries      (size_t bytesNeeded);
+bool        growBuckets       ();
+uint64_t*   findDiskOffset    (const CacheKey* key);
+bool        addDiskOffset     (const CacheKey* key, uint64_t offset);
+ETNode*     readDiskResult    (uint64_t offset, const CacheKey* key);
+void        appendDiskResult  (const CacheKey* key, const ETNode* result);
+void        replaceTree       (ETNode* root, ETNode* tree);
+
+//-----------------------------------------------------------------------------
+//! @return false if the cache is already open, or there isn't enough memory,
+//!         or the file can't be opened or isn't a cache file.
+//-----------------------------------------------------------------------------
+bool openResultCache(const CacheConfig* config)
+{
+    assert(config != nullptr);
+
+    std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+    if (RESULT_CACHE.isOpen.load(std::memory_order_relaxed)) { return false; }
+
+    RESULT_CACHE.memoryBudget = config->memoryBudget;
+    RESULT_CACHE.salt         = config->salt;
+    RESULT_CACHE.diskFd       = -1;
+    RESULT_CACHE.stats        = {};
+
+    RESULT_CACHE.buckets      = (CacheEntry**) calloc(CACHE_INIT_BUCKETS, sizeof(CacheEntry*));
+    RESULT_CACHE.bucketsCount = CACHE_INIT_BUCKETS;
+    CHECK_NULL(RESULT_CACHE.buckets, return false);
+
+    if (config->diskPath != nullptr && !openDisk(config->diskPath))
+    {
+        destroyCache();
+        return false;
+    }
+
+    RESULT_CACHE.isOpen.store(true, std::memory_order_release);
+
+    return true;
+}
+
+void closeResultCache()
+{
+    std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+    if (!RESULT_CACHE.isOpen.load(std::memory_order_relaxed)) { return; }
+
+    RESULT_CACHE.isOpen.store(false, std::memory_order_release);
+
+    destroyCache();
+}
+
+bool isResultCacheOpen()
+{
+    return RESULT_CACHE.isOpen.load(std::memory_order_acquire);
+}
+
+void destroyCache()
+{
+    for (CacheEntry* entry = RESULT_CACHE.newest; entry != nullptr; )
+    {
+        CacheEntry* older = entry->older;
+
+        destroySubtree(entry->result);
+        free(entry);
+
+        entry = older;
+    }
+
+    free(RESULT_CACHE.buckets);
+    free(RESULT_CACHE.index.keys);
+    free(RESULT_CACHE.index.offsets);
+
+    if (RESULT_CACHE.diskFd != -1) { close(RESULT_CACHE.diskFd); }
+
+    RESULT_CACHE.buckets      = nullptr;
+    RESULT_CACHE.bucketsCount = 0;
+    RESULT_CACHE.newest       = nullptr;
+    RESULT_CACHE.oldest       = nullptr;
+    RESULT_CACHE.diskFd       = -1;
+    RESULT_CACHE.index        = {};
+}
+
+bool openDisk(const char* path)
+{
+    assert(path != nullptr);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    struct stat fileStat = {};
+    if (fd == -1 || fstat(fd, &fileStat) == -1)
+    {
+        logMessage("Unable to open cache file '%s': %s.", LG_STYLE_CLASS_ERROR, path, strerror(errno));
+        if (fd != -1) { close(fd); }
+        return false;
+    }
+
+    RESULT_CACHE.diskFd = fd;
+
+    CacheFileHeader header = { CACHE_FILE_SIGNATURE, CACHE_FILE_VERSION };
+
+    if (fileStat.st_size == 0)
+    {
+        if (write(fd, &header, sizeof(header)) != sizeof(header))
+        {
+            logMessage("Unable to write cache file '%s'.", LG_STYLE_CLASS_ERROR, path);
+            return false;
+        }
+
+        return true;
+    }
+
+    CacheFileHeader fileHeader = {};
+    if (pread(fd, &fileHeader, sizeof(fileHeader), 0) != sizeof(fileHeader) ||
+        fileHeader.signature != header.signature || fileHeader.version != header.version)
+    {
+        logMessage("'%s' isn't a cache file of this version.", LG_STYLE_CLASS_ERROR, path);
+        return false;
+    }
+
+    if (!indexDisk((uint64_t) fileStat.st_size))
+    {
+        logMessage("Not enough memory to index cache file '%s'.", LG_STYLE_CLASS_ERROR, path);
+        return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Indexes the records one after another, a later record of a key wins. The
+//! first record that is cut short or has a wrong checksum is truncated with
+//! everything after it.
+//-----------------------------------------------------------------------------
+bool indexDisk(uint64_t fileSize)
+{
+    int      fd       = RESULT_CACHE.diskFd;
+    uint64_t offset   = sizeof(CacheFileHeader);
+    char*    text     = nullptr;
+    size_t   capacity = 0;
+    bool     isOk     = true;
+
+    while (offset < fileSize)
+    {
+        CacheRecordHeader record = {};
+        uint64_t          end    = offset + sizeof(record);
+
+        if (end > fileSize || pread(fd, &record, sizeof(record), (off_t) offset) != sizeof(record)) { break; }
+
+        end += record.length;
+        if (end > fileSize) { break; }
+
+        if (record.length > capacity)
+        {
+            char* newText = (char*) realloc(text, record.length);
+            CHECK_NULL(newText, isOk = false; break);
+
+            text     = newText;
+            capacity = record.length;
+        }
+
+        if (pread(fd, text, record.length, (off_t) (offset + sizeof(record))) != (ssize_t) record.length ||
+            checksumText(text, record.length) != record.checksum)
+        {
+            break;
+        }
+
+        CacheKey key = { record.keyLow, record.keyHigh };
+        if (!addDiskOffset(&key, offset)) { isOk = false; break; }
+
+        offset = end;
+    }
+
+    free(text);
+
+    if (isOk && offset < fileSize)
+    {
+        logMessage("Cache file is torn at %llu, the rest is cut off.", LG_STYLE_CLASS_ERROR,
+                   (unsigned long long) offset);
+
+        if (ftruncate(fd, (off_t) offset) == -1) { return false; }
+    }
+
+    RESULT_CACHE.stats.diskRecords = RESULT_CACHE.index.count;
+
+    return isOk;
+}
+
+//-----------------------------------------------------------------------------
+//! Same as differentiate().
+//-----------------------------------------------------------------------------
+ETNode* cachedDifferentiate(ETNode* root)
+{
+    assert(root != nullptr);
+
+    if (!isResultCacheOpen()) { return differentiate(root); }
+
+    CacheKey key = makeKey(root, CACHE_DIFFERENTIATE, 0, 0);
+
+    ETNode* derivative = lookupResult(&key);
+    if (derivative != nullptr) { return derivative; }
+
+    derivative = differentiate(root);
+    storeResult(&key, derivative);
+
+    return derivative;
+}
+
+//-----------------------------------------------------------------------------
+//! Same as simplifyTree(), a cached result replaces the children of root and
+//! its data, root itself stays.
+//-----------------------------------------------------------------------------
+void cachedSimplifyTree(ETNode* root)
+{
+    assert(root != nullptr);
+
+    if (!isResultCacheOpen())
+    {
+        simplifyTree(root);
+        return;
+    }
+
+    CacheKey key = makeKey(root, CACHE_SIMPLIFY, 0, 0);
+
+    ETNode* simplified = lookupResult(&key);
+    if (simplified != nullptr)
+    {
+        replaceTree(root, simplified);
+        return;
+    }
+
+    simplifyTree(root);
+    storeResult(&key, root);
+}
+
+//-----------------------------------------------------------------------------
+//! Same as taylorExpansion().
+//-----------------------------------------------------------------------------
+ETNode* cachedTaylorExpansion(ETNode* root, int atPoint, size_t maxPower)
+{
+    assert(root != nullptr);
+
+    if (!isResultCacheOpen()) { return taylorExpansion(root, atPoint, maxPower); }
+
+    CacheKey key = makeKey(root, CACHE_TAYLOR, atPoint, maxPower);
+
+    ETNode* expansion = lookupResult(&key);
+    if (expansion != nullptr) { return expansion; }
+
+    expansion = taylorExpansion(root, atPoint, maxPower);
+    storeResult(&key, expansion);
+
+    return expansion;
+}
+
+//-----------------------------------------------------------------------------
+//! Canonical structural hash, two independent 64 bit halves.
+//-----------------------------------------------------------------------------
+void hashCanonical(const ETNode* node, CacheKey* key)
+{
+    assert(key != nullptr);
+
+    if (node == nullptr)
+    {
+        *key = {};
+        return;
+    }
+
+    CacheKey left  = {};
+    CacheKey right = {};
+
+    hashCanonical(node->left,  &left);
+    hashCanonical(node->right, &right);
+
+    if (isTypeOp(node) && (node->data.op == OP_ADD || node->data.op == OP_MUL) && compareKeys(&left, &right) > 0)
+    {
+        CacheKey swap = left;
+        left  = right;
+        right = swap;
+    }
+
+    uint64_t dataLow  = 0;
+    uint64_t dataHigh = 0;
+
+    switch (node->type)
+    {
+        case TYPE_NUMBER:
+        {
+            double number = node->data.number == 0 ? 0 : node->data.number;
+            memcpy(&dataLow, &number, sizeof(dataLow));
+            dataHigh = dataLow;
+            break;
+        }
+
+        case TYPE_VAR:
+        {
+            // ids of longer names differ between runs
+            if (node->data.var < SINGLE_LETTER_VARIABLES_COUNT)
+            {
+                dataLow  = (uint64_t) node->data.var;
+                dataHigh = dataLow;
+                break;
+            }
+
+            const char* name = getVariableName(node->data.var);
+            dataLow  = hashVariableName(name, 0xA4093822299F31D0ull);
+            dataHigh = hashVariableName(name, 0x082EFA98EC4E6C89ull);
+            break;
+        }
+
+        case TYPE_OP:
+            dataLow  = (uint64_t) node->data.op;
+            dataHigh = dataLow;
+            break;
+
+        default:
+            break;
+    }
+
+    dataLow  ^= (uint64_t) node->type << 56;
+    dataHigh ^= (uint64_t) node->type << 56;
+
+    key->low  = mixCacheHash(dataLow ^ 0x243F6A8885A308D3ull);
+    key->low  = mixCacheHash(key->low ^ (left.low  * 0x9E3779B97F4A7C15ull));
+    key->low  = mixCacheHash(key->low ^ (right.low + 0x632BE59BD9B4E019ull));
+
+    key->high = mixCacheHash(dataHigh ^ 0x13198A2E03707344ull);
+    key->high = mixCacheHash(key->high ^ (left.high  * 0xC2B2AE3D27D4EB4Full));
+    key->high = mixCacheHash(key->high ^ (right.high + 0x165667B19E3779F9ull));
+}
+
+CacheKey makeKey(const ETNode* root, CacheOperation operation, int64_t param1, uint64_t param2)
+{
+    assert(root != nullptr);
+
+    CacheKey key = {};
+    hashCanonical(root, &key);
+
+    uint64_t params[] = { (uint64_t) operation, (uint64_t) param1, param2, RESULT_CACHE.salt };
+
+    for (size_t i = 0; i < sizeof(params) / sizeof(params[0]); i++)
+    {
+        key.low  = mixCacheHash(key.low  ^ (params[i] * 0x9E3779B97F4A7C15ull));
+        key.high = mixCacheHash(key.high ^ (params[i] + 0xC2B2AE3D27D4EB4Full));
+    }
+
+    return key;
+}
+
+//! splitmix64 finalizer.
+uint64_t mixCacheHash(uint64_t value)
+{
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+    return value ^ (value >> 31);
+}
+
+//-----------------------------------------------------------------------------
+//! Hashes the name 8 bytes at a time, the halves of the key use different
+//! seeds so that they don't collide together.
+//-----------------------------------------------------------------------------
+uint64_t hashVariableName(const char* name, uint64_t seed)
+{
+    assert(name != nullptr);
+
+    size_t   length = strlen(name);
+    uint64_t hash   = mixCacheHash(seed ^ length);
+
+    for (size_t i = 0; i < length; i += sizeof(uint64_t))
+    {
+        uint64_t chunk = 0;
+        memcpy(&chunk, name + i, length - i < sizeof(chunk) ? length - i : sizeof(chunk));
+
+        hash = mixCacheHash(hash ^ chunk);
+    }
+
+    return hash;
+}
+
+int compareKeys(const CacheKey* key1, const CacheKey* key2)
+{
+    assert(key1 != nullptr);
+    assert(key2 != nullptr);
+
+    if (key1->low  != key2->low)  { return key1->low  < key2->low  ? -1 : 1; }
+    if (key1->high != key2->high) { return key1->high < key2->high ? -1 : 1; }
+
+    return 0;
+}
+
+//! FNV-1a.
+uint32_t checksumText(const char* text, size_t length)
+{
+    assert(text != nullptr || length == 0);
+
+    uint32_t hash = 0x811C9DC5u;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (uint8_t) text[i]) * 0x01000193u;
+    }
+
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+//! @return copy of the cached result, nullptr on a miss.
+//-----------------------------------------------------------------------------
+ETNode* lookupResult(const CacheKey* key)
+{
+    assert(key != nullptr);
+
+    uint64_t offset = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+        CacheEntry* entry = findEntry(key);
+        if (entry != nullptr)
+        {
+            RESULT_CACHE.stats.memoryHits++;
+
+            unlinkEntry(entry);
+            pushNewest(entry);
+
+            return copyTree(entry->result);
+        }
+
+        uint64_t* diskOffset = findDiskOffset(key);
+        if (diskOffset != nullptr) { offset = *diskOffset; }
+    }
+
+    ETNode* result = offset == 0 ? nullptr : readDiskResult(offset, key);
+
+    std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+    if (result == nullptr)
+    {
+        RESULT_CACHE.stats.misses++;
+        return nullptr;
+    }
+
+    RESULT_CACHE.stats.diskHits++;
+
+    ETNode* copy = copyTree(result);
+    if (findEntry(key) == nullptr) { insertEntry(key, copy); }
+    else                           { destroySubtree(copy);   }
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//! Keeps a copy of result in memory and appends it to the log if it isn't
+//! there yet.
+//-----------------------------------------------------------------------------
+void storeResult(const CacheKey* key, const ETNode* result)
+{
+    assert(key    != nullptr);
+    assert(result != nullptr);
+
+    ETNode* copy = copyTree(result);
+    bool    isOnDisk = true;
+
+    {
+        std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+        // another thread may have done the same work meanwhile
+        if (findEntry(key) == nullptr) { insertEntry(key, copy); }
+        else                           { destroySubtree(copy);   }
+
+        isOnDisk = RESULT_CACHE.diskFd == -1 || findDiskOffset(key) != nullptr;
+    }
+
+    if (!isOnDisk) { appendDiskResult(key, result); }
+}
+
+CacheEntry* findEntry(const CacheKey* key)
+{
+    assert(key != nullptr);
+
+    CacheEntry* entry = RESULT_CACHE.buckets[key->low % RESULT_CACHE.bucketsCount];
+
+    while (entry != nullptr && compareKeys(&entry->key, key) != 0) { entry = entry->nextInBucket; }
+
+    return entry;
+}
+
+//-----------------------------------------------------------------------------
+//! Takes the result, frees it if it doesn't fit into the budget.
+//-----------------------------------------------------------------------------
+void insertEntry(const CacheKey* key, ETNode* result)
+{
+    assert(key    != nullptr);
+    assert(result != nullptr);
+
+    size_t nodesCount = 0;
+    treeSize(result, &nodesCount);
+
+    size_t bytes = sizeof(CacheEntry) + nodesCount * sizeof(ETNode);
+
+    CacheEntry* entry = bytes > RESULT_CACHE.memoryBudget ? nullptr : (CacheEntry*) calloc(1, sizeof(CacheEntry));
+    if (entry == nullptr)
+    {
+        destroySubtree(result);
+        return;
+    }
+
+    evictEntries(bytes);
+
+    if (RESULT_CACHE.stats.entries >= RESULT_CACHE.bucketsCount) { growBuckets(); }
+
+    entry->key    = *key;
+    entry->result = result;
+    entry->bytes  = bytes;
+
+    CacheEntry** bucket = &RESULT_CACHE.buckets[key->low % RESULT_CACHE.bucketsCount];
+    entry->nextInBucket = *bucket;
+    *bucket             = entry;
+
+    pushNewest(entry);
+
+    RESULT_CACHE.stats.entries++;
+    RESULT_CACHE.stats.memoryBytes += bytes;
+}
+
+//-----------------------------------------------------------------------------
+//! Takes the entry out of the LRU list only.
+//-----------------------------------------------------------------------------
+void unlinkEntry(CacheEntry* entry)
+{
+    assert(entry != nullptr);
+
+    if (entry->newer != nullptr) { entry->newer->older = entry->older; }
+    else                         { RESULT_CACHE.newest = entry->older; }
+
+    if (entry->older != nullptr) { entry->older->newer = entry->newer; }
+    else                         { RESULT_CACHE.oldest = entry->newer; }
+
+    entry->newer = nullptr;
+    entry->older = nullptr;
+}
+
+void pushNewest(CacheEntry* entry)
+{
+    assert(entry != nullptr);
+
+    entry->older = RESULT_CACHE.newest;
+    if (RESULT_CACHE.newest != nullptr) { RESULT_CACHE.newest->newer = entry; }
+
+    RESULT_CACHE.newest = entry;
+    if (RESULT_CACHE.oldest == nullptr) { RESULT_CACHE.oldest = entry; }
+}
+
+void evictEntries(size_t bytesNeeded)
+{
+    while (RESULT_CACHE.oldest != nullptr && RESULT_CACHE.stats.memoryBytes + bytesNeeded > RESULT_CACHE.memoryBudget)
+    {
+        CacheEntry* entry = RESULT_CACHE.oldest;
+
+        unlinkEntry(entry);
+
+        CacheEntry** link = &RESULT_CACHE.buckets[entry->key.low % RESULT_CACHE.bucketsCount];
+        while (*link != entry) { link = &(*link)->nextInBucket; }
+        *link = entry->nextInBucket;
+
+        RESULT_CACHE.stats.entries--;
+        RESULT_CACHE.stats.memoryBytes -= entry->bytes;
+        RESULT_CACHE.stats.evictions++;
+
+        destroySubtree(entry->result);
+        free(entry);
+    }
+}
+
+//-----------------------------------------------------------------------------
+//! @return false if there isn't enough memory, the buckets stay as they are.
+//-----------------------------------------------------------------------------
+bool growBuckets()
+{
+    size_t       bucketsCount = 2 * RESULT_CACHE.bucketsCount;
+    CacheEntry** buckets      = (CacheEntry**) calloc(bucketsCount, sizeof(CacheEntry*));
+    CHECK_NULL(buckets, return false);
+
+    for (CacheEntry* entry = RESULT_CACHE.newest; entry != nullptr; entry = entry->older)
+    {
+        CacheEntry** bucket = &buckets[entry->key.low % bucketsCount];
+
+        entry->nextInBucket = *bucket;
+        *bucket             = entry;
+    }
+
+    free(RESULT_CACHE.buckets);
+
+    RESULT_CACHE.buckets      = buckets;
+    RESULT_CACHE.bucketsCount = bucketsCount;
+
+    return true;
+}
+
+uint64_t* findDiskOffset(const CacheKey* key)
+{
+    assert(key != nullptr);
+
+    const DiskIndex* index = &RESULT_CACHE.index;
+    if (index->capacity == 0) { return nullptr; }
+
+    for (size_t i = key->high % index->capacity; index->offsets[i] != 0; i = (i + 1) % index->capacity)
+    {
+        if (compareKeys(&index->keys[i], key) == 0) { return &index->offsets[i]; }
+    }
+
+    return nullptr;
+}
+
+bool addDiskOffset(const CacheKey* key, uint64_t offset)
+{
+    assert(key    != nullptr);
+    assert(offset != 0);
+
+    DiskIndex* index = &RESULT_CACHE.index;
+
+    uint64_t* oldOffset = findDiskOffset(key);
+    if (oldOffset != nullptr)
+    {
+        *oldOffset = offset;
+        return true;
+    }
+
+    // kept at most half full
+    if (2 * (index->count + 1) > index->capacity)
+    {
+        DiskIndex newIndex = {};
+
+        newIndex.capacity = index->capacity == 0 ? CACHE_INIT_BUCKETS : 2 * index->capacity;
+        newIndex.keys     = (CacheKey*) calloc(newIndex.capacity, sizeof(CacheKey));
+        newIndex.offsets  = (uint64_t*) calloc(newIndex.capacity, sizeof(uint64_t));
+
+        if (newIndex.keys == nullptr || newIndex.offsets == nullptr)
+        {
+            free(newIndex.keys);
+            free(newIndex.offsets);
+            return false;
+        }
+
+        for (size_t i = 0; i < index->capacity; i++)
+        {
+            if (index->offsets[i] == 0) { continue; }
+
+            size_t slot = index->keys[i].high % newIndex.capacity;
+            while (newIndex.offsets[slot] != 0) { slot = (slot + 1) % newIndex.capacity; }
+
+            newIndex.keys[slot]    = index->keys[i];
+            newIndex.offsets[slot] = index->offsets[i];
+        }
+
+        newIndex.count = index->count;
+
+        free(index->keys);
+        free(index->offsets);
+        *index = newIndex;
+    }
+
+    size_t slot = key->high % index->capacity;
+    while (index->offsets[slot] != 0) { slot = (slot + 1) % index->capacity; }
+
+    index->keys[slot]    = *key;
+    index->offsets[slot] = offset;
+    index->count++;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the record's result parsed, nullptr if it can't be read.
+//-----------------------------------------------------------------------------
+ETNode* readDiskResult(uint64_t offset, const CacheKey* key)
+{
+    assert(key != nullptr);
+
+    CacheRecordHeader record = {};
+    if (pread(RESULT_CACHE.diskFd, &record, sizeof(record), (off_t) offset) != sizeof(record) ||
+        record.keyLow != key->low || record.keyHigh != key->high)
+    {
+        return nullptr;
+    }
+
+    char* text = (char*) calloc(record.length + 1, sizeof(char));
+    CHECK_NULL(text, return nullptr);
+
+    ExprTree tree = {};
+
+    if (pread(RESULT_CACHE.diskFd, text, record.length, (off_t) (offset + sizeof(record))) == (ssize_t) record.length &&
+        checksumText(text, record.length) == record.checksum)
+    {
+        StringBuilder errors = {};
+        construct(&errors);
+
+        if (parseExpression(&tree, text, record.length, &errors) != PARSE_NO_ERROR) { tree.root = nullptr; }
+
+        destroy(&errors);
+    }
+
+    free(text);
+
+    return tree.root;
+}
+
+//-----------------------------------------------------------------------------
+//! Writes the record with a single write(), so records of processes sharing
+//! the file don't interleave.
+//-----------------------------------------------------------------------------
+void appendDiskResult(const CacheKey* key, const ETNode* result)
+{
+    assert(key    != nullptr);
+    assert(result != nullptr);
+
+    StringBuilder recordText = {};
+    construct(&recordText);
+
+    CacheRecordHeader record = { key->low, key->high, 0, 0 };
+
+    if (!appendString(&recordText, (const char*) &record, sizeof(record)) ||
+        !writeExpression(&recordText, result, EXPR_FORMAT_INFIX))
+    {
+        destroy(&recordText);
+        return;
+    }
+
+    record.length   = (uint32_t) (recordText.length - sizeof(record));
+    record.checksum = checksumText(recordText.buffer + sizeof(record), record.length);
+    memcpy(recordText.buffer, &record, sizeof(record));
+
+    std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+    if (RESULT_CACHE.diskFd != -1 && findDiskOffset(key) == nullptr)
+    {
+        off_t offset = lseek(RESULT_CACHE.diskFd, 0, SEEK_END);
+
+        if (offset != -1 &&
+            write(RESULT_CACHE.diskFd, recordText.buffer, recordText.length) == (ssize_t) recordText.length)
+        {
+            if (addDiskOffset(key, (uint64_t) offset)) { RESULT_CACHE.stats.diskRecords++; }
+        }
+        else
+        {
+            LOG_ERROR("Unable to append to the cache file, errno %d, only memory is used from now.", errno);
+
+            close(RESULT_CACHE.diskFd);
+            RESULT_CACHE.diskFd = -1;
+        }
+    }
+
+    destroy(&recordText);
+}
+
+void replaceTree(ETNode* root, ETNode* tree)
+{
+    assert(root != nullptr);
+    assert(tree != nullptr);
+
+    destroySubtree(root->left);
+    destroySubtree(root->right);
+
+    ETNode* parent = root->parent;
+
+    copyNode(root, tree);
+    root->parent = parent;
+
+    deleteNode(tree);
+}
+
+CacheStats getCacheStats()
+{
+    std::lock_guard<std::mutex> lock(RESULT_CACHE.mutex);
+
+    return RESULT_CACHE.stats;
+}
+
+//-----------------------------------------------------------------------------
+//! Appends the stats as a JSON object.
+//-----------------------------------------------------------------------------
+bool writeCacheStats(StringBuilder* builder)
+{
+    assert(builder != nullptr);
+
+    CacheStats stats = getCacheStats();
+
+    return appendFormat(builder, "{\"memoryHits\":%llu,\"diskHits\":%llu,\"misses\":%llu,\"evictions\":%llu,"
+                                 "\"entries\":%zu,\"memoryBytes\":%zu,\"diskRecords\":%zu}",
+                        (unsigned long long) stats.memoryHits, (unsigned long long) stats.diskHits,
+                        (unsigned long long) stats.misses, (unsigned long long) stats.evictions,
+                        stats.entries, stats.memoryBytes, stats.diskRecords);
+}
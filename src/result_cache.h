@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "expression_tree.h"
+#include "string_builder.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup RESULT_CACHE Cache of derivatives, simplifications and expansions
+//!
+//! cachedDifferentiate(), cachedSimplifyTree() and cachedTaylorExpansion()
+//! look the result up by a key before doing the work. The key is a pair of
+//! independent 64 bit structural hashes of the argument tree in a canonical
+//! form, where the operands of + and * are ordered by their hashes and
+//! variables are hashed by their full names, combined with the operation,
+//! its parameters and the config's salt. So "x*sin(x)" and "sin(x) * x" share
+//! their results. No trees are compared, both hashes have to collide for two
+//! arguments to share a result by mistake.
+//!
+//! Results are kept as trees in memory, the least recently used ones are
+//! dropped to stay within memoryBudget bytes. With a diskPath they are also
+//! appended to a log file as infix text, which is indexed when the cache is
+//! opened, so the results survive restarts. A record torn by a crash is cut
+//! off at the next open.
+//!
+//! The cache is process wide and locked, the work of a miss is done outside
+//! of the lock. When it isn't open the functions just do the work.
+//!
+//! @addtogroup RESULT_CACHE
+//! @{
+
+static const size_t   CACHE_DEFAULT_MEMORY_BUDGET = 64 << 20;
+static const size_t   CACHE_INIT_BUCKETS          = 1024;
+
+static const uint32_t CACHE_FILE_SIGNATURE        = 0x43524344; // "DCRC"
+static const uint32_t CACHE_FILE_VERSION          = 1;
+
+struct CacheConfig
+{
+    size_t      memoryBudget = CACHE_DEFAULT_MEMORY_BUDGET;
+    const char* diskPath     = nullptr;     //!< nullptr for memory only
+    uint64_t    salt         = 0;           //!< has to change with the simplification rules
+};
+
+struct CacheStats
+{
+    uint64_t memoryHits  = 0;
+    uint64_t diskHits    = 0;
+    uint64_t misses      = 0;
+    uint64_t evictions   = 0;
+
+    size_t   entries     = 0;
+    size_t   memoryBytes = 0;
+    size_t   diskRecords = 0;
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+bool       openResultCache       (const CacheConfig* config);
+void       closeResultCache      ();
+bool       isResultCacheOpen     ();
+
+ETNode*    cachedDifferentiate   (ETNode* root);
+void       cachedSimplifyTree    (ETNode* root);
+ETNode*    cachedTaylorExpansion (ETNode* root, int atPoint, size_t maxPower);
+
+CacheStats getCacheStats         ();
+bool       writeCacheStats       (StringBuilder* builder);
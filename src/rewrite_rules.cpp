@@ -0,0 +1,575 @@
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "rewrite_rules.h"
+#include "expression_loader.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+struct RuleTrieEdge
+{
+    double        number;
+    RuleTrieNode* child;
+};
+
+//! Node of the discrimination tree. Edges are labeled with the next pattern
+//! symbol in pre-order: an operation, a number or a wildcard (any variable).
+struct RuleTrieNode
+{
+    RuleTrieNode* opEdges[OPERATIONS_COUNT];
+    RuleTrieNode* wildcard;
+
+    RuleTrieEdge* numberEdges;
+    size_t        numberEdgesCount;
+
+    size_t*       rules;
+    size_t        rulesCount;
+};
+
+struct RuleMatcher
+{
+    const RuleSet* ruleSet;
+    ETNode*        subject;
+    ETNode**       bindings;
+    size_t         best;
+
+    ETNode*        pending[RULE_MAX_PATTERN_SIZE + 1];
+    size_t         pendingCount;
+};
+
+RuleTrieNode* newTrieNode      ();
+void          deleteTrie       (RuleTrieNode* trie);
+RuleTrieNode* insertPattern    (RuleTrieNode* trie, const ETNode* pattern);
+bool          addTrieRule      (RuleTrieNode* trie, size_t ruleIndex);
+void          matchTrie        (RuleMatcher* matcher, const RuleTrieNode* trie);
+
+bool          copyRuleSide     (char* dest, const char* begin, const char* end);
+bool          collectVariables (RewriteRule* rule, const ETNode* node);
+bool          hasOnlyVariables (const RewriteRule* rule, const ETNode* node);
+size_t        variableSlot     (const RewriteRule* rule, int variable);
+bool          matchPattern     (const RewriteRule* rule, const ETNode* pattern, ETNode* subject, ETNode** bindings);
+ETNode*       instantiate      (const RewriteRule* rule, const ETNode* replacement, ETNode** bindings);
+
+RuleSet* construct(RuleSet* ruleSet)
+{
+    CHECK_NULL(ruleSet, return nullptr);
+
+    ruleSet->rules      = nullptr;
+    ruleSet->rulesCount = 0;
+    ruleSet->capacity   = 0;
+    ruleSet->trie       = newTrieNode();
+
+    return ruleSet;
+}
+
+void destroy(RuleSet* ruleSet)
+{
+    assert(ruleSet != nullptr);
+
+    for (size_t i = 0; i < ruleSet->rulesCount; i++)
+    {
+        destroySubtree(ruleSet->rules[i].pattern);
+        destroySubtree(ruleSet->rules[i].replacement);
+    }
+
+    free(ruleSet->rules);
+    deleteTrie(ruleSet->trie);
+
+    ruleSet->rules      = nullptr;
+    ruleSet->rulesCount = 0;
+    ruleSet->capacity   = 0;
+    ruleSet->trie       = nullptr;
+}
+
+RuleTrieNode* newTrieNode()
+{
+    return (RuleTrieNode*) calloc(1, sizeof(RuleTrieNode));
+}
+
+void deleteTrie(RuleTrieNode* trie)
+{
+    if (trie == nullptr) { return; }
+
+    for (size_t i = 0; i < OPERATIONS_COUNT; i++)
+    {
+        deleteTrie(trie->opEdges[i]);
+    }
+
+    for (size_t i = 0; i < trie->numberEdgesCount; i++)
+    {
+        deleteTrie(trie->numberEdges[i].child);
+    }
+
+    deleteTrie(trie->wildcard);
+
+    free(trie->numberEdges);
+    free(trie->rules);
+    free(trie);
+}
+
+//-----------------------------------------------------------------------------
+//! Walks (and extends) the path of the pattern's pre-order symbols.
+//!
+//! @return trie node at the end of the path or nullptr if out of memory.
+//-----------------------------------------------------------------------------
+RuleTrieNode* insertPattern(RuleTrieNode* trie, const ETNode* pattern)
+{
+    CHECK_NULL(trie,    return nullptr);
+    CHECK_NULL(pattern, return trie);
+
+    switch (pattern->type)
+    {
+        case TYPE_VAR:
+            if (trie->wildcard == nullptr) { trie->wildcard = newTrieNode(); }
+
+            return trie->wildcard;
+
+        case TYPE_NUMBER:
+        {
+            for (size_t i = 0; i < trie->numberEdgesCount; i++)
+            {
+                if (trie->numberEdges[i].number == pattern->data.number)
+                {
+                    return trie->numberEdges[i].child;
+                }
+            }
+
+            RuleTrieEdge* edges = (RuleTrieEdge*) realloc(trie->numberEdges, (trie->numberEdgesCount + 1) * sizeof(RuleTrieEdge));
+            CHECK_NULL(edges, return nullptr);
+
+            trie->numberEdges = edges;
+            trie->numberEdges[trie->numberEdgesCount++] = { pattern->data.number, newTrieNode() };
+
+            return trie->numberEdges[trie->numberEdgesCount - 1].child;
+        }
+
+        case TYPE_OP:
+        {
+            RuleTrieNode** child = &trie->opEdges[pattern->data.op];
+            if (*child == nullptr) { *child = newTrieNode(); }
+
+            return insertPattern(insertPattern(*child, pattern->left), pattern->right);
+        }
+
+        default:
+            return nullptr;
+    }
+
+    return nullptr;
+}
+
+bool addTrieRule(RuleTrieNode* trie, size_t ruleIndex)
+{
+    assert(trie != nullptr);
+
+    size_t* rules = (size_t*) realloc(trie->rules, (trie->rulesCount + 1) * sizeof(size_t));
+    CHECK_NULL(rules, return false);
+
+    trie->rules = rules;
+    trie->rules[trie->rulesCount++] = ruleIndex;
+
+    return true;
+}
+
+bool copyRuleSide(char* dest, const char* begin, const char* end)
+{
+    assert(dest  != nullptr);
+    assert(begin != nullptr);
+    assert(end   != nullptr);
+
+    while (begin < end && isspace(*begin))     { begin++; }
+    while (end > begin && isspace(*(end - 1))) { end--;   }
+
+    if (begin == end || (size_t) (end - begin) >= RULE_MAX_LENGTH) { return false; }
+
+    memcpy(dest, begin, end - begin);
+    dest[end - begin] = '\0';
+
+    return true;
+}
+
+size_t variableSlot(const RewriteRule* rule, int variable)
+{
+    assert(rule != nullptr);
+
+    for (size_t i = 0; i < rule->variablesCount; i++)
+    {
+        if (rule->variables[i] == variable) { return i; }
+    }
+
+    return RULE_MAX_VARIABLES;
+}
+
+bool collectVariables(RewriteRule* rule, const ETNode* node)
+{
+    assert(rule != nullptr);
+
+    if (node == nullptr) { return true; }
+
+    if (isTypeVar(node) && variableSlot(rule, node->data.var) == RULE_MAX_VARIABLES)
+    {
+        if (rule->variablesCount == RULE_MAX_VARIABLES) { return false; }
+
+        rule->variables[rule->variablesCount++] = node->data.var;
+    }
+
+    return collectVariables(rule, node->left) && collectVariables(rule, node->right);
+}
+
+bool hasOnlyVariables(const RewriteRule* rule, const ETNode* node)
+{
+    assert(rule != nullptr);
+
+    if (node == nullptr) { return true; }
+
+    if (isTypeVar(node) && variableSlot(rule, node->data.var) == RULE_MAX_VARIABLES) { return false; }
+
+    return hasOnlyVariables(rule, node->left) && hasOnlyVariables(rule, node->right);
+}
+
+//-----------------------------------------------------------------------------
+//! Parses 'pattern -> replacement' and compiles the pattern into the trie.
+//! The pattern has to be an operation and the replacement can only use the
+//! variables of the pattern.
+//!
+//! @return whether or not the rule is valid and has been added.
+//-----------------------------------------------------------------------------
+bool addRule(RuleSet* ruleSet, const char* rule)
+{
+    assert(ruleSet       != nullptr);
+    assert(ruleSet->trie != nullptr);
+    assert(rule          != nullptr);
+
+    const char* arrow = strstr(rule, "->");
+    CHECK_NULL(arrow, return false);
+
+    char patternText[RULE_MAX_LENGTH]     = {};
+    char replacementText[RULE_MAX_LENGTH] = {};
+
+    if (!copyRuleSide(patternText,     rule,      arrow))                 { return false; }
+    if (!copyRuleSide(replacementText, arrow + 2, arrow + strlen(arrow))) { return false; }
+
+    ExprTree pattern     = {};
+    ExprTree replacement = {};
+    RewriteRule newRule  = {};
+
+    bool isValid = parseExpression(&pattern,     patternText)     == PARSE_NO_ERROR &&
+                   parseExpression(&replacement, replacementText) == PARSE_NO_ERROR;
+
+    size_t patternSize = 0;
+    if (isValid) { treeSize(pattern.root, &patternSize); }
+
+    isValid = isValid && isTypeOp(pattern.root) && patternSize <= RULE_MAX_PATTERN_SIZE &&
+              collectVariables(&newRule, pattern.root) && hasOnlyVariables(&newRule, replacement.root);
+
+    if (isValid && ruleSet->rulesCount == ruleSet->capacity)
+    {
+        size_t       capacity = ruleSet->capacity == 0 ? 16 : 2 * ruleSet->capacity;
+        RewriteRule* rules    = (RewriteRule*) realloc(ruleSet->rules, capacity * sizeof(RewriteRule));
+
+        isValid = rules != nullptr;
+        if (isValid)
+        {
+            ruleSet->rules    = rules;
+            ruleSet->capacity = capacity;
+        }
+    }
+
+    RuleTrieNode* leaf = isValid ? insertPattern(ruleSet->trie, pattern.root) : nullptr;
+
+    if (leaf == nullptr || !addTrieRule(leaf, ruleSet->rulesCount))
+    {
+        destroy(&pattern);
+        destroy(&replacement);
+        return false;
+    }
+
+    newRule.pattern     = pattern.root;
+    newRule.replacement = replacement.root;
+
+    ruleSet->rules[ruleSet->rulesCount++] = newRule;
+
+    return true;
+}
+
+bool loadRules(RuleSet* ruleSet, const char* filename)
+{
+    assert(ruleSet  != nullptr);
+    assert(filename != nullptr);
+
+    FILE* file = fopen(filename, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Unable to open rule file '%s'.\n", filename);
+        return false;
+    }
+
+    char   line[RULE_MAX_LENGTH] = {};
+    size_t lineNumber            = 0;
+
+    while (fgets(line, sizeof(line), file) != nullptr)
+    {
+        lineNumber++;
+
+        char* comment = strchr(line, '#');
+        if (comment != nullptr) { *comment = '\0'; }
+
+        if (line[strspn(line, " \t\r\n")] == '\0') { continue; }
+
+        if (strchr(line, '\n') == nullptr && !feof(file))
+        {
+            fprintf(stderr, "Rule file '%s', line %zu: the rule is too long.\n", filename, lineNumber);
+            fclose(file);
+            return false;
+        }
+
+        if (!addRule(ruleSet, line))
+        {
+            fprintf(stderr, "Rule file '%s', line %zu: invalid rule.\n", filename, lineNumber);
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Resolves DEFAULT_RULES_FILE_NAME against the directory of the running
+//! executable, so the rules don't depend on the working directory.
+//!
+//! @return false if the executable can't be found or the path doesn't fit.
+//-----------------------------------------------------------------------------
+bool getDefaultRulesPath(char* path, size_t size)
+{
+    assert(path != nullptr);
+
+    ssize_t length = readlink("/proc/self/exe", path, size);
+    if (length <= 0 || (size_t) length >= size) { return false; }
+
+    path[length] = '\0';
+
+    char* directoryEnd = strrchr(path, '/');
+    if (directoryEnd == nullptr) { return false; }
+
+    size_t directoryLength = (size_t) (directoryEnd - path) + 1;
+    int    written         = snprintf(directoryEnd + 1, size - directoryLength, "%s", DEFAULT_RULES_FILE_NAME);
+
+    return written >= 0 && (size_t) written < size - directoryLength;
+}
+
+bool matchPattern(const RewriteRule* rule, const ETNode* pattern, ETNode* subject, ETNode** bindings)
+{
+    assert(rule     != nullptr);
+    assert(bindings != nullptr);
+
+    if (pattern == nullptr) { return subject == nullptr; }
+    if (subject == nullptr) { return false; }
+
+    switch (pattern->type)
+    {
+        case TYPE_VAR:
+        {
+            size_t slot = variableSlot(rule, pattern->data.var);
+            assert(slot < RULE_MAX_VARIABLES);
+
+            if (bindings[slot] == nullptr)
+            {
+                bindings[slot] = subject;
+                return true;
+            }
+
+            return areTreesEqual(bindings[slot], subject);
+        }
+
+        case TYPE_NUMBER:
+            return isTypeNumber(subject) && pattern->data.number == subject->data.number;
+
+        case TYPE_OP:
+            return isTypeOp(subject) && subject->data.op == pattern->data.op &&
+                   matchPattern(rule, pattern->left,  subject->left,  bindings) &&
+                   matchPattern(rule, pattern->right, subject->right, bindings);
+
+        default:
+            return false;
+    }
+
+    return false;
+}
+
+//-----------------------------------------------------------------------------
+//! Follows every trie branch consistent with the subject. The pending stack
+//! holds the subject subtrees still to be matched in pre-order, a wildcard
+//! edge consumes a whole subtree. Candidates found at the leaves only have
+//! repeated variables left to check, the first rule (in file order) wins.
+//-----------------------------------------------------------------------------
+void matchTrie(RuleMatcher* matcher, const RuleTrieNode* trie)
+{
+    assert(matcher != nullptr);
+
+    if (trie == nullptr) { return; }
+
+    if (matcher->pendingCount == 0)
+    {
+        for (size_t i = 0; i < trie->rulesCount; i++)
+        {
+            size_t             ruleIndex = trie->rules[i];
+            const RewriteRule* rule      = &matcher->ruleSet->rules[ruleIndex];
+
+            if (ruleIndex >= matcher->best) { continue; }
+
+            memset(matcher->bindings, 0, RULE_MAX_VARIABLES * sizeof(ETNode*));
+            if (matchPattern(rule, rule->pattern, matcher->subject, matcher->bindings)) { matcher->best = ruleIndex; }
+        }
+
+        return;
+    }
+
+    ETNode* node = matcher->pending[--matcher->pendingCount];
+
+    matchTrie(matcher, trie->wildcard);
+
+    if (isTypeOp(node) && trie->opEdges[node->data.op] != nullptr &&
+        matcher->pendingCount + 2 <= RULE_MAX_PATTERN_SIZE)
+    {
+        size_t pendingCount = matcher->pendingCount;
+
+        matcher->pending[matcher->pendingCount++] = node->right;
+        if (node->left != nullptr) { matcher->pending[matcher->pendingCount++] = node->left; }
+
+        matchTrie(matcher, trie->opEdges[node->data.op]);
+
+        matcher->pendingCount = pendingCount;
+    }
+    else if (isTypeNumber(node))
+    {
+        for (size_t i = 0; i < trie->numberEdgesCount; i++)
+        {
+            if (trie->numberEdges[i].number == node->data.number)
+            {
+                matchTrie(matcher, trie->numberEdges[i].child);
+            }
+        }
+    }
+
+    matcher->pending[matcher->pendingCount++] = node;
+}
+
+//-----------------------------------------------------------------------------
+//! @param [in]  ruleSet
+//! @param [in]  node
+//! @param [out] bindings  RULE_MAX_VARIABLES subtrees bound to the variables
+//!
+//! @return the first rule matching the node or nullptr.
+//-----------------------------------------------------------------------------
+const RewriteRule* matchRules(const RuleSet* ruleSet, ETNode* node, ETNode** bindings)
+{
+    assert(ruleSet  != nullptr);
+    assert(node     != nullptr);
+    assert(bindings != nullptr);
+
+    RuleMatcher matcher  = {};
+    matcher.ruleSet      = ruleSet;
+    matcher.subject      = node;
+    matcher.bindings     = bindings;
+    matcher.best         = ruleSet->rulesCount;
+    matcher.pending[0]   = node;
+    matcher.pendingCount = 1;
+
+    matchTrie(&matcher, ruleSet->trie);
+
+    if (matcher.best == ruleSet->rulesCount) { return nullptr; }
+
+    const RewriteRule* rule = &ruleSet->rules[matcher.best];
+
+    memset(bindings, 0, RULE_MAX_VARIABLES * sizeof(ETNode*));
+    matchPattern(rule, rule->pattern, node, bindings);
+
+    return rule;
+}
+
+ETNode* instantiate(const RewriteRule* rule, const ETNode* replacement, ETNode** bindings)
+{
+    assert(rule     != nullptr);
+    assert(bindings != nullptr);
+
+    if (replacement == nullptr) { return nullptr; }
+
+    if (isTypeVar(replacement))
+    {
+        return copyTree(bindings[variableSlot(rule, replacement->data.var)]);
+    }
+
+    return newNode(replacement->type, replacement->data, instantiate(rule, replacement->left,  bindings),
+                                                         instantiate(rule, replacement->right, bindings));
+}
+
+//-----------------------------------------------------------------------------
+//! Replaces the node (in place, so the pointers to it stay valid) with the
+//! rule's replacement.
+//-----------------------------------------------------------------------------
+bool rewriteNode(const RewriteRule* rule, ETNode* node, ETNode** bindings)
+{
+    assert(rule     != nullptr);
+    assert(node     != nullptr);
+    assert(bindings != nullptr);
+
+    ETNode* result = instantiate(rule, rule->replacement, bindings);
+    CHECK_NULL(result, return false);
+
+    destroySubtree(node->left);
+    destroySubtree(node->right);
+
+    result->parent = node->parent;
+    copyNode(node, result);
+
+    deleteNode(result);
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Single bottom-up pass, every node is rewritten at most once.
+//!
+//! @return whether or not there have been any changes in the subtree.
+//-----------------------------------------------------------------------------
+bool applyRules(const RuleSet* ruleSet, ETNode* root)
+{
+    assert(ruleSet != nullptr);
+
+    if (root == nullptr) { return false; }
+
+    bool isChanged = applyRules(ruleSet, root->left);
+    isChanged      = applyRules(ruleSet, root->right) || isChanged;
+
+    if (!isTypeOp(root)) { return isChanged; }
+
+    ETNode*            bindings[RULE_MAX_VARIABLES] = {};
+    const RewriteRule* rule                         = matchRules(ruleSet, root, bindings);
+
+    if (rule != nullptr && rewriteNode(rule, root, bindings)) { isChanged = true; }
+
+    return isChanged;
+}
+
+//-----------------------------------------------------------------------------
+//! Structural hash of the rules in order, for caches of simplified trees.
+//-----------------------------------------------------------------------------
+uint64_t hashRules(const RuleSet* ruleSet)
+{
+    assert(ruleSet != nullptr);
+
+    uint64_t hash = ruleSet->rulesCount;
+
+    for (size_t i = 0; i < ruleSet->rulesCount; i++)
+    {
+        hash = hash * 0x9E3779B97F4A7C15ull + hashSubtree(ruleSet->rules[i].pattern);
+        hash = hash * 0x9E3779B97F4A7C15ull + hashSubtree(ruleSet->rules[i].replacement);
+    }
+
+    return hash;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "expression_tree.h"
+
+//-----------------------------------------------------------------------------
+//! @defgroup REWRITE_RULES Pattern-matching rewrite rules
+//!
+//! Rules are written one per line as 'pattern -> replacement', both sides in
+//! the usual expression syntax, '#' starts a comment. Every variable of a rule
+//! is a pattern variable matching any subtree, a variable repeated in the
+//! pattern only matches equal subtrees (e.g. 'u - u -> 0').
+//!
+//! Patterns of a rule set are compiled into a discrimination tree keyed by the
+//! pre-order of pattern symbols, so matching a node only walks the branches
+//! that agree with it no matter how many rules there are.
+//!
+//! @addtogroup REWRITE_RULES
+//! @{
+
+//! Rules of the build, relative to the directory of the executable (bin/ of
+//! the Makefile), see getDefaultRulesPath().
+static const char*  DEFAULT_RULES_FILE_NAME = "../rules/simplify.rules";
+static const size_t RULES_MAX_PATH_LENGTH   = 4096;
+
+static const size_t RULE_MAX_LENGTH         = 256;
+static const size_t RULE_MAX_PATTERN_SIZE   = 64;
+static const size_t RULE_MAX_VARIABLES      = 8;
+
+struct RewriteRule
+{
+    ETNode* pattern                       = nullptr;
+    ETNode* replacement                   = nullptr;
+    int     variables[RULE_MAX_VARIABLES] = {};
+    size_t  variablesCount                = 0;
+};
+
+struct RuleTrieNode;
+
+struct RuleSet
+{
+    RewriteRule*  rules      = nullptr;
+    size_t        rulesCount = 0;
+    size_t        capacity   = 0;
+
+    RuleTrieNode* trie       = nullptr;
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+RuleSet*           construct           (RuleSet* ruleSet);
+void               destroy             (RuleSet* ruleSet);
+
+bool               addRule             (RuleSet* ruleSet, const char* rule);
+bool               loadRules           (RuleSet* ruleSet, const char* filename);
+bool               getDefaultRulesPath (char* path, size_t size);
+
+const RewriteRule* matchRules          (const RuleSet* ruleSet, ETNode* node, ETNode** bindings);
+bool               rewriteNode         (const RewriteRule* rule, ETNode* node, ETNode** bindings);
+bool               applyRules          (const RuleSet* ruleSet, ETNode* root);
+uint64_t           hashRules           (const RuleSet* ruleSet);
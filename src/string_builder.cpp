@@ -0,0 +1,150 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "string_builder.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+StringBuilder* construct(StringBuilder* builder)
+{
+    CHECK_NULL(builder, return nullptr);
+
+    builder->buffer   = nullptr;
+    builder->length   = 0;
+    builder->capacity = 0;
+
+    return builder;
+}
+
+void destroy(StringBuilder* builder)
+{
+    assert(builder != nullptr);
+
+    free(builder->buffer);
+
+    builder->buffer   = nullptr;
+    builder->length   = 0;
+    builder->capacity = 0;
+}
+
+//-----------------------------------------------------------------------------
+//! Empties the string keeping the memory.
+//-----------------------------------------------------------------------------
+void clear(StringBuilder* builder)
+{
+    assert(builder != nullptr);
+
+    builder->length = 0;
+    if (builder->buffer != nullptr) { builder->buffer[0] = '\0'; }
+}
+
+//-----------------------------------------------------------------------------
+//! Drops everything after the first length characters.
+//-----------------------------------------------------------------------------
+void truncate(StringBuilder* builder, size_t length)
+{
+    assert(builder != nullptr);
+
+    if (length >= builder->length) { return; }
+
+    builder->length         = length;
+    builder->buffer[length] = '\0';
+}
+
+//-----------------------------------------------------------------------------
+//! Makes room for length more characters (and the null terminator).
+//-----------------------------------------------------------------------------
+bool reserve(StringBuilder* builder, size_t length)
+{
+    assert(builder != nullptr);
+
+    size_t required = builder->length + length + 1;
+    if (required <= builder->capacity) { return true; }
+
+    size_t capacity = builder->capacity == 0 ? STRING_BUILDER_INIT_CAPACITY : builder->capacity;
+    while (capacity < required) { capacity *= 2; }
+
+    char* buffer = (char*) realloc(builder->buffer, capacity);
+    CHECK_NULL(buffer, return false);
+
+    builder->buffer   = buffer;
+    builder->capacity = capacity;
+
+    return true;
+}
+
+bool appendChar(StringBuilder* builder, char symbol)
+{
+    assert(builder != nullptr);
+
+    if (!reserve(builder, 1)) { return false; }
+
+    builder->buffer[builder->length++] = symbol;
+    builder->buffer[builder->length]   = '\0';
+
+    return true;
+}
+
+bool appendString(StringBuilder* builder, const char* string)
+{
+    assert(string != nullptr);
+
+    return appendString(builder, string, strlen(string));
+}
+
+bool appendString(StringBuilder* builder, const char* string, size_t length)
+{
+    assert(builder != nullptr);
+    assert(string  != nullptr);
+
+    if (!reserve(builder, length)) { return false; }
+
+    memcpy(builder->buffer + builder->length, string, length);
+
+    builder->length                 += length;
+    builder->buffer[builder->length] = '\0';
+
+    return true;
+}
+
+bool appendFormat(StringBuilder* builder, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+
+    bool isAppended = appendFormatV(builder, format, args);
+
+    va_end(args);
+
+    return isAppended;
+}
+
+bool appendFormatV(StringBuilder* builder, const char* format, va_list args)
+{
+    assert(builder != nullptr);
+    assert(format  != nullptr);
+
+    va_list argsCopy;
+    va_copy(argsCopy, args);
+
+    int length = vsnprintf(nullptr, 0, format, argsCopy);
+    va_end(argsCopy);
+
+    if (length < 0 || !reserve(builder, (size_t) length)) { return false; }
+
+    vsnprintf(builder->buffer + builder->length, (size_t) length + 1, format, args);
+    builder->length += (size_t) length;
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! @return the string, "" if nothing has been appended yet.
+//-----------------------------------------------------------------------------
+const char* getString(const StringBuilder* builder)
+{
+    assert(builder != nullptr);
+
+    return builder->buffer != nullptr ? builder->buffer : "";
+}
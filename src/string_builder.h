@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+//! @defgroup STRING_BUILDER Growing null terminated string
+//! @addtogroup STRING_BUILDER
+//! @{
+
+struct StringBuilder
+{
+    char*  buffer   = nullptr;
+    size_t length   = 0;
+    size_t capacity = 0;
+};
+
+static const size_t STRING_BUILDER_INIT_CAPACITY = 256;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+StringBuilder* construct     (StringBuilder* builder);
+void           destroy       (StringBuilder* builder);
+void           clear         (StringBuilder* builder);
+void           truncate      (StringBuilder* builder, size_t length);
+
+bool           reserve       (StringBuilder* builder, size_t length);
+bool           appendChar    (StringBuilder* builder, char symbol);
+bool           appendString  (StringBuilder* builder, const char* string);
+bool           appendString  (StringBuilder* builder, const char* string, size_t length);
+bool           appendFormat  (StringBuilder* builder, const char* format, ...);
+bool           appendFormatV (StringBuilder* builder, const char* format, va_list args);
+
+const char*    getString     (const StringBuilder* builder);
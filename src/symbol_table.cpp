@@ -0,0 +1,220 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include "math_syntax.h"
+#include "symbol_table.h"
+
+//! Names are kept in pages that never move, so the table grows without
+//! invalidating the names handed out.
+static const size_t SYMBOL_PAGE_SIZE        = 1024;
+static const size_t SYMBOL_MAX_PAGES        = 1 << 14;
+static const size_t SYMBOL_INIT_SLOTS_COUNT = 256;
+
+struct LetterNames
+{
+    char names[SINGLE_LETTER_VARIABLES_COUNT][2];
+
+    constexpr LetterNames() : names()
+    {
+        for (int i = 0; i < SINGLE_LETTER_VARIABLES_COUNT; i++) { names[i][0] = (char) i; }
+    }
+};
+
+//! Names are only appended, and a name is stored before its id is published,
+//! so reading a name by an id that has been handed out needs no lock.
+struct SymbolTable
+{
+    const char**        pages[SYMBOL_MAX_PAGES];
+    std::atomic<size_t> count;
+
+    // open addressing, 0 is an empty slot (no interned name has id 0), grown
+    // to keep it at most half full
+    int*                slots;
+    size_t              slotsCount;
+    std::mutex          mutex;
+};
+
+static constexpr LetterNames LETTER_NAMES;
+static SymbolTable           SYMBOL_TABLE = {};
+
+uint64_t    hashName   (const char* name, size_t length);
+size_t      findSlot   (const char* name, size_t length, uint64_t hash);
+bool        growSlots  ();
+const char* getName    (size_t id);
+
+uint64_t hashName(const char* name, size_t length)
+{
+    assert(name != nullptr);
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char) name[i]) * 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+//-----------------------------------------------------------------------------
+//! @return slot holding the name or the empty slot where it would go, the
+//!         table has to be locked.
+//-----------------------------------------------------------------------------
+size_t findSlot(const char* name, size_t length, uint64_t hash)
+{
+    assert(name != nullptr);
+
+    assert(SYMBOL_TABLE.slotsCount != 0);
+
+    size_t mask = SYMBOL_TABLE.slotsCount - 1;
+    size_t slot = (size_t) hash & mask;
+
+    for (; SYMBOL_TABLE.slots[slot] != 0; slot = (slot + 1) & mask)
+    {
+        const char* slotName = getName((size_t) SYMBOL_TABLE.slots[slot]);
+
+        if (strncmp(slotName, name, length) == 0 && slotName[length] == '\0') { break; }
+    }
+
+    return slot;
+}
+
+//-----------------------------------------------------------------------------
+//! Doubles the slots, the table has to be locked.
+//-----------------------------------------------------------------------------
+bool growSlots()
+{
+    size_t slotsCount = SYMBOL_TABLE.slotsCount != 0 ? 2 * SYMBOL_TABLE.slotsCount : SYMBOL_INIT_SLOTS_COUNT;
+    int*   slots      = (int*) calloc(slotsCount, sizeof(int));
+    if (slots == nullptr) { return false; }
+
+    int*   oldSlots      = SYMBOL_TABLE.slots;
+    size_t oldSlotsCount = SYMBOL_TABLE.slotsCount;
+
+    SYMBOL_TABLE.slots      = slots;
+    SYMBOL_TABLE.slotsCount = slotsCount;
+
+    for (size_t i = 0; i < oldSlotsCount; i++)
+    {
+        if (oldSlots[i] == 0) { continue; }
+
+        const char* name   = getName((size_t) oldSlots[i]);
+        size_t      length = strlen(name);
+
+        slots[findSlot(name, length, hashName(name, length))] = oldSlots[i];
+    }
+
+    free(oldSlots);
+
+    return true;
+}
+
+const char* getName(size_t id)
+{
+    assert(id >= (size_t) SINGLE_LETTER_VARIABLES_COUNT);
+
+    return SYMBOL_TABLE.pages[id / SYMBOL_PAGE_SIZE][id % SYMBOL_PAGE_SIZE];
+}
+
+//-----------------------------------------------------------------------------
+//! @return id of the name, VARIABLE_INVALID_ID if it isn't a valid variable
+//!         name or the table is full.
+//-----------------------------------------------------------------------------
+int internVariable(const char* name, size_t length)
+{
+    assert(name != nullptr);
+
+    if (length == 1) { return isVariable(name[0]) ? (unsigned char) name[0] : VARIABLE_INVALID_ID; }
+
+    if (length == 0 || length > VARIABLE_NAME_MAX_LENGTH) { return VARIABLE_INVALID_ID; }
+
+    uint64_t hash = hashName(name, length);
+
+    std::lock_guard<std::mutex> lock(SYMBOL_TABLE.mutex);
+
+    size_t count = SYMBOL_TABLE.count.load(std::memory_order_relaxed);
+    if (count == 0) { count = SINGLE_LETTER_VARIABLES_COUNT; }
+
+    if (2 * (count + 1 - SINGLE_LETTER_VARIABLES_COUNT) > SYMBOL_TABLE.slotsCount && !growSlots())
+    {
+        return VARIABLE_INVALID_ID;
+    }
+
+    size_t slot = findSlot(name, length, hash);
+    if (SYMBOL_TABLE.slots[slot] != 0) { return SYMBOL_TABLE.slots[slot]; }
+
+    if (count == SYMBOL_MAX_PAGES * SYMBOL_PAGE_SIZE) { return VARIABLE_INVALID_ID; }
+
+    const char** page = SYMBOL_TABLE.pages[count / SYMBOL_PAGE_SIZE];
+    if (page == nullptr)
+    {
+        page = (const char**) calloc(SYMBOL_PAGE_SIZE, sizeof(const char*));
+        if (page == nullptr) { return VARIABLE_INVALID_ID; }
+
+        SYMBOL_TABLE.pages[count / SYMBOL_PAGE_SIZE] = page;
+    }
+
+    char* nameCopy = (char*) calloc(length + 1, sizeof(char));
+    if (nameCopy == nullptr) { return VARIABLE_INVALID_ID; }
+
+    memcpy(nameCopy, name, length);
+
+    page[count % SYMBOL_PAGE_SIZE] = nameCopy;
+    SYMBOL_TABLE.slots[slot]       = (int) count;
+    SYMBOL_TABLE.count.store(count + 1, std::memory_order_release);
+
+    return (int) count;
+}
+
+//-----------------------------------------------------------------------------
+//! @return id of the name or VARIABLE_INVALID_ID if it hasn't been interned.
+//-----------------------------------------------------------------------------
+int findVariable(const char* name, size_t length)
+{
+    assert(name != nullptr);
+
+    if (length == 1) { return isVariable(name[0]) ? (unsigned char) name[0] : VARIABLE_INVALID_ID; }
+
+    if (length == 0 || length > VARIABLE_NAME_MAX_LENGTH) { return VARIABLE_INVALID_ID; }
+
+    uint64_t hash = hashName(name, length);
+
+    std::lock_guard<std::mutex> lock(SYMBOL_TABLE.mutex);
+
+    if (SYMBOL_TABLE.slotsCount == 0) { return VARIABLE_INVALID_ID; }
+
+    size_t slot = findSlot(name, length, hash);
+
+    return SYMBOL_TABLE.slots[slot] != 0 ? SYMBOL_TABLE.slots[slot] : VARIABLE_INVALID_ID;
+}
+
+const char* getVariableName(int id)
+{
+    assert(isVariableId(id));
+
+    if (id < SINGLE_LETTER_VARIABLES_COUNT) { return LETTER_NAMES.names[id]; }
+
+    return getName((size_t) id);
+}
+
+bool isVariableId(int id)
+{
+    if (id < 0) { return false; }
+
+    if (id < SINGLE_LETTER_VARIABLES_COUNT) { return isVariable((char) id); }
+
+    return (size_t) id < variablesCount();
+}
+
+//-----------------------------------------------------------------------------
+//! @return number of ids in use, all ids are below it.
+//-----------------------------------------------------------------------------
+size_t variablesCount()
+{
+    size_t count = SYMBOL_TABLE.count.load(std::memory_order_acquire);
+
+    return count == 0 ? SINGLE_LETTER_VARIABLES_COUNT : count;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+//! @defgroup SYMBOL_TABLE Variable names
+//!
+//! Variables are stored in nodes as integer ids. A one letter variable's id
+//! is its character code, so 'x' is still 'x'. Longer names are interned
+//! into a process wide table and get dense ids starting at
+//! SINGLE_LETTER_VARIABLES_COUNT. Ids never change and names are never
+//! removed, so trees parsed on different threads can be mixed freely.
+//!
+//! Arrays of variable values are indexed by id and need variablesCount()
+//! elements, taken once the trees they're used with have been parsed.
+//!
+//! @addtogroup SYMBOL_TABLE
+//! @{
+
+static const int    VARIABLE_INVALID_ID           = -1;
+static const int    SINGLE_LETTER_VARIABLES_COUNT = 128;
+static const size_t VARIABLE_NAME_MAX_LENGTH      = 64;
+
+//! @}
+//-----------------------------------------------------------------------------
+
+int         internVariable  (const char* name, size_t length);
+int         findVariable    (const char* name, size_t length);
+const char* getVariableName (int id);
+bool        isVariableId    (int id);
+size_t      variablesCount  ();
@@ -0,0 +1,193 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#include "thread_pool.h"
+
+#define CHECK_NULL(value, action) if (value == nullptr) { action; }
+
+static const size_t TASKS_INIT_CAPACITY = 64;
+
+struct Task
+{
+    TaskFunction function;
+    void*        arg;
+};
+
+//! Tasks are kept in a ring buffer, pending tasks are [first, first + count).
+struct ThreadPoolState
+{
+    std::thread*            threads;
+
+    Task*                   tasks;
+    size_t                  tasksFirst;
+    size_t                  tasksCount;
+    size_t                  tasksCapacity;
+    size_t                  runningCount;
+    bool                    isStopping;
+
+    std::mutex              mutex;
+    std::condition_variable hasTask;
+    std::condition_variable isIdle;
+};
+
+void workerLoop (ThreadPoolState* state);
+
+//-----------------------------------------------------------------------------
+//! @param [out] pool
+//! @param [in]  threadsCount  0 for defaultThreadsCount()
+//!
+//! @return pool or nullptr if the threads haven't been started.
+//-----------------------------------------------------------------------------
+ThreadPool* construct(ThreadPool* pool, size_t threadsCount)
+{
+    CHECK_NULL(pool, return nullptr);
+
+    if (threadsCount == 0) { threadsCount = defaultThreadsCount(); }
+
+    ThreadPoolState* state = new (std::nothrow) ThreadPoolState();
+    CHECK_NULL(state, return nullptr);
+
+    state->tasks         = (Task*) calloc(TASKS_INIT_CAPACITY, sizeof(Task));
+    state->tasksCapacity = TASKS_INIT_CAPACITY;
+    state->threads       = new (std::nothrow) std::thread[threadsCount];
+
+    if (state->tasks == nullptr || state->threads == nullptr)
+    {
+        free(state->tasks);
+        delete[] state->threads;
+        delete state;
+
+        return nullptr;
+    }
+
+    pool->state        = state;
+    pool->threadsCount = threadsCount;
+
+    for (size_t i = 0; i < threadsCount; i++)
+    {
+        state->threads[i] = std::thread(workerLoop, state);
+    }
+
+    return pool;
+}
+
+//-----------------------------------------------------------------------------
+//! Finishes all the submitted tasks and stops the threads.
+//-----------------------------------------------------------------------------
+void destroy(ThreadPool* pool)
+{
+    assert(pool != nullptr);
+
+    ThreadPoolState* state = pool->state;
+    CHECK_NULL(state, return);
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->isStopping = true;
+    }
+
+    state->hasTask.notify_all();
+
+    for (size_t i = 0; i < pool->threadsCount; i++)
+    {
+        state->threads[i].join();
+    }
+
+    free(state->tasks);
+    delete[] state->threads;
+    delete state;
+
+    pool->state        = nullptr;
+    pool->threadsCount = 0;
+}
+
+bool submitTask(ThreadPool* pool, TaskFunction function, void* arg)
+{
+    assert(pool        != nullptr);
+    assert(pool->state != nullptr);
+    assert(function    != nullptr);
+
+    ThreadPoolState* state = pool->state;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        if (state->tasksCount == state->tasksCapacity)
+        {
+            Task* tasks = (Task*) calloc(2 * state->tasksCapacity, sizeof(Task));
+            CHECK_NULL(tasks, return false);
+
+            for (size_t i = 0; i < state->tasksCount; i++)
+            {
+                tasks[i] = state->tasks[(state->tasksFirst + i) % state->tasksCapacity];
+            }
+
+            free(state->tasks);
+
+            state->tasks          = tasks;
+            state->tasksFirst     = 0;
+            state->tasksCapacity *= 2;
+        }
+
+        size_t last = (state->tasksFirst + state->tasksCount) % state->tasksCapacity;
+
+        state->tasks[last] = { function, arg };
+        state->tasksCount++;
+    }
+
+    state->hasTask.notify_one();
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+//! Blocks until all the submitted tasks are finished.
+//-----------------------------------------------------------------------------
+void waitTasks(ThreadPool* pool)
+{
+    assert(pool        != nullptr);
+    assert(pool->state != nullptr);
+
+    ThreadPoolState* state = pool->state;
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->isIdle.wait(lock, [state] { return state->tasksCount == 0 && state->runningCount == 0; });
+}
+
+size_t defaultThreadsCount()
+{
+    size_t threadsCount = std::thread::hardware_concurrency();
+
+    return threadsCount != 0 ? threadsCount : 1;
+}
+
+void workerLoop(ThreadPoolState* state)
+{
+    assert(state != nullptr);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    while (true)
+    {
+        state->hasTask.wait(lock, [state] { return state->tasksCount > 0 || state->isStopping; });
+
+        if (state->tasksCount == 0) { return; }
+
+        Task task = state->tasks[state->tasksFirst];
+
+        state->tasksFirst = (state->tasksFirst + 1) % state->tasksCapacity;
+        state->tasksCount--;
+        state->runningCount++;
+
+        lock.unlock();
+        task.function(task.arg);
+        lock.lock();
+
+        state->runningCount--;
+
+        if (state->tasksCount == 0 && state->runningCount == 0) { state->isIdle.notify_all(); }
+    }
+}
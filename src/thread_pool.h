@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+
+//-----------------------------------------------------------------------------
+//! @defgroup THREAD_POOL Fixed size pool of worker threads
+//!
+//! Tasks are run in submission order by whichever worker is free, so tasks
+//! that depend on the order have to put their results into preallocated
+//! slots rather than into a shared list.
+//!
+//! @addtogroup THREAD_POOL
+//! @{
+
+typedef void (*TaskFunction)(void* arg);
+
+struct ThreadPoolState;
+
+struct ThreadPool
+{
+    ThreadPoolState* state        = nullptr;
+    size_t           threadsCount = 0;
+};
+
+//! @}
+//-----------------------------------------------------------------------------
+
+ThreadPool* construct           (ThreadPool* pool, size_t threadsCount);
+void        destroy             (ThreadPool* pool);
+
+bool        submitTask          (ThreadPool* pool, TaskFunction function, void* arg);
+void        waitTasks           (ThreadPool* pool);
+
+size_t      defaultThreadsCount ();
@@ -11,7 +11,8 @@ int dcompare(double num1, double num2);
 
 int dcompare(double num1, double num2, double precision)
 {
-    if (fabs(num1 - num2) < precision) { return 0; }
+    // infinities of the same sign are equal, their difference is NaN
+    if (num1 == num2 || fabs(num1 - num2) < precision) { return 0; }
 
     if (num1 > num2) { return 1; }
 
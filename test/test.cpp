@@ -1,10 +1,71 @@
 #include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UTB_DEFINITIONS
+#include "../src/utilib.h"
+#include "../src/expression_binary.h"
+#include "../src/expression_loader.h"
 #include "../src/math_syntax.h"
+#include "../src/string_builder.h"
+#include "../src/symbol_table.h"
 #include <cifuzz/cifuzz.h>
 #include <fuzzer/FuzzedDataProvider.h>
 
+struct ParseCase
+{
+    const char* text;
+    ParseError  status;
+};
+
+//! Status the parser returns for each input, errors included.
+static const ParseCase PARSE_CASES[] =
+{
+    { "x+1",         PARSE_NO_ERROR              },
+    { "sin(x)^2",    PARSE_NO_ERROR              },
+    { "2*x - 3/y",   PARSE_NO_ERROR              },
+    { "e^pi",        PARSE_NO_ERROR              },
+    { "1.5e3*x",     PARSE_NO_ERROR              },
+    { "((((x))))",   PARSE_NO_ERROR              },
+    { "abc*def",     PARSE_NO_ERROR              },
+    { "x^-inf+inf",  PARSE_NO_ERROR              },
+    { "0x10*-0x1p3", PARSE_NO_ERROR              },
+    { "",            PARSE_UNKNOWN_OPERATION     },
+    { "1+",          PARSE_UNKNOWN_OPERATION     },
+    { "x^",          PARSE_UNKNOWN_OPERATION     },
+    { ")",           PARSE_UNKNOWN_OPERATION     },
+    { "sin()",       PARSE_UNKNOWN_OPERATION     },
+    { "(x+1",        PARSE_NO_CLOSING_BRACKET    },
+    { "x+1)",        PARSE_UNFINISHED_EXPRESSION },
+    { "foo(x)",      PARSE_UNFINISHED_EXPRESSION },
+    { "ln(",         PARSE_UNFINISHED_EXPRESSION },
+    { "2 3",         PARSE_UNFINISHED_EXPRESSION },
+    { "1..2",        PARSE_UNFINISHED_EXPRESSION },
+};
+
+static char BIN_PATH[256] = "";
+
+ParseError checkParse     (const char* text, size_t length);
+void       checkBinFormat (ETNode* root);
+void       removeBinFile  ();
+
 FUZZ_TEST_SETUP() {
-  // Perform any one-time setup required by the FUZZ_TEST function.
+    const char* tmpDir = getenv("TEST_TMPDIR");
+    snprintf(BIN_PATH, sizeof(BIN_PATH), "%s/test_XXXXXX", tmpDir == nullptr ? "/tmp" : tmpDir);
+
+    int fd = mkstemp(BIN_PATH);
+    assert(fd != -1);
+    close(fd);
+    atexit(removeBinFile);
+
+    for (size_t i = 0; i < sizeof(PARSE_CASES) / sizeof(PARSE_CASES[0]); i++)
+    {
+        ParseError status = checkParse(PARSE_CASES[i].text, strlen(PARSE_CASES[i].text));
+        assert(status == PARSE_CASES[i].status);
+    }
 }
 
 FUZZ_TEST(const uint8_t *data, size_t size) {
@@ -18,4 +79,72 @@ FUZZ_TEST(const uint8_t *data, size_t size) {
       isArithmeticOp(stringi2);
       isTrigOp(stringi);
       isVariable(random_string[0]);
+
+      checkParse(random_string.data(), random_string.size());
+}
+
+//-----------------------------------------------------------------------------
+//! Parses the text and checks the tree through the binary format.
+//!
+//! @return status of the parser.
+//-----------------------------------------------------------------------------
+ParseError checkParse(const char* text, size_t length)
+{
+    assert(text != nullptr);
+
+    StringBuilder errors = {};
+    construct(&errors);
+
+    ExprTree   tree   = {};
+    ParseError result = parseExpression(&tree, text, length, &errors);
+
+    assert((result == PARSE_NO_ERROR) == (tree.root != nullptr));
+
+    if (tree.root != nullptr) { checkBinFormat(tree.root); }
+
+    destroySubtree(tree.root);
+    destroy(&errors);
+
+    return result;
+}
+
+//-----------------------------------------------------------------------------
+//! Saves the tree, opens it back and checks that it evaluates to the same
+//! value and rebuilds into the same tree.
+//-----------------------------------------------------------------------------
+void checkBinFormat(ETNode* root)
+{
+    assert(root != nullptr);
+
+    bool isSaved = saveExprBin(root, BIN_PATH);
+    assert(isSaved);
+
+    ExprBinView view     = {};
+    bool        isOpened = openExprBin(&view, BIN_PATH);
+    assert(isOpened);
+
+    size_t  varValuesCount = variablesCount();
+    double* varValues      = (double*) calloc(varValuesCount, sizeof(double));
+    assert(varValues != nullptr);
+
+    for (size_t i = 0; i < varValuesCount; i++) { varValues[i] = 0.5 + (double) (i % 7); }
+
+    double value       = 0;
+    bool   isEvaluated = evaluateBin(&view, varValues, &value);
+    double expected    = evaluateSubtree(root, varValues);
+
+    assert(isEvaluated);
+    assert(value == expected || (isnan(value) && isnan(expected)));
+
+    ETNode* rebuilt = rebuildTree(&view);
+    assert(rebuilt != nullptr && areTreesEqual(root, rebuilt));
+
+    destroySubtree(rebuilt);
+    free(varValues);
+    closeExprBin(&view);
+}
+
+void removeBinFile()
+{
+    remove(BIN_PATH);
 }